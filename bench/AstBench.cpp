@@ -0,0 +1,135 @@
+/**
+ * AST benchmark.
+ *
+ * Parses generated sources to the arena-allocated AST and reports
+ * parse time and memory per node. For comparison the same token
+ * stream is built into the previous representation: nodes holding
+ * a std::string and a std::vector of children, the list copied on
+ * each entry as the previous ListEntries reduction did. It grows
+ * quadratically, so it only runs on the smaller inputs.
+ */
+
+#include "parser/EvaParser.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using syntax::Token;
+using syntax::Tokenizer;
+using syntax::TokenType;
+
+static constexpr int RUNS = 3;
+
+static constexpr size_t LEGACY_MAX_BYTES = 256 << 10;
+
+/**
+ * Node of the previous AST.
+ */
+struct LegacyExp {
+  ExpType type;
+  int number;
+  std::string string;
+  std::vector<LegacyExp> list;
+};
+
+static LegacyExp parseLegacy(Tokenizer& tokenizer, const Token& token) {
+  LegacyExp exp{ExpType::LIST, 0, "", {}};
+
+  switch (token.type) {
+    case TokenType::NUMBER:
+      exp.type = ExpType::NUMBER;
+      exp.number = std::stoi(std::string(token.value));
+      return exp;
+    case TokenType::STRING:
+      exp.type = ExpType::STRING;
+      exp.string = token.value.substr(1, token.value.size() - 2);
+      return exp;
+    case TokenType::SYMBOL:
+      exp.type = ExpType::SYMBOL;
+      exp.string = token.value;
+      return exp;
+    default:
+      break;
+  }
+
+  for (auto next = tokenizer.getNextToken(); next.type != TokenType::TOKEN_TYPE_8;
+       next = tokenizer.getNextToken()) {
+    auto entries = exp;
+    entries.list.push_back(parseLegacy(tokenizer, next));
+    exp = entries;
+  }
+
+  return exp;
+}
+
+/**
+ * Counts the nodes and their bytes, including heap buffers.
+ */
+static void measureLegacy(const LegacyExp& exp, size_t& nodes, size_t& bytes) {
+  nodes++;
+
+  if (exp.string.capacity() > std::string().capacity()) {
+    bytes += exp.string.capacity() + 1;
+  }
+
+  bytes += exp.list.capacity() * sizeof(LegacyExp);
+  for (const auto& child : exp.list) {
+    measureLegacy(child, nodes, bytes);
+  }
+}
+
+static size_t countNodes(const Exp& exp) {
+  size_t nodes = 1;
+
+  if (exp.type == ExpType::LIST) {
+    for (const auto& child : exp.list()) {
+      nodes += countNodes(child);
+    }
+  }
+
+  return nodes;
+}
+
+int main(int argc, char** argv) {
+  for (auto kilobytes : {64, 256, 1024, 10240}) {
+    auto source = "(begin " + generateSource((size_t)kilobytes << 10) + ")";
+
+    syntax::EvaParser parser;
+    size_t nodes = 0;
+    size_t arenaBytes = 0;
+
+    auto ms = bestTimeMs(RUNS, [&]() {
+      auto ast = parser.parse(source);
+      nodes = countNodes(ast);
+      arenaBytes = parser.arena.bytesUsed() - source.size();
+    });
+
+    std::cout << "input=" << kilobytes << "KB"
+      << " nodes=" << nodes
+      << " sizeof_node=" << sizeof(Exp)
+      << " arena_bytes_per_node=" << (double)arenaBytes / nodes
+      << " parse_ms=" << ms;
+
+    if (source.size() <= LEGACY_MAX_BYTES + 1024) {
+      size_t legacyNodes = 0;
+      size_t legacyBytes = sizeof(LegacyExp);
+
+      auto legacyMs = bestTimeMs(1, [&]() {
+        Tokenizer tokenizer;
+        tokenizer.initString(source);
+
+        auto ast = parseLegacy(tokenizer, tokenizer.getNextToken());
+        measureLegacy(ast, legacyNodes, legacyBytes);
+      });
+
+      std::cout << " legacy_bytes_per_node=" << (double)legacyBytes / legacyNodes
+        << " legacy_parse_ms=" << legacyMs;
+    }
+
+    std::cout << '\n';
+  }
+
+  return 0;
+}
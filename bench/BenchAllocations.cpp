@@ -0,0 +1,20 @@
+#include "BenchAllocations.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocations{0};
+
+size_t benchAllocations() {
+  return allocations.load();
+}
+
+void* operator new(size_t size) {
+  allocations++;
+  if (auto ptr = malloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
@@ -0,0 +1,16 @@
+/**
+ * Heap allocation counter of the benchmarks.
+ */
+#ifndef BENCH_BENCHALLOCATIONS_HPP
+#define BENCH_BENCHALLOCATIONS_HPP
+
+#include <cstddef>
+
+/**
+ * Calls of the global operator new since the start, counted by the
+ * replacement operator of BenchAllocations.cpp (link it into the
+ * benchmark to count).
+ */
+size_t benchAllocations();
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * Workloads and timing helpers shared by the benchmarks.
+ */
+#ifndef BENCH_BENCHPROGRAMS_HPP
+#define BENCH_BENCHPROGRAMS_HPP
+
+#include <chrono>
+#include <string>
+
+struct BenchProgram {
+  std::string name;
+  std::string source;
+};
+
+/**
+ * Loop-heavy program: locals, arithmetic and a backward jump.
+ */
+static const BenchProgram loopProgram = {
+  "loop",
+  R"(
+    (def loop (n)
+      (begin
+        (var i 0)
+        (var sum 0)
+        (while (< i n)
+          (begin
+            (set sum (+ sum i))
+            (set i (+ i 1))))
+        sum))
+    (loop 2000000)
+  )"
+};
+
+/**
+ * Call-heavy program: recursive calls and returns.
+ */
+static const BenchProgram callsProgram = {
+  "calls",
+  R"(
+    (def fib (n)
+      (if (< n 2)
+        n
+        (+ (fib (- n 1)) (fib (- n 2)))))
+    (fib 25)
+  )"
+};
+
+/**
+ * Arithmetic-heavy program: expressions over locals.
+ */
+static const BenchProgram arithProgram = {
+  "arith",
+  R"(
+    (def poly (n)
+      (begin
+        (var x 0)
+        (var acc 0)
+        (while (< x n)
+          (begin
+            (set acc (+ acc (- (* (* x x) 3) (/ (+ x 1) 2))))
+            (set x (+ x 1))))
+        acc))
+    (poly 1000000)
+  )"
+};
+
+/**
+ * Source of the size (at least) built of definitions with comments,
+ * strings, numbers, symbols and nested lists.
+ */
+inline std::string generateSource(size_t bytes) {
+  std::string source;
+  source.reserve(bytes + 256);
+
+  for (int i = 0; source.size() < bytes; i++) {
+    auto n = std::to_string(i);
+    source += "// Function " + n + ".\n"
+      "(def f" + n + " (x y)\n"
+      "  /* block\n     comment */\n"
+      "  (if (>= x " + n + ")\n"
+      "    (set y (+ (* x 2) (- y 1)))\n"
+      "    (print \"value of f" + n + ":\" x)))\n\n";
+  }
+
+  return source;
+}
+
+/**
+ * Runs the callback several times and returns the best time in ms.
+ */
+template <typename Callback>
+double bestTimeMs(int runs, Callback callback) {
+  double best = 0;
+
+  for (int run = 0; run < runs; run++) {
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    auto end = std::chrono::steady_clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    if (run == 0 || ms < best) best = ms;
+  }
+
+  return best;
+}
+
+#endif
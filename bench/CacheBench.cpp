@@ -0,0 +1,112 @@
+/**
+ * Compile cache benchmark.
+ *
+ * Startup latency of short-lived script invocations: a fresh VM
+ * executes a program with many small functions without a cache, with
+ * an empty cache (compile and store) and with a warm cache (map and
+ * load the stored entry). Then many distinct programs run through a
+ * small cache to exercise the eviction.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static constexpr int RUNS = 5;
+
+/**
+ * Program defining the amount of functions, the last one is called.
+ */
+static std::string startupProgram(int functions) {
+  std::string source;
+
+  for (int i = 0; i < functions; i++) {
+    auto name = "f" + std::to_string(i);
+    source += "(def " + name + " (x) (if (> x 10) (+ x " + std::to_string(i) + ") (* x 2)))\n";
+  }
+
+  return source + "(f" + std::to_string(functions - 1) + " 20)";
+}
+
+static std::string execWith(const std::shared_ptr<EvaCompileCache>& cache, const std::string& source) {
+  EvaVM vm;
+  vm.setJitMode(JitMode::OFF);
+  vm.setCompileCache(cache);
+  return evaValueToConstantString(vm.exec(source));
+}
+
+int main(int argc, char** argv) {
+  auto dir = (fs::temp_directory_path() / "evm-bench-cache").string();
+  int failures = 0;
+
+  for (auto functions : {10, 50, 100}) {
+    auto source = startupProgram(functions);
+
+    std::string result;
+    auto sourceMs = bestTimeMs(RUNS, [&]() { result = execWith(nullptr, source); });
+
+    // Cold: every run starts from an empty cache directory.
+    double coldMs = 0;
+    std::string coldResult;
+    size_t coldMisses = 0;
+    for (int run = 0; run < RUNS; run++) {
+      fs::remove_all(dir);
+      auto cache = std::make_shared<EvaCompileCache>(dir);
+      auto ms = bestTimeMs(1, [&]() { coldResult = execWith(cache, source); });
+      if (run == 0 || ms < coldMs) coldMs = ms;
+      coldMisses += cache->getStats().misses;
+    }
+
+    auto cache = std::make_shared<EvaCompileCache>(dir);
+    std::string warmResult;
+    auto warmMs = bestTimeMs(RUNS, [&]() { warmResult = execWith(cache, source); });
+
+    if (coldResult != result || warmResult != result) {
+      std::cerr << "Mismatch: functions=" << functions << " source=" << result
+        << " cold=" << coldResult << " warm=" << warmResult << '\n';
+      failures++;
+    }
+
+    auto& stats = cache->getStats();
+    std::cout << "program=startup(" << functions << ")"
+      << " source_ms=" << sourceMs
+      << " cold_ms=" << coldMs
+      << " warm_ms=" << warmMs
+      << " cold_misses=" << coldMisses
+      << " warm_hits=" << stats.hits
+      << " warm_misses=" << stats.misses
+      << " result=" << result << '\n';
+  }
+
+  // Eviction: 100 programs through a cache holding a few of them.
+  fs::remove_all(dir);
+  auto small = std::make_shared<EvaCompileCache>(dir, 64 << 10);
+  for (int i = 0; i < 100; i++) {
+    execWith(small, startupProgram(20) + " " + std::to_string(i));
+  }
+
+  size_t entries = 0;
+  uintmax_t bytes = 0;
+  for (auto& entry : fs::directory_iterator(dir)) {
+    entries++;
+    bytes += entry.file_size();
+  }
+
+  auto& stats = small->getStats();
+  std::cout << "eviction programs=100 limit_bytes=" << (64 << 10)
+    << " stores=" << stats.stores
+    << " evictions=" << stats.evictions
+    << " entries=" << entries
+    << " bytes=" << bytes << '\n';
+
+  if (bytes > (64 << 10) || stats.stores != entries + stats.evictions) {
+    failures++;
+  }
+
+  fs::remove_all(dir);
+  return failures == 0 ? 0 : 1;
+}
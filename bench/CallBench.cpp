@@ -0,0 +1,43 @@
+/**
+ * Call benchmark.
+ *
+ * Runs recursive fib(N) for growing N and reports time and the amount
+ * of heap allocations made by the whole run (parse, compile, execute).
+ * Calls and returns do not allocate, so the allocation count stays the
+ * same while the amount of calls grows exponentially.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+#include "BenchAllocations.hpp"
+
+#include <iostream>
+
+int main(int argc, char** argv) {
+  for (auto n : {20, 25, 30}) {
+    auto source = R"(
+      (def fib (n)
+        (if (< n 2)
+          n
+          (+ (fib (- n 1)) (fib (- n 2)))))
+      (fib )" + std::to_string(n) + ")";
+
+    EvaValue result;
+    size_t runAllocations = 0;
+
+    auto best = bestTimeMs(3, [&]() {
+      EvaVM vm;
+      vm.setJitMode(JitMode::OFF);
+      auto before = benchAllocations();
+      result = vm.exec(source);
+      runAllocations = benchAllocations() - before;
+    });
+
+    std::cout << "program=fib(" << n << ")"
+      << " best_ms=" << best
+      << " allocations=" << runAllocations
+      << " result=" << evaValueToConstantString(result) << '\n';
+  }
+
+  return 0;
+}
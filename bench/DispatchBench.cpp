@@ -0,0 +1,37 @@
+/**
+ * Dispatch benchmark.
+ *
+ * Runs loop-heavy and call-heavy programs and reports the best time
+ * of several runs. Built once per dispatch mode (evm-bench-dispatch-switch,
+ * evm-bench-dispatch-threaded), `make bench-dispatch` runs both.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+#ifndef EVA_DISPATCH_NAME
+#define EVA_DISPATCH_NAME "unknown"
+#endif
+
+static constexpr int RUNS = 5;
+
+int main(int argc, char** argv) {
+  for (const auto& program : {loopProgram, callsProgram}) {
+    EvaValue result;
+
+    auto best = bestTimeMs(RUNS, [&]() {
+      EvaVM vm;
+      vm.setJitMode(JitMode::OFF);
+      result = vm.exec(program.source);
+    });
+
+    std::cout << "dispatch=" << EVA_DISPATCH_NAME
+      << " program=" << program.name
+      << " best_ms=" << best
+      << " result=" << evaValueToConstantString(result) << '\n';
+  }
+
+  return 0;
+}
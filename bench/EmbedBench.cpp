@@ -0,0 +1,98 @@
+/**
+ * Embedding benchmark.
+ *
+ * A service calls the same Eva handler per request. Compares the cost
+ * per request of executing the source each time (parse, compile, run),
+ * of vm.call on the program loaded once, and of a call made from Eva
+ * code (interpreted OP_CALL in a loop, including the loop overhead).
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 3;
+
+static constexpr int CALLS = 1000000;
+
+static constexpr int EXECS = 10000;
+
+static const std::string handlerProgram = R"(
+  (def handler (request size)
+    (if (> size 100)
+      (+ request (* size 2))
+      (- request size)))
+)";
+
+static const std::string serveProgram = R"(
+  (def serve (n)
+    (begin
+      (var i 0)
+      (var total 0)
+      (while (< i n)
+        (begin
+          (set total (+ total (handler i 150)))
+          (set i (+ i 1))))
+      total))
+)";
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  for (auto tier : {ExecutionTier::STACK, ExecutionTier::REGISTER}) {
+    auto tierName = tier == ExecutionTier::STACK ? "stack" : "register";
+
+    // Source per request: (handler i 150) executed as a program.
+    double execTotal = 0;
+    auto execMs = bestTimeMs(RUNS, [&]() {
+      EvaVM vm(tier);
+      vm.setJitMode(JitMode::OFF);
+      vm.exec(handlerProgram);
+
+      execTotal = 0;
+      for (int i = 0; i < EXECS; i++) {
+        auto result = vm.exec("(handler " + std::to_string(i) + " 150)");
+        execTotal += TO_NUMBER(result);
+      }
+    });
+
+    // Loaded once, called per request.
+    double callTotal = 0;
+    auto callMs = bestTimeMs(RUNS, [&]() {
+      EvaVM vm(tier);
+      vm.setJitMode(JitMode::OFF);
+      vm.exec(handlerProgram);
+
+      callTotal = 0;
+      for (int i = 0; i < CALLS; i++) {
+        auto result = vm.call("handler", {INTEGER(i), INTEGER(150)});
+        callTotal += TO_NUMBER(result);
+      }
+    });
+
+    // Called from Eva code.
+    double loopTotal = 0;
+    auto loopMs = bestTimeMs(RUNS, [&]() {
+      EvaVM vm(tier);
+      vm.setJitMode(JitMode::OFF);
+      vm.exec(handlerProgram + serveProgram);
+      loopTotal = TO_NUMBER(vm.call("serve", {INTEGER(CALLS)}));
+    });
+
+    if (callTotal != loopTotal) {
+      std::cerr << "Mismatch: tier=" << tierName << " call=" << callTotal
+        << " loop=" << loopTotal << '\n';
+      failures++;
+    }
+
+    std::cout << "tier=" << tierName
+      << " exec_ns_per_request=" << execMs * 1e6 / EXECS
+      << " call_ns_per_request=" << callMs * 1e6 / CALLS
+      << " interpreted_ns_per_call=" << loopMs * 1e6 / CALLS
+      << " exec_result=" << execTotal
+      << " call_result=" << callTotal << '\n';
+  }
+
+  return failures == 0 ? 0 : 1;
+}
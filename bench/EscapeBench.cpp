@@ -0,0 +1,146 @@
+/**
+ * Escape analysis benchmark.
+ *
+ * Runs closure workloads with escape analysis off (every captured
+ * variable is a heap cell) and on (variables captured by functions
+ * which never leave their defining frame stay in the frame), in both
+ * tiers. Reports the best time, the cells and the objects allocated.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+/**
+ * Local helper updating an accumulator of its frame.
+ */
+static const BenchProgram accumulateProgram = {
+  "accumulate",
+  R"(
+    (def sum (n)
+      (begin
+        (var total 0)
+        (def add (k) (set total (+ total k)))
+        (var i 0)
+        (while (< i n)
+          (begin
+            (add i)
+            (set i (+ i 1))))
+        total))
+
+    (def run (n)
+      (begin
+        (var result 0)
+        (var j 0)
+        (while (< j n)
+          (begin
+            (set result (+ result (sum 10)))
+            (set j (+ j 1))))
+        result))
+
+    (run 100000)
+  )"
+};
+
+/**
+ * Local predicate and step functions reading the parameters of
+ * their frame.
+ */
+static const BenchProgram helpersProgram = {
+  "helpers",
+  R"(
+    (def count (lo hi step)
+      (begin
+        (def inRange (x) (if (>= x lo) (< x hi) false))
+        (def next (x) (+ x step))
+        (var x 0)
+        (var hits 0)
+        (while (< x 1000)
+          (begin
+            (if (inRange x) (set hits (+ hits 1)) 0)
+            (set x (next x))))
+        hits))
+
+    (def run (n)
+      (begin
+        (var result 0)
+        (var j 0)
+        (while (< j n)
+          (begin
+            (set result (+ result (count 100 600 1)))
+            (set j (+ j 1))))
+        result))
+
+    (run 1000)
+  )"
+};
+
+/**
+ * Counters returned to the caller: the cells escape either way.
+ */
+static const BenchProgram countersProgram = {
+  "counters",
+  R"(
+    (def makeCounter ()
+      (begin
+        (var count 0)
+        (lambda () (set count (+ count 1)))))
+
+    (def run (n)
+      (begin
+        (var result 0)
+        (var j 0)
+        (while (< j n)
+          (begin
+            (var counter (makeCounter))
+            (counter)
+            (set result (+ result (counter)))
+            (set j (+ j 1))))
+        result))
+
+    (run 100000)
+  )"
+};
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  for (const auto& program : {accumulateProgram, helpersProgram, countersProgram}) {
+    for (auto tier : {ExecutionTier::STACK, ExecutionTier::REGISTER}) {
+      double expected = 0;
+
+      for (auto escapeAnalysis : {false, true}) {
+        EvaValue result;
+        GCStats stats;
+
+        auto best = bestTimeMs(RUNS, [&]() {
+          EvaVM vm(tier);
+          vm.setJitMode(JitMode::OFF);
+          vm.setEscapeAnalysis(escapeAnalysis);
+          result = vm.exec(program.source);
+          stats = vm.getGCStats();
+        });
+
+        if (!escapeAnalysis) {
+          expected = TO_NUMBER(result);
+        } else if (TO_NUMBER(result) != expected) {
+          std::cerr << "Mismatch: program=" << program.name << '\n';
+          failures++;
+        }
+
+        std::cout << "program=" << program.name
+          << " tier=" << (tier == ExecutionTier::REGISTER ? "register" : "stack")
+          << " escape_analysis=" << (escapeAnalysis ? "on" : "off")
+          << " best_ms=" << best
+          << " cells=" << stats.totalCells
+          << " objects=" << stats.totalObjects
+          << " result=" << evaValueToConstantString(result) << '\n';
+      }
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+/**
+ * Garbage collector benchmark.
+ *
+ * Runs an allocation-heavy program (string concatenation and closure
+ * creation) with different collection thresholds and reports time,
+ * collections and heap statistics, to tune the collection trigger.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static const BenchProgram churnProgram = {
+  "churn",
+  R"(
+    (def makeCounter ()
+      (begin
+        (var count 0)
+        (def inc () (begin (set count (+ count 1)) count))
+        inc))
+
+    (def churn (n)
+      (begin
+        (var i 0)
+        (var s "")
+        (while (< i n)
+          (begin
+            (var counter (makeCounter))
+            (counter)
+            (set s (+ "item-" "suffix"))
+            (set i (+ i 1))))
+        i))
+
+    (churn 200000)
+  )"
+};
+
+static constexpr size_t thresholds[] = {
+  64 * 1024,
+  EvaCollector::INITIAL_THRESHOLD,
+  16 * 1024 * 1024,
+};
+
+int main(int argc, char** argv) {
+  for (auto threshold : thresholds) {
+    EvaVM vm;
+    vm.setGCThreshold(threshold);
+
+    auto ms = bestTimeMs(1, [&]() { vm.exec(churnProgram.source); });
+    const auto& stats = vm.getGCStats();
+
+    std::cout << "program=" << churnProgram.name
+      << " threshold=" << threshold
+      << " time_ms=" << ms
+      << " collections=" << stats.collections
+      << " peak_bytes=" << stats.peakAllocated
+      << " live_bytes=" << stats.bytesAllocated
+      << " live_objects=" << stats.objectsCount
+      << " total_allocated=" << stats.totalAllocated
+      << " total_freed=" << stats.totalFreed << '\n';
+  }
+
+  return 0;
+}
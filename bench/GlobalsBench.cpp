@@ -0,0 +1,54 @@
+/**
+ * Globals compile benchmark.
+ *
+ * Compiles generated programs with 100 to 100k top-level variables,
+ * each referencing the previous one, and reports compile times. With
+ * O(1) global lookups the compile time per global stays flat as the
+ * number of globals grows. The AST is generated directly, so parsing
+ * is not measured.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr size_t globalCounts[] = {100, 1000, 10000, 100000};
+
+/**
+ * (begin (var g0 0) (var g1 (+ g0 1)) ... (var gN (+ gN-1 1)))
+ */
+static Exp generateGlobals(ExpArena& arena, size_t count) {
+  std::vector<Exp> program = {arena.symbol("begin")};
+
+  program.push_back(arena.list({arena.symbol("var"), arena.symbol("g0"), Exp(0)}));
+
+  for (size_t i = 1; i < count; i++) {
+    auto previous = arena.symbol("g" + std::to_string(i - 1));
+    auto value = arena.list({arena.symbol("+"), previous, Exp(1)});
+    program.push_back(arena.list({arena.symbol("var"), arena.symbol("g" + std::to_string(i)), value}));
+  }
+
+  return arena.list(program.data(), program.size());
+}
+
+int main(int argc, char** argv) {
+  for (auto count : globalCounts) {
+    ExpArena arena;
+    auto ast = generateGlobals(arena, count);
+
+    EvaCollector collector;
+    EvaCollector::Scope gcScope(&collector);
+
+    auto compileMs = bestTimeMs(1, [&]() {
+      EvaCompiler compiler(std::make_shared<Global>());
+      compiler.compile(ast);
+    });
+
+    std::cout << "globals=" << count
+      << " compile_ms=" << compileMs
+      << " compile_us_per_global=" << compileMs * 1000 / count << '\n';
+  }
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Cold start benchmark.
+ *
+ * Short-lived script invocations: a fresh VM executes a program with
+ * many small functions and little work, once from source (parse,
+ * compile, run) and once from its bytecode image (map, load, run).
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+/**
+ * Program defining the amount of functions, the last one is called.
+ */
+static std::string startupProgram(int functions) {
+  std::string source;
+
+  for (int i = 0; i < functions; i++) {
+    auto name = "f" + std::to_string(i);
+    source += "(def " + name + " (x) (if (> x 10) (+ x " + std::to_string(i) + ") (* x 2)))\n";
+  }
+
+  return source + "(f" + std::to_string(functions - 1) + " 20)";
+}
+
+int main(int argc, char** argv) {
+  auto path = (std::filesystem::temp_directory_path() / "evm-bench-image.evi").string();
+  int failures = 0;
+
+  for (auto functions : {10, 50, 100}) {
+    auto source = startupProgram(functions);
+
+    EvaVM compiler;
+    compiler.setJitMode(JitMode::OFF);
+    compiler.compileImage(source, path);
+
+    EvaValue sourceResult;
+    auto sourceMs = bestTimeMs(RUNS, [&]() {
+      EvaVM vm;
+      vm.setJitMode(JitMode::OFF);
+      sourceResult = vm.exec(source);
+    });
+
+    EvaValue imageResult;
+    auto imageMs = bestTimeMs(RUNS, [&]() {
+      EvaVM vm;
+      vm.setJitMode(JitMode::OFF);
+      imageResult = vm.execImage(path);
+    });
+
+    auto result = evaValueToConstantString(sourceResult);
+    if (evaValueToConstantString(imageResult) != result) {
+      std::cerr << "Mismatch: functions=" << functions
+        << " image=" << evaValueToConstantString(imageResult) << " source=" << result << '\n';
+      failures++;
+    }
+
+    std::cout << "program=startup(" << functions << ")"
+      << " source_bytes=" << source.size()
+      << " image_bytes=" << std::filesystem::file_size(path)
+      << " source_ms=" << sourceMs
+      << " image_ms=" << imageMs
+      << " result=" << result << '\n';
+  }
+
+  std::remove(path.c_str());
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/**
+ * Integer benchmark.
+ *
+ * Runs integer loops with number literals compiled to doubles (as
+ * before integers) and to integers, on both interpreter tiers and the
+ * JIT of the stack tier. Reports the best time of each and checks the
+ * results match. Then checks that 64-bit ids round-trip exactly
+ * through literals and calls.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+/**
+ * Counters and products which stay below 2^53, so doubles compute the
+ * same results.
+ */
+static const BenchProgram countersProgram = {
+  "counters",
+  R"(
+    (def run (n)
+      (begin
+        (var hits 0)
+        (var total 0)
+        (var i 0)
+        (while (< i n)
+          (begin
+            (if (> (* i 7) (- (* n 3) i)) (set hits (+ hits 1)) 0)
+            (set total (+ total (- (* i 3) hits)))
+            (set i (+ i 1))))
+        total))
+
+    (run 1000000)
+  )"
+};
+
+/**
+ * Execution configuration.
+ */
+struct IntegerConfig {
+  const char* name;
+  ExecutionTier tier;
+  JitMode jitMode;
+};
+
+/**
+ * Ids above 2^53 are not representable as doubles.
+ */
+static bool checkIds() {
+  const int64_t id = 9007199254740993;
+
+  EvaVM vm;
+  auto literal = vm.exec(R"(
+    (def echo (id) id)
+    (def next (id) (+ id 2))
+    9007199254740993
+  )");
+  auto echoed = vm.call("echo", {INTEGER(id)});
+  auto next = vm.call("next", {INTEGER(id)});
+
+  bool exact = IS_INTEGER(literal) && AS_INTEGER(literal) == id &&
+    IS_INTEGER(echoed) && AS_INTEGER(echoed) == id &&
+    IS_INTEGER(next) && AS_INTEGER(next) == id + 2;
+
+  std::cout << "ids literal=" << evaValueToConstantString(literal)
+    << " echoed=" << evaValueToConstantString(echoed)
+    << " next=" << evaValueToConstantString(next)
+    << " exact=" << (exact ? "yes" : "no") << '\n';
+
+  return exact;
+}
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  const IntegerConfig configs[] = {
+    {"stack", ExecutionTier::STACK, JitMode::OFF},
+    {"register", ExecutionTier::REGISTER, JitMode::OFF},
+    {"jit", ExecutionTier::STACK, JitMode::ALWAYS},
+  };
+
+  for (const auto& program : {loopProgram, callsProgram, countersProgram}) {
+    for (const auto& config : configs) {
+      double expected = 0;
+      double doublesMs = 0;
+
+      for (auto integers : {false, true}) {
+        EvaValue result;
+
+        auto best = bestTimeMs(RUNS, [&]() {
+          EvaVM vm(config.tier);
+          vm.setJitMode(config.jitMode);
+          vm.setIntegers(integers);
+          result = vm.exec(program.source);
+        });
+
+        if (!integers) {
+          expected = TO_NUMBER(result);
+          doublesMs = best;
+        } else if (TO_NUMBER(result) != expected) {
+          std::cerr << "Mismatch: program=" << program.name << " config=" << config.name << '\n';
+          failures++;
+        }
+
+        std::cout << "program=" << program.name
+          << " config=" << config.name
+          << " integers=" << (integers ? "on" : "off")
+          << " best_ms=" << best
+          << " speedup=" << doublesMs / best
+          << " result=" << evaValueToConstantString(result) << '\n';
+      }
+    }
+  }
+
+  if (!checkIds()) {
+    std::cerr << "Ids are not exact\n";
+    failures++;
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/**
+ * Isolate scaling benchmark.
+ *
+ * One program compiled and frozen once (EvaProgram), executed by a pool
+ * of isolates from 1 thread up to the cores of the machine (or the
+ * thread count passed):
+ *
+ *   evm-bench-isolates [max_threads]
+ *
+ * The same batch of tasks runs at each thread count. The baseline is a
+ * single VM running the batch with the JIT off, as the frozen code is
+ * interpreted.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "isolate/EvaIsolatePool.hpp"
+#include "BenchPrograms.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+static constexpr int RUNS = 3;
+
+static constexpr int TASKS = 128;
+
+static const std::string workProgram = R"(
+  (def mix (a b)
+    (if (> a b)
+      (- a b)
+      (+ a b)))
+
+  (def work (seed)
+    (begin
+      (var i 0)
+      (var total 0)
+      (var suffix "done")
+      (while (< i 20000)
+        (begin
+          (set total (+ total (mix i seed)))
+          (set i (+ i 1))))
+      (if (== (+ "task-" suffix) "task-done") total 0)))
+)";
+
+int main(int argc, char** argv) {
+  size_t maxThreads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+  maxThreads = std::max<size_t>(maxThreads, 1);
+
+  // Single VM, compiled as usual.
+  double expected = 0;
+  auto baselineMs = bestTimeMs(RUNS, [&]() {
+    EvaVM vm;
+    vm.setJitMode(JitMode::OFF);
+    vm.exec(workProgram);
+
+    expected = 0;
+    for (int i = 0; i < TASKS; i++) {
+      expected += TO_NUMBER(vm.call("work", {INTEGER(i)}));
+    }
+  });
+
+  std::cout << "single_vm ms=" << baselineMs << " tasks_per_s=" << TASKS * 1000 / baselineMs
+    << " result=" << expected << '\n';
+
+  auto program = std::make_shared<const EvaProgram>(workProgram);
+
+  int failures = 0;
+  double oneThreadMs = 0;
+
+  std::vector<size_t> threadCounts;
+  for (size_t threads = 1; threads < maxThreads; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  for (auto threads : threadCounts) {
+    EvaIsolatePool pool(program, threads);
+
+    double total = 0;
+    auto ms = bestTimeMs(RUNS, [&]() {
+      std::vector<std::future<double>> results;
+      for (int i = 0; i < TASKS; i++) {
+        results.push_back(pool.submit([i](EvaVM& vm) {
+          return TO_NUMBER(vm.call("work", {INTEGER(i)}));
+        }));
+      }
+
+      total = 0;
+      for (auto& result : results) {
+        total += result.get();
+      }
+    });
+
+    if (total != expected) {
+      std::cerr << "Mismatch: threads=" << threads << " result=" << total
+        << " expected=" << expected << '\n';
+      failures++;
+    }
+
+    if (threads == 1) {
+      oneThreadMs = ms;
+    }
+
+    std::cout << "isolates threads=" << threads
+      << " ms=" << ms
+      << " tasks_per_s=" << TASKS * 1000 / ms
+      << " speedup=" << oneThreadMs / ms
+      << " efficiency=" << oneThreadMs / ms / threads << '\n';
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+/**
+ * JIT benchmark.
+ *
+ * Runs the stack tier programs interpreted (JIT off), with hot
+ * functions compiled (default threshold) and with every function
+ * compiled, including the main one. Results of the modes must match,
+ * the benchmark fails otherwise.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+int main(int argc, char** argv) {
+  if (!EvaJit::isAvailable()) {
+    std::cout << "JIT is not available in this build\n";
+    return 0;
+  }
+
+  const std::pair<const char*, JitMode> modes[] = {
+    {"off", JitMode::OFF},
+    {"hot", JitMode::HOT},
+    {"always", JitMode::ALWAYS},
+  };
+
+  int failures = 0;
+
+  for (const auto& program : {loopProgram, callsProgram, arithProgram}) {
+    std::string expected;
+
+    for (const auto& [modeName, mode] : modes) {
+      EvaValue result;
+      JitStats stats;
+
+      auto best = bestTimeMs(RUNS, [&]() {
+        EvaVM vm;
+        vm.setJitMode(mode);
+        result = vm.exec(program.source);
+        stats = vm.getJitStats();
+      });
+
+      auto resultString = evaValueToConstantString(result);
+      if (mode == JitMode::OFF) {
+        expected = resultString;
+      } else if (resultString != expected) {
+        std::cerr << "Mismatch: program=" << program.name << " jit=" << modeName
+          << " result=" << resultString << " expected=" << expected << '\n';
+        failures++;
+      }
+
+      std::cout << "jit=" << modeName
+        << " program=" << program.name
+        << " best_ms=" << best
+        << " compiled=" << stats.compiled
+        << " code_bytes=" << stats.codeBytes
+        << " result=" << resultString << '\n';
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+/**
+ * Opcode pair frequencies.
+ *
+ * Runs the benchmark programs (or the programs from files passed as
+ * arguments) on the stack tier and prints the most frequent executed
+ * opcode pairs, which are the candidates for superinstructions.
+ * Pass --fused to profile the code after the peephole pass.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static constexpr size_t TOP_PAIRS = 15;
+
+int main(int argc, char** argv) {
+  bool fused = false;
+  std::vector<BenchProgram> programs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (arg == "--fused") {
+      fused = true;
+      continue;
+    }
+
+    std::ifstream file(arg);
+    if (!file) {
+      std::cerr << "Can't open " << arg << '\n';
+      return 1;
+    }
+
+    std::stringstream source;
+    source << file.rdbuf();
+    programs.push_back({arg, source.str()});
+  }
+
+  if (programs.empty()) {
+    programs = {loopProgram, callsProgram, arithProgram};
+  }
+
+  std::vector<uint64_t> total(BYTECODES_COUNT * BYTECODES_COUNT, 0);
+
+  for (const auto& program : programs) {
+    EvaVM vm;
+    vm.setJitMode(JitMode::OFF);
+    vm.setPeephole(fused);
+    vm.exec(program.source);
+
+    const auto& pairs = vm.getOpcodePairs();
+    for (size_t i = 0; i < pairs.size(); i++) {
+      total[i] += pairs[i];
+    }
+  }
+
+  uint64_t executed = 0;
+  std::vector<size_t> order;
+
+  for (size_t i = 0; i < total.size(); i++) {
+    executed += total[i];
+    if (total[i] != 0) {
+      order.push_back(i);
+    }
+  }
+
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return total[a] > total[b];
+  });
+
+  std::cout << "code=" << (fused ? "fused" : "unfused")
+    << " pairs=" << executed << '\n';
+
+  for (size_t i = 0; i < order.size() && i < TOP_PAIRS; i++) {
+    auto pair = order[i];
+    std::cout << opcodeToString(pair / BYTECODES_COUNT) << ' '
+      << opcodeToString(pair % BYTECODES_COUNT) << ' '
+      << total[pair] << " (" << (100.0 * total[pair] / executed) << "%)\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+/**
+ * Superinstructions benchmark.
+ *
+ * Runs the stack tier with and without the peephole pass and reports
+ * the best time of several runs. The evm-bench-peephole-count build
+ * counts executed instructions (EVA_INSTRUCTION_COUNT) as well,
+ * `make bench-peephole` runs both.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+int main(int argc, char** argv) {
+  for (const auto& program : {loopProgram, callsProgram, arithProgram}) {
+    for (auto peephole : {false, true}) {
+      EvaValue result;
+      uint64_t instructions = 0;
+
+      auto best = bestTimeMs(RUNS, [&]() {
+        EvaVM vm;
+        vm.setJitMode(JitMode::OFF);
+        vm.setPeephole(peephole);
+        result = vm.exec(program.source);
+        instructions = vm.getInstructionsExecuted();
+      });
+
+      std::cout << "peephole=" << (peephole ? "on" : "off")
+        << " program=" << program.name
+        << " best_ms=" << best;
+
+#ifdef EVA_INSTRUCTION_COUNT
+      std::cout << " instructions=" << instructions;
+#endif
+
+      std::cout << " result=" << evaValueToConstantString(result) << '\n';
+    }
+  }
+
+  return 0;
+}
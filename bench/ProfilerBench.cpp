@@ -0,0 +1,101 @@
+/**
+ * Profiler benchmark.
+ *
+ * Runs the workloads (and one calling a native function in its loop)
+ * with the profiler stopped and sampling at 1 and 10 kHz, reporting
+ * the overhead, the samples and the hottest stack.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+#include <sstream>
+
+static constexpr int RUNS = 3;
+
+/**
+ * Native-heavy program: a loop calling a native function.
+ */
+static const BenchProgram nativeProgram = {
+  "native",
+  R"(
+    (def clamp (n)
+      (begin
+        (var i 0)
+        (var acc 0)
+        (while (< i n)
+          (begin
+            (set acc (+ acc (max i 100)))
+            (set i (+ i 1))))
+        acc))
+    (clamp 1000000)
+  )"
+};
+
+/**
+ * Hottest line of the collapsed profile.
+ */
+static std::string hottestStack(const std::string& profile) {
+  std::istringstream lines(profile);
+  std::string line, hottest;
+  size_t best = 0;
+
+  while (std::getline(lines, line)) {
+    auto count = std::stoul(line.substr(line.rfind(' ') + 1));
+    if (count > best) {
+      best = count;
+      hottest = line;
+    }
+  }
+
+  return hottest;
+}
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  for (auto program : {loopProgram, callsProgram, arithProgram, nativeProgram}) {
+    EvaValue result;
+    auto baseMs = bestTimeMs(RUNS, [&]() {
+      EvaVM vm;
+      vm.setJitMode(JitMode::OFF);
+      result = vm.exec(program.source);
+    });
+
+    for (auto hz : {1000, 10000}) {
+      EvaValue sampledResult;
+      std::ostringstream profile;
+      ProfilerStats stats;
+
+      auto ms = bestTimeMs(RUNS, [&]() {
+        EvaVM vm;
+        vm.setJitMode(JitMode::OFF);
+
+        vm.startProfiler(hz);
+        sampledResult = vm.exec(program.source);
+        vm.stopProfiler();
+
+        profile.str("");
+        vm.writeProfile(profile);
+        stats = vm.getProfilerStats();
+      });
+
+      if (evaValueToConstantString(sampledResult) != evaValueToConstantString(result)) {
+        std::cerr << "Mismatch: " << program.name << " hz=" << hz << '\n';
+        failures++;
+      }
+
+      std::cout << "program=" << program.name
+        << " hz=" << hz
+        << " base_ms=" << baseMs
+        << " profiled_ms=" << ms
+        << " overhead=" << (ms / baseMs - 1) * 100 << "%"
+        << " samples=" << stats.samples
+        << " dropped=" << stats.dropped
+        << " hottest=\"" << hottestStack(profile.str()) << "\"\n";
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/**
+ * Quickening benchmark.
+ *
+ * Runs number arithmetic, comparisons, string concatenation and an
+ * addition of changing operand types on the stack tier (interpreted)
+ * with the generic instructions only and with quickening. Reports the
+ * best time of each and checks the results match.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 7;
+
+/**
+ * Sums of products: ADD of numbers not fused by the peephole pass.
+ */
+static const BenchProgram arithmeticProgram = {
+  "arithmetic",
+  R"(
+    (def run (n)
+      (begin
+        (var total 0)
+        (var i 0)
+        (while (< i n)
+          (begin
+            (set total (+ total (* i 2)))
+            (set total (+ (/ total 2) (- i 1)))
+            (set i (+ i 1))))
+        total))
+
+    (run 1000000)
+  )"
+};
+
+/**
+ * Comparisons used as values (not fused with a jump).
+ */
+static const BenchProgram compareProgram = {
+  "compare",
+  R"(
+    (def run (n)
+      (begin
+        (var below 0)
+        (var i 0)
+        (while (< i n)
+          (begin
+            (var flag (< (* i 3) (- n i)))
+            (set below (if flag (+ below 1) below))
+            (set i (+ i 1))))
+        below))
+
+    (run 1000000)
+  )"
+};
+
+/**
+ * String concatenation next to number additions.
+ */
+static const BenchProgram concatProgram = {
+  "concat",
+  R"(
+    (def run (n)
+      (begin
+        (var s "")
+        (var prefix "item-")
+        (var suffix "y")
+        (var count 0)
+        (var i 0)
+        (while (< i n)
+          (begin
+            (set s (+ (+ prefix "x") suffix))
+            (set count (+ count (* i 1)))
+            (set i (+ i 1))))
+        (if (== s "item-xy") count 0)))
+
+    (run 300000)
+  )"
+};
+
+/**
+ * One ADD site meeting strings and integers in turns: past a few
+ * deoptimizations it stays generic.
+ */
+static const BenchProgram polymorphicProgram = {
+  "polymorphic",
+  R"(
+    (def add (a b) (+ a b))
+
+    (def run (n)
+      (begin
+        (var count 0)
+        (var i 0)
+        (while (< i n)
+          (begin
+            (add "a" "b")
+            (set count (add count 1))
+            (set i (+ i 1))))
+        count))
+
+    (run 300000)
+  )"
+};
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  for (const auto& program : {arithmeticProgram, compareProgram, concatProgram, polymorphicProgram}) {
+    double expected = 0;
+    double genericMs = 0;
+
+    for (auto quickening : {false, true}) {
+      EvaValue result;
+
+      auto best = bestTimeMs(RUNS, [&]() {
+        EvaVM vm;
+        vm.setJitMode(JitMode::OFF);
+        vm.setQuickening(quickening);
+        result = vm.exec(program.source);
+      });
+
+      if (!quickening) {
+        expected = TO_NUMBER(result);
+        genericMs = best;
+      } else if (TO_NUMBER(result) != expected) {
+        std::cerr << "Mismatch: program=" << program.name << '\n';
+        failures++;
+      }
+
+      std::cout << "program=" << program.name
+        << " quickening=" << (quickening ? "on" : "off")
+        << " best_ms=" << best
+        << " speedup=" << genericMs / best
+        << " result=" << evaValueToConstantString(result) << '\n';
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+/**
+ * Execution tier benchmark.
+ *
+ * Runs the same programs on the stack and register tiers and reports
+ * the best time of several runs. The evm-bench-register-count build
+ * counts executed instructions (EVA_INSTRUCTION_COUNT) as well,
+ * `make bench-register` runs both.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+int main(int argc, char** argv) {
+  const std::pair<const char*, ExecutionTier> tiers[] = {
+    {"stack", ExecutionTier::STACK},
+    {"register", ExecutionTier::REGISTER},
+  };
+
+  for (const auto& program : {loopProgram, callsProgram, arithProgram}) {
+    for (const auto& [tierName, tier] : tiers) {
+      EvaValue result;
+      uint64_t instructions = 0;
+
+      auto best = bestTimeMs(RUNS, [&]() {
+        EvaVM vm(tier);
+        vm.setJitMode(JitMode::OFF);
+        result = vm.exec(program.source);
+        instructions = vm.getInstructionsExecuted();
+      });
+
+      std::cout << "tier=" << tierName
+        << " program=" << program.name
+        << " best_ms=" << best;
+
+#ifdef EVA_INSTRUCTION_COUNT
+      std::cout << " instructions=" << instructions;
+#endif
+
+      std::cout << " result=" << evaValueToConstantString(result) << '\n';
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * Streaming execution benchmark.
+ *
+ * Executes generated scripts of 10 to 200 MB from a file, reading the
+ * whole source and executing it as one program (exec) vs executing
+ * it form by form (execStream). Each run is a child process, so its
+ * peak resident memory is measured on its own.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Writes the script of the size (at least): a function and many
+ * small top-level forms calling it.
+ */
+static void writeScript(const std::string& path, size_t bytes) {
+  std::ofstream file(path, std::ios::trunc);
+
+  file << "(def step (x) (if (> x 10) (- x 1) (+ x 2)))\n(var acc 0)\n";
+
+  for (size_t i = 0, size = 0; size < bytes; i++) {
+    auto form = "// step " + std::to_string(i) + "\n"
+      "(set acc (+ acc (step " + std::to_string(i % 20) + ")))\n";
+    file << form;
+    size += form.size();
+  }
+
+  file << "acc\n";
+}
+
+static EvaValue execFile(const std::string& mode, const std::string& path) {
+  EvaVM vm;
+  std::ifstream file(path, std::ios::binary);
+
+  if (mode == "stream") {
+    return vm.execStream(file);
+  }
+
+  std::stringstream source;
+  source << file.rdbuf();
+  return vm.exec(source.str());
+}
+
+int main(int argc, char** argv) {
+  auto path = (std::filesystem::temp_directory_path() / "evm-bench-stream.eva").string();
+  int failures = 0;
+
+  for (auto megabytes : {10, 50, 200}) {
+    writeScript(path, (size_t)megabytes << 20);
+
+    std::string results[2];
+    int index = 0;
+
+    for (std::string mode : {"exec", "stream"}) {
+      int channel[2];
+      if (pipe(channel) != 0) {
+        return 1;
+      }
+
+      auto pid = fork();
+      if (pid == 0) {
+        close(channel[0]);
+
+        EvaValue result;
+        auto ms = bestTimeMs(1, [&]() { result = execFile(mode, path); });
+
+        auto report = "ms=" + std::to_string(ms) + " result=" + evaValueToConstantString(result);
+        if (write(channel[1], report.data(), report.size()) < 0) {
+          _exit(1);
+        }
+        _exit(0);
+      }
+
+      close(channel[1]);
+
+      std::string report;
+      char buffer[256];
+      for (ssize_t count; (count = read(channel[0], buffer, sizeof(buffer))) > 0;) {
+        report.append(buffer, count);
+      }
+      close(channel[0]);
+
+      int status;
+      struct rusage usage;
+      wait4(pid, &status, 0, &usage);
+
+      std::cout << "input=" << megabytes << "MB"
+        << " mode=" << mode
+        << " " << report
+        << " peak_rss_mb=" << usage.ru_maxrss / 1024 << '\n';
+
+      results[index++] = report.substr(report.find("result="));
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        failures++;
+      }
+    }
+
+    if (results[0] != results[1]) {
+      std::cerr << "Mismatch: " << results[0] << " vs " << results[1] << '\n';
+      failures++;
+    }
+  }
+
+  std::remove(path.c_str());
+  return failures == 0 ? 0 : 1;
+}
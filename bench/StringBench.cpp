@@ -0,0 +1,66 @@
+/**
+ * String benchmark.
+ *
+ * Runs a string-heavy program (concatenation, equality and ordering)
+ * with and without string interning and reports time, heap
+ * allocations made by the whole run, string objects allocated
+ * and allocations served by the intern table.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+#include "BenchAllocations.hpp"
+
+#include <iostream>
+
+static const BenchProgram stringsProgram = {
+  "strings",
+  R"(
+    (def strings (n)
+      (begin
+        (var i 0)
+        (var matches 0)
+        (var key "")
+        (while (< i n)
+          (begin
+            (set key (+ "customer-account-" "session-identifier"))
+            (if (== key "customer-account-session-identifier")
+              (set matches (+ matches 1))
+              0)
+            (if (< key "customer-zzz")
+              (set matches (+ matches 1))
+              0)
+            (set i (+ i 1))))
+        matches))
+    (strings 200000)
+  )"
+};
+
+static constexpr int RUNS = 5;
+
+int main(int argc, char** argv) {
+  for (auto interning : {false, true}) {
+    EvaValue result;
+    size_t runAllocations = 0;
+    GCStats stats;
+
+    auto best = bestTimeMs(RUNS, [&]() {
+      auto before = benchAllocations();
+      EvaVM vm;
+      vm.setStringInterning(interning);
+      result = vm.exec(stringsProgram.source);
+      stats = vm.getGCStats();
+      runAllocations = benchAllocations() - before;
+    });
+
+    std::cout << "interning=" << (interning ? "on" : "off")
+      << " program=" << stringsProgram.name
+      << " best_ms=" << best
+      << " allocations=" << runAllocations
+      << " heap_bytes_allocated=" << stats.totalAllocated
+      << " intern_hits=" << stats.internHits
+      << " result=" << evaValueToConstantString(result) << '\n';
+  }
+
+  return 0;
+}
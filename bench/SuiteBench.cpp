@@ -0,0 +1,289 @@
+/**
+ * Benchmark suite.
+ *
+ * Eva ports of classic interpreter benchmarks. Each workload runs in a
+ * fresh VM, the parse, compile and execute phases are timed apart, and
+ * the executed instructions and heap allocations are counted. The
+ * results are printed as JSON to compare builds and releases:
+ *
+ *   evm-bench [--runs N] [--jit]
+ *
+ * Times are the best of the runs for each phase. The instruction count
+ * covers interpreted code only, so the JIT is off unless --jit.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const std::vector<BenchProgram> suite = {
+  {
+    "fib",
+    R"(
+      (def fib (n)
+        (if (< n 2)
+          n
+          (+ (fib (- n 1)) (fib (- n 2)))))
+      (fib 27)
+    )"
+  },
+  {
+    "loops",
+    R"(
+      (def whileLoop (n)
+        (begin
+          (var i 0)
+          (var sum 0)
+          (while (< i n)
+            (begin
+              (set sum (+ sum i))
+              (set i (+ i 1))))
+          sum))
+
+      (def forLoop (n)
+        (begin
+          (var sum 0)
+          (for (var i 0) (< i n) (set i (+ i 1))
+            (set sum (+ sum (* i 2))))
+          sum))
+
+      (+ (whileLoop 1000000) (forLoop 1000000))
+    )"
+  },
+  {
+    "closures",
+    R"(
+      (def makeCounter (start)
+        (begin
+          (var count start)
+          (lambda ()
+            (begin
+              (set count (+ count 1))
+              count))))
+
+      (def closures (n)
+        (begin
+          (var i 0)
+          (var total 0)
+          (while (< i n)
+            (begin
+              (var counter (makeCounter i))
+              (counter)
+              (set total (+ total (counter)))
+              (set i (+ i 1))))
+          total))
+
+      (closures 200000)
+    )"
+  },
+  {
+    "strings",
+    R"(
+      (def build (n)
+        (begin
+          (var i 0)
+          (var s "")
+          (var line "")
+          (while (< i n)
+            (begin
+              (set s (+ s "x"))
+              (set line (+ (+ "item-" "value") ";"))
+              (set i (+ i 1))))
+          (+ s line)))
+
+      (def strings (rounds)
+        (begin
+          (var r 0)
+          (while (< r rounds)
+            (begin
+              (build 2000)
+              (set r (+ r 1))))
+          r))
+
+      (strings 20)
+    )"
+  },
+  {
+    "nbody",
+    R"(
+      (def sqrt (x)
+        (begin
+          (var g (/ (+ x 1) 2))
+          (var k 0)
+          (while (< k 8)
+            (begin
+              (set g (/ (+ g (/ x g)) 2))
+              (set k (+ k 1))))
+          g))
+
+      (def nbody (steps)
+        (begin
+          (var x1 0) (var y1 0) (var vx1 0) (var vy1 0)
+          (var x2 10) (var y2 0) (var vx2 0) (var vy2 (/ 1 3))
+          (var dt (/ 1 100))
+          (var i 0)
+          (while (< i steps)
+            (begin
+              (var dx (- x2 x1))
+              (var dy (- y2 y1))
+              (var d2 (+ (* dx dx) (* dy dy)))
+              (var f (/ dt (* d2 (sqrt d2))))
+              (set vx1 (+ vx1 (* dx f)))
+              (set vy1 (+ vy1 (* dy f)))
+              (set vx2 (- vx2 (* dx f)))
+              (set vy2 (- vy2 (* dy f)))
+              (set x1 (+ x1 (* vx1 dt)))
+              (set y1 (+ y1 (* vy1 dt)))
+              (set x2 (+ x2 (* vx2 dt)))
+              (set y2 (+ y2 (* vy2 dt)))
+              (set i (+ i 1))))
+          (+ (* x2 1000) y2)))
+
+      (nbody 50000)
+    )"
+  },
+  // Close to the depth of the call stack (EVA_CALL_STACK_LIMIT).
+  {
+    "recursion",
+    R"(
+      (def depth (n)
+        (if (== n 0)
+          0
+          (+ 1 (depth (- n 1)))))
+
+      (def recursion (rounds)
+        (begin
+          (var r 0)
+          (var total 0)
+          (while (< r rounds)
+            (begin
+              (set total (+ total (depth 1000)))
+              (set r (+ r 1))))
+          total))
+
+      (recursion 600)
+    )"
+  },
+};
+
+/**
+ * Measurements of a workload, times are the best of the runs.
+ */
+struct SuiteResult {
+  double parseMs = 0;
+  double compileMs = 0;
+  double executeMs = 0;
+  double wallMs = 0;
+  uint64_t instructions = 0;
+  GCStats gc;
+  std::string result;
+};
+
+static std::string jsonString(const std::string& string) {
+  std::string quoted = "\"";
+  for (auto c : string) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + '"';
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static SuiteResult runWorkload(const BenchProgram& program, int runs, bool jit) {
+  SuiteResult best;
+
+  for (int run = 0; run < runs; run++) {
+    EvaVM vm;
+    vm.setJitMode(jit ? JitMode::HOT : JitMode::OFF);
+
+    EvaCollector::Scope gcScope(vm.getCollector());
+    SuiteResult current;
+
+    auto start = std::chrono::steady_clock::now();
+    auto ast = vm.parseProgram(program.source);
+    current.parseMs = elapsedMs(start);
+
+    auto compileStart = std::chrono::steady_clock::now();
+    vm.compileAst(ast);
+    current.compileMs = elapsedMs(compileStart);
+
+    auto executeStart = std::chrono::steady_clock::now();
+    auto result = vm.run();
+    current.executeMs = elapsedMs(executeStart);
+    current.wallMs = elapsedMs(start);
+
+    current.instructions = vm.getInstructionsExecuted();
+    current.gc = vm.getGCStats();
+    current.result = evaValueToConstantString(result);
+
+    if (run == 0) {
+      best = current;
+      continue;
+    }
+
+    best.parseMs = std::min(best.parseMs, current.parseMs);
+    best.compileMs = std::min(best.compileMs, current.compileMs);
+    best.executeMs = std::min(best.executeMs, current.executeMs);
+    best.wallMs = std::min(best.wallMs, current.wallMs);
+  }
+
+  return best;
+}
+
+int main(int argc, char** argv) {
+  int runs = 3;
+  bool jit = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--jit") == 0) {
+      jit = true;
+    } else {
+      std::cerr << "Usage: evm-bench [--runs N] [--jit]\n";
+      return 1;
+    }
+  }
+
+#ifdef EVA_NAN_BOXING
+  auto value = "nanbox";
+#else
+  auto value = "tagged";
+#endif
+
+  std::cout << "{\n"
+    << "  \"suite\": \"evm-bench\",\n"
+    << "  \"config\": {\"dispatch\": \"" << (EVA_THREADED_DISPATCH ? "threaded" : "switch")
+    << "\", \"value\": \"" << value
+    << "\", \"jit\": " << (jit ? "true" : "false")
+    << ", \"runs\": " << runs << "},\n"
+    << "  \"benchmarks\": [\n";
+
+  for (size_t i = 0; i < suite.size(); i++) {
+    auto result = runWorkload(suite[i], runs, jit);
+
+    std::cout << "    {\"name\": \"" << suite[i].name << "\""
+      << ", \"result\": " << jsonString(result.result)
+      << ", \"wall_ms\": " << result.wallMs
+      << ", \"parse_ms\": " << result.parseMs
+      << ", \"compile_ms\": " << result.compileMs
+      << ", \"execute_ms\": " << result.executeMs
+      << ", \"instructions\": " << result.instructions
+      << ", \"allocations\": " << result.gc.totalObjects
+      << ", \"allocated_bytes\": " << result.gc.totalAllocated
+      << ", \"collections\": " << result.gc.collections
+      << ", \"peak_heap_bytes\": " << result.gc.peakAllocated
+      << "}" << (i + 1 < suite.size() ? "," : "") << '\n';
+  }
+
+  std::cout << "  ]\n}\n";
+  return 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * Tokenizer benchmark.
+ *
+ * Tokenizes generated sources of 1, 10 and 100 MB to the end of input
+ * and reports the throughput.
+ */
+
+#include "parser/EvaParser.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+using syntax::Tokenizer;
+using syntax::TokenType;
+
+static constexpr int RUNS = 3;
+
+int main(int argc, char** argv) {
+  for (auto megabytes : {1, 10, 100}) {
+    auto source = generateSource((size_t)megabytes << 20);
+
+    size_t tokens = 0;
+    auto ms = bestTimeMs(RUNS, [&]() {
+      Tokenizer tokenizer;
+      tokenizer.initString(source);
+
+      tokens = 0;
+      while (tokenizer.getNextToken().type != TokenType::__EOF) {
+        tokens++;
+      }
+    });
+
+    std::cout << "input=" << megabytes << "MB"
+      << " bytes=" << source.size()
+      << " tokens=" << tokens
+      << " ms=" << ms
+      << " mb_per_s=" << (source.size() / double(1 << 20)) / (ms / 1000) << '\n';
+  }
+
+  return 0;
+}
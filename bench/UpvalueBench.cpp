@@ -0,0 +1,151 @@
+/**
+ * Upvalue benchmark.
+ *
+ * Closure patterns whose captured variables escape: counters returned
+ * to the caller, an accumulator updated both by its frame and by a
+ * closure, and closures made in a loop. Runs the interpreter of both
+ * tiers and the JIT of the stack tier. Reports the best time, the cells
+ * and the objects allocated.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+/**
+ * Counters made once and called many times.
+ */
+static const BenchProgram counterProgram = {
+  "counter",
+  R"(
+    (def makeCounter ()
+      (begin
+        (var count 0)
+        (lambda () (set count (+ count 1)))))
+
+    (def run (n)
+      (begin
+        (var a (makeCounter))
+        (var b (makeCounter))
+        (var i 0)
+        (while (< i n)
+          (begin
+            (a)
+            (b)
+            (set i (+ i 1))))
+        (+ (a) (b))))
+
+    (run 500000)
+  )"
+};
+
+/**
+ * Accumulator captured by a returned closure, updated by its frame in
+ * a loop.
+ */
+static const BenchProgram accumulatorProgram = {
+  "accumulator",
+  R"(
+    (def makeAccumulator (n)
+      (begin
+        (var total 0)
+        (var add (lambda (k) (set total (+ total k))))
+        (var i 0)
+        (while (< i n)
+          (begin
+            (set total (+ total i))
+            (set i (+ i 1))))
+        add))
+
+    (def run (n)
+      (begin
+        (var result 0)
+        (var j 0)
+        (while (< j n)
+          (begin
+            (set result (+ result ((makeAccumulator 1000) 1)))
+            (set j (+ j 1))))
+        result))
+
+    (run 1000)
+  )"
+};
+
+/**
+ * Closures made in a loop, each capturing the variable of its
+ * iteration, called in the next one.
+ */
+static const BenchProgram closureLoopProgram = {
+  "loop",
+  R"(
+    (def run (n)
+      (begin
+        (var result 0)
+        (var previous (lambda () 0))
+        (var i 0)
+        (while (< i n)
+          (begin
+            (var x i)
+            (set result (+ result (previous)))
+            (set previous (lambda () x))
+            (set x (+ x 1))
+            (set i (+ i 1))))
+        (+ result (previous))))
+
+    (run 200000)
+  )"
+};
+
+/**
+ * Execution configuration.
+ */
+struct UpvalueConfig {
+  const char* name;
+  ExecutionTier tier;
+  JitMode jitMode;
+};
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  const UpvalueConfig configs[] = {
+    {"stack", ExecutionTier::STACK, JitMode::OFF},
+    {"register", ExecutionTier::REGISTER, JitMode::OFF},
+    {"jit", ExecutionTier::STACK, JitMode::ALWAYS},
+  };
+
+  for (const auto& program : {counterProgram, accumulatorProgram, closureLoopProgram}) {
+    double expected = 0;
+
+    for (const auto& config : configs) {
+      EvaValue result;
+      GCStats stats;
+
+      auto best = bestTimeMs(RUNS, [&]() {
+        EvaVM vm(config.tier);
+        vm.setJitMode(config.jitMode);
+        result = vm.exec(program.source);
+        stats = vm.getGCStats();
+      });
+
+      if (config.tier == ExecutionTier::STACK && config.jitMode == JitMode::OFF) {
+        expected = TO_NUMBER(result);
+      } else if (TO_NUMBER(result) != expected) {
+        std::cerr << "Mismatch: program=" << program.name << " config=" << config.name << '\n';
+        failures++;
+      }
+
+      std::cout << "program=" << program.name
+        << " config=" << config.name
+        << " best_ms=" << best
+        << " cells=" << stats.totalCells
+        << " objects=" << stats.totalObjects
+        << " result=" << evaValueToConstantString(result) << '\n';
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
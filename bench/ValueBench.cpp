@@ -0,0 +1,64 @@
+/**
+ * Value representation benchmark.
+ *
+ * Reports the memory footprint of EvaValue and the structures that
+ * store values (VM stack, constant pools, globals, cells), and the
+ * throughput of loop-heavy and call-heavy programs. Built once per
+ * representation (evm-bench-value-tagged, evm-bench-value-nanbox),
+ * `make bench-value` runs both.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+#ifndef EVA_VALUE_NAME
+#define EVA_VALUE_NAME "unknown"
+#endif
+
+static constexpr int RUNS = 5;
+
+/**
+ * Compiles the program and returns the size of all constant pools in bytes.
+ */
+size_t constantPoolBytes(const std::string& source) {
+  auto global = std::make_shared<Global>();
+  syntax::EvaParser parser;
+  EvaCompiler compiler(global);
+
+  auto ast = parser.parse("(begin " + source + ")");
+  compiler.compile(ast);
+
+  size_t bytes = 0;
+  for (auto co : compiler.getCodeObjects()) {
+    bytes += co->constants.size() * sizeof(EvaValue);
+  }
+  return bytes;
+}
+
+int main(int argc, char** argv) {
+  std::cout << "value=" << EVA_VALUE_NAME
+    << " sizeof_value=" << sizeof(EvaValue)
+    << " sizeof_vm=" << sizeof(EvaVM)
+    << " sizeof_global_var=" << sizeof(GlobalVar)
+    << " sizeof_cell=" << sizeof(CellObject) << '\n';
+
+  for (const auto& program : {loopProgram, callsProgram}) {
+    EvaValue result;
+
+    auto best = bestTimeMs(RUNS, [&]() {
+      EvaVM vm;
+      vm.setJitMode(JitMode::OFF);
+      result = vm.exec(program.source);
+    });
+
+    std::cout << "value=" << EVA_VALUE_NAME
+      << " program=" << program.name
+      << " constant_pool_bytes=" << constantPoolBytes(program.source)
+      << " best_ms=" << best
+      << " result=" << evaValueToConstantString(result) << '\n';
+  }
+
+  return 0;
+}
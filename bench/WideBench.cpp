@@ -0,0 +1,197 @@
+/**
+ * Wide operand benchmark.
+ *
+ * Generates rule scripts reading many globals, functions with many
+ * locals and loops with long bodies, small enough for the one-byte
+ * operands and 2-byte jump addresses and past them (wide forms), and
+ * runs them on both interpreter tiers and the JIT of the stack tier. Every program does the same number of reads. Reports the
+ * best time of each and checks the results.
+ */
+
+#include "vm/EvaVM.hpp"
+#include "BenchPrograms.hpp"
+
+#include <iostream>
+
+static constexpr int RUNS = 5;
+
+/**
+ * Variable reads per run.
+ */
+static constexpr int64_t READS = 2000000;
+
+/**
+ * Generated program with its expected result.
+ */
+struct WideProgram {
+  std::string name;
+  size_t size;
+  std::string source;
+  int64_t expected;
+};
+
+/**
+ * Value of the generated variable: distinct, so every one is a
+ * constant of its own.
+ */
+static int64_t variableValue(size_t index) {
+  return 1000 + index * 7;
+}
+
+/**
+ * Statements adding each variable to the total.
+ */
+static std::string sumStatements(const std::string& prefix, size_t size) {
+  std::string statements;
+  for (size_t i = 0; i < size; i++) {
+    statements += "(set total (+ total " + prefix + std::to_string(i) + "))\n";
+  }
+  return statements;
+}
+
+/**
+ * Sum of the variables times the loop count.
+ */
+static int64_t expectedSum(size_t size, int64_t n) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum += variableValue(i);
+  }
+  return sum * n;
+}
+
+/**
+ * Rules as globals, summed by a loop of the run function.
+ */
+static WideProgram rulesProgram(size_t size) {
+  auto n = READS / size;
+  std::string source;
+
+  for (size_t i = 0; i < size; i++) {
+    source += "(var rule" + std::to_string(i) + " " + std::to_string(variableValue(i)) + ")\n";
+  }
+
+  source +=
+    "(def run (n)\n"
+    "  (begin\n"
+    "    (var total 0)\n"
+    "    (var i 0)\n"
+    "    (while (< i n)\n"
+    "      (begin\n" + sumStatements("rule", size) +
+    "        (set i (+ i 1))))\n"
+    "    total))\n"
+    "(run " + std::to_string(n) + ")\n";
+
+  return {"rules", size, source, expectedSum(size, n)};
+}
+
+/**
+ * Locals of the run function, summed by its loop.
+ */
+static WideProgram localsProgram(size_t size) {
+  auto n = READS / size;
+  std::string source = "(def run (n)\n  (begin\n";
+
+  for (size_t i = 0; i < size; i++) {
+    source += "    (var local" + std::to_string(i) + " " + std::to_string(variableValue(i)) + ")\n";
+  }
+
+  source +=
+    "    (var total 0)\n"
+    "    (var i 0)\n"
+    "    (while (< i n)\n"
+    "      (begin\n" + sumStatements("local", size) +
+    "        (set i (+ i 1))))\n"
+    "    total))\n"
+    "(run " + std::to_string(n) + ")\n";
+
+  return {"locals", size, source, expectedSum(size, n)};
+}
+
+/**
+ * Loop of the run function over a body of size statements summing a
+ * few locals: past 64 KB of code its jumps are wide.
+ */
+static WideProgram codeProgram(size_t size) {
+  static constexpr size_t LOCALS = 10;
+
+  auto n = READS / size;
+  std::string source = "(def run (n)\n  (begin\n";
+
+  for (size_t i = 0; i < LOCALS; i++) {
+    source += "    (var local" + std::to_string(i) + " " + std::to_string(variableValue(i)) + ")\n";
+  }
+
+  source +=
+    "    (var total 0)\n"
+    "    (var i 0)\n"
+    "    (while (< i n)\n"
+    "      (begin\n";
+
+  int64_t sum = 0;
+  for (size_t i = 0; i < size; i++) {
+    source += "(set total (+ total local" + std::to_string(i % LOCALS) + "))\n";
+    sum += variableValue(i % LOCALS);
+  }
+
+  source +=
+    "        (set i (+ i 1))))\n"
+    "    total))\n"
+    "(run " + std::to_string(n) + ")\n";
+
+  return {"code", size, source, sum * (int64_t)n};
+}
+
+/**
+ * Execution configuration.
+ */
+struct WideConfig {
+  const char* name;
+  ExecutionTier tier;
+  JitMode jitMode;
+};
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  const WideConfig configs[] = {
+    {"stack", ExecutionTier::STACK, JitMode::OFF},
+    {"register", ExecutionTier::REGISTER, JitMode::OFF},
+    {"jit", ExecutionTier::STACK, JitMode::ALWAYS},
+  };
+
+  const WideProgram programs[] = {
+    rulesProgram(100),
+    rulesProgram(300),
+    localsProgram(100),
+    localsProgram(300),
+    codeProgram(2000),
+    codeProgram(20000),
+  };
+
+  for (const auto& program : programs) {
+    for (const auto& config : configs) {
+      EvaValue result;
+
+      auto best = bestTimeMs(RUNS, [&]() {
+        EvaVM vm(config.tier);
+        vm.setJitMode(config.jitMode);
+        result = vm.exec(program.source);
+      });
+
+      if (TO_NUMBER(result) != program.expected) {
+        std::cerr << "Mismatch: program=" << program.name << " size=" << program.size
+          << " config=" << config.name << '\n';
+        failures++;
+      }
+
+      std::cout << "program=" << program.name
+        << " size=" << program.size
+        << " config=" << config.name
+        << " best_ms=" << best
+        << " result=" << evaValueToConstantString(result) << '\n';
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+/**
+ * EVM trace decoder
+ *
+ * Usage:
+ *
+ *   evm-trace <trace>            prints the records of a trace file
+ *
+ * Trace files are written by `evm` with EVA_TRACE set (see EvaTracer).
+*/
+
+#include "trace/EvaTraceDecoder.hpp"
+#include <iostream>
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: evm-trace <trace>\n";
+    return 1;
+  }
+
+  EvaTraceDecoder decoder(argv[1]);
+  decoder.print();
+  return 0;
+}
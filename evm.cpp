@@ -1,14 +1,119 @@
 /**
  * EVM Launcher
+ *
+ * Usage:
+ *
+ *   evm                          runs the built-in example
+ *   evm run <file>               executes the source file
+ *   evm stream <file | ->        executes the file (or stdin) form by form
+ *   evm compile <file> <image>   compiles the source file to a bytecode image
+ *   evm run-image <image>        executes the bytecode image
+ *   evm disassemble <file>       prints the bytecode of the source file
+ *
+ * With EVA_CACHE_DIR set, `run` keeps the compiled programs in that
+ * directory and skips compiling unchanged sources (see EvaCompileCache).
+ *
+ * With EVA_PROFILE=<file> set, the run is sampled (EVA_PROFILE_HZ times
+ * per second of CPU time, 1000 by default) and the stacks are written
+ * to the file in the collapsed format of flame graph tools.
+ *
+ * With EVA_TRACE=calls|instructions|stack set, the last events of the
+ * run are written to EVA_TRACE_FILE (evm.trace by default), which
+ * evm-trace decodes. The JIT is off while tracing.
+ *
+ * With EVA_DISASSEMBLE set, the bytecode is printed after the run, with
+ * the sites the interpreter quickened (see EvaVM::quicken).
 */
 
 #include "vm/EvaVM.hpp"
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+
+static const char* USAGE =
+  "Usage: evm [run <file> | stream <file | -> | compile <file> <image> | run-image <image>"
+  " | disassemble <file>]\n";
+
+/**
+ * Trace level of the EVA_TRACE value.
+ */
+static TraceLevel traceLevel(const std::string& name) {
+  if (name == "calls") {
+    return TraceLevel::CALLS;
+  } else if (name == "instructions") {
+    return TraceLevel::INSTRUCTIONS;
+  } else if (name == "stack") {
+    return TraceLevel::STACK;
+  } else if (name == "off") {
+    return TraceLevel::OFF;
+  }
+
+  DIE << "Unknown trace level " << name << " (off, calls, instructions, stack)";
+  return TraceLevel::OFF;
+}
+
+static std::string readFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    DIE << "Cannot open " << path;
+  }
+
+  std::stringstream source;
+  source << file.rdbuf();
+  return source.str();
+}
 
 int main(int argc, char** argv) {
   EvaVM evm;
+  EvaValue result;
 
-  auto result = evm.exec(R"(
+  std::string mode = argc > 1 ? argv[1] : "";
+
+  auto trace = std::getenv("EVA_TRACE");
+  if (trace != nullptr) {
+    if (!EVA_TRACE) {
+      DIE << "evm is built without EVA_TRACE";
+    }
+    evm.setTraceLevel(traceLevel(trace));
+    evm.setJitMode(JitMode::OFF);
+  }
+
+  auto profilePath = std::getenv("EVA_PROFILE");
+  if (profilePath != nullptr) {
+    auto hz = std::getenv("EVA_PROFILE_HZ");
+    evm.startProfiler(hz != nullptr ? std::atoi(hz) : EvaProfiler::DEFAULT_HZ);
+  }
+
+  if (mode == "run" && argc == 3) {
+    if (auto cacheDir = std::getenv("EVA_CACHE_DIR")) {
+      evm.setCompileCache(std::make_shared<EvaCompileCache>(cacheDir));
+    }
+    result = evm.exec(readFile(argv[2]));
+  } else if (mode == "stream" && argc == 3) {
+    std::string path = argv[2];
+    if (path == "-") {
+      // Unsynchronized, std::cin tells how much input is available
+      // (see EvaFormReader::readChunk).
+      std::ios::sync_with_stdio(false);
+      result = evm.execStream(std::cin);
+    } else {
+      std::ifstream file(path, std::ios::binary);
+      if (!file) {
+        DIE << "Cannot open " << path;
+      }
+      result = evm.execStream(file);
+    }
+  } else if (mode == "compile" && argc == 4) {
+    evm.compileImage(readFile(argv[2]), argv[3]);
+    return 0;
+  } else if (mode == "run-image" && argc == 3) {
+    result = evm.execImage(argv[2]);
+  } else if (mode == "disassemble" && argc == 3) {
+    evm.disassemble(readFile(argv[2]));
+    return 0;
+  } else if (argc == 1) {
+    result = evm.exec(R"(
         (var x 10)
         (def foo () x)
 
@@ -22,9 +127,28 @@ int main(int argc, char** argv) {
             z
             (def bar () (+ y z))
             (bar)))
-  )");
+    )");
+  } else {
+    std::cerr << USAGE;
+    return 1;
+  }
+
+  if (trace != nullptr) {
+    auto tracePath = std::getenv("EVA_TRACE_FILE");
+    evm.writeTrace(tracePath != nullptr ? tracePath : "evm.trace");
+  }
+
+  if (profilePath != nullptr) {
+    evm.stopProfiler();
+
+    std::ofstream profile(profilePath);
+    evm.writeProfile(profile);
+  }
+
+  if (std::getenv("EVA_DISASSEMBLE") != nullptr) {
+    evm.disassembleCode();
+  }
 
   std::cout << "\nVM exited gracefully with value: " << result << std::endl;
   return 0;
 }
-
@@ -1,6 +1,8 @@
 #include "compiler/EvaCompiler.hpp"
+#include "compiler/EvaPeephole.hpp"
 #include "logging/Logger.hpp"
 #include "vm/OpCode.hpp"
+#include "vm/RegOpCode.hpp"
 
 #define ALLOC_CONST(tester, converter, allocator, value) do {   \
     /* Checking if constant is already defined */               \
@@ -16,72 +18,116 @@
 } while (0)
 
 #define GEN_BINARY_OPERATOR(op) do {                            \
-    gen(exp.list[1]);                                           \
-    gen(exp.list[2]);                                           \
+    gen(exp.list()[1]);                                           \
+    gen(exp.list()[2]);                                           \
     emit(op);                                                   \
 } while(0)
 
-std::map<std::string, uint8_t> EvaCompiler::cmpOps = {
+std::map<std::string, uint8_t, std::less<>> EvaCompiler::cmpOps = {
   {"<", 0}, {">", 1}, {"==", 2}, {">=", 3}, {"<=", 4}, {"!=", 5}
 };
 
-void EvaCompiler::compile(const Exp& exp) {
+void EvaCompiler::compile(Exp& exp) {
+  resetProgram();
+
   // Allocate new code object and set it as a main function
   codeObj = AS_CODE(createCodeObjectValue("main"));
   main = AS_FUNCTION(ALLOC_FUNCTION(codeObj));
 
   // Scope analysis.
   analyze(exp, nullptr);
+  resolveReferences();
+
+  // Constant folding.
+  fold(exp);
 
+  genMain(exp);
+}
+
+void EvaCompiler::genMain(const Exp& exp) {
   gen(exp);
 
   emit(OP_HALT);
+
+  widenJumps();
+
+  // Superinstructions.
+  if (peephole_) {
+    EvaPeephole peephole;
+    for (auto co : codeObjects_) {
+      if (co->tier == ExecutionTier::STACK) {
+        peephole.optimize(co);
+      }
+    }
+  }
+}
+
+void EvaCompiler::setCode(const std::vector<CodeObject*>& codeObjects) {
+  codeObjects_.insert(codeObjects_.end(), codeObjects.begin(), codeObjects.end());
+  main = AS_FUNCTION(ALLOC_FUNCTION(codeObjects[0]));
 }
 
 void EvaCompiler::analyze(const Exp& exp, std::shared_ptr<Scope> scope) {
   if (exp.type == ExpType::SYMBOL) {
     // Variables
-    if (exp.string != "true" && exp.string != "false") {
-      scope->maybePromote(exp.string);
+    if (exp.string() != "true" && exp.string() != "false") {
+      addReference(scope.get(), std::string(exp.string()), false);
     }
   } else if (exp.type == ExpType::LIST) {
     // Lists
-    auto tag = exp.list[0];
+    auto tag = exp.list()[0];
 
     if (tag.type == ExpType::SYMBOL) {
-      auto op = tag.string;
+      auto op = tag.string();
 
       if (op == "begin") {
-        auto newScope = std::make_shared<Scope>(
-            scope == nullptr ? ScopeType::GLOBAL : ScopeType::BLOCK, scope);
+        // Top-level block: the globals of the previous programs
+        // stay visible.
+        if (scope == nullptr && globalScope_ == nullptr) {
+          globalScope_ = std::make_shared<Scope>(ScopeType::GLOBAL, nullptr);
+        }
+
+        auto newScope = scope == nullptr ? globalScope_
+                                         : std::make_shared<Scope>(ScopeType::BLOCK, scope);
 
         scopeInfo_[&exp] = newScope;
 
-        for (int i = 1; i < exp.list.size(); ++i) {
-          analyze(exp.list[i], newScope);
+        for (size_t i = 1; i < exp.list().size(); ++i) {
+          analyze(exp.list()[i], newScope);
         }
       }
 
       else if (op == "var") {
-        scope->addLocal(exp.list[1].string);
-        analyze(exp.list[2], scope);
+        std::string varName(exp.list()[1].string());
+        declare(scope.get(), varName);
+        analyze(exp.list()[2], scope);
+
+        if (isLambda(exp.list()[2])) {
+          bindFunction(scope.get(), varName, scopeInfo_.at(&exp.list()[2]).get());
+        }
       }
 
       else if (op == "def") {
-        auto fnName = exp.list[1].string;
-        scope->addLocal(fnName);
+        std::string fnName(exp.list()[1].string());
+        declare(scope.get(), fnName);
         auto newScope = std::make_shared<Scope>(ScopeType::FUNCTION, scope);
         scopeInfo_[&exp] = newScope;
 
         newScope->addLocal(fnName);
 
         // Params
-        auto arity = exp.list[2].list.size();
-        for (int i = 0; i < arity; ++i) {
-          scope->addLocal(exp.list[2].list[i].string);
+        auto arity = exp.list()[2].list().size();
+        for (size_t i = 0; i < arity; ++i) {
+          newScope->addLocal(std::string(exp.list()[2].list()[i].string()));
         }
 
-        analyze(exp.list[3], newScope);
+        analyze(exp.list()[3], newScope);
+
+        bindFunction(scope.get(), fnName, newScope.get());
+
+        // Recursive calls are made from the frame of the function
+        // itself: they are references of this binding.
+        newScope->functions[fnName] = newScope.get();
       }
 
       else if (op == "lambda") {
@@ -89,48 +135,133 @@ void EvaCompiler::analyze(const Exp& exp, std::shared_ptr<Scope> scope) {
         scopeInfo_[&exp] = newScope;
 
         // Params
-        auto arity = exp.list[1].list.size();
-        for (int i = 0; i < arity; ++i) {
-          scope->addLocal(exp.list[1].list[i].string);
+        auto arity = exp.list()[1].list().size();
+        for (size_t i = 0; i < arity; ++i) {
+          newScope->addLocal(std::string(exp.list()[1].list()[i].string()));
         }
 
-        analyze(exp.list[2], newScope);
+        analyze(exp.list()[2], newScope);
       }
 
       else {
-        for (int i = 1; i < exp.list.size(); ++i) {
-          analyze(exp.list[i], scope);
+        // Function calls by name (special forms and natives do not
+        // resolve).
+        addReference(scope.get(), std::string(op), true);
+
+        for (size_t i = 1; i < exp.list().size(); ++i) {
+          analyze(exp.list()[i], scope);
         }
       }
     } else {
-      for (int i = 0; i < exp.list.size(); ++i) {
-        analyze(exp.list[i], scope);
+      for (size_t i = 0; i < exp.list().size(); ++i) {
+        analyze(exp.list()[i], scope);
+      }
+
+      // Immediately invoked lambda: called from its defining frame only.
+      if (escapeAnalysis_ && isLambda(tag)) {
+        scopeInfo_.at(&exp.list()[0])->escapes = false;
       }
     }
   }
 }
 
+void EvaCompiler::addReference(Scope* scope, const std::string& name, bool isCall) {
+  auto [owner, crossed] = scope->lookup(name);
+
+  if (owner == nullptr) {
+    if (isCall) {
+      return;
+    }
+    DIE << "[Scope] Reference error: " << name << " is not defined." << std::endl;
+  }
+
+  references_.push_back(Reference{scope, name, isCall, owner, crossed});
+}
+
+void EvaCompiler::declare(Scope* scope, const std::string& name) {
+  auto binding = scope->functions.find(name);
+  if (binding != scope->functions.end()) {
+    binding->second->escapes = true;
+    scope->functions.erase(binding);
+  }
+
+  scope->addLocal(name);
+}
+
+void EvaCompiler::bindFunction(Scope* scope, const std::string& name, Scope* fnScope) {
+  // Globals can be called from anywhere (and from the host).
+  if (!escapeAnalysis_ || scope->type == ScopeType::GLOBAL) {
+    return;
+  }
+
+  scope->functions[name] = fnScope;
+  fnScope->escapes = false;
+}
+
+void EvaCompiler::resolveReferences() {
+  // 1. A function escapes if it is used as a value, or called from
+  //    another frame than the one it is defined in.
+  for (const auto& ref : references_) {
+    auto binding = ref.owner->functions.find(ref.name);
+    if (binding == ref.owner->functions.end()) {
+      continue;
+    }
+
+    auto fnScope = binding->second;
+    if (!ref.isCall || ref.scope->frame() != fnScope->parent->frame()) {
+      fnScope->escapes = true;
+    }
+  }
+
+  // Variables of the enclosing function captured by a function which
+  // does not escape are read in the caller frame: it is their frame.
+  auto isOuter = [](const Reference& ref) {
+    return ref.crossed == 1 && !ref.scope->frame()->escapes;
+  };
+
+  // 2. Other captured variables are promoted to the heap.
+  for (const auto& ref : references_) {
+    if (ref.crossed > 0 && ref.owner->type != ScopeType::GLOBAL && !isOuter(ref)) {
+      ref.owner->addCell(ref.name);
+    }
+  }
+
+  // 3. Allocation of the references.
+  for (const auto& ref : references_) {
+    auto allocType = ref.owner->allocInfo[ref.name];
+
+    if (ref.crossed == 0 || allocType == AllocType::GLOBAL) {
+      ref.scope->allocInfo[ref.name] = allocType;
+    } else if (ref.owner->cells.count(ref.name) == 0) {
+      ref.scope->allocInfo[ref.name] = AllocType::OUTER;
+      ref.owner->outers.insert(ref.name);
+    } else {
+      ref.scope->promote(ref.name, ref.owner);
+    }
+  }
+
+  references_.clear();
+}
+
 void EvaCompiler::compileFunction(const Exp& exp, const std::string& fnName,
                                   const Exp& params, const Exp& body) {
   auto scopeInfo = scopeInfo_.at(&exp);
   scopeStack_.push(scopeInfo);
 
-  auto arity = params.list.size();
+  auto arity = params.list().size();
   // Save current CodeObject to restore it later.
   auto prevCodeObj = codeObj;
+  auto prevOuterCodeObj = outerCodeObj_;
+  outerCodeObj_ = prevCodeObj;
 
   // New function CodeObject.
   auto coValue = createCodeObjectValue(fnName, arity);
   codeObj = AS_CODE(coValue);
 
-  // Put free and cell variables from the scope into the
-  // cellNames of the codeObj.
+  // Put free variables from the scope into the cellNames of the
+  // codeObj. Own cells stay locals of the frame.
   codeObj->freeCount = scopeInfo->free.size();
-
-  codeObj->cellNames.reserve(scopeInfo->free.size() + scopeInfo->cells.size());
-
-  codeObj->cellNames.insert(codeObj->cellNames.end(), scopeInfo->free.begin(), scopeInfo->free.end());
-  codeObj->cellNames.insert(codeObj->cellNames.end(), scopeInfo->cells.begin(), scopeInfo->cells.end());
+  codeObj->cellNames.assign(scopeInfo->free.begin(), scopeInfo->free.end());
 
   // Store new CodeObject as a constant of the previous CodeObject.
   prevCodeObj->addConst(coValue);
@@ -138,32 +269,24 @@ void EvaCompiler::compileFunction(const Exp& exp, const std::string& fnName,
 
   // Adding arguments to the list of locals.
   for (size_t i = 0; i < arity; i++) {
-    auto argName = params.list[i].string;
+    std::string argName(params.list()[i].string());
     codeObj->addLocal(argName);
-
-    // NOTE: if param is captured by cell, emit the code for it.
-    // We also don't pop the param value at this case since 
-    // OP_SCOPE_EXIT will pop it.
-    auto cellIndex = codeObj->getCellIndex(argName);
-    if (cellIndex != -1) {
-      emit(OP_SET_CELL);
-      emit(cellIndex);
-    }
   }
 
   // Compile function body in the new code object.
   gen(body);
 
   if (!isBlock(body)) {
-    emit(OP_SCOPE_EXIT);
     // Number of params + function itself.
-    emit(arity + 1);
+    emitIndexed(OP_SCOPE_EXIT, arity + 1);
   }
 
   // Explicit return to restore caller address.
   emit(OP_RETURN);
 
-  if (scopeInfo->free.size() == 0) {
+  // Functions without free variables are constants: immutable (and
+  // can be shared, see EvaProgram).
+  if (codeObj->cellNames.empty()) {
     // Creating a function and adding it as a constant to the
     // previous code object.
     auto fn = ALLOC_FUNCTION(codeObj);
@@ -172,8 +295,7 @@ void EvaCompiler::compileFunction(const Exp& exp, const std::string& fnName,
 
     codeObj->addConst(fn);
 
-    emit(OP_CONST);
-    emit(codeObj->constants.size() - 1);
+    emitIndexed(OP_CONST, codeObj->constants.size() - 1);
   }
   
   // Closures:
@@ -184,15 +306,18 @@ void EvaCompiler::compileFunction(const Exp& exp, const std::string& fnName,
   else {
     codeObj = prevCodeObj;
 
-    // Load free vars.
+    // Load free vars: locals of this frame are captured in their
+    // slots, free vars of this function are shared cells.
     for (const auto& freeVar : scopeInfo->free) {
-      emit(OP_LOAD_CELL);
-      emit(prevCodeObj->getCellIndex(freeVar));
+      if (isFrameLocal(scopeInfo->parent.get(), freeVar)) {
+        emitIndexed(OP_CAPTURE_LOCAL, codeObj->getLocalIndex(freeVar));
+      } else {
+        emitIndexed(OP_LOAD_CELL, codeObj->getCellIndex(freeVar));
+      }
     }
 
     // Load code object.
-    emit(OP_CONST);
-    emit(codeObj->constants.size() - 1);
+    emitIndexed(OP_CONST, codeObj->constants.size() - 1);
 
     // Create the function.
     emit(OP_MAKE_FUNCTION);
@@ -200,67 +325,78 @@ void EvaCompiler::compileFunction(const Exp& exp, const std::string& fnName,
     // How many cells to capture.
     emit(scopeInfo->free.size());
   }
-  
+
+  outerCodeObj_ = prevOuterCodeObj;
   scopeStack_.pop();
 }
 
+bool EvaCompiler::isFrameLocal(Scope* scope, const std::string& name) {
+  auto owner = scope->lookup(name).first;
+  return owner->allocInfo.at(name) != AllocType::CELL;
+}
+
 #define FUNCTION_CALL(exp) do {                     \
-    gen(exp.list[0]);                               \
-    for (size_t i = 1; i < exp.list.size(); i++) {  \
-        gen(exp.list[i]);                           \
+    gen(exp.list()[0]);                               \
+    for (size_t i = 1; i < exp.list().size(); i++) {  \
+        gen(exp.list()[i]);                           \
     }                                               \
     emit(OP_CALL);                                  \
-    emit(exp.list.size() - 1);                      \
+    emit(exp.list().size() - 1);                      \
     } while(0)
 
 void EvaCompiler::gen(const Exp& exp) {
   switch (exp.type) {
     case ExpType::NUMBER:
-      emit(OP_CONST);
-      emit(numericConstIdx(exp.number));
+      emitIndexed(OP_CONST, numericConstIdx(exp.number));
+      break;
+
+    case ExpType::DOUBLE:
+      emitIndexed(OP_CONST, doubleConstIdx(exp.real));
       break;
 
     case ExpType::STRING:
-      emit(OP_CONST);
-      emit(stringConstIdx(exp.string));
+      emitIndexed(OP_CONST, stringConstIdx(std::string(exp.string())));
       break;
 
     case ExpType::SYMBOL:
       // Booleans
-      if (exp.string == "true" || exp.string == "false") {
-        emit(OP_CONST);
-        emit(booleanConstIdx(exp.string == "true" ? true : false));
+      if (exp.string() == "true" || exp.string() == "false") {
+        emitIndexed(OP_CONST, booleanConstIdx(exp.string() == "true" ? true : false));
       } else {
         // Variables
-        auto varName = exp.string;
+        std::string varName(exp.string());
 
         auto opCodeGetter = scopeStack_.top()->getNameGetter(varName);
-        emit(opCodeGetter);
 
         // Local variables
         if (opCodeGetter == OP_GET_LOCAL) {
-          emit(codeObj->getLocalIndex(varName));
+          emitIndexed(opCodeGetter, codeObj->getLocalIndex(varName));
         }
 
         // Cell variables
         else if (opCodeGetter == OP_GET_CELL) {
-          emit(codeObj->getCellIndex(varName));
+          emitIndexed(opCodeGetter, codeObj->getCellIndex(varName));
+        }
+
+        // Locals of the enclosing function
+        else if (opCodeGetter == OP_GET_OUTER) {
+          emitIndexed(opCodeGetter, outerCodeObj_->getLocalIndex(varName));
         }
 
         // Global variables
         else {
           if (!global->exists(varName))
             DIE << "[EvaCompiler] Reference error: " << varName << std::endl;
-          emit(global->getGlobalIndex(varName));
+          emitIndexed(opCodeGetter, global->getGlobalIndex(varName));
         }
       }
       break;
 
     case ExpType::LIST: {
-      auto tag = exp.list[0];
+      auto tag = exp.list()[0];
 
       if (tag.type == ExpType::SYMBOL) {
-        auto op = tag.string;
+        auto op = tag.string();
 
         // Binary math operations:
         if (op == "+") {
@@ -275,18 +411,18 @@ void EvaCompiler::gen(const Exp& exp) {
 
         // Comparison operations:
         else if (cmpOps.count(op) != 0) {
-          gen(exp.list[1]);
-          gen(exp.list[2]);
+          gen(exp.list()[1]);
+          gen(exp.list()[2]);
 
           emit(OP_CMP);
-          emit(cmpOps[op]);
+          emit(cmpOps.find(op)->second);
         }
 
         // Branch instructions:
         // (if <test> <consequent> <alternate>)
         else if (op == "if") {
           // Emit <test>
-          gen(exp.list[1]);
+          gen(exp.list()[1]);
 
           // Else branch initialized with 0 and patched later
           // Takes 2 bytes
@@ -297,7 +433,7 @@ void EvaCompiler::gen(const Exp& exp) {
           auto elseJmpAddr = getCurrentOffset() - 2;
 
           // Emit <consequent>
-          gen(exp.list[2]);
+          gen(exp.list()[2]);
           emit(OP_JMP);
           emit(0);
           emit(0);
@@ -307,9 +443,12 @@ void EvaCompiler::gen(const Exp& exp) {
           auto elseBranchAddr = getCurrentOffset();
           patchJumpAddres(elseJmpAddr, elseBranchAddr);
 
-          // Emit alternate if we have it
-          if (exp.list.size() == 4) {
-            gen(exp.list[3]);
+          // Emit alternate if we have it, without it the value is false
+          // (both branches leave one value on the stack)
+          if (exp.list().size() == 4) {
+            gen(exp.list()[3]);
+          } else {
+            emitIndexed(OP_CONST, booleanConstIdx(false));
           }
 
           auto endBranchAddr = getCurrentOffset();
@@ -321,7 +460,7 @@ void EvaCompiler::gen(const Exp& exp) {
           auto loopStartAddr = getCurrentOffset();
 
           // Emit <test>
-          gen(exp.list[1]);
+          gen(exp.list()[1]);
 
           emit(OP_JMP_IF_FALSE);
 
@@ -331,15 +470,19 @@ void EvaCompiler::gen(const Exp& exp) {
 
           auto loopEndJmpAddress = getCurrentOffset() - 2;
 
-          // Emit <body>
-          gen(exp.list[2]);
+          // Emit <body>, its value is dropped on every iteration.
+          gen(exp.list()[2]);
+          emit(OP_POP);
 
           emit(OP_JMP);
           emit(0);
           emit(0);
 
           patchJumpAddres(getCurrentOffset() - 2, loopStartAddr);
-          patchJumpAddres(loopEndJmpAddress, getCurrentOffset() + 1);
+          patchJumpAddres(loopEndJmpAddress, getCurrentOffset());
+
+          // Loop as an expression evaluates to false.
+          emitIndexed(OP_CONST, booleanConstIdx(false));
         }
 
         // for loop: (for <init> <test> <modifier> <body>)
@@ -348,12 +491,18 @@ void EvaCompiler::gen(const Exp& exp) {
         else if (op == "for") {
           // Emit <init>
           // FIXME: make init to define variables in local scope, not global.
-          gen(exp.list[1]);
+          gen(exp.list()[1]);
+
+          // Local declarations keep their value on the stack as the
+          // variable slot, everything else is dropped.
+          if (!isDeclaration(exp.list()[1]) || isGlobalScope()) {
+            emit(OP_POP);
+          }
 
           auto loopStartAddr = getCurrentOffset();
 
           // Emit <test>
-          gen(exp.list[2]);
+          gen(exp.list()[2]);
 
           emit(OP_JMP_IF_FALSE);
 
@@ -365,15 +514,14 @@ void EvaCompiler::gen(const Exp& exp) {
 
           // Emit <body>
           // Can be empty loop with no body
-          if (exp.list.size() == 5) {
-            gen(exp.list[4]);
+          if (exp.list().size() == 5) {
+            gen(exp.list()[4]);
+            emit(OP_POP);
           }
 
-          // FIXME - Initializer of the for loop creates global
-          // variables. Poping it's value before calling modifier.
-          emit(OP_POP);
           // Emit <modifier>
-          gen(exp.list[3]);
+          gen(exp.list()[3]);
+          emit(OP_POP);
 
           emit(OP_JMP);
           emit(0);
@@ -381,66 +529,65 @@ void EvaCompiler::gen(const Exp& exp) {
 
           patchJumpAddres(getCurrentOffset() - 2, loopStartAddr);
           patchJumpAddres(loopEndJmpAddress, getCurrentOffset());
+
+          // Loop as an expression evaluates to false.
+          emitIndexed(OP_CONST, booleanConstIdx(false));
         }
 
         else if (op == "var") {
-          auto varName = exp.list[1].string;   
+          std::string varName(exp.list()[1].string());   
           
           auto opCodeSetter = scopeStack_.top()->getNameSetter(varName);
 
+          // The slot of a local exists before the initializer runs: the
+          // closures it makes may capture the variable.
+          if (opCodeSetter != OP_SET_GLOBAL) {
+            codeObj->addLocal(varName);
+          }
+
           // Initializer or lambda function
-          if (isLambda(exp.list[2])) {
-            compileFunction(exp.list[2],
+          if (isLambda(exp.list()[2])) {
+            compileFunction(exp.list()[2],
                 varName, 
-                exp.list[2].list[1],
-                exp.list[2].list[2]);
+                exp.list()[2].list()[1],
+                exp.list()[2].list()[2]);
           } else {
-            gen(exp.list[2]);
+            gen(exp.list()[2]);
           }
 
           // Global variables
           if (opCodeSetter == OP_SET_GLOBAL) {
             global->define(varName);
-            emit(OP_SET_GLOBAL);
-            emit(global->getGlobalIndex(varName));
-          }
-
-          // Cells
-          else if (opCodeSetter == OP_SET_CELL) {
-            codeObj->cellNames.push_back(varName);
-            emit(OP_SET_CELL);
-            emit(codeObj->cellNames.size() - 1);
-            // Explicitly pop the value of initializer from the stack
-            // since it was promoted to the heap.
-            emit(OP_POP);
+            emitIndexed(OP_SET_GLOBAL, global->getGlobalIndex(varName));
           }
 
           // Local variables
           else {
-            codeObj->addLocal(varName);
-            emit(OP_SET_LOCAL);
-            emit(codeObj->getLocalIndex(varName));
+            emitIndexed(OP_SET_LOCAL, codeObj->getLocalIndex(varName));
           }
         }
 
         else if (op == "set") {
-          auto varName = exp.list[1].string;
+          std::string varName(exp.list()[1].string());
 
           auto opCodeSetter = scopeStack_.top()->getNameSetter(varName);
 
           // Value:
-          gen(exp.list[2]);
+          gen(exp.list()[2]);
 
           // Local variables
           if (opCodeSetter == OP_SET_LOCAL) {
-            emit(OP_SET_LOCAL);
-            emit(codeObj->getLocalIndex(varName));
+            emitIndexed(OP_SET_LOCAL, codeObj->getLocalIndex(varName));
           }
 
           // Cell variables
           else if (opCodeSetter == OP_SET_CELL) {
-            emit(OP_SET_CELL);
-            emit(codeObj->getCellIndex(varName));
+            emitIndexed(OP_SET_CELL, codeObj->getCellIndex(varName));
+          }
+
+          // Locals of the enclosing function
+          else if (opCodeSetter == OP_SET_OUTER) {
+            emitIndexed(OP_SET_OUTER, outerCodeObj_->getLocalIndex(varName));
           }
 
           // Global variables
@@ -450,11 +597,7 @@ void EvaCompiler::gen(const Exp& exp) {
               DIE << "Reference error: " << varName << " is not defined." << std::endl;
             }
 
-            // Initializer
-            gen(exp.list[2]);
-
-            emit(OP_SET_GLOBAL);
-            emit(globalIndex);
+            emitIndexed(OP_SET_GLOBAL, globalIndex);
           }
         }
 
@@ -462,14 +605,14 @@ void EvaCompiler::gen(const Exp& exp) {
           scopeStack_.push(scopeInfo_.at(&exp));
           blockEnter();
 
-          for (size_t i = 1; i < exp.list.size(); i++) {
+          for (size_t i = 1; i < exp.list().size(); i++) {
             // The value of the last expression is kept on the stack as the
             // result of the block. Everything else must be popped from stack.
-            bool isLast = i == exp.list.size() - 1;
+            bool isLast = i == exp.list().size() - 1;
 
             // Local variables of functions should not be popped.
-            auto isLocalDeclaration = isDeclaration(exp.list[i]) && !isGlobalScope();
-            gen(exp.list[i]);
+            auto isLocalDeclaration = isDeclaration(exp.list()[i]) && !isGlobalScope();
+            gen(exp.list()[i]);
 
             if (!isLast && !isLocalDeclaration) emit(OP_POP);
           }
@@ -479,22 +622,22 @@ void EvaCompiler::gen(const Exp& exp) {
         }
 
         else if (op == "lambda") {
-          compileFunction(exp, "lambda", exp.list[1], exp.list[2]);
+          compileFunction(exp, "lambda", exp.list()[1], exp.list()[2]);
         }
 
         else if (op == "def") {
-          auto fnName = exp.list[1].string;
+          std::string fnName(exp.list()[1].string());
 
-          compileFunction(exp, fnName, exp.list[2], exp.list[3]);
+          compileFunction(exp, fnName, exp.list()[2], exp.list()[3]);
 
           if (isGlobalScope()) {
             global->define(fnName);
-            emit(OP_SET_GLOBAL);
-            emit(global->getGlobalIndex(fnName));
-          } else {
+            emitIndexed(OP_SET_GLOBAL, global->getGlobalIndex(fnName));
+          }
+
+          else {
             codeObj->addLocal(fnName);
-            emit(OP_SET_LOCAL);
-            emit(codeObj->getLocalIndex(fnName));
+            emitIndexed(OP_SET_LOCAL, codeObj->getLocalIndex(fnName));
           }
         }
 
@@ -517,7 +660,21 @@ void EvaCompiler::gen(const Exp& exp) {
   }
 }
 
-size_t EvaCompiler::numericConstIdx(double value) {
+size_t EvaCompiler::numericConstIdx(int64_t value) {
+#ifdef EVA_NAN_BOXING
+  // Integers are doubles.
+  ALLOC_CONST(IS_NUMBER, AS_NUMBER, NUMBER, value);
+#else
+  if (integers_) {
+    ALLOC_CONST(IS_INTEGER, AS_INTEGER, INTEGER, value);
+  } else {
+    ALLOC_CONST(IS_NUMBER, AS_NUMBER, NUMBER, value);
+  }
+#endif
+  return codeObj->constants.size() - 1;
+}
+
+size_t EvaCompiler::doubleConstIdx(double value) {
   ALLOC_CONST(IS_NUMBER, AS_NUMBER, NUMBER, value);
   return codeObj->constants.size() - 1;
 }
@@ -528,31 +685,136 @@ size_t EvaCompiler::booleanConstIdx(bool value) {
 }
 
 size_t EvaCompiler::stringConstIdx(const std::string& value) {
-  ALLOC_CONST(IS_STRING, AS_CPPSTRING, ALLOC_STRING, value);
+  // Interned: the same string is the same object.
+  auto string = ALLOC_STRING(value);
+
+  for (size_t i = 0; i < codeObj->constants.size(); i++) {
+    if (IS_STRING(codeObj->constants[i]) &&
+        stringEquals(AS_STRING(codeObj->constants[i]), AS_STRING(string))) {
+      return i;
+    }
+  }
+
+  codeObj->addConst(string);
   return codeObj->constants.size() - 1;
 }
 
-void EvaCompiler::emit(uint8_t code) {
+void EvaCompiler::emit(size_t code) {
+  if (code > 0xFF) {
+    DIE << "[EvaCompiler] Operand " << code << " does not fit a byte in "
+        << codeObj->name << std::endl;
+  }
   codeObj->code.push_back(code);
 }
 
-void EvaCompiler::patchJumpAddres(size_t offset, uint16_t value) {
+void EvaCompiler::emitIndexed(ByteCode opcode, size_t index) {
+  if (index <= 0xFF) {
+    emit(opcode);
+    emit(index);
+    return;
+  }
+
+  auto wide = wideOpcode(opcode);
+  if (wide == OP_HALT || index > 0xFFFF) {
+    DIE << "[EvaCompiler] Index " << index << " of " << opcodeToString(opcode)
+        << " is too large in " << codeObj->name << std::endl;
+  }
+
+  emit(wide);
+  emit(index >> 8 & 0xFF);
+  emit(index & 0xFF);
+}
+
+void EvaCompiler::patchJumpAddres(size_t offset, size_t value) {
+  if (value > 0xFFFF) {
+    longJumps_[codeObj][offset] = value;
+    return;
+  }
   writeByteAtOffset(value >> 8 & 0xFF, offset);
   writeByteAtOffset(value & 0xFF, offset + 1);
 }
 
+/**
+ * Wide form of the jump of the tier, HALT (0 on both tiers) if the
+ * opcode is not a jump.
+ */
+static ByteCode wideJumpOpcode(ExecutionTier tier, ByteCode opcode) {
+  if (tier == ExecutionTier::REGISTER) {
+    return opcode == ROP_JMP ? ROP_JMP_WIDE
+      : opcode == ROP_JMP_IF_FALSE ? ROP_JMP_IF_FALSE_WIDE : ROP_HALT;
+  }
+
+  return opcode == OP_JMP ? OP_JMP_WIDE
+    : opcode == OP_JMP_IF_FALSE ? OP_JMP_IF_FALSE_WIDE : OP_HALT;
+}
+
+void EvaCompiler::widenJumps() {
+  for (const auto& [co, longJumps] : longJumps_) {
+    widenJumps(co, longJumps);
+  }
+  longJumps_.clear();
+}
+
+void EvaCompiler::widenJumps(CodeObject* co, const std::map<size_t, size_t>& longJumps) {
+  auto isRegister = co->tier == ExecutionTier::REGISTER;
+  const auto& code = co->code;
+
+  std::vector<uint8_t> widened;
+  widened.reserve(code.size() + code.size() / 8);
+
+  // New offsets of the original instructions.
+  std::vector<size_t> newOffsets(code.size() + 1, 0);
+
+  // Address operands in the widened code with their original targets.
+  std::vector<std::pair<size_t, size_t>> jumps;
+
+  // Every jump is widened: the code grows, so short addresses may not
+  // fit either.
+  size_t offset = 0;
+  while (offset < code.size()) {
+    auto opcode = code[offset];
+    auto size = isRegister ? regBytecodeSize(opcode) : bytecodeSizes[opcode];
+    auto wide = wideJumpOpcode(co->tier, opcode);
+    newOffsets[offset] = widened.size();
+
+    if (wide == OP_HALT) {
+      widened.insert(widened.end(), code.begin() + offset, code.begin() + offset + size);
+      offset += size;
+      continue;
+    }
+
+    // The address is the last operand.
+    auto address = offset + size - 2;
+    auto longJump = longJumps.find(address);
+    auto target = longJump != longJumps.end() ? longJump->second : readJumpAddress(&code[address], 2);
+
+    widened.push_back(wide);
+    widened.insert(widened.end(), code.begin() + offset + 1, code.begin() + address);
+    jumps.push_back({widened.size(), target});
+    widened.resize(widened.size() + 4);
+
+    offset += size;
+  }
+
+  newOffsets[code.size()] = widened.size();
+
+  for (auto [operand, target] : jumps) {
+    writeJumpAddress(&widened[operand], 4, newOffsets[target]);
+  }
+
+  co->code = std::move(widened);
+}
+
 void EvaCompiler::blockExit() {
   // Pops all local variables that was define in this scope.
   auto varCount = getVarCountOnScopeExit();
 
-  if (varCount > 0 || codeObj->arity > 0) {
-    emit(OP_SCOPE_EXIT);
-
+  if (varCount > 0 || isFunctionBody()) {
     if (isFunctionBody()) {
       // Adding amount of function arguments + function itself.
       varCount += codeObj->arity + 1;
     }
-    emit(varCount);
+    emitIndexed(OP_SCOPE_EXIT, varCount);
   } 
 
   codeObj->scopeLevel--;
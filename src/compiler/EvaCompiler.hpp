@@ -13,6 +13,7 @@
 #include <map>
 #include <stack>
 #include <memory>
+#include <initializer_list>
 
 /**
  * Compiler class, emits bytecodes, records constant pools, vars, etc.
@@ -27,17 +28,23 @@ class EvaCompiler {
     /**
      * Main entry point (function).
      */
-    FunctionObject* main;
+    FunctionObject* main = nullptr;
 
     /**
      * All code objects.
      */
     std::vector<CodeObject*> codeObjects_;
 
+    /**
+     * Jump targets which do not fit 2-byte addresses: by code object,
+     * offset of the address operand to the target.
+     */
+    std::map<CodeObject*, std::map<size_t, size_t>> longJumps_;
+
     /**
      * Comparing operations.
      */
-    static std::map<std::string, uint8_t> cmpOps;
+    static std::map<std::string, uint8_t, std::less<>> cmpOps;
 
     /**
      * Global object. Shared with VM.
@@ -59,15 +66,109 @@ class EvaCompiler {
      */
     std::stack<std::shared_ptr<Scope>> scopeStack_;
 
+    /**
+     * Scope of the globals, shared by all compiled programs.
+     */
+    std::shared_ptr<Scope> globalScope_;
+
+    /**
+     * Whether the peephole pass runs after compilation.
+     */
+    bool peephole_ = true;
+
+    /**
+     * Whether variables captured by non-escaping functions stay locals
+     * of their frame (see resolveReferences).
+     */
+    bool escapeAnalysis_ = true;
+
+    /**
+     * Whether number literals are integers (doubles otherwise).
+     */
+    bool integers_ = true;
+
+    /**
+     * Variable reference recorded by the scope analysis.
+     */
+    struct Reference {
+      // Scope of the reference.
+      Scope* scope;
+
+      std::string name;
+
+      // Whether the variable is called: (name args...).
+      bool isCall;
+
+      // Scope declaring the variable.
+      Scope* owner;
+
+      // Function boundaries between the reference and the declaration.
+      size_t crossed;
+    };
+
+    /**
+     * References of the analyzed program.
+     */
+    std::vector<Reference> references_;
+
+    /**
+     * Code object of the function enclosing the compiling one (outer
+     * locals are accessed by their indices in it).
+     */
+    CodeObject* outerCodeObj_ = nullptr;
+
+    /**
+     * Texts of the folded expressions.
+     */
+    ExpArena arena_;
+
   public:
     EvaCompiler(std::shared_ptr<Global> global) :
       global(global),
       disassembler(std::make_unique<EvaDisassembler>(global)) {};
 
     /**
-     * Main compiling API.
+     * Main compiling API. The AST is folded in place.
+     *
+     * Programs compiled by the same compiler share the globals. Code
+     * objects of the previous program are dropped from the compiler:
+     * they stay alive while reachable from the globals.
+     */
+    void compile(Exp& exp);
+
+    /**
+     * Enables or disables the peephole pass (superinstructions).
+     */
+    void setPeephole(bool enabled) { peephole_ = enabled; }
+
+    bool getPeephole() const { return peephole_; }
+
+    /**
+     * Enables or disables escape analysis of closures.
      */
-    void compile(const Exp& exp);
+    void setEscapeAnalysis(bool enabled) { escapeAnalysis_ = enabled; }
+
+    bool getEscapeAnalysis() const { return escapeAnalysis_; }
+
+    /**
+     * Enables or disables integer literals.
+     */
+    void setIntegers(bool enabled) { integers_ = enabled; }
+
+    bool getIntegers() const { return integers_; }
+
+    /**
+     * Compiles to the register-based instruction set. A program whose
+     * frames need more registers than a byte addresses is compiled to
+     * the stack instruction set instead.
+     */
+    void compileRegister(Exp& exp);
+
+    /**
+     * Installs code compiled ahead of time (see EvaImage) as the
+     * program, main is the first code object.
+     */
+    void setCode(const std::vector<CodeObject*>& codeObjects);
 
     /**
      * Disassembly method.
@@ -82,27 +183,92 @@ class EvaCompiler {
      * Getter for the main function.
      */
     FunctionObject* getMainFunction() { return this->main; }
+
+    /**
+     * All compiled code objects.
+     */
+    const std::vector<CodeObject*>& getCodeObjects() { return codeObjects_; }
   
   private:
+    /**
+     * Clears the state of the previous program.
+     */
+    void resetProgram() {
+      codeObjects_.clear();
+      longJumps_.clear();
+      scopeInfo_.clear();
+      references_.clear();
+      arena_.reset();
+    }
+
     /**
      * Scope analysis.
      */
     void analyze(const Exp& exp, std::shared_ptr<Scope> scope);
 
+    /**
+     * Records a reference to the variable, resolved in the scope chain.
+     * Calls of names which are not variables (special forms, natives)
+     * are skipped.
+     */
+    void addReference(Scope* scope, const std::string& name, bool isCall);
+
+    /**
+     * Declares a variable in the scope, a function previously bound
+     * to the name escapes.
+     */
+    void declare(Scope* scope, const std::string& name);
+
+    /**
+     * Binds the function (scope) to the variable declared in the scope:
+     * the function does not escape unless its references say so.
+     */
+    void bindFunction(Scope* scope, const std::string& name, Scope* fnScope);
+
+    /**
+     * Escape analysis and allocation of the referenced variables, after
+     * the whole program is analyzed.
+     */
+    void resolveReferences();
+
+    /**
+     * Whether the variable seen from the scope is a local of its frame
+     * (captured in its slot), rather than a free variable of it.
+     */
+    bool isFrameLocal(Scope* scope, const std::string& name);
+
+    /**
+     * Generates the main function of the analyzed program (stack tier).
+     */
+    void genMain(const Exp& exp);
+
     /**
      * Recursive code generation.
      */
     void gen(const Exp& exp);
 
     /**
-     * Code emission.
+     * Code emission. Operands which do not fit a byte are a compile
+     * error.
+     */
+    void emit(size_t code);
+
+    /**
+     * Emits an opcode with an index operand: the one-byte form when
+     * the index fits, the wide form (2-byte index) otherwise.
+     */
+    void emitIndexed(ByteCode opcode, size_t index);
+
+    /**
+     * Allocates numeric constant in constant pool: an integer, or
+     * a double if integers are disabled.
      */
-    void emit(uint8_t code);
+    size_t numericConstIdx(int64_t value);
 
     /**
-     * Allocates numeric constant in constant pool.
+     * Allocates double constant in constant pool.
      */
-    size_t numericConstIdx(double value);
+    size_t doubleConstIdx(double value);
 
     /**
      * Allocates boolean constant in constant pool.
@@ -125,9 +291,23 @@ class EvaCompiler {
     void writeByteAtOffset(uint8_t byte, size_t offset) { codeObj->code[offset] = byte; }
 
     /**
-     * Patches jump address.
+     * Patches jump address. Addresses which do not fit 2 bytes are
+     * recorded, the jumps of their code object are widened when the
+     * code is complete (see widenJumps).
+     */
+    void patchJumpAddres(size_t offset, size_t value);
+
+    /**
+     * Rewrites all jumps of the code objects with long jumps to the
+     * wide forms (4-byte addresses).
+     */
+    void widenJumps();
+
+    /**
+     * Rewrites all jumps of the code object to the wide forms, the
+     * longJumps are the targets of the placeholder addresses.
      */
-    void patchJumpAddres(size_t offset, uint16_t value);
+    void widenJumps(CodeObject* co, const std::map<size_t, size_t>& longJumps);
 
     /**
      * Enter and exit block scope.
@@ -145,17 +325,18 @@ class EvaCompiler {
      */
     bool isFunctionBody() { return codeObj->name != "main" && codeObj->scopeLevel == 1; }
 
-    bool isDeclaration(const Exp& exp) { return isVarDeclaration(exp); }
+    bool isDeclaration(const Exp& exp) { return isVarDeclaration(exp) || isFunctionDeclaration(exp); }
     bool isVarDeclaration(const Exp& exp) { return isTaggedList(exp, "var"); }
+    bool isFunctionDeclaration(const Exp& exp) { return isTaggedList(exp, "def"); }
     bool isBlock(const Exp& exp) { return isTaggedList(exp, "begin"); }
     bool isLambda(const Exp& exp) { return isTaggedList(exp, "lambda"); }
 
     /**
      * Tagged list.
      */
-    bool isTaggedList(const Exp& exp, const std::string& tag) {
-      return exp.type == ExpType::LIST && exp.list[0].type == ExpType::SYMBOL
-        && exp.list[0].string == tag;
+    bool isTaggedList(const Exp& exp, std::string_view tag) {
+      return exp.type == ExpType::LIST && exp.list()[0].type == ExpType::SYMBOL
+        && exp.list()[0].string() == tag;
     }
 
     /**
@@ -163,11 +344,10 @@ class EvaCompiler {
      */
     size_t getVarCountOnScopeExit() {
       size_t varsCount = 0;
-      if (codeObj->locals.size() > 0) {
-        while(codeObj->locals.back().scopeLevel == codeObj->scopeLevel) {
-          codeObj->locals.pop_back();
-          varsCount++;
-        }
+      while (codeObj->locals.size() > 0 &&
+             codeObj->locals.back().scopeLevel == codeObj->scopeLevel) {
+        codeObj->locals.pop_back();
+        varsCount++;
       }
 
       return varsCount;
@@ -187,6 +367,140 @@ class EvaCompiler {
      * Compiling a function body.
      */
     void compileFunction(const Exp& exp, const std::string& fnName, const Exp& params, const Exp& body);
+
+    // -----------------------------------------------
+    // Constant folding (EvaConstantFolding.cpp).
+
+    /**
+     * Folds constant expressions of the analyzed AST in place.
+     */
+    void fold(Exp& exp);
+
+    /**
+     * Math on literals and identities.
+     */
+    void foldArithmetic(Exp& exp, std::string_view op);
+
+    /**
+     * Comparisons of literals.
+     */
+    void foldComparison(Exp& exp, std::string_view op);
+
+    /**
+     * Branches with a constant test.
+     */
+    void foldIf(Exp& exp);
+
+    /**
+     * Replaces the expression with its child at index.
+     */
+    void replaceWith(Exp& exp, size_t index);
+
+    // -----------------------------------------------
+    // Register tier (EvaRegisterGen.cpp).
+
+    /**
+     * Destination register of a discarded value.
+     */
+    static constexpr int NO_REG = -1;
+
+    /**
+     * Local variable mapped to a frame register.
+     */
+    struct RegisterLocal {
+      std::string name;
+      size_t scopeLevel;
+      uint8_t reg;
+
+      // Accessed by the functions it defines (see AllocType::OUTER, or
+      // through an open cell): calls may change it.
+      bool outer;
+    };
+
+    /**
+     * Locals of the compiling function.
+     */
+    std::vector<RegisterLocal> regLocals_;
+
+    /**
+     * Locals of the function enclosing the compiling one.
+     */
+    const std::vector<RegisterLocal>* outerRegLocals_ = nullptr;
+
+    /**
+     * First free register of the compiling function.
+     */
+    size_t nextReg_ = 0;
+
+    /**
+     * Whether a frame of the compiling program ran out of registers.
+     */
+    bool registerOverflow_ = false;
+
+    /**
+     * Recursive code generation, stores the value to the dst register.
+     */
+    void genRegister(const Exp& exp, int dst);
+
+    /**
+     * Generates the value into a newly allocated register.
+     */
+    uint8_t genRegisterTemp(const Exp& exp);
+
+    /**
+     * Returns a register with the value: register of the local
+     * variable as is, otherwise a new temporary.
+     */
+    uint8_t genRegisterOperand(const Exp& exp);
+
+    /**
+     * Generates a call, the result is left in the returned register.
+     */
+    uint8_t genRegisterCall(const Exp& exp);
+
+    /**
+     * Compiling a function body to register code.
+     */
+    void compileRegisterFunction(const Exp& exp, const std::string& fnName,
+                                 const Exp& params, const Exp& body, int dst);
+
+    /**
+     * Allocates next free register of the frame.
+     */
+    uint8_t allocRegister();
+
+    /**
+     * Returns the local variable or nullptr if not found.
+     */
+    const RegisterLocal* findRegisterLocal(const std::string& name);
+
+    /**
+     * Returns register of the local variable or -1 if not found.
+     */
+    int getRegisterLocal(const std::string& name);
+
+    /**
+     * Register of the local of the enclosing function.
+     */
+    uint8_t getOuterRegister(const std::string& name);
+
+    /**
+     * Whether the local declared in the scope is accessed by functions
+     * it defines (see RegisterLocal::outer).
+     */
+    bool isChangedByCalls(Scope* scope, const std::string& name);
+
+    /**
+     * Emits a move unless the value is discarded or already in place.
+     */
+    void emitMove(int dst, uint8_t src);
+
+    /**
+     * Emits a register opcode with a constant or global index and its
+     * other operands in order: the wide form (2-byte index) when the
+     * index does not fit a byte.
+     */
+    void emitRegisterIndexed(ByteCode opcode, size_t index, std::initializer_list<int> operands);
 };
 
 #endif
@@ -0,0 +1,210 @@
+/**
+ * Constant folding.
+ *
+ * Runs on the analyzed AST before code generation: evaluates math
+ * and comparisons on literals, simplifies identities and drops `if`
+ * branches with a constant test.
+ *
+ * Numbers of the AST are integers, so only integral results are
+ * folded (a division only if it is exact). Nothing is folded which would fail or behave differently
+ * at runtime (mixed types, division by zero, `+` of a non-number
+ * with 0 which may be a string).
+ */
+
+#include "compiler/EvaCompiler.hpp"
+
+#include <cstdint>
+
+/**
+ * Magnitude (2^62) of the literal results folded.
+ */
+static constexpr double INTEGER_FOLDING_LIMIT = 4611686018427387904.0;
+
+static bool isNumber(const Exp& exp) { return exp.type == ExpType::NUMBER; }
+static bool isString(const Exp& exp) { return exp.type == ExpType::STRING; }
+
+static bool isBooleanLiteral(const Exp& exp) {
+  return exp.type == ExpType::SYMBOL && (exp.string() == "true" || exp.string() == "false");
+}
+
+static bool isNumberLiteral(const Exp& exp, int64_t value) {
+  return isNumber(exp) && exp.number == value;
+}
+
+/**
+ * Whether the expression always evaluates to a number.
+ */
+static bool isNumeric(const Exp& exp) {
+  if (isNumber(exp)) {
+    return true;
+  }
+
+  if (exp.type != ExpType::LIST || exp.list()[0].type != ExpType::SYMBOL) {
+    return false;
+  }
+
+  auto op = exp.list()[0].string();
+  if (op == "-" || op == "*" || op == "/") {
+    return true;
+  }
+
+  return op == "+" && isNumeric(exp.list()[1]) && isNumeric(exp.list()[2]);
+}
+
+/**
+ * Evaluates comparison operator (see cmpOps) on literals.
+ */
+template <typename T>
+static bool compareLiterals(uint8_t op, const T& v1, const T& v2) {
+  switch (op) {
+    case 0:
+      return v1 < v2;
+    case 1:
+      return v1 > v2;
+    case 2:
+      return v1 == v2;
+    case 3:
+      return v1 >= v2;
+    case 4:
+      return v1 <= v2;
+    default:
+      return v1 != v2;
+  }
+}
+
+static Exp booleanExp(bool value) {
+  return Exp(ExpType::SYMBOL, value ? "true" : "false");
+}
+
+void EvaCompiler::fold(Exp& exp) {
+  if (exp.type != ExpType::LIST || exp.list().empty()) {
+    return;
+  }
+
+  auto& tag = exp.list()[0];
+  auto op = tag.type == ExpType::SYMBOL ? tag.string() : "";
+
+  // Only expression positions are folded.
+  if (op == "var" || op == "set") {
+    fold(exp.list()[2]);
+    return;
+  } else if (op == "def") {
+    fold(exp.list()[3]);
+    return;
+  } else if (op == "lambda") {
+    fold(exp.list()[2]);
+    return;
+  }
+
+  for (size_t i = op.empty() ? 0 : 1; i < exp.list().size(); i++) {
+    fold(exp.list()[i]);
+  }
+
+  if (op == "+" || op == "-" || op == "*" || op == "/") {
+    foldArithmetic(exp, op);
+  } else if (cmpOps.count(op) != 0) {
+    foldComparison(exp, op);
+  } else if (op == "if") {
+    foldIf(exp);
+  }
+}
+
+void EvaCompiler::foldArithmetic(Exp& exp, std::string_view op) {
+  auto& lhs = exp.list()[1];
+  auto& rhs = exp.list()[2];
+
+  // Literals: folded far from the limits of integers only, where the
+  // runtime result is an integer (it overflows to a double).
+  if (isNumber(lhs) && isNumber(rhs)) {
+    auto a = lhs.number;
+    auto b = rhs.number;
+
+    double estimate;
+    if (op == "+") {
+      estimate = (double)a + b;
+    } else if (op == "-") {
+      estimate = (double)a - b;
+    } else if (op == "*") {
+      estimate = (double)a * b;
+    } else if (b != 0 && a != INT64_MIN && a % b == 0) {
+      estimate = (double)a / b;
+    } else {
+      return;
+    }
+
+    if (estimate >= INTEGER_FOLDING_LIMIT || estimate <= -INTEGER_FOLDING_LIMIT) {
+      return;
+    }
+
+    if (op == "+") {
+      exp = Exp(a + b);
+    } else if (op == "-") {
+      exp = Exp(a - b);
+    } else if (op == "*") {
+      exp = Exp(a * b);
+    } else {
+      exp = Exp(a / b);
+    }
+    return;
+  }
+
+  if (op == "+" && isString(lhs) && isString(rhs)) {
+    exp = arena_.string(std::string(lhs.string()) + std::string(rhs.string()));
+    return;
+  }
+
+  // Identities: (* x 1), (* 1 x), (/ x 1), (- x 0), (+ x 0), (+ 0 x).
+  if ((op == "*" || op == "/") && isNumberLiteral(rhs, 1)) {
+    replaceWith(exp, 1);
+  } else if (op == "*" && isNumberLiteral(lhs, 1)) {
+    replaceWith(exp, 2);
+  } else if (op == "-" && isNumberLiteral(rhs, 0)) {
+    replaceWith(exp, 1);
+  } else if (op == "+" && isNumberLiteral(rhs, 0) && isNumeric(lhs)) {
+    replaceWith(exp, 1);
+  } else if (op == "+" && isNumberLiteral(lhs, 0) && isNumeric(rhs)) {
+    replaceWith(exp, 2);
+  }
+}
+
+void EvaCompiler::foldComparison(Exp& exp, std::string_view op) {
+  auto& lhs = exp.list()[1];
+  auto& rhs = exp.list()[2];
+  auto cmp = cmpOps.find(op)->second;
+
+  if (isNumber(lhs) && isNumber(rhs)) {
+    exp = booleanExp(compareLiterals(cmp, lhs.number, rhs.number));
+  } else if (isString(lhs) && isString(rhs)) {
+    exp = booleanExp(compareLiterals(cmp, lhs.string(), rhs.string()));
+  }
+}
+
+void EvaCompiler::foldIf(Exp& exp) {
+  auto& test = exp.list()[1];
+
+  if (!isBooleanLiteral(test)) {
+    return;
+  }
+
+  if (test.string() == "true") {
+    replaceWith(exp, 2);
+  } else if (exp.list().size() == 4) {
+    replaceWith(exp, 3);
+  } else {
+    exp = booleanExp(false);
+  }
+}
+
+void EvaCompiler::replaceWith(Exp& exp, size_t index) {
+  // Nodes are copied shallowly, nested nodes keep their addresses:
+  // only the child itself moves, its scope info is moved along.
+  const Exp* child = &exp.list()[index];
+  auto scope = scopeInfo_.find(child);
+
+  exp = Exp(*child);
+
+  if (scope != scopeInfo_.end()) {
+    scopeInfo_[&exp] = scope->second;
+    scopeInfo_.erase(child);
+  }
+}
@@ -0,0 +1,103 @@
+#include "compiler/EvaPeephole.hpp"
+
+void EvaPeephole::optimize(CodeObject* co) {
+  code_ = co->code;
+  isJumpTarget_.assign(code_.size() + 1, false);
+
+  for (size_t offset = 0; offset < code_.size(); offset += bytecodeSizes[code_[offset]]) {
+    if (isJumpOpcode(code_[offset])) {
+      isJumpTarget_[readJumpAddress(&code_[offset + 1], jumpAddressSize(code_[offset]))] = true;
+    }
+  }
+
+  std::vector<uint8_t> optimized;
+  optimized.reserve(code_.size());
+
+  // New offsets of the original instructions.
+  std::vector<size_t> newOffsets(code_.size() + 1, 0);
+
+  // Offsets and sizes of the address operands in the optimized code.
+  std::vector<std::pair<size_t, size_t>> jumpOperands;
+
+  size_t offset = 0;
+  while (offset < code_.size()) {
+    auto opcode = code_[offset];
+    auto next = nextOpcode(offset);
+    newOffsets[offset] = optimized.size();
+
+    // CMP <op>; JMP_IF_FALSE <addr> => JMP_IF_NOT_<op> <addr> (wide jumps
+    // are left as is)
+    if (opcode == OP_CMP && next == OP_JMP_IF_FALSE) {
+      optimized.push_back(OP_JMP_IF_NOT_LT + code_[offset + 1]);
+      jumpOperands.push_back({optimized.size(), 2});
+      optimized.push_back(code_[offset + 3]);
+      optimized.push_back(code_[offset + 4]);
+      offset += 5;
+      continue;
+    }
+
+    // GET_LOCAL <a>; GET_LOCAL <b>; ADD => ADD_LOCAL_LOCAL <a> <b>
+    if (opcode == OP_GET_LOCAL && next == OP_GET_LOCAL && nextOpcode(offset + 2) == OP_ADD) {
+      optimized.push_back(OP_ADD_LOCAL_LOCAL);
+      optimized.push_back(code_[offset + 1]);
+      optimized.push_back(code_[offset + 3]);
+      offset += 5;
+      continue;
+    }
+
+    // GET_LOCAL <l>; CONST <k>; ADD => ADD_LOCAL_CONST <l> <k>
+    if (opcode == OP_GET_LOCAL && next == OP_CONST && nextOpcode(offset + 2) == OP_ADD) {
+      optimized.push_back(OP_ADD_LOCAL_CONST);
+      optimized.push_back(code_[offset + 1]);
+      optimized.push_back(code_[offset + 3]);
+      offset += 5;
+      continue;
+    }
+
+    // CONST <k>; SET_LOCAL <l> => CONST_SET_LOCAL <k> <l>
+    if (opcode == OP_CONST && next == OP_SET_LOCAL) {
+      optimized.push_back(OP_CONST_SET_LOCAL);
+      optimized.push_back(code_[offset + 1]);
+      optimized.push_back(code_[offset + 3]);
+      offset += 4;
+      continue;
+    }
+
+    // SET_LOCAL <l>; POP => SET_LOCAL_POP <l>
+    if (opcode == OP_SET_LOCAL && next == OP_POP) {
+      optimized.push_back(OP_SET_LOCAL_POP);
+      optimized.push_back(code_[offset + 1]);
+      offset += 3;
+      continue;
+    }
+
+    // Not fused: copied as is.
+    if (isJumpOpcode(opcode)) {
+      jumpOperands.push_back({optimized.size() + 1, jumpAddressSize(opcode)});
+    }
+
+    auto size = bytecodeSizes[opcode];
+    optimized.insert(optimized.end(), code_.begin() + offset, code_.begin() + offset + size);
+    offset += size;
+  }
+
+  newOffsets[code_.size()] = optimized.size();
+
+  // Re-patch jumps to the new offsets.
+  for (auto [operand, size] : jumpOperands) {
+    auto address = newOffsets[readJumpAddress(&optimized[operand], size)];
+    writeJumpAddress(&optimized[operand], size, address);
+  }
+
+  co->code = std::move(optimized);
+}
+
+ByteCode EvaPeephole::nextOpcode(size_t offset) {
+  auto next = offset + bytecodeSizes[code_[offset]];
+
+  if (next >= code_.size() || isJumpTarget_[next]) {
+    return OP_HALT;
+  }
+
+  return code_[next];
+}
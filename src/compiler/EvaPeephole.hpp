@@ -0,0 +1,46 @@
+/**
+ * Peephole optimizer.
+ */
+#ifndef SRC_COMPILER_EVAPEEPHOLE_HPP
+#define SRC_COMPILER_EVAPEEPHOLE_HPP
+
+#include "vm/EvaValue.hpp"
+#include "vm/OpCode.hpp"
+
+#include <vector>
+
+/**
+ * Rewrites frequent opcode sequences of the stack bytecode into
+ * superinstructions (see OpCode.hpp), jump addresses are re-patched
+ * to the rewritten code.
+ *
+ * Sequences are fused only inside of a basic block: an instruction
+ * which is a jump target always starts a new instruction.
+ */
+class EvaPeephole {
+  public:
+    /**
+     * Optimizes the code of the code object in place.
+     */
+    void optimize(CodeObject* co);
+
+  private:
+    /**
+     * Original code.
+     */
+    std::vector<uint8_t> code_;
+
+    /**
+     * Offsets of the instructions which are jump targets.
+     */
+    std::vector<bool> isJumpTarget_;
+
+    /**
+     * Opcode of the instruction following the one at offset,
+     * OP_HALT if the next instruction is a jump target or
+     * the end of the code.
+     */
+    ByteCode nextOpcode(size_t offset);
+};
+
+#endif
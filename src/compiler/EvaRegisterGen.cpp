@@ -0,0 +1,616 @@
+/**
+ * Register tier code generation.
+ *
+ * Locals live in frame registers (r0 is the function itself, then
+ * arguments), expressions are compiled into a destination register
+ * and operations read their operands from registers directly, so
+ * `(+ y z)` on locals is a single `ADD rD, rY, rZ`.
+ */
+
+#include "compiler/EvaCompiler.hpp"
+#include "logging/Logger.hpp"
+#include "vm/RegOpCode.hpp"
+
+#include <set>
+
+/**
+ * Everything which is not a special form or operator is a call.
+ */
+static bool isFunctionCall(const Exp& exp) {
+  static const std::set<std::string, std::less<>> specialForms = {
+    "+", "-", "*", "/", "<", ">", "==", ">=", "<=", "!=",
+    "if", "while", "for", "var", "set", "begin", "lambda", "def",
+  };
+
+  if (exp.type != ExpType::LIST) {
+    return false;
+  }
+
+  return exp.list()[0].type != ExpType::SYMBOL ||
+    specialForms.count(exp.list()[0].string()) == 0;
+}
+
+void EvaCompiler::compileRegister(Exp& exp) {
+  resetProgram();
+
+  // Allocate new code object and set it as a main function
+  codeObj = AS_CODE(createCodeObjectValue("main"));
+  codeObj->tier = ExecutionTier::REGISTER;
+  main = AS_FUNCTION(ALLOC_FUNCTION(codeObj));
+
+  // Scope analysis.
+  analyze(exp, nullptr);
+  resolveReferences();
+
+  // Constant folding.
+  fold(exp);
+
+  regLocals_.clear();
+  nextReg_ = 0;
+  registerOverflow_ = false;
+
+  auto result = genRegisterOperand(exp);
+
+  emit(ROP_HALT);
+  emit(result);
+
+  // Registers are bytes: the program runs on the stack tier, the
+  // analysis of the program is the same.
+  if (registerOverflow_) {
+    codeObjects_.clear();
+    longJumps_.clear();
+
+    codeObj = AS_CODE(createCodeObjectValue("main"));
+    main = AS_FUNCTION(ALLOC_FUNCTION(codeObj));
+
+    genMain(exp);
+    return;
+  }
+
+  widenJumps();
+}
+
+uint8_t EvaCompiler::allocRegister() {
+  // The code of the program is dropped (see compileRegister), the
+  // generation goes on with a valid register.
+  if (nextReg_ > UINT8_MAX) {
+    registerOverflow_ = true;
+    return 0;
+  }
+
+  auto reg = nextReg_++;
+  codeObj->frameSize = std::max(codeObj->frameSize, nextReg_);
+  return reg;
+}
+
+const EvaCompiler::RegisterLocal* EvaCompiler::findRegisterLocal(const std::string& name) {
+  for (auto it = regLocals_.rbegin(); it != regLocals_.rend(); it++) {
+    if (it->name == name) {
+      return &*it;
+    }
+  }
+
+  return nullptr;
+}
+
+int EvaCompiler::getRegisterLocal(const std::string& name) {
+  auto local = findRegisterLocal(name);
+  return local == nullptr ? -1 : local->reg;
+}
+
+uint8_t EvaCompiler::getOuterRegister(const std::string& name) {
+  for (auto it = outerRegLocals_->rbegin(); it != outerRegLocals_->rend(); it++) {
+    if (it->name == name) {
+      return it->reg;
+    }
+  }
+
+  DIE << "[EvaCompiler] Reference error: " << name << std::endl;
+  return 0;
+}
+
+bool EvaCompiler::isChangedByCalls(Scope* scope, const std::string& name) {
+  return scope->outers.count(name) != 0 || scope->cells.count(name) != 0;
+}
+
+void EvaCompiler::emitMove(int dst, uint8_t src) {
+  if (dst == NO_REG || dst == src) {
+    return;
+  }
+
+  emit(ROP_MOVE);
+  emit(dst);
+  emit(src);
+}
+
+void EvaCompiler::emitRegisterIndexed(ByteCode opcode, size_t index,
+                                      std::initializer_list<int> operands) {
+  auto wide = index > 0xFF;
+  if (wide) {
+    if (index > 0xFFFF) {
+      DIE << "[EvaCompiler] Index " << index << " of " << regOpcodeToString(opcode)
+          << " is too large in " << codeObj->name << std::endl;
+    }
+    opcode = regWideOpcode(opcode);
+  }
+
+  emit(opcode);
+
+  auto operand = operands.begin();
+  for (auto kind = regOpcodeOperands(opcode); *kind != '\0'; kind++) {
+    if (*kind == 'k' || *kind == 'g') {
+      emit(index);
+    } else if (*kind == 'K' || *kind == 'G') {
+      emit(index >> 8 & 0xFF);
+      emit(index & 0xFF);
+    } else {
+      emit(*operand++);
+    }
+  }
+}
+
+uint8_t EvaCompiler::genRegisterTemp(const Exp& exp) {
+  if (isFunctionCall(exp)) {
+    return genRegisterCall(exp);
+  }
+
+  auto reg = allocRegister();
+  genRegister(exp, reg);
+  nextReg_ = reg + 1;
+  return reg;
+}
+
+uint8_t EvaCompiler::genRegisterOperand(const Exp& exp) {
+  if (exp.type == ExpType::SYMBOL && exp.string() != "true" && exp.string() != "false" &&
+      scopeStack_.top()->getNameGetter(std::string(exp.string())) == OP_GET_LOCAL) {
+    auto local = findRegisterLocal(std::string(exp.string()));
+    if (local == nullptr) {
+      DIE << "[EvaCompiler] Reference error: " << exp.string() << std::endl;
+    }
+
+    // Locals changed by calls are copied before the rest of the
+    // expression runs.
+    if (!local->outer) {
+      return local->reg;
+    }
+  }
+
+  return genRegisterTemp(exp);
+}
+
+uint8_t EvaCompiler::genRegisterCall(const Exp& exp) {
+  // Callee and arguments in consecutive registers.
+  auto base = allocRegister();
+  genRegister(exp.list()[0], base);
+
+  for (size_t i = 1; i < exp.list().size(); i++) {
+    nextReg_ = base + i;
+    genRegister(exp.list()[i], allocRegister());
+  }
+
+  emit(ROP_CALL);
+  emit(base);
+  emit(exp.list().size() - 1);
+
+  // The result is left in the callee register.
+  nextReg_ = base + 1;
+  return base;
+}
+
+void EvaCompiler::compileRegisterFunction(const Exp& exp, const std::string& fnName,
+                                          const Exp& params, const Exp& body, int dst) {
+  auto scopeInfo = scopeInfo_.at(&exp);
+  scopeStack_.push(scopeInfo);
+
+  auto arity = params.list().size();
+
+  // Save current function state to restore it later.
+  auto prevCodeObj = codeObj;
+  auto prevLocals = std::move(regLocals_);
+  auto prevNextReg = nextReg_;
+  auto prevOuterRegLocals = outerRegLocals_;
+  outerRegLocals_ = &prevLocals;
+
+  // New function CodeObject.
+  auto coValue = createCodeObjectValue(fnName, arity);
+  codeObj = AS_CODE(coValue);
+  codeObj->tier = ExecutionTier::REGISTER;
+
+  codeObj->freeCount = scopeInfo->free.size();
+  codeObj->cellNames.assign(scopeInfo->free.begin(), scopeInfo->free.end());
+
+  // Store new CodeObject as a constant of the previous CodeObject.
+  prevCodeObj->addConst(coValue);
+  auto coIndex = prevCodeObj->constants.size() - 1;
+
+  // r0 is the function itself, then arguments.
+  regLocals_.clear();
+  nextReg_ = 0;
+  regLocals_.push_back({fnName, 0, allocRegister(), isChangedByCalls(scopeInfo.get(), fnName)});
+
+  for (size_t i = 0; i < arity; i++) {
+    std::string argName(params.list()[i].string());
+    regLocals_.push_back({argName, 0, allocRegister(), isChangedByCalls(scopeInfo.get(), argName)});
+  }
+
+  auto result = genRegisterOperand(body);
+
+  emit(ROP_RETURN);
+  emit(result);
+
+  codeObj = prevCodeObj;
+  regLocals_ = std::move(prevLocals);
+  outerRegLocals_ = prevOuterRegLocals;
+  nextReg_ = prevNextReg;
+
+  auto target = dst == NO_REG ? allocRegister() : (uint8_t)dst;
+
+  // Functions without free variables are constants (see compileFunction).
+  if (AS_CODE(coValue)->cellNames.empty()) {
+    codeObj->addConst(ALLOC_FUNCTION(AS_CODE(coValue)));
+
+    emitRegisterIndexed(ROP_LOADK, codeObj->constants.size() - 1, {target});
+  }
+
+  // Closures: load cells to capture into consecutive registers, the
+  // locals of this frame are captured in their registers.
+  else {
+    auto firstCell = nextReg_;
+
+    for (const auto& freeVar : scopeInfo->free) {
+      if (isFrameLocal(scopeInfo->parent.get(), freeVar)) {
+        auto local = getRegisterLocal(freeVar);
+        if (local == -1) {
+          DIE << "[EvaCompiler] Reference error: " << freeVar << std::endl;
+        }
+
+        emit(ROP_CAPTURE);
+        emit(allocRegister());
+        emit(local);
+      } else {
+        emit(ROP_LOAD_CELL);
+        emit(allocRegister());
+        emit(codeObj->getCellIndex(freeVar));
+      }
+    }
+
+    emitRegisterIndexed(ROP_MAKE_FUNCTION, coIndex,
+                        {target, (int)firstCell, (int)scopeInfo->free.size()});
+  }
+
+  nextReg_ = prevNextReg;
+  scopeStack_.pop();
+}
+
+void EvaCompiler::genRegister(const Exp& exp, int dst) {
+  switch (exp.type) {
+    case ExpType::NUMBER:
+      if (dst != NO_REG) {
+        emitRegisterIndexed(ROP_LOADK, numericConstIdx(exp.number), {dst});
+      }
+      break;
+
+    case ExpType::DOUBLE:
+      if (dst != NO_REG) {
+        emitRegisterIndexed(ROP_LOADK, doubleConstIdx(exp.real), {dst});
+      }
+      break;
+
+    case ExpType::STRING:
+      if (dst != NO_REG) {
+        emitRegisterIndexed(ROP_LOADK, stringConstIdx(std::string(exp.string())), {dst});
+      }
+      break;
+
+    case ExpType::SYMBOL: {
+      // Booleans
+      if (exp.string() == "true" || exp.string() == "false") {
+        if (dst != NO_REG) {
+          emitRegisterIndexed(ROP_LOADK, booleanConstIdx(exp.string() == "true"), {dst});
+        }
+        break;
+      }
+
+      // Variables
+      std::string varName(exp.string());
+      auto opCodeGetter = scopeStack_.top()->getNameGetter(varName);
+
+      // Local variables
+      if (opCodeGetter == OP_GET_LOCAL) {
+        auto reg = getRegisterLocal(varName);
+        if (reg == -1) {
+          DIE << "[EvaCompiler] Reference error: " << varName << std::endl;
+        }
+        emitMove(dst, reg);
+      }
+
+      // Locals of the enclosing function
+      else if (opCodeGetter == OP_GET_OUTER) {
+        if (dst != NO_REG) {
+          emit(ROP_GET_OUTER);
+          emit(dst);
+          emit(getOuterRegister(varName));
+        }
+      }
+
+      // Cell variables
+      else if (opCodeGetter == OP_GET_CELL) {
+        if (dst != NO_REG) {
+          emit(ROP_GET_CELL);
+          emit(dst);
+          emit(codeObj->getCellIndex(varName));
+        }
+      }
+
+      // Global variables
+      else {
+        if (!global->exists(varName))
+          DIE << "[EvaCompiler] Reference error: " << varName << std::endl;
+
+        if (dst != NO_REG) {
+          emitRegisterIndexed(ROP_GET_GLOBAL, global->getGlobalIndex(varName), {dst});
+        }
+      }
+      break;
+    }
+
+    case ExpType::LIST: {
+      // Temporaries are freed when the expression is done,
+      // declared locals stay allocated until the block exit.
+      auto freeReg = nextReg_;
+
+      // Destination of operations which always produce a value.
+      auto target = [&]() { return dst == NO_REG ? allocRegister() : (uint8_t)dst; };
+
+      auto tag = exp.list()[0];
+      auto op = tag.type == ExpType::SYMBOL ? tag.string() : "";
+
+      static const std::map<std::string, ByteCode, std::less<>> arithmeticOps = {
+        {"+", ROP_ADD}, {"-", ROP_SUB}, {"*", ROP_MUL}, {"/", ROP_DIV},
+      };
+
+      // Binary math operations:
+      if (arithmeticOps.count(op) != 0) {
+        auto op1 = genRegisterOperand(exp.list()[1]);
+        auto op2 = genRegisterOperand(exp.list()[2]);
+
+        emit(arithmeticOps.find(op)->second);
+        emit(target());
+        emit(op1);
+        emit(op2);
+      }
+
+      // Comparison operations:
+      else if (cmpOps.count(op) != 0) {
+        auto op1 = genRegisterOperand(exp.list()[1]);
+        auto op2 = genRegisterOperand(exp.list()[2]);
+
+        emit(ROP_CMP);
+        emit(target());
+        emit(op1);
+        emit(op2);
+        emit(cmpOps.find(op)->second);
+      }
+
+      // (if <test> <consequent> <alternate>)
+      else if (op == "if") {
+        auto cond = genRegisterOperand(exp.list()[1]);
+
+        emit(ROP_JMP_IF_FALSE);
+        emit(cond);
+        emit(0);
+        emit(0);
+
+        auto elseJmpAddr = getCurrentOffset() - 2;
+        nextReg_ = freeReg;
+
+        genRegister(exp.list()[2], dst);
+
+        emit(ROP_JMP);
+        emit(0);
+        emit(0);
+
+        auto endJmpAddr = getCurrentOffset() - 2;
+        patchJumpAddres(elseJmpAddr, getCurrentOffset());
+
+        if (exp.list().size() == 4) {
+          genRegister(exp.list()[3], dst);
+        } else if (dst != NO_REG) {
+          emitRegisterIndexed(ROP_LOADK, booleanConstIdx(false), {dst});
+        }
+
+        patchJumpAddres(endJmpAddr, getCurrentOffset());
+      }
+
+      // (while <test> <body>)
+      // (for <init> <test> <modifier> <body>)
+      else if (op == "while" || op == "for") {
+        auto isFor = op == "for";
+
+        if (isFor) {
+          // Init may declare a local.
+          genRegister(exp.list()[1], NO_REG);
+          freeReg = nextReg_;
+        }
+
+        auto loopStartAddr = getCurrentOffset();
+        auto cond = genRegisterOperand(exp.list()[isFor ? 2 : 1]);
+
+        emit(ROP_JMP_IF_FALSE);
+        emit(cond);
+        emit(0);
+        emit(0);
+
+        auto loopEndJmpAddr = getCurrentOffset() - 2;
+        nextReg_ = freeReg;
+
+        if (!isFor) {
+          genRegister(exp.list()[2], NO_REG);
+        } else {
+          if (exp.list().size() == 5) {
+            genRegister(exp.list()[4], NO_REG);
+          }
+          genRegister(exp.list()[3], NO_REG);
+        }
+
+        emit(ROP_JMP);
+        emit(0);
+        emit(0);
+
+        patchJumpAddres(getCurrentOffset() - 2, loopStartAddr);
+        patchJumpAddres(loopEndJmpAddr, getCurrentOffset());
+
+        // Loop as an expression evaluates to false.
+        if (dst != NO_REG) {
+          emitRegisterIndexed(ROP_LOADK, booleanConstIdx(false), {dst});
+        }
+      }
+
+      // (var <name> <init>), (def <name> <params> <body>)
+      else if (op == "var" || op == "def") {
+        std::string name(exp.list()[1].string());
+        auto opCodeSetter = scopeStack_.top()->getNameSetter(name);
+
+        if (opCodeSetter == OP_SET_GLOBAL) {
+          global->define(name);
+        }
+
+        // The register of a captured local exists before the initializer
+        // runs: the closures it makes may capture the variable.
+        auto isCaptured = opCodeSetter == OP_SET_LOCAL && scopeStack_.top()->cells.count(name) != 0;
+        uint8_t value = isCaptured ? allocRegister() : 0;
+
+        if (isCaptured) {
+          regLocals_.push_back({name, codeObj->scopeLevel, value, true});
+        }
+
+        if (op == "def") {
+          value = isCaptured ? value : allocRegister();
+          compileRegisterFunction(exp, name, exp.list()[2], exp.list()[3], value);
+        } else if (isLambda(exp.list()[2])) {
+          value = isCaptured ? value : allocRegister();
+          compileRegisterFunction(exp.list()[2], name, exp.list()[2].list()[1], exp.list()[2].list()[2], value);
+        } else if (isCaptured) {
+          genRegister(exp.list()[2], value);
+        } else if (opCodeSetter == OP_SET_LOCAL) {
+          value = genRegisterTemp(exp.list()[2]);
+        } else {
+          value = genRegisterOperand(exp.list()[2]);
+        }
+
+        // Global variables
+        if (opCodeSetter == OP_SET_GLOBAL) {
+          emitRegisterIndexed(ROP_SET_GLOBAL, global->getGlobalIndex(name), {value});
+        }
+
+        // Local variables: the value register becomes the variable.
+        else {
+          nextReg_ = value + 1;
+          if (!isCaptured) {
+            regLocals_.push_back({name, codeObj->scopeLevel, value,
+                                  isChangedByCalls(scopeStack_.top().get(), name)});
+          }
+          freeReg = nextReg_;
+        }
+
+        emitMove(dst, value);
+      }
+
+      // (set <name> <value>)
+      else if (op == "set") {
+        std::string varName(exp.list()[1].string());
+        auto opCodeSetter = scopeStack_.top()->getNameSetter(varName);
+
+        // Local variables
+        if (opCodeSetter == OP_SET_LOCAL) {
+          auto reg = getRegisterLocal(varName);
+          if (reg == -1) {
+            DIE << "Reference error: " << varName << " is not defined." << std::endl;
+          }
+
+          genRegister(exp.list()[2], reg);
+          emitMove(dst, reg);
+        }
+
+        // Cell variables
+        else if (opCodeSetter == OP_SET_CELL) {
+          auto value = genRegisterOperand(exp.list()[2]);
+
+          emit(ROP_SET_CELL);
+          emit(codeObj->getCellIndex(varName));
+          emit(value);
+
+          emitMove(dst, value);
+        }
+
+        // Locals of the enclosing function
+        else if (opCodeSetter == OP_SET_OUTER) {
+          auto value = genRegisterOperand(exp.list()[2]);
+
+          emit(ROP_SET_OUTER);
+          emit(getOuterRegister(varName));
+          emit(value);
+
+          emitMove(dst, value);
+        }
+
+        // Global variables
+        else {
+          auto globalIndex = global->getGlobalIndex(varName);
+          if (globalIndex == -1) {
+            DIE << "Reference error: " << varName << " is not defined." << std::endl;
+          }
+
+          auto value = genRegisterOperand(exp.list()[2]);
+
+          emitRegisterIndexed(ROP_SET_GLOBAL, globalIndex, {value});
+
+          emitMove(dst, value);
+        }
+      }
+
+      else if (op == "begin") {
+        scopeStack_.push(scopeInfo_.at(&exp));
+        blockEnter();
+        auto firstLocal = nextReg_;
+
+        for (size_t i = 1; i < exp.list().size(); i++) {
+          // The value of the last expression is the result of the block.
+          bool isLast = i == exp.list().size() - 1;
+          genRegister(exp.list()[i], isLast ? dst : NO_REG);
+        }
+
+        // Cells of the block are closed: each run of the block (an
+        // iteration of a loop) has its own variables. Returns close the
+        // function body.
+        if (!scopeStack_.top()->cells.empty() && !isFunctionBody()) {
+          emit(ROP_CLOSE);
+          emit(firstLocal);
+        }
+
+        // Locals of the block are freed.
+        while (!regLocals_.empty() && regLocals_.back().scopeLevel == codeObj->scopeLevel) {
+          regLocals_.pop_back();
+        }
+
+        codeObj->scopeLevel--;
+        scopeStack_.pop();
+      }
+
+      else if (op == "lambda") {
+        compileRegisterFunction(exp, "lambda", exp.list()[1], exp.list()[2], target());
+      }
+
+      // Everything else is treated as a function call.
+      else {
+        emitMove(dst, genRegisterCall(exp));
+      }
+
+      nextReg_ = freeReg;
+      break;
+    }
+
+    default:
+      DIE << "Unknown expression type met, must be a parser error.";
+  }
+}
@@ -1,15 +1,34 @@
 
 #include "disassembler/EvaDisassembler.hpp"
+#include "vm/RegOpCode.hpp"
 
 void EvaDisassembler::disassemble(CodeObject* co) {
   std::cout << "\n---------------- Disassembly: " << co->name << " ----------------\n\n";
   size_t offset = 0;
   while (offset < co->code.size()) {
-    offset = disassembleInstruction(co, offset);
+    offset = disassembleAt(co, offset);
     std::cout << '\n';
   }
 }
 
+size_t EvaDisassembler::disassembleAt(CodeObject* co, size_t offset) {
+  std::ios_base::fmtflags f(std::cout.flags());
+
+  auto opcode = co->code[offset];
+
+  offset = co->tier == ExecutionTier::REGISTER
+    ? disassembleRegisterInstruction(co, offset)
+    : disassembleInstruction(co, offset);
+
+  // Sites rewritten by the interpreter (see EvaVM::quicken).
+  if (co->tier == ExecutionTier::STACK && isQuickenedOpcode(opcode)) {
+    std::cout << "  (quickened)";
+  }
+
+  std::cout.flags(f);
+  return offset;
+}
+
 size_t EvaDisassembler::disassembleInstruction(CodeObject* co, size_t offset) {
   std::ios_base::fmtflags f(std::cout.flags());
 
@@ -27,26 +46,61 @@ size_t EvaDisassembler::disassembleInstruction(CodeObject* co, size_t offset) {
     case OP_DIV:
     case OP_POP:
     case OP_RETURN:
+    case OP_ADD_NUM:
+    case OP_ADD_STR:
+    case OP_ADD_INT:
       return disassembleSimple(co, opcode, offset);
     case OP_SCOPE_EXIT:
     case OP_CALL:
+    case OP_GET_OUTER:
+    case OP_SET_OUTER:
+    case OP_SCOPE_EXIT_WIDE:
+    case OP_GET_OUTER_WIDE:
+    case OP_SET_OUTER_WIDE:
       return disassembleWord(co, opcode, offset);
     case OP_CONST:
+    case OP_CONST_WIDE:
       return disassembleConst(co, opcode, offset);
     case OP_CMP:
+    case OP_LT_NUM:
+    case OP_LT_INT:
       return disassembleCompare(co, opcode, offset);
     case OP_JMP:
     case OP_JMP_IF_FALSE:
+    case OP_JMP_IF_NOT_LT:
+    case OP_JMP_IF_NOT_GT:
+    case OP_JMP_IF_NOT_EQ:
+    case OP_JMP_IF_NOT_GE:
+    case OP_JMP_IF_NOT_LE:
+    case OP_JMP_IF_NOT_NE:
+    case OP_JMP_WIDE:
+    case OP_JMP_IF_FALSE_WIDE:
       return disassembleJump(co, opcode, offset);
+    case OP_ADD_LOCAL_LOCAL:
+      return disassembleLocalPair(co, opcode, offset);
+    case OP_CONST_SET_LOCAL:
+      return disassembleConstLocal(co, opcode, offset);
+    case OP_ADD_LOCAL_CONST:
+      return disassembleLocalConst(co, opcode, offset);
     case OP_GET_GLOBAL:
     case OP_SET_GLOBAL:
+    case OP_GET_GLOBAL_WIDE:
+    case OP_SET_GLOBAL_WIDE:
       return disassembleGlobal(co, opcode, offset);
     case OP_GET_LOCAL:
     case OP_SET_LOCAL:
+    case OP_SET_LOCAL_POP:
+    case OP_CAPTURE_LOCAL:
+    case OP_GET_LOCAL_WIDE:
+    case OP_SET_LOCAL_WIDE:
+    case OP_CAPTURE_LOCAL_WIDE:
       return disassembleLocal(co, opcode, offset);
     case OP_GET_CELL:
     case OP_SET_CELL:
     case OP_LOAD_CELL:
+    case OP_GET_CELL_WIDE:
+    case OP_SET_CELL_WIDE:
+    case OP_LOAD_CELL_WIDE:
       return disassembleCell(co, opcode, offset);
     case OP_MAKE_FUNCTION:
       return disassembleMakeFunction(co, opcode, offset);
@@ -59,26 +113,106 @@ size_t EvaDisassembler::disassembleInstruction(CodeObject* co, size_t offset) {
   std::cout.flags(f);
 }
 
+uint16_t readWordAtOffset(CodeObject* co, size_t offset);
+
+size_t EvaDisassembler::disassembleRegisterInstruction(CodeObject* co, size_t offset) {
+  std::ios_base::fmtflags f(std::cout.flags());
+
+  // Print bytecode offset
+  std::cout << std::uppercase << std::hex << std::setfill('0') << std::setw(4)
+    << offset << "    ";
+  std::cout.flags(f);
+
+  auto opcode = co->code[offset];
+  std::string operands = regOpcodeOperands(opcode);
+
+  auto size = regBytecodeSize(opcode);
+
+  // Register instructions are up to 6 bytes.
+  dumpBytes(co, offset, size, 16);
+  std::cout << std::left << std::setfill(' ') << std::setw(20) << regOpcodeToString(opcode);
+  std::cout.flags(f);
+
+  auto operandOffset = offset + 1;
+  for (size_t i = 0; i < operands.size(); i++) {
+    if (i > 0) {
+      std::cout << ", ";
+    }
+
+    auto operand = co->code[operandOffset++];
+
+    switch (operands[i]) {
+      case 'r':
+        std::cout << 'r' << (int)operand;
+        break;
+      case 'k':
+        std::cout << (int)operand << " (" << evaValueToConstantString(co->constants[operand]) << ')';
+        break;
+      case 'g':
+        std::cout << (int)operand << " (" << global->get(operand).name << ')';
+        break;
+      case 'l':
+        std::cout << (int)operand << " (" << co->cellNames[operand] << ')';
+        break;
+      case 'o':
+        std::cout << "caller.r" << (int)operand;
+        break;
+      case 'c':
+        std::cout << inverseCompareOps[operand];
+        break;
+      case 'K':
+      case 'G': {
+        auto index = readWordAtOffset(co, operandOffset - 1);
+        operandOffset++;
+        std::cout << (int)index << " (" << (operands[i] == 'K'
+          ? evaValueToConstantString(co->constants[index])
+          : global->get(index).name) << ')';
+        break;
+      }
+      case 'j':
+      case 'J': {
+        auto addressSize = regOperandSize(operands[i]);
+        auto address = readJumpAddress(&co->code[operandOffset - 1], addressSize);
+        operandOffset += addressSize - 1;
+        std::cout << std::uppercase << std::hex << std::setfill('0') << std::setw(4)
+          << address;
+        std::cout.flags(f);
+        break;
+      }
+      default:
+        std::cout << (int)operand;
+    }
+  }
+
+  return offset + size;
+}
+
 size_t EvaDisassembler::disassembleSimple(CodeObject* co, ByteCode opcode, size_t offset) {
   dumpBytes(co, offset, 1);
   printOpcode(opcode);
   return offset + 1;
 }
 
+size_t EvaDisassembler::readIndex(CodeObject* co, ByteCode opcode, size_t offset) {
+  return isWideOpcode(opcode) ? readWordAtOffset(co, offset + 1) : co->code[offset + 1];
+}
+
 size_t EvaDisassembler::disassembleWord(CodeObject* co, ByteCode opcode, size_t offset) {
-  dumpBytes(co, offset, 2);
+  auto size = bytecodeSizes[opcode];
+  dumpBytes(co, offset, size);
   printOpcode(opcode);
-  std::cout << (int)co->code[offset + 1];
-  return offset + 2;
+  std::cout << readIndex(co, opcode, offset);
+  return offset + size;
 }
 
 size_t EvaDisassembler::disassembleConst(CodeObject* co, ByteCode opcode, size_t offset) {
-  dumpBytes(co, offset, 2);
+  auto size = bytecodeSizes[opcode];
+  dumpBytes(co, offset, size);
   printOpcode(opcode);
-  auto constIndex = co->code[offset + 1];
-  std::cout << (int)constIndex << " (" << evaValueToConstantString(co->constants[constIndex]) << ')'; 
+  auto constIndex = readIndex(co, opcode, offset);
+  std::cout << constIndex << " (" << evaValueToConstantString(co->constants[constIndex]) << ')'; 
 
-  return offset + 2;
+  return offset + size;
 }
 
 std::array<std::string, 6> EvaDisassembler::inverseCompareOps = {
@@ -96,30 +230,69 @@ size_t EvaDisassembler::disassembleCompare(CodeObject* co, ByteCode opcode, size
 }
 
 size_t EvaDisassembler::disassembleGlobal(CodeObject* co, ByteCode opcode, size_t offset) {
-  dumpBytes(co, offset, 2);
+  auto size = bytecodeSizes[opcode];
+  dumpBytes(co, offset, size);
   printOpcode(opcode);
-  auto globalIndex = co->code[offset + 1];
-  std::cout << (int)globalIndex << " (" << global->get(globalIndex).name << ')'; 
+  auto globalIndex = readIndex(co, opcode, offset);
+  std::cout << globalIndex << " (" << global->get(globalIndex).name << ')'; 
 
-  return offset + 2;
+  return offset + size;
 }
 
 size_t EvaDisassembler::disassembleLocal(CodeObject* co, ByteCode opcode, size_t offset) {
-  dumpBytes(co, offset, 2);
+  auto size = bytecodeSizes[opcode];
+  dumpBytes(co, offset, size);
   printOpcode(opcode);
-  auto localIndex = co->code[offset + 1];
-  std::cout << (int)localIndex << " (" << co->locals[localIndex].name << ')'; 
+  printLocal(co, readIndex(co, opcode, offset));
 
-  return offset + 2;
+  return offset + size;
+}
+
+size_t EvaDisassembler::disassembleLocalPair(CodeObject* co, ByteCode opcode, size_t offset) {
+  dumpBytes(co, offset, 3);
+  printOpcode(opcode);
+  printLocal(co, co->code[offset + 1]);
+  std::cout << ", ";
+  printLocal(co, co->code[offset + 2]);
+
+  return offset + 3;
+}
+
+size_t EvaDisassembler::disassembleConstLocal(CodeObject* co, ByteCode opcode, size_t offset) {
+  dumpBytes(co, offset, 3);
+  printOpcode(opcode);
+  auto constIndex = co->code[offset + 1];
+  std::cout << (int)constIndex << " (" << evaValueToConstantString(co->constants[constIndex]) << "), ";
+  printLocal(co, co->code[offset + 2]);
+
+  return offset + 3;
+}
+
+size_t EvaDisassembler::disassembleLocalConst(CodeObject* co, ByteCode opcode, size_t offset) {
+  dumpBytes(co, offset, 3);
+  printOpcode(opcode);
+  printLocal(co, co->code[offset + 1]);
+  auto constIndex = co->code[offset + 2];
+  std::cout << ", " << (int)constIndex << " (" << evaValueToConstantString(co->constants[constIndex]) << ')';
+
+  return offset + 3;
+}
+
+void EvaDisassembler::printLocal(CodeObject* co, size_t localIndex) {
+  std::cout << localIndex;
+  if (localIndex < co->locals.size()) {
+    std::cout << " (" << co->locals[localIndex].name << ')';
+  }
 }
 
 size_t EvaDisassembler::disassembleCell(CodeObject* co, ByteCode opcode, size_t offset) {
-  dumpBytes(co, offset, 2);
+  auto size = bytecodeSizes[opcode];
+  dumpBytes(co, offset, size);
   printOpcode(opcode);
-  auto cellIndex = co->code[offset + 1];
-  std::cout << (int)cellIndex << " (" << co->cellNames[cellIndex] << ')'; 
+  auto cellIndex = readIndex(co, opcode, offset);
+  std::cout << cellIndex << " (" << co->cellNames[cellIndex] << ')'; 
 
-  return offset + 2;
+  return offset + size;
 }
 
 size_t EvaDisassembler::disassembleMakeFunction(CodeObject* co, ByteCode opcode, size_t offset) {
@@ -133,19 +306,20 @@ uint16_t readWordAtOffset(CodeObject* co, size_t offset) {
 size_t EvaDisassembler::disassembleJump(CodeObject* co, ByteCode opcode, size_t offset) {
   std::ios_base::fmtflags f(std::cout.flags());
 
-  dumpBytes(co, offset, 2);
+  auto size = bytecodeSizes[opcode];
+  dumpBytes(co, offset, size);
   printOpcode(opcode);
-  uint16_t address = readWordAtOffset(co, offset + 1);
+  auto address = readJumpAddress(&co->code[offset + 1], jumpAddressSize(opcode));
 
   std::cout << std::uppercase << std::hex << std::setfill('0') << std::setw(4)
-    << (int)address << ' ';
+    << address << ' ';
 
   std::cout.flags(f);
 
-  return offset + 3;
+  return offset + size;
 }
 
-void EvaDisassembler::dumpBytes(CodeObject* co, size_t offset, size_t count) {
+void EvaDisassembler::dumpBytes(CodeObject* co, size_t offset, size_t count, size_t width) {
   std::ios_base::fmtflags f(std::cout.flags());
   std::stringstream ss;
 
@@ -154,7 +328,7 @@ void EvaDisassembler::dumpBytes(CodeObject* co, size_t offset, size_t count) {
       << ((int)co->code[offset + i] & 0xFF) << " ";
   }
 
-  std::cout << std::left << std::setfill(' ') << std::setw(12) << ss.str();
+  std::cout << std::left << std::setfill(' ') << std::setw(width) << ss.str();
 
   std::cout.flags(f);
 }
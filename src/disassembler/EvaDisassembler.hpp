@@ -20,6 +20,12 @@ class EvaDisassembler {
      */
     void disassemble(CodeObject* co);
 
+    /**
+     * Disassembles the instruction at the offset (without a newline),
+     * returns the offset of the next one.
+     */
+    size_t disassembleAt(CodeObject* co, size_t offset);
+
   private:
     /**
      * Global object. Shared with VM.
@@ -36,13 +42,20 @@ class EvaDisassembler {
      */
     size_t disassembleInstruction(CodeObject* co, size_t offset);
 
+    /**
+     * Disassembles register tier instruction, operands are
+     * decoded by their kinds (see RegOpCode.hpp).
+     */
+    size_t disassembleRegisterInstruction(CodeObject* co, size_t offset);
+
     /**
      * Disassembles one byte.
      */
     size_t disassembleSimple(CodeObject* co, ByteCode opcode, size_t offset);
 
     /**
-     * Disassembles two bytes.
+     * Disassembles an instruction with an index operand (two bytes, or
+     * three for the wide form).
      */
     size_t disassembleWord(CodeObject* co, ByteCode opcode, size_t offset);
 
@@ -61,6 +74,32 @@ class EvaDisassembler {
      */
     size_t disassembleLocal(CodeObject* co, ByteCode opcode, size_t offset);
 
+    /**
+     * Disassembles GET_LOCAL; GET_LOCAL; ADD superinstruction.
+     */
+    size_t disassembleLocalPair(CodeObject* co, ByteCode opcode, size_t offset);
+
+    /**
+     * Disassembles CONST; SET_LOCAL superinstruction.
+     */
+    size_t disassembleConstLocal(CodeObject* co, ByteCode opcode, size_t offset);
+
+    /**
+     * Disassembles GET_LOCAL; CONST; ADD superinstruction.
+     */
+    size_t disassembleLocalConst(CodeObject* co, ByteCode opcode, size_t offset);
+
+    /**
+     * Prints local variable index and its name if still known
+     * (locals of exited scopes are dropped by the compiler).
+     */
+    void printLocal(CodeObject* co, size_t localIndex);
+
+    /**
+     * Reads the index operand: one byte, or two for the wide form.
+     */
+    size_t readIndex(CodeObject* co, ByteCode opcode, size_t offset);
+
     /**
      * Disassembles cells.
      */
@@ -84,7 +123,7 @@ class EvaDisassembler {
     /**
      * Prints raw bytes.
      */
-    void dumpBytes(CodeObject* co, size_t offset, size_t count);
+    void dumpBytes(CodeObject* co, size_t offset, size_t count, size_t width = 12);
 
     /**
      * Prints opcode as string.
@@ -0,0 +1,265 @@
+#include "gc/EvaCollector.hpp"
+
+#include <algorithm>
+
+static thread_local EvaCollector* currentCollector = nullptr;
+
+void trackObject(Object* object, size_t size) {
+  if (currentCollector != nullptr) {
+    currentCollector->track(object, size);
+  }
+}
+
+Object* internString(const std::string& string) {
+  if (currentCollector != nullptr) {
+    return currentCollector->intern(string);
+  }
+
+  return allocObject<StringObject>(string);
+}
+
+/**
+ * Bytes of the buffers owned by the object: the string of a string
+ * object, the name and the vectors of a code object, the cells of a
+ * function.
+ */
+static size_t ownedBytes(Object* object) {
+  switch (object->type) {
+    case ObjectType::STRING:
+      return ((StringObject*)object)->string.capacity();
+
+    case ObjectType::CODE: {
+      auto co = (CodeObject*)object;
+      return co->name.capacity() + co->code.capacity() +
+             co->constants.capacity() * sizeof(EvaValue) +
+             co->locals.capacity() * sizeof(LocalVar) +
+             co->cellNames.capacity() * sizeof(std::string) +
+             co->deoptimizations.capacity();
+    }
+
+    case ObjectType::NATIVE:
+      return ((NativeObject*)object)->name.capacity();
+
+    case ObjectType::FUNCTION:
+      return ((FunctionObject*)object)->cells.capacity() * sizeof(CellObject*);
+
+    case ObjectType::CELL:
+      return 0;
+  }
+
+  return 0;
+}
+
+EvaCollector* EvaCollector::current() {
+  return currentCollector;
+}
+
+EvaCollector::Scope::Scope(EvaCollector* collector) : previous(currentCollector) {
+  currentCollector = collector;
+}
+
+EvaCollector::Scope::~Scope() {
+  currentCollector = previous;
+}
+
+EvaCollector::~EvaCollector() {
+  while (objects != nullptr) {
+    auto next = objects->next;
+    free(objects);
+    objects = next;
+  }
+}
+
+void EvaCollector::track(Object* object, size_t size) {
+  size += ownedBytes(object);
+  object->size = size;
+  object->next = objects;
+  objects = object;
+
+  stats.bytesAllocated += size;
+  stats.totalAllocated += size;
+  stats.totalObjects++;
+  stats.objectsCount++;
+
+  if (object->type == ObjectType::CELL) {
+    stats.totalCells++;
+  }
+
+  if (stats.bytesAllocated > stats.peakAllocated) {
+    stats.peakAllocated = stats.bytesAllocated;
+  }
+}
+
+StringObject* EvaCollector::intern(const std::string& string) {
+  if (!interning) {
+    return (StringObject*)allocObject<StringObject>(string);
+  }
+
+  auto hash = std::hash<std::string>{}(string);
+  auto range = strings.equal_range(hash);
+
+  for (auto it = range.first; it != range.second; it++) {
+    if (it->second->string == string) {
+      stats.internHits++;
+      return it->second;
+    }
+  }
+
+  auto object = (StringObject*)allocObject<StringObject>(string, hash);
+  object->interned = true;
+  strings.emplace(hash, object);
+
+  return object;
+}
+
+size_t EvaCollector::collect(const std::vector<Object*>& roots) {
+  mark(roots);
+  auto freed = sweep();
+
+  stats.collections++;
+  stats.threshold = std::max(minThreshold, stats.bytesAllocated * GROWTH_FACTOR);
+
+  return freed;
+}
+
+void EvaCollector::mark(const std::vector<Object*>& roots) {
+  for (auto root : roots) {
+    markObject(root);
+  }
+
+  while (!worklist.empty()) {
+    auto object = worklist.back();
+    worklist.pop_back();
+
+    switch (object->type) {
+      case ObjectType::CODE: {
+        for (const auto& constant : ((CodeObject*)object)->constants) {
+          markValue(constant);
+        }
+        break;
+      }
+
+      case ObjectType::FUNCTION: {
+        auto fn = (FunctionObject*)object;
+        markObject(fn->co);
+        for (auto cell : fn->cells) {
+          markObject(cell);
+        }
+        break;
+      }
+
+      case ObjectType::CELL:
+        markValue(*((CellObject*)object)->location);
+        break;
+
+      case ObjectType::STRING:
+      case ObjectType::NATIVE:
+        break;
+    }
+  }
+}
+
+void EvaCollector::markValue(const EvaValue& value) {
+  if (IS_OBJECT(value)) {
+    markObject(AS_OBJECT(value));
+  }
+}
+
+void EvaCollector::markObject(Object* object) {
+  if (object == nullptr || object->marked || object->shared) {
+    return;
+  }
+
+  object->marked = true;
+  worklist.push_back(object);
+}
+
+size_t EvaCollector::sweep() {
+  size_t freed = 0;
+  auto link = &objects;
+
+  while (*link != nullptr) {
+    auto object = *link;
+
+    if (object->marked) {
+      object->marked = false;
+      remeasure(object);
+      link = &object->next;
+      continue;
+    }
+
+    *link = object->next;
+
+    freed += object->size;
+    stats.bytesAllocated -= object->size;
+    stats.objectsCount--;
+
+    if (object->type == ObjectType::CODE && codeFinalizer) {
+      codeFinalizer((CodeObject*)object);
+    }
+
+    free(object);
+  }
+
+  stats.totalFreed += freed;
+  return freed;
+}
+
+void EvaCollector::remeasure(Object* object) {
+  size_t size;
+
+  switch (object->type) {
+    case ObjectType::CODE:
+      size = sizeof(CodeObject) + ownedBytes(object);
+      break;
+    case ObjectType::FUNCTION:
+      size = sizeof(FunctionObject) + ownedBytes(object);
+      break;
+    default:
+      return;
+  }
+
+  if (size > object->size) {
+    stats.totalAllocated += size - object->size;
+  }
+
+  stats.bytesAllocated = stats.bytesAllocated - object->size + size;
+  object->size = size;
+
+  if (stats.bytesAllocated > stats.peakAllocated) {
+    stats.peakAllocated = stats.bytesAllocated;
+  }
+}
+
+void EvaCollector::free(Object* object) {
+  switch (object->type) {
+    case ObjectType::STRING: {
+      auto string = (StringObject*)object;
+
+      if (string->interned) {
+        auto range = strings.equal_range(string->hash);
+        for (auto it = range.first; it != range.second; it++) {
+          if (it->second == string) {
+            strings.erase(it);
+            break;
+          }
+        }
+      }
+
+      delete string;
+      break;
+    }
+    case ObjectType::CODE:
+      delete (CodeObject*)object;
+      break;
+    case ObjectType::NATIVE:
+      delete (NativeObject*)object;
+      break;
+    case ObjectType::FUNCTION:
+      delete (FunctionObject*)object;
+      break;
+    case ObjectType::CELL:
+      delete (CellObject*)object;
+      break;
+  }
+}
@@ -0,0 +1,212 @@
+/**
+ * Eva garbage collector.
+ */
+#ifndef SRC_GC_EVACOLLECTOR_HPP
+#define SRC_GC_EVACOLLECTOR_HPP
+
+#include "vm/EvaValue.hpp"
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Heap statistics.
+ */
+struct GCStats {
+  /**
+   * Bytes currently allocated on the heap.
+   */
+  size_t bytesAllocated = 0;
+
+  /**
+   * Maximal heap size reached.
+   */
+  size_t peakAllocated = 0;
+
+  /**
+   * Amount of live objects on the heap.
+   */
+  size_t objectsCount = 0;
+
+  /**
+   * Heap size which triggers the next collection.
+   */
+  size_t threshold = 0;
+
+  /**
+   * Amount of collections performed.
+   */
+  size_t collections = 0;
+
+  /**
+   * Total bytes allocated and freed since start.
+   */
+  size_t totalAllocated = 0;
+  size_t totalFreed = 0;
+
+  /**
+   * Objects allocated since start.
+   */
+  size_t totalObjects = 0;
+
+  /**
+   * Cells (captured variables) allocated since start.
+   */
+  size_t totalCells = 0;
+
+  /**
+   * String allocations served by an already interned string.
+   */
+  size_t internHits = 0;
+};
+
+/**
+ * Mark-sweep collector. Owns the list of all objects allocated
+ * while it is the current collector of the thread.
+ */
+class EvaCollector {
+  public:
+    /**
+     * Initial collection threshold and the growth of it relative
+     * to the live heap after each collection.
+     */
+    static constexpr size_t INITIAL_THRESHOLD = 1024 * 1024;
+    static constexpr size_t GROWTH_FACTOR = 2;
+
+    EvaCollector() { stats.threshold = INITIAL_THRESHOLD; }
+
+    /**
+     * Frees all objects of the heap.
+     */
+    ~EvaCollector();
+
+    EvaCollector(const EvaCollector&) = delete;
+    EvaCollector& operator=(const EvaCollector&) = delete;
+
+    /**
+     * Adds an object of the size to the heap. The buffers it owns
+     * (string and vector capacities) are counted with it.
+     */
+    void track(Object* object, size_t size);
+
+    /**
+     * Whether the heap has grown over the collection threshold.
+     */
+    bool shouldCollect() const { return stats.bytesAllocated >= stats.threshold; }
+
+    /**
+     * Full collection: marks everything reachable from the roots,
+     * frees the rest. Returns the amount of freed bytes.
+     */
+    size_t collect(const std::vector<Object*>& roots);
+
+    /**
+     * Sets the minimal heap size which triggers a collection.
+     */
+    void setThreshold(size_t bytes) { minThreshold = bytes; stats.threshold = bytes; }
+
+    /**
+     * Heap statistics.
+     */
+    const GCStats& getStats() const { return stats; }
+
+    /**
+     * Returns the only string object with the value, allocates
+     * it on the first use. The intern table is weak: unreachable
+     * strings are removed from it when swept.
+     */
+    StringObject* intern(const std::string& string);
+
+    /**
+     * Enables or disables interning of new strings.
+     */
+    void setInterning(bool enabled) { interning = enabled; }
+
+    /**
+     * Sets the function called with each swept code object before it
+     * is deleted (the JIT frees its machine code). Not called when the
+     * collector itself is destroyed.
+     */
+    void setCodeFinalizer(std::function<void(CodeObject*)> finalizer) { codeFinalizer = std::move(finalizer); }
+
+    /**
+     * Collector which tracks allocations on the current thread.
+     */
+    static EvaCollector* current();
+
+    /**
+     * Makes the collector current for the lifetime of the scope.
+     */
+    struct Scope {
+      Scope(EvaCollector* collector);
+      ~Scope();
+
+      EvaCollector* previous;
+    };
+
+  private:
+    /**
+     * Marks objects reachable from the roots.
+     */
+    void mark(const std::vector<Object*>& roots);
+
+    /**
+     * Pushes the object of the value to the mark worklist.
+     */
+    void markValue(const EvaValue& value);
+    void markObject(Object* object);
+
+    /**
+     * Frees unreachable objects, returns the amount of freed bytes.
+     */
+    size_t sweep();
+
+    /**
+     * Updates the size of a live code object or function: their
+     * vectors are filled after the allocation.
+     */
+    void remeasure(Object* object);
+
+    /**
+     * Deletes the object with the proper type.
+     */
+    void free(Object* object);
+
+    /**
+     * Head of the objects list.
+     */
+    Object* objects = nullptr;
+
+    /**
+     * Mark worklist.
+     */
+    std::vector<Object*> worklist;
+
+    /**
+     * Interned strings by their hashes.
+     */
+    std::unordered_multimap<size_t, StringObject*> strings;
+
+    /**
+     * Whether new strings are interned.
+     */
+    bool interning = true;
+
+    /**
+     * Called with swept code objects.
+     */
+    std::function<void(CodeObject*)> codeFinalizer;
+
+    /**
+     * Minimal collection threshold.
+     */
+    size_t minThreshold = INITIAL_THRESHOLD;
+
+    /**
+     * Heap statistics.
+     */
+    GCStats stats;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "image/EvaCompileCache.hpp"
+#include "image/EvaImage.hpp"
+#include "vm/OpCode.hpp"
+#include "vm/RegOpCode.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static constexpr const char* ENTRY_EXTENSION = ".evi";
+static constexpr const char* TEMP_PREFIX = ".tmp-";
+
+/**
+ * Age after which a temporary file is left by a store which crashed
+ * before the rename (writing an entry takes milliseconds).
+ */
+static constexpr auto STALE_TEMP_AGE = std::chrono::minutes(10);
+
+/**
+ * 128-bit key hash: two 64-bit multiplicative hashes with different
+ * seeds and multipliers (FNV-1a and a golden ratio variant).
+ */
+class KeyHash {
+  public:
+    void update(const void* data, size_t size) {
+      auto bytes = (const uint8_t*)data;
+      for (size_t i = 0; i < size; i++) {
+        fnv_ = (fnv_ ^ bytes[i]) * 0x100000001b3ULL;
+        mix_ = (mix_ ^ bytes[i]) * 0x9e3779b97f4a7c15ULL;
+        mix_ ^= mix_ >> 29;
+      }
+    }
+
+    /**
+     * Length prefixed, so consecutive fields can't run into each other.
+     */
+    void update(std::string_view string) {
+      uint64_t size = string.size();
+      update(&size, sizeof(size));
+      update(string.data(), string.size());
+    }
+
+    void update(uint32_t value) { update(&value, sizeof(value)); }
+
+    std::string hex() const {
+      char buffer[33];
+      snprintf(buffer, sizeof(buffer), "%016llx%016llx",
+               (unsigned long long)fnv_, (unsigned long long)mix_);
+      return buffer;
+    }
+
+  private:
+    uint64_t fnv_ = 0xcbf29ce484222325ULL;
+    uint64_t mix_ = 0x243f6a8885a308d3ULL;
+};
+
+EvaCompileCache::EvaCompileCache(const std::string& dir, size_t maxBytes)
+    : dir_(dir), maxBytes_(maxBytes) {
+  std::error_code error;
+  fs::create_directories(dir_, error);
+}
+
+std::string EvaCompileCache::key(std::string_view source, std::string_view config, Global& global) {
+  KeyHash hash;
+
+  hash.update(EvaImage::VERSION);
+  hash.update((uint32_t)BYTECODES_COUNT);
+  hash.update((uint32_t)REG_BYTECODES_COUNT);
+  hash.update(config);
+
+  // Globals get their indices in the order of definition.
+  hash.update((uint32_t)global.size());
+  for (size_t i = 0; i < global.size(); i++) {
+    hash.update(global.get(i).name);
+  }
+
+  hash.update(source);
+  return hash.hex();
+}
+
+std::string EvaCompileCache::entryPath(const std::string& key) const {
+  return (fs::path(dir_) / (key + ENTRY_EXTENSION)).string();
+}
+
+std::vector<CodeObject*> EvaCompileCache::lookup(const std::string& key, Global& global) {
+  auto path = entryPath(key);
+
+  // A missing entry, or one evicted by another process meanwhile.
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    stats_.misses++;
+    return {};
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    stats_.misses++;
+    return {};
+  }
+
+  auto size = (size_t)info.st_size;
+  auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    stats_.misses++;
+    return {};
+  }
+
+  std::string error;
+  auto codeObjects = EvaImage::tryLoad((const uint8_t*)data, size, global, error);
+  munmap(data, size);
+
+  // A corrupt entry is a miss: it is removed, so the program is
+  // compiled and stored again.
+  if (!codeObjects) {
+    unlink(path.c_str());
+    stats_.invalid++;
+    stats_.misses++;
+    return {};
+  }
+
+  // Recently used: eviction goes by the modification time.
+  utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+  stats_.hits++;
+  return *codeObjects;
+}
+
+void EvaCompileCache::store(const std::string& key, CodeObject* main, Global& global) {
+  static std::atomic<uint64_t> tempCounter{0};
+
+  auto image = EvaImage::serialize(main, global);
+
+  auto temp = (fs::path(dir_) / (TEMP_PREFIX + std::to_string(getpid()) + "-" +
+                                 std::to_string(tempCounter++))).string();
+
+  auto file = fopen(temp.c_str(), "wb");
+  if (file == nullptr) {
+    return;
+  }
+
+  auto written = fwrite(image.data(), 1, image.size(), file) == image.size();
+  if (fclose(file) != 0 || !written) {
+    std::remove(temp.c_str());
+    return;
+  }
+
+  // Atomic: readers see the previous entry or the complete new one.
+  if (rename(temp.c_str(), entryPath(key).c_str()) != 0) {
+    std::remove(temp.c_str());
+    return;
+  }
+
+  stats_.stores++;
+  evict(key);
+}
+
+void EvaCompileCache::evict(const std::string& keep) {
+  struct Entry {
+    fs::path path;
+    size_t size;
+    fs::file_time_type time;
+  };
+
+  std::vector<Entry> entries;
+  size_t total = 0;
+  std::error_code error;
+  auto now = fs::file_time_type::clock::now();
+
+  for (auto it = fs::directory_iterator(dir_, error); !error && it != fs::directory_iterator();
+       it.increment(error)) {
+    auto& path = it->path();
+    auto temp = path.filename().string().rfind(TEMP_PREFIX, 0) == 0;
+
+    if (!temp && (path.extension() != ENTRY_EXTENSION || path.stem() == keep)) {
+      continue;
+    }
+
+    // Entries removed by another process are skipped.
+    std::error_code entryError;
+    auto size = it->file_size(entryError);
+    auto time = it->last_write_time(entryError);
+    if (entryError) {
+      continue;
+    }
+
+    // Stale temporary files are removed, the ones of stores in
+    // progress take space as well.
+    if (temp) {
+      if (now - time > STALE_TEMP_AGE) {
+        if (fs::remove(path, entryError)) {
+          stats_.staleTemps++;
+        }
+      } else {
+        total += size;
+      }
+      continue;
+    }
+
+    entries.push_back({path, size, time});
+    total += size;
+  }
+
+  if (!keep.empty()) {
+    auto size = fs::file_size(entryPath(keep), error);
+    if (!error) {
+      total += size;
+    }
+  }
+
+  if (total <= maxBytes_) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+  for (auto& entry : entries) {
+    if (total <= maxBytes_) {
+      break;
+    }
+
+    if (fs::remove(entry.path, error)) {
+      stats_.evictions++;
+    }
+    total -= entry.size;
+  }
+}
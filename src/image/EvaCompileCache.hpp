@@ -0,0 +1,114 @@
+/**
+ * Persistent compile cache.
+ */
+#ifndef SRC_IMAGE_EVACOMPILECACHE_HPP
+#define SRC_IMAGE_EVACOMPILECACHE_HPP
+
+#include "vm/EvaValue.hpp"
+#include "vm/Global.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Compile cache statistics.
+ */
+struct CompileCacheStats {
+  /**
+   * Lookups which loaded a cached image.
+   */
+  size_t hits = 0;
+
+  /**
+   * Lookups without an entry (the program is compiled).
+   */
+  size_t misses = 0;
+
+  /**
+   * Entries which failed to load (removed, counted as misses too).
+   */
+  size_t invalid = 0;
+
+  /**
+   * Entries written.
+   */
+  size_t stores = 0;
+
+  /**
+   * Entries removed to stay under the size limit.
+   */
+  size_t evictions = 0;
+
+  /**
+   * Temporary files of interrupted stores removed.
+   */
+  size_t staleTemps = 0;
+};
+
+/**
+ * Directory of bytecode images (see EvaImage) addressed by the hash
+ * of the source and of everything the compiled code depends on: the
+ * image version, the opcode sets, the compiler configuration and the
+ * globals defined before the program.
+ *
+ * The directory can be shared by processes: an entry is written to
+ * a temporary file and renamed into place, so it is either complete
+ * or absent, and read through a read-only mapping. The least recently
+ * used entries are removed when the directory grows over the limit.
+ * Temporary files count against it too, and the eviction removes the
+ * ones left for minutes by a process which crashed before the rename.
+ *
+ * The cache is best effort: if the directory can't be created or
+ * written, programs are compiled every time, and an entry which fails
+ * to load is removed and compiled again.
+ */
+class EvaCompileCache {
+  public:
+    static constexpr size_t DEFAULT_MAX_BYTES = 64 << 20;
+
+    EvaCompileCache(const std::string& dir, size_t maxBytes = DEFAULT_MAX_BYTES);
+
+    /**
+     * Key of the source compiled in the configuration (any string
+     * identifying the compiler settings) with the globals.
+     */
+    static std::string key(std::string_view source, std::string_view config, Global& global);
+
+    /**
+     * Loads the code objects of the entry (main first) into the
+     * current collector and defines its globals. Empty on a miss.
+     */
+    std::vector<CodeObject*> lookup(const std::string& key, Global& global);
+
+    /**
+     * Stores the image of the program and evicts old entries.
+     */
+    void store(const std::string& key, CodeObject* main, Global& global);
+
+    /**
+     * Removes stale temporary files, then the least recently used
+     * entries (except keep) while the entries and the temporary
+     * files take more than the limit.
+     */
+    void evict(const std::string& keep = "");
+
+    const std::string& getDir() const { return dir_; }
+
+    const CompileCacheStats& getStats() const { return stats_; }
+
+  private:
+    /**
+     * Path of the entry file.
+     */
+    std::string entryPath(const std::string& key) const;
+
+    std::string dir_;
+
+    size_t maxBytes_;
+
+    CompileCacheStats stats_;
+};
+
+#endif
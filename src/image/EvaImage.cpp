@@ -0,0 +1,810 @@
+#include "image/EvaImage.hpp"
+#include "vm/OpCode.hpp"
+#include "vm/RegOpCode.hpp"
+#include "logging/Logger.hpp"
+
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char MAGIC[4] = {'E', 'V', 'A', 'I'};
+
+/**
+ * Constant tags.
+ */
+enum ConstantTag : uint8_t {
+  TAG_NUMBER,
+  TAG_BOOLEAN,
+  TAG_STRING,
+  TAG_CODE,
+  TAG_FUNCTION,
+  TAG_INTEGER,
+};
+
+/**
+ * Code object of a CODE constant or of a FUNCTION constant (function
+ * without free variables created at compile time), nullptr otherwise.
+ */
+static CodeObject* constantCode(const EvaValue& constant) {
+  if (IS_CODE(constant)) {
+    return AS_CODE(constant);
+  } else if (IS_FUNCTION(constant)) {
+    return AS_FUNCTION(constant)->co;
+  }
+  return nullptr;
+}
+
+/**
+ * Appends image fields to a buffer.
+ */
+class ImageWriter {
+  public:
+    std::vector<uint8_t> data;
+
+    template <typename T>
+    void write(T value) { append(&value, sizeof(value)); }
+
+    void writeString(const std::string& string) {
+      write<uint32_t>(string.size());
+      append(string.data(), string.size());
+    }
+
+    void writeBytes(const std::vector<uint8_t>& bytes) {
+      write<uint32_t>(bytes.size());
+      append(bytes.data(), bytes.size());
+    }
+
+  private:
+    void append(const void* bytes, size_t count) {
+      auto begin = (const uint8_t*)bytes;
+      data.insert(data.end(), begin, begin + count);
+    }
+};
+
+/**
+ * Reads image fields, every read is bounds checked. The first failure
+ * is recorded, reads after it return zeros and empty strings.
+ */
+class ImageReader {
+  public:
+    ImageReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    template <typename T>
+    T read() {
+      T value{};
+      if (auto bytes = take(sizeof(T))) {
+        memcpy(&value, bytes, sizeof(T));
+      }
+      return value;
+    }
+
+    std::string readString() {
+      auto length = read<uint32_t>();
+      auto bytes = take(length);
+      return bytes == nullptr ? "" : std::string((const char*)bytes, length);
+    }
+
+    /**
+     * Count of the elements which follow: each takes a byte at least.
+     */
+    uint32_t readCount() {
+      auto count = read<uint32_t>();
+      if (count > size - offset) {
+        fail("Bad count " + std::to_string(count));
+        return 0;
+      }
+      return count;
+    }
+
+    /**
+     * Code object index.
+     */
+    uint32_t readCodeIndex(uint32_t codeCount) {
+      auto index = read<uint32_t>();
+      if (index >= codeCount) {
+        fail("Bad code constant " + std::to_string(index));
+        return 0;
+      }
+      return index;
+    }
+
+    /**
+     * Next count bytes, nullptr past the end of the image.
+     */
+    const uint8_t* take(size_t count) {
+      if (!ok()) {
+        return nullptr;
+      }
+
+      if (size - offset < count) {
+        fail("Truncated image");
+        return nullptr;
+      }
+
+      auto bytes = data + offset;
+      offset += count;
+      return bytes;
+    }
+
+    void fail(const std::string& message) {
+      if (ok()) {
+        error = message;
+      }
+    }
+
+    bool ok() const { return error.empty(); }
+
+    const std::string& getError() const { return error; }
+
+  private:
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+    std::string error;
+};
+
+/**
+ * Checks the bytecode of the loaded code objects before it runs: the
+ * interpreters and the JIT trust operands. Every opcode is known, every
+ * operand is in range (constants, globals, cells, locals or registers
+ * of the frame, slots of the defining frame), jumps land on instructions
+ * and control never runs past the end of the code. The first failure
+ * is recorded.
+ */
+class ImageVerifier {
+  public:
+    ImageVerifier(const std::vector<CodeObject*>& codeObjects, size_t globalsCount)
+      : codeObjects(codeObjects), globalsCount(globalsCount) {}
+
+    bool verify() {
+      // Defining code object of each function.
+      for (auto co : codeObjects) {
+        for (const auto& constant : co->constants) {
+          auto child = constantCode(constant);
+          if (child != nullptr && parents.count(child) == 0) {
+            parents[child] = co;
+          }
+        }
+      }
+
+      for (auto co : codeObjects) {
+        current = co;
+
+        // Arguments count of CALL is a byte.
+        if (co->arity > UINT8_MAX) {
+          fail("Bad arity " + std::to_string(co->arity));
+        } else if (co->cellNames.size() != co->freeCount) {
+          fail("Bad cells count");
+        } else if (co->code.empty()) {
+          fail("Empty code");
+        } else if (co->tier == ExecutionTier::STACK) {
+          verifyStack(co);
+        } else if (co->tier == ExecutionTier::REGISTER) {
+          verifyRegister(co);
+        } else {
+          fail("Bad execution tier");
+        }
+
+        if (!ok()) {
+          return false;
+        }
+      }
+
+      // Slots of the defining frame are known once it is verified.
+      for (auto [co, slots] : outerSlots) {
+        current = co;
+        auto parent = parents.find(co);
+
+        if (parent == parents.end() || slots > frameSlots[parent->second]) {
+          fail("Bad outer slot " + std::to_string(slots - 1));
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    const std::string& getError() const { return error; }
+
+  private:
+    /**
+     * Comparison operators (see compareValues).
+     */
+    static constexpr size_t COMPARE_OPS_COUNT = 6;
+
+    /**
+     * Stack tier: operands first, then the stack heights along the
+     * paths from the entry, which must agree where paths join.
+     */
+    void verifyStack(CodeObject* co) {
+      const auto& code = co->code;
+
+      // Instruction starts.
+      std::vector<bool> starts(code.size(), false);
+      for (size_t offset = 0; offset < code.size(); offset += bytecodeSizes[code[offset]]) {
+        if (code[offset] >= BYTECODES_COUNT) {
+          return fail("Unknown opcode " + std::to_string(code[offset]), offset);
+        }
+        if (bytecodeSizes[code[offset]] > code.size() - offset) {
+          return fail("Truncated instruction", offset);
+        }
+        starts[offset] = true;
+      }
+
+      std::vector<bool> targets(code.size(), false);
+      for (size_t offset = 0; offset < code.size(); offset += bytecodeSizes[code[offset]]) {
+        if (isJumpOpcode(code[offset])) {
+          auto target = readJumpAddress(&code[offset + 1], jumpAddressSize(code[offset]));
+          if (target >= code.size() || !starts[target]) {
+            return fail("Bad jump address " + std::to_string(target), offset);
+          }
+          targets[target] = true;
+        }
+      }
+
+      size_t previous = 0;
+      for (size_t offset = 0; offset < code.size() && ok();
+           previous = offset, offset += bytecodeSizes[code[offset]]) {
+        auto instruction = &code[offset];
+        auto opcode = instruction[0];
+
+        // The operator of JMP_IF_NOT_<op> is the opcode.
+        if (isJumpOpcode(opcode)) {
+          continue;
+        }
+
+        auto isWide = isWideOpcode(opcode);
+        auto index = indexOperand(instruction);
+
+        switch (isWide ? narrowOpcode(opcode) : opcode) {
+          case OP_CONST:
+            checkConstant(index, offset);
+            break;
+          case OP_GET_GLOBAL:
+          case OP_SET_GLOBAL:
+            checkGlobal(index, offset);
+            break;
+          case OP_GET_CELL:
+          case OP_SET_CELL:
+          case OP_LOAD_CELL:
+            checkCell(index, offset);
+            break;
+          case OP_GET_OUTER:
+          case OP_SET_OUTER:
+            outerSlots[co] = std::max(outerSlots[co], index + 1);
+            break;
+          case OP_CMP:
+          case OP_LT_NUM:
+          case OP_LT_INT:
+            if (index >= COMPARE_OPS_COUNT) {
+              fail("Bad comparison operator " + std::to_string(index), offset);
+            }
+            break;
+          case OP_ADD_LOCAL_CONST:
+            checkConstant(instruction[2], offset);
+            break;
+          case OP_CONST_SET_LOCAL:
+            checkConstant(instruction[1], offset);
+            break;
+
+          // The function is made of the code object pushed right before.
+          case OP_MAKE_FUNCTION: {
+            auto pushed = code[previous];
+            CodeObject* made = nullptr;
+
+            if (offset > 0 && (pushed == OP_CONST || pushed == OP_CONST_WIDE) && !targets[offset]) {
+              auto k = pushed == OP_CONST ? code[previous + 1] : (code[previous + 1] << 8) | code[previous + 2];
+              if (IS_CODE(co->constants[k])) {
+                made = AS_CODE(co->constants[k]);
+              }
+            }
+
+            if (made == nullptr || made->freeCount != index) {
+              fail("Bad function construction", offset);
+            }
+            break;
+          }
+        }
+      }
+
+      if (ok()) {
+        verifyStackHeights(co);
+      }
+    }
+
+    /**
+     * Follows the paths from the entry: values taken from the stack
+     * are there, locals are in the frame (the slot of a variable exists
+     * before its initializer is pushed, so the next slot counts), and
+     * heights agree at join points.
+     */
+    void verifyStackHeights(CodeObject* co) {
+      const auto& code = co->code;
+
+      // Function and arguments are below the stack of a function.
+      int32_t base = co == codeObjects[0] ? 0 : co->arity + 1;
+      int32_t maxHeight = 0;
+
+      std::vector<int32_t> heights(code.size(), -1);
+      std::vector<size_t> pending = {0};
+      heights[0] = 0;
+
+      auto flowTo = [&](size_t target, int32_t height, size_t offset) {
+        if (heights[target] < 0) {
+          heights[target] = height;
+          pending.push_back(target);
+        } else if (heights[target] != height) {
+          fail("Stack height mismatch at " + std::to_string(target), offset);
+        }
+      };
+
+      while (!pending.empty() && ok()) {
+        auto offset = pending.back();
+        pending.pop_back();
+
+        auto instruction = &code[offset];
+        auto opcode = instruction[0];
+        auto height = heights[offset];
+        auto effect = stackEffect(instruction);
+
+        if (base + height < effect.pops) {
+          return fail("Stack underflow", offset);
+        }
+
+        auto isWide = isWideOpcode(opcode);
+        auto index = indexOperand(instruction);
+        auto slots = (size_t)(base + height);
+
+        switch (isWide ? narrowOpcode(opcode) : opcode) {
+          case OP_GET_LOCAL:
+          case OP_SET_LOCAL:
+          case OP_CAPTURE_LOCAL:
+          case OP_SET_LOCAL_POP:
+          case OP_ADD_LOCAL_CONST:
+            checkLocal(index, slots, offset);
+            break;
+          case OP_ADD_LOCAL_LOCAL:
+            checkLocal(instruction[1], slots, offset);
+            checkLocal(instruction[2], slots, offset);
+            break;
+          case OP_CONST_SET_LOCAL:
+            checkLocal(instruction[2], slots, offset);
+            break;
+        }
+
+        maxHeight = std::max(maxHeight, height + effect.peak);
+        height += effect.delta;
+
+        if (isJumpOpcode(opcode)) {
+          flowTo(readJumpAddress(&instruction[1], jumpAddressSize(opcode)), height, offset);
+        }
+
+        if (opcode == OP_JMP || opcode == OP_JMP_WIDE || opcode == OP_HALT || opcode == OP_RETURN) {
+          continue;
+        }
+
+        auto next = offset + bytecodeSizes[opcode];
+        if (next == code.size()) {
+          return fail("Code runs past the end", offset);
+        }
+        flowTo(next, height, offset);
+      }
+
+      frameSlots[co] = base + maxHeight;
+    }
+
+    /**
+     * Register tier: operands by their kinds.
+     */
+    void verifyRegister(CodeObject* co) {
+      const auto& code = co->code;
+
+      if (co != codeObjects[0] && co->frameSize < co->arity + 1) {
+        return fail("Frame size " + std::to_string(co->frameSize) + " is too small");
+      }
+
+      std::vector<bool> starts(code.size(), false);
+      size_t last = 0;
+      for (size_t offset = 0; offset < code.size(); offset += regBytecodeSize(code[offset])) {
+        if (code[offset] >= REG_BYTECODES_COUNT) {
+          return fail("Unknown opcode " + std::to_string(code[offset]), offset);
+        }
+        if (regBytecodeSize(code[offset]) > code.size() - offset) {
+          return fail("Truncated instruction", offset);
+        }
+        starts[offset] = true;
+        last = offset;
+      }
+
+      if (code[last] != ROP_HALT && code[last] != ROP_RETURN &&
+          code[last] != ROP_JMP && code[last] != ROP_JMP_WIDE) {
+        return fail("Code runs past the end", last);
+      }
+
+      for (size_t offset = 0; offset < code.size() && ok(); offset += regBytecodeSize(code[offset])) {
+        auto opcode = code[offset];
+
+        // Operand values in the order of their kinds.
+        std::vector<size_t> operands;
+        auto operand = &code[offset + 1];
+
+        for (auto kind = regOpcodeOperands(opcode); *kind != '\0'; kind++) {
+          auto size = regOperandSize(*kind);
+          auto value = readJumpAddress(operand, size);
+          operand += size;
+          operands.push_back(value);
+
+          switch (*kind) {
+            case 'r':
+              if (value >= co->frameSize) {
+                fail("Bad register " + std::to_string(value), offset);
+              }
+              break;
+            case 'k':
+            case 'K':
+              checkConstant(value, offset);
+              break;
+            case 'g':
+            case 'G':
+              checkGlobal(value, offset);
+              break;
+            case 'l':
+              checkCell(value, offset);
+              break;
+            case 'c':
+              if (value >= COMPARE_OPS_COUNT) {
+                fail("Bad comparison operator " + std::to_string(value), offset);
+              }
+              break;
+            case 'j':
+            case 'J':
+              if (value >= code.size() || !starts[value]) {
+                fail("Bad jump address " + std::to_string(value), offset);
+              }
+              break;
+            case 'o':
+              outerSlots[co] = std::max(outerSlots[co], value + 1);
+              break;
+          }
+        }
+
+        if (!ok()) {
+          break;
+        }
+
+        // Arguments follow the callee register.
+        if (opcode == ROP_CALL && operands[0] + operands[1] >= co->frameSize) {
+          fail("Bad arguments count " + std::to_string(operands[1]), offset);
+        }
+
+        // rA = function(K[index]) capturing cells rC..rC+N.
+        if (opcode == ROP_MAKE_FUNCTION || opcode == ROP_MAKE_FUNCTION_WIDE) {
+          auto& constant = co->constants[operands[1]];
+          if (!IS_CODE(constant) || AS_CODE(constant)->freeCount != operands[3] ||
+              operands[2] + operands[3] > co->frameSize) {
+            fail("Bad function construction", offset);
+          }
+        }
+      }
+
+      frameSlots[co] = co->frameSize;
+    }
+
+    void checkConstant(size_t index, size_t offset) {
+      if (index >= current->constants.size()) {
+        fail("Bad constant " + std::to_string(index), offset);
+      }
+    }
+
+    void checkGlobal(size_t index, size_t offset) {
+      if (index >= globalsCount) {
+        fail("Bad global " + std::to_string(index), offset);
+      }
+    }
+
+    void checkCell(size_t index, size_t offset) {
+      if (index >= current->cellNames.size()) {
+        fail("Bad cell " + std::to_string(index), offset);
+      }
+    }
+
+    void checkLocal(size_t index, size_t slots, size_t offset) {
+      if (index > slots) {
+        fail("Bad local " + std::to_string(index), offset);
+      }
+    }
+
+    void fail(const std::string& message, size_t offset) {
+      fail(message + " at " + std::to_string(offset));
+    }
+
+    void fail(const std::string& message) {
+      if (ok()) {
+        error = message + " in " + current->name;
+      }
+    }
+
+    /**
+     * First operand of the stack instruction (a wide index is 2 bytes).
+     */
+    static size_t indexOperand(const uint8_t* instruction) {
+      auto opcode = instruction[0];
+      if (isWideOpcode(opcode)) {
+        return (instruction[1] << 8) | instruction[2];
+      }
+      return bytecodeSizes[opcode] > 1 ? instruction[1] : 0;
+    }
+
+    bool ok() const { return error.empty(); }
+
+    const std::vector<CodeObject*>& codeObjects;
+    size_t globalsCount;
+
+    CodeObject* current = nullptr;
+    std::unordered_map<CodeObject*, CodeObject*> parents;
+
+    /**
+     * Slots a frame of the code object spans at most, and the slots
+     * of the defining frame its outer operands need.
+     */
+    std::unordered_map<CodeObject*, size_t> frameSlots;
+    std::unordered_map<CodeObject*, size_t> outerSlots;
+
+    std::string error;
+};
+
+std::vector<uint8_t> EvaImage::serialize(CodeObject* main, Global& global) {
+  // Code objects reachable from main, in the order of discovery.
+  std::vector<CodeObject*> codeObjects = {main};
+  std::unordered_map<CodeObject*, uint32_t> indices = {{main, 0}};
+
+  for (size_t i = 0; i < codeObjects.size(); i++) {
+    for (const auto& constant : codeObjects[i]->constants) {
+      auto co = constantCode(constant);
+      if (co != nullptr && indices.count(co) == 0) {
+        indices[co] = codeObjects.size();
+        codeObjects.push_back(co);
+      }
+    }
+  }
+
+  ImageWriter writer;
+
+  for (auto c : MAGIC) {
+    writer.write(c);
+  }
+  writer.write<uint32_t>(VERSION);
+  writer.write<uint32_t>(BYTECODES_COUNT);
+  writer.write<uint32_t>(REG_BYTECODES_COUNT);
+
+  writer.write<uint32_t>(global.size());
+  for (size_t i = 0; i < global.size(); i++) {
+    writer.writeString(global.get(i).name);
+  }
+
+  writer.write<uint32_t>(codeObjects.size());
+  for (auto co : codeObjects) {
+    writer.writeString(co->name);
+    writer.write<uint32_t>(co->arity);
+    writer.write<uint8_t>((uint8_t)co->tier);
+    writer.write<uint32_t>(co->frameSize);
+    writer.write<uint32_t>(co->freeCount);
+
+    writer.write<uint32_t>(co->cellNames.size());
+    for (const auto& name : co->cellNames) {
+      writer.writeString(name);
+    }
+
+    writer.writeBytes(co->code);
+
+    writer.write<uint32_t>(co->constants.size());
+    for (const auto& constant : co->constants) {
+      if (IS_NUMBER(constant)) {
+        writer.write<uint8_t>(TAG_NUMBER);
+        writer.write<double>(AS_NUMBER(constant));
+      } else if (IS_INTEGER(constant)) {
+        writer.write<uint8_t>(TAG_INTEGER);
+        writer.write<int64_t>(AS_INTEGER(constant));
+      } else if (IS_BOOLEAN(constant)) {
+        writer.write<uint8_t>(TAG_BOOLEAN);
+        writer.write<uint8_t>(AS_BOOLEAN(constant));
+      } else if (IS_STRING(constant)) {
+        writer.write<uint8_t>(TAG_STRING);
+        writer.writeString(AS_CPPSTRING(constant));
+      } else if (IS_CODE(constant)) {
+        writer.write<uint8_t>(TAG_CODE);
+        writer.write<uint32_t>(indices[AS_CODE(constant)]);
+      } else if (IS_FUNCTION(constant)) {
+        writer.write<uint8_t>(TAG_FUNCTION);
+        writer.write<uint32_t>(indices[AS_FUNCTION(constant)->co]);
+      } else {
+        DIE << "[EvaImage] Unsupported constant: " << constant;
+      }
+    }
+  }
+
+  return writer.data;
+}
+
+void EvaImage::write(const std::string& path, CodeObject* main, Global& global) {
+  auto image = serialize(main, global);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write((const char*)image.data(), image.size());
+
+  if (!file) {
+    DIE << "[EvaImage] Cannot write " << path;
+  }
+}
+
+std::vector<CodeObject*> EvaImage::load(const std::string& path, Global& global) {
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    DIE << "[EvaImage] Cannot open " << path;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    DIE << "[EvaImage] Empty image " << path;
+  }
+
+  auto size = (size_t)info.st_size;
+  auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    DIE << "[EvaImage] Cannot map " << path;
+  }
+
+  auto codeObjects = load((const uint8_t*)data, size, global);
+  munmap(data, size);
+
+  return codeObjects;
+}
+
+std::vector<CodeObject*> EvaImage::load(const uint8_t* data, size_t size, Global& global) {
+  std::string error;
+  auto codeObjects = tryLoad(data, size, global, error);
+
+  if (!codeObjects) {
+    DIE << "[EvaImage] " << error;
+  }
+
+  return *codeObjects;
+}
+
+std::optional<std::vector<CodeObject*>> EvaImage::tryLoad(const uint8_t* data, size_t size,
+                                                          Global& global, std::string& error) {
+  return read(data, size, global, error, true);
+}
+
+std::vector<CodeObject*> EvaImage::loadForDisassembly(const uint8_t* data, size_t size,
+                                                      Global& global) {
+  std::string error;
+  auto codeObjects = read(data, size, global, error, false);
+
+  if (!codeObjects) {
+    DIE << "[EvaImage] " << error;
+  }
+
+  return *codeObjects;
+}
+
+std::optional<std::vector<CodeObject*>> EvaImage::read(const uint8_t* data, size_t size,
+                                                       Global& global, std::string& error,
+                                                       bool verify) {
+  ImageReader reader(data, size);
+
+  auto magic = reader.take(sizeof(MAGIC));
+  if (magic == nullptr || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    error = "Not an image";
+    return std::nullopt;
+  }
+
+  auto version = reader.read<uint32_t>();
+  auto bytecodesCount = reader.read<uint32_t>();
+  auto regBytecodesCount = reader.read<uint32_t>();
+
+  if (version != VERSION || bytecodesCount != BYTECODES_COUNT ||
+      regBytecodesCount != REG_BYTECODES_COUNT) {
+    error = "Incompatible image version " + std::to_string(version);
+    return std::nullopt;
+  }
+
+  // Globals are defined once the whole image is read.
+  auto globalsCount = reader.readCount();
+  std::vector<std::string> globalNames;
+  for (uint32_t i = 0; i < globalsCount && reader.ok(); i++) {
+    globalNames.push_back(reader.readString());
+  }
+
+  auto codeCount = reader.readCount();
+  if (reader.ok() && codeCount == 0) {
+    reader.fail("No main function");
+  }
+
+  // Code objects are allocated up front for the CODE constants.
+  std::vector<CodeObject*> codeObjects;
+  codeObjects.reserve(codeCount);
+  for (uint32_t i = 0; i < codeCount; i++) {
+    codeObjects.push_back(AS_CODE(ALLOC_CODE("", 0)));
+  }
+
+  for (auto co : codeObjects) {
+    co->name = reader.readString();
+    co->arity = reader.read<uint32_t>();
+    co->tier = (ExecutionTier)reader.read<uint8_t>();
+    co->frameSize = reader.read<uint32_t>();
+    co->freeCount = reader.read<uint32_t>();
+
+    auto cellsCount = reader.readCount();
+    for (uint32_t i = 0; i < cellsCount && reader.ok(); i++) {
+      co->cellNames.push_back(reader.readString());
+    }
+
+    auto codeSize = reader.read<uint32_t>();
+    if (auto code = reader.take(codeSize)) {
+      co->code.assign(code, code + codeSize);
+    }
+
+    auto constantsCount = reader.readCount();
+    co->constants.reserve(constantsCount);
+
+    for (uint32_t i = 0; i < constantsCount && reader.ok(); i++) {
+      switch (reader.read<uint8_t>()) {
+        case TAG_NUMBER:
+          co->addConst(NUMBER(reader.read<double>()));
+          break;
+        case TAG_INTEGER:
+          co->addConst(INTEGER(reader.read<int64_t>()));
+          break;
+        case TAG_BOOLEAN:
+          co->addConst(BOOLEAN(reader.read<uint8_t>()));
+          break;
+        case TAG_STRING:
+          co->addConst(ALLOC_STRING(reader.readString()));
+          break;
+        case TAG_CODE:
+          co->addConst(OBJECT(codeObjects[reader.readCodeIndex(codeCount)]));
+          break;
+        case TAG_FUNCTION:
+          co->addConst(ALLOC_FUNCTION(codeObjects[reader.readCodeIndex(codeCount)]));
+          break;
+        default:
+          reader.fail("Bad constant tag");
+      }
+    }
+
+    if (!reader.ok()) {
+      break;
+    }
+  }
+
+  if (!reader.ok()) {
+    error = reader.getError();
+    return std::nullopt;
+  }
+
+  ImageVerifier verifier(codeObjects, globalNames.size());
+  if (verify && !verifier.verify()) {
+    error = verifier.getError();
+    return std::nullopt;
+  }
+
+  // Globals keep their indices: natives and constants of the VM are
+  // already defined, the rest is defined in order.
+  for (uint32_t i = 0; i < globalNames.size(); i++) {
+    global.define(globalNames[i]);
+
+    if (global.getGlobalIndex(globalNames[i]) != (int)i) {
+      error = "Global " + globalNames[i] + " has a different index in the VM";
+      return std::nullopt;
+    }
+  }
+
+  return codeObjects;
+}
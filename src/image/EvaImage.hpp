@@ -0,0 +1,83 @@
+/**
+ * Bytecode image: compiled program on disk.
+ */
+#ifndef SRC_IMAGE_EVAIMAGE_HPP
+#define SRC_IMAGE_EVAIMAGE_HPP
+
+#include "vm/EvaValue.hpp"
+#include "vm/Global.hpp"
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Image layout (little-endian, strings are u32 length + bytes):
+ *
+ *   header:    "EVAI", u32 version, u32 stack opcodes count,
+ *              u32 register opcodes count
+ *   globals:   u32 count, names in the order of their indices
+ *   code:      u32 count, code objects (main first):
+ *                name, u32 arity, u8 tier, u32 frame size,
+ *                u32 free count, u32 count + cell names,
+ *                u32 size + bytecode,
+ *                u32 count + constants (u8 tag + value):
+ *                  NUMBER f64, BOOLEAN u8, STRING string,
+ *                  CODE u32 index of the code object,
+ *                  FUNCTION u32 index of the code object
+ *
+ * Images depend on the opcode numbering only: the version and the
+ * opcode counts must match the VM which loads them. The bytecode is
+ * verified when it is loaded (opcodes, operands, jumps and stack
+ * heights).
+ */
+class EvaImage {
+  public:
+    static constexpr uint32_t VERSION = 4;
+
+    /**
+     * Serializes main and all code objects reachable from its
+     * constants, with the names of the globals.
+     */
+    static std::vector<uint8_t> serialize(CodeObject* main, Global& global);
+
+    /**
+     * Writes the image of the program to the file.
+     */
+    static void write(const std::string& path, CodeObject* main, Global& global);
+
+    /**
+     * Maps the image file and loads it (see below).
+     */
+    static std::vector<CodeObject*> load(const std::string& path, Global& global);
+
+    /**
+     * Allocates code objects of the image (main first) in the current
+     * collector and defines its globals, which must get the same
+     * indices as in the image.
+     */
+    static std::vector<CodeObject*> load(const uint8_t* data, size_t size, Global& global);
+
+    /**
+     * Loads the image as load does, but a truncated, corrupt (including
+     * bytecode which fails verification) or incompatible image is not fatal: returns nothing and the error.
+     */
+    static std::optional<std::vector<CodeObject*>> tryLoad(const uint8_t* data, size_t size,
+                                                           Global& global, std::string& error);
+
+    /**
+     * Loads the image as load does without verifying the bytecode: for
+     * code which is disassembled and not run (traced code objects, see
+     * EvaTraceDecoder, whose main is any traced function).
+     */
+    static std::vector<CodeObject*> loadForDisassembly(const uint8_t* data, size_t size,
+                                                       Global& global);
+
+  private:
+    static std::optional<std::vector<CodeObject*>> read(const uint8_t* data, size_t size,
+                                                        Global& global, std::string& error,
+                                                        bool verify);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "isolate/EvaIsolatePool.hpp"
+#include "vm/EvaVM.hpp"
+
+EvaIsolatePool::EvaIsolatePool(std::shared_ptr<const EvaProgram> program, size_t threads)
+    : program_(program) {
+  if (threads == 0) {
+    DIE << "[EvaIsolatePool] At least one thread is needed";
+  }
+
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; i++) {
+    threads_.emplace_back(&EvaIsolatePool::work, this);
+  }
+}
+
+EvaIsolatePool::~EvaIsolatePool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  available_.notify_all();
+
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void EvaIsolatePool::enqueue(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(task));
+  }
+  available_.notify_one();
+}
+
+void EvaIsolatePool::work() {
+  // The VM is large (stacks are inline), keep it off the thread stack.
+  auto vm = std::make_unique<EvaVM>(program_->getTier());
+  vm->exec(*program_);
+
+  while (true) {
+    Task task;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      available_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+
+      if (queue_.empty()) {
+        return;
+      }
+
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    task(*vm);
+  }
+}
@@ -0,0 +1,88 @@
+/**
+ * Thread pool of isolates.
+ */
+#ifndef SRC_ISOLATE_EVAISOLATEPOOL_HPP
+#define SRC_ISOLATE_EVAISOLATEPOOL_HPP
+
+#include "isolate/EvaProgram.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class EvaVM;
+
+/**
+ * Runs tasks on a fixed number of threads. Each thread owns an
+ * isolate: a VM of its own which executed the shared program once
+ * when the thread started. A task gets the VM of the thread it runs on:
+ *
+ *   EvaIsolatePool pool(program, 4);
+ *   auto result = pool.submit([](EvaVM& vm) {
+ *     return TO_NUMBER(vm.call("handler", {INTEGER(1)}));
+ *   });
+ *   result.get();
+ *
+ * Values of an isolate heap must not leave the task: results are plain
+ * C++ values (numbers, copies of strings).
+ */
+class EvaIsolatePool final {
+  public:
+    using Task = std::function<void(EvaVM&)>;
+
+    EvaIsolatePool(std::shared_ptr<const EvaProgram> program, size_t threads);
+
+    /**
+     * Runs the tasks left in the queue, then joins the threads.
+     */
+    ~EvaIsolatePool();
+
+    EvaIsolatePool(const EvaIsolatePool&) = delete;
+    EvaIsolatePool& operator=(const EvaIsolatePool&) = delete;
+
+    /**
+     * Queues the task, the future gets its result.
+     */
+    template <typename F>
+    auto submit(F task) -> std::future<decltype(task(std::declval<EvaVM&>()))> {
+      using Result = decltype(task(std::declval<EvaVM&>()));
+
+      auto packaged = std::make_shared<std::packaged_task<Result(EvaVM&)>>(std::move(task));
+      auto future = packaged->get_future();
+
+      enqueue([packaged](EvaVM& vm) { (*packaged)(vm); });
+      return future;
+    }
+
+    /**
+     * Amount of threads (isolates).
+     */
+    size_t size() const { return threads_.size(); }
+
+  private:
+    void enqueue(Task task);
+
+    /**
+     * Thread body: creates the isolate and runs the tasks.
+     */
+    void work();
+
+    std::shared_ptr<const EvaProgram> program_;
+
+    std::vector<std::thread> threads_;
+
+    std::deque<Task> queue_;
+
+    std::mutex mutex_;
+
+    std::condition_variable available_;
+
+    bool stopping_ = false;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#include "isolate/EvaProgram.hpp"
+#include "vm/EvaVM.hpp"
+
+EvaProgram::EvaProgram(const std::string& source, ExecutionTier tier) : tier_(tier) {
+  // Compiled with the globals (natives) every VM defines, the objects
+  // of the program are allocated in its own heap.
+  EvaVM vm(tier);
+  EvaCollector::Scope gcScope(&collector_);
+
+  vm.compileProgram(source);
+  codeObjects_ = vm.compiler->getCodeObjects();
+
+  for (size_t i = 0; i < vm.global->size(); i++) {
+    globalNames_.push_back(vm.global->get(i).name);
+  }
+
+  freeze();
+}
+
+void EvaProgram::freeze() {
+  for (auto co : codeObjects_) {
+    co->shared = true;
+
+    for (auto& constant : co->constants) {
+      if (!IS_OBJECT(constant)) {
+        continue;
+      }
+
+      // Strings are interned in the heap of the program only: the
+      // VMs compare them by value.
+      if (IS_STRING(constant)) {
+        AS_STRING(constant)->interned = false;
+      }
+
+      AS_OBJECT(constant)->shared = true;
+    }
+  }
+}
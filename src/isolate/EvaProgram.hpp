@@ -0,0 +1,60 @@
+/**
+ * Compiled program shared by isolates.
+ */
+#ifndef SRC_ISOLATE_EVAPROGRAM_HPP
+#define SRC_ISOLATE_EVAPROGRAM_HPP
+
+#include "vm/EvaValue.hpp"
+#include "gc/EvaCollector.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * Program compiled once and frozen: its code objects and constant
+ * pools are shared read-only by VMs on any number of threads (see
+ * EvaVM::exec(const EvaProgram&)), each VM keeps its own stack,
+ * globals and heap. Frozen objects are outside of the VM heaps, the
+ * collectors of the VMs do not mark or free them.
+ *
+ * The JIT patches the code objects it compiles, so the frozen code
+ * runs in the interpreter of its tier.
+ */
+class EvaProgram final {
+  public:
+    EvaProgram(const std::string& source, ExecutionTier tier = ExecutionTier::STACK);
+
+    EvaProgram(const EvaProgram&) = delete;
+    EvaProgram& operator=(const EvaProgram&) = delete;
+
+    /**
+     * Code objects, the one of the main function first.
+     */
+    const std::vector<CodeObject*>& getCodeObjects() const { return codeObjects_; }
+
+    /**
+     * Names of the globals, in the order of their indices in the code.
+     */
+    const std::vector<std::string>& getGlobalNames() const { return globalNames_; }
+
+    ExecutionTier getTier() const { return tier_; }
+
+  private:
+    /**
+     * Marks the code objects and their constants shared.
+     */
+    void freeze();
+
+    /**
+     * Owns the frozen objects, never collects.
+     */
+    EvaCollector collector_;
+
+    ExecutionTier tier_;
+
+    std::vector<CodeObject*> codeObjects_;
+
+    std::vector<std::string> globalNames_;
+};
+
+#endif
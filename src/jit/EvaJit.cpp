@@ -0,0 +1,1013 @@
+/**
+ * Baseline JIT: one x86-64 code template per stack opcode.
+ *
+ * Register assignment of the compiled code:
+ *
+ *   rbx - EvaVM (first argument)
+ *   r12 - stack pointer (sp of the VM)
+ *   r13 - base pointer (bp of the VM)
+ *
+ * sp is written back to the VM before every call into the VM and both
+ * pointers are reloaded after it, since the call may push, pop or
+ * switch frames. Everything else (ip, fn, call frames) lives in the VM
+ * as in the interpreter.
+ */
+
+#include "jit/EvaJit.hpp"
+#include "vm/EvaVM.hpp"
+
+#define OPCODE(op) OP_##op
+#include "vm/InterpreterMacros.hpp"
+
+#include <algorithm>
+
+#if EVA_JIT
+#include "jit/X64Assembler.hpp"
+
+#include <cstddef>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Operations compiled code calls into the VM for, with the
+ * calling convention of JitFunction plus one operand.
+ */
+struct JitHelpers {
+  /**
+   * Return address of frames called from compiled code: returns of
+   * interpreted callees land on HALT, which exits the interpreter
+   * back to the compiled caller.
+   */
+  static uint8_t exitCode[];
+
+  static void add(EvaVM* vm, uint32_t) {
+    auto op2 = vm->pop();
+    auto op1 = vm->pop();
+
+    if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {
+      vm->push(addNumbers(op1, op2));
+    } else if (IS_STRING(op1) && IS_STRING(op2)) {
+      auto string = AS_CPPSTRING(op1) + AS_CPPSTRING(op2);
+      vm->maybeGC();
+      vm->push(ALLOC_STRING(string));
+    } else {
+      DIE << "Incompatible types in addition \n";
+    }
+  }
+
+  static void arithmetic(EvaVM* vm, uint32_t opcode) {
+    auto op2 = vm->pop();
+    auto op1 = vm->pop();
+
+    switch (opcode) {
+      case OP_SUB:
+        vm->push(subtractNumbers(op1, op2));
+        break;
+      case OP_MUL:
+        vm->push(multiplyNumbers(op1, op2));
+        break;
+      default:
+        vm->push(divideNumbers(op1, op2));
+        break;
+    }
+  }
+
+  static bool compare(EvaVM* vm, uint32_t op) {
+    auto op2 = vm->pop();
+    auto op1 = vm->pop();
+
+    if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {
+      return compareNumbers(op, op1, op2);
+    } else if (IS_STRING(op1) && IS_STRING(op2)) {
+      return compareStrings(op, AS_STRING(op1), AS_STRING(op2));
+    }
+
+    DIE << "Incompatible types in comparison \n";
+    return false;
+  }
+
+  static void cmp(EvaVM* vm, uint32_t op) {
+    vm->push(BOOLEAN(compare(vm, op)));
+  }
+
+  static void getGlobal(EvaVM* vm, uint32_t globalIndex) {
+    vm->push(vm->global->get(globalIndex).value);
+  }
+
+  static void setGlobal(EvaVM* vm, uint32_t globalIndex) {
+    auto value = vm->peek();
+    vm->global->set(globalIndex, value);
+  }
+
+  static void getOuter(EvaVM* vm, uint32_t localIndex) {
+    vm->push((vm->csp - 1)->bp[localIndex]);
+  }
+
+  static void setOuter(EvaVM* vm, uint32_t localIndex) {
+    (vm->csp - 1)->bp[localIndex] = vm->peek(0);
+  }
+
+  static void getCell(EvaVM* vm, uint32_t cellIndex) {
+    vm->push(*vm->fn->cells[cellIndex]->location);
+  }
+
+  static void setCell(EvaVM* vm, uint32_t cellIndex) {
+    *vm->fn->cells[cellIndex]->location = vm->peek(0);
+  }
+
+  static void captureLocal(EvaVM* vm, uint32_t localIndex) {
+    vm->push(CELL(vm->captureCell(&vm->bp[localIndex])));
+  }
+
+  static void closeCells(EvaVM* vm, uint32_t vars) {
+    vm->closeCells(vm->sp - 1 - vars);
+  }
+
+  static void loadCell(EvaVM* vm, uint32_t cellIndex) {
+    vm->push(CELL(vm->fn->cells[cellIndex]));
+  }
+
+  static void makeFunction(EvaVM* vm, uint32_t cellsCount) {
+    auto co = AS_CODE(vm->pop());
+
+    vm->maybeGC();
+    auto fnValue = ALLOC_FUNCTION(co);
+    auto fn = AS_FUNCTION(fnValue);
+
+    fn->cells.resize(cellsCount);
+    for (auto i = cellsCount; i > 0; i--) {
+      fn->cells[i - 1] = AS_CELL(vm->pop());
+    }
+
+    vm->push(fnValue);
+  }
+
+  static void call(EvaVM* vm, uint32_t argc) {
+    auto fnValue = vm->peek(argc);
+
+    if (IS_NATIVE(fnValue)) {
+      vm->callNative(AS_NATIVE(fnValue));
+
+      auto result = vm->pop();
+      vm->popN(argc + 1);
+      vm->push(result);
+      return;
+    }
+
+    auto callee = AS_FUNCTION(fnValue);
+    vm->checkArity(callee, argc);
+
+    vm->ip = exitCode;
+    vm->pushFrame();
+
+    vm->fn = callee;
+    vm->bp = vm->sp - argc - 1;
+    vm->ip = &callee->co->code[0];
+    vm->traceCall(TraceEvent::CALL);
+
+    if (!vm->enterJit(callee->co)) {
+      vm->push(vm->eval());
+    }
+  }
+
+  static void ret(EvaVM* vm, uint32_t) {
+    vm->traceCall(TraceEvent::RETURN);
+    vm->popFrame();
+  }
+
+  static void stackOverflow(EvaVM* vm, uint32_t) {
+    DIE << "Stack overflow (limit: " << EvaVM::STACK_LIMIT << " slots)";
+  }
+};
+
+uint8_t JitHelpers::exitCode[] = { OP_HALT };
+
+#if EVA_JIT
+
+static constexpr int32_t VALUE_SIZE = sizeof(EvaValue);
+
+// Layout of EvaValue: a number is a double at PAYLOAD, its type tag
+// (tagged union only) is 0 at TYPE, an integer is an int64 at PAYLOAD
+// tagged INTEGER_TAG. The tag is written as a whole 8-byte word (with
+// the padding) to keep store forwarding to copies.
+#ifdef EVA_NAN_BOXING
+static constexpr int32_t PAYLOAD = 0;
+#else
+static constexpr int32_t PAYLOAD = offsetof(EvaValue, value);
+static constexpr int32_t TYPE = offsetof(EvaValue, type);
+
+static_assert(sizeof(EvaValueType) == 4 && (int)EvaValueType::NUMBER == 0,
+    "JIT templates test the type tag as a 32-bit zero");
+static_assert(TYPE == 0 && PAYLOAD == 8, "JIT templates expect the tag word first");
+
+static constexpr uint32_t INTEGER_TAG = (uint32_t)EvaValueType::INTEGER;
+#endif
+
+static_assert(VALUE_SIZE == 8 || VALUE_SIZE == 16, "Unexpected EvaValue size");
+
+/**
+ * Offset of the n-th value from the top of the stack (1 is TOS).
+ */
+static constexpr int32_t top(int32_t n) { return -VALUE_SIZE * n; }
+
+/**
+ * Offset of the local variable from the base pointer.
+ */
+static constexpr int32_t local(int32_t index) { return VALUE_SIZE * index; }
+
+/**
+ * Translates the bytecode of one code object.
+ */
+class TemplateCompiler {
+  public:
+    TemplateCompiler(CodeObject* co, int32_t spOffset, int32_t bpOffset, int32_t stackEndOffset,
+                     int32_t stackLimit)
+      : co(co),
+      spOffset(spOffset),
+      bpOffset(bpOffset),
+      stackEndOffset(stackEndOffset),
+      stackLimit(stackLimit),
+      labels(co->code.size() + 1, 0) {}
+
+    /**
+     * Generates the machine code, returns false on an unsupported opcode
+     * (or a function whose stack never fits, see maxStackHeight).
+     */
+    bool compile() {
+      for (size_t offset = 0; offset < co->code.size(); offset += bytecodeSizes[co->code[offset]]) {
+        auto opcode = co->code[offset];
+        capturesLocals = capturesLocals ||
+          opcode == OP_CAPTURE_LOCAL || opcode == OP_CAPTURE_LOCAL_WIDE;
+      }
+
+      // A frame which can't fit even an empty stack is left to the
+      // interpreter, which overflows only on the path it takes.
+      maxHeight = maxStackHeight();
+      if (maxHeight > stackLimit) {
+        return false;
+      }
+
+      prologue();
+
+      size_t offset = 0;
+      while (offset < co->code.size()) {
+        labels[offset] = as.size();
+
+        if (!compileInstruction(offset)) {
+          return false;
+        }
+
+        offset += bytecodeSizes[co->code[offset]];
+      }
+      labels[offset] = as.size();
+
+      for (const auto& [position, target] : jumps) {
+        as.patch(position, labels[target]);
+      }
+
+      return true;
+    }
+
+    const std::vector<uint8_t>& code() const { return as.code; }
+
+  private:
+    CodeObject* co;
+    int32_t spOffset;
+    int32_t bpOffset;
+    int32_t stackEndOffset;
+
+    /**
+     * Values the VM stack holds.
+     */
+    int32_t stackLimit;
+
+    X64Assembler as;
+
+    /**
+     * Machine code offsets of the instructions.
+     */
+    std::vector<size_t> labels;
+
+    /**
+     * Jumps to patch: displacement position and target bytecode offset.
+     */
+    std::vector<std::pair<size_t, size_t>> jumps;
+
+    /**
+     * Whether the function captures its locals (opens cells of its frame).
+     */
+    bool capturesLocals = false;
+
+    /**
+     * Highest stack height of the function above its entry sp.
+     */
+    int32_t maxHeight = 0;
+
+    uint8_t operand(size_t offset, size_t index) { return co->code[offset + 1 + index]; }
+
+    /**
+     * Index operand: one byte, or two for the wide form.
+     */
+    size_t index(size_t offset) {
+      if (isWideOpcode(co->code[offset])) {
+        return (size_t)((co->code[offset + 1] << 8) | co->code[offset + 2]);
+      }
+      return operand(offset, 0);
+    }
+
+    size_t address(size_t offset) {
+      return readJumpAddress(&co->code[offset + 1], jumpAddressSize(co->code[offset]));
+    }
+
+    bool compileInstruction(size_t offset) {
+      auto opcode = co->code[offset];
+
+      // Wide forms compile as the one-byte ones (see index).
+      if (isWideOpcode(opcode)) {
+        opcode = narrowOpcode(opcode);
+      }
+
+      switch (opcode) {
+        case OP_HALT:
+          syncOut();
+          epilogue();
+          return true;
+
+        case OP_CONST:
+          pushConst(index(offset));
+          return true;
+
+        // Quickened sites compile as the generic instruction: the
+        // template has its own number fast paths.
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_STR:
+        case OP_ADD_INT:
+          add();
+          return true;
+
+        case OP_SUB:
+          arithmetic(OP_SUB);
+          return true;
+
+        case OP_MUL:
+          arithmetic(OP_MUL);
+          return true;
+
+        case OP_DIV:
+          arithmetic(OP_DIV);
+          return true;
+
+        case OP_CMP:
+        case OP_LT_NUM:
+        case OP_LT_INT:
+          callHelper((void*)&JitHelpers::cmp, operand(offset, 0));
+          return true;
+
+        case OP_JMP:
+        case OP_JMP_WIDE:
+          jumpTo(as.jmp(), address(offset));
+          return true;
+
+        case OP_JMP_IF_FALSE:
+        case OP_JMP_IF_FALSE_WIDE:
+          jumpIfFalse(address(offset));
+          return true;
+
+        case OP_GET_GLOBAL:
+          callHelper((void*)&JitHelpers::getGlobal, index(offset));
+          return true;
+
+        case OP_SET_GLOBAL:
+          callHelper((void*)&JitHelpers::setGlobal, index(offset));
+          return true;
+
+        case OP_POP:
+          as.subImm(R12, VALUE_SIZE);
+          return true;
+
+        case OP_SET_LOCAL:
+          copyValue(R13, local(index(offset)), R12, top(1));
+          return true;
+
+        case OP_GET_LOCAL:
+          pushLocal(index(offset));
+          return true;
+
+        case OP_SCOPE_EXIT: {
+          auto vars = (int32_t)index(offset);
+
+          // Only the function itself opens cells of its frame.
+          if (capturesLocals) {
+            callHelper((void*)&JitHelpers::closeCells, vars);
+          }
+
+          copyValue(R12, top(vars + 1), R12, top(1));
+          as.subImm(R12, VALUE_SIZE * vars);
+          return true;
+        }
+
+        case OP_CALL:
+          callHelper((void*)&JitHelpers::call, operand(offset, 0));
+          return true;
+
+        case OP_RETURN:
+          syncOut();
+          as.mov(RDI, RBX);
+          as.movImm64(RAX, (uint64_t)&JitHelpers::ret);
+          as.call(RAX);
+          epilogue();
+          return true;
+
+        case OP_GET_OUTER:
+          callHelper((void*)&JitHelpers::getOuter, index(offset));
+          return true;
+
+        case OP_SET_OUTER:
+          callHelper((void*)&JitHelpers::setOuter, index(offset));
+          return true;
+
+        case OP_SET_CELL:
+          callHelper((void*)&JitHelpers::setCell, index(offset));
+          return true;
+
+        case OP_GET_CELL:
+          callHelper((void*)&JitHelpers::getCell, index(offset));
+          return true;
+
+        case OP_LOAD_CELL:
+          callHelper((void*)&JitHelpers::loadCell, index(offset));
+          return true;
+
+        case OP_CAPTURE_LOCAL:
+          callHelper((void*)&JitHelpers::captureLocal, index(offset));
+          return true;
+
+        case OP_MAKE_FUNCTION:
+          callHelper((void*)&JitHelpers::makeFunction, operand(offset, 0));
+          return true;
+
+        case OP_JMP_IF_NOT_LT:
+        case OP_JMP_IF_NOT_GT:
+        case OP_JMP_IF_NOT_EQ:
+        case OP_JMP_IF_NOT_GE:
+        case OP_JMP_IF_NOT_LE:
+        case OP_JMP_IF_NOT_NE:
+          compareAndJump(opcode - OP_JMP_IF_NOT_LT, address(offset));
+          return true;
+
+        case OP_ADD_LOCAL_LOCAL:
+          pushLocal(operand(offset, 0));
+          pushLocal(operand(offset, 1));
+          add();
+          return true;
+
+        case OP_CONST_SET_LOCAL:
+          pushConst(operand(offset, 0));
+          copyValue(R13, local(operand(offset, 1)), R12, top(1));
+          return true;
+
+        case OP_SET_LOCAL_POP:
+          copyValue(R13, local(operand(offset, 0)), R12, top(1));
+          as.subImm(R12, VALUE_SIZE);
+          return true;
+
+        case OP_ADD_LOCAL_CONST:
+          pushLocal(operand(offset, 0));
+          pushConst(operand(offset, 1));
+          add();
+          return true;
+
+        default:
+          return false;
+      }
+    }
+
+    /**
+     * Stack height the function reaches, following the jumps from the
+     * entry: heights agree at join points, so every instruction is
+     * visited once.
+     */
+    int32_t maxStackHeight() {
+      std::vector<bool> visited(co->code.size(), false);
+      std::vector<std::pair<size_t, int32_t>> pending = {{0, 0}};
+      int32_t result = 0;
+
+      while (!pending.empty()) {
+        auto [offset, height] = pending.back();
+        pending.pop_back();
+
+        while (offset < co->code.size() && !visited[offset]) {
+          visited[offset] = true;
+
+          auto opcode = co->code[offset];
+          auto effect = stackEffect(&co->code[offset]);
+          result = std::max(result, height + effect.peak);
+          height += effect.delta;
+
+          if (isJumpOpcode(opcode)) {
+            pending.push_back({address(offset), height});
+          }
+
+          if (opcode == OP_JMP || opcode == OP_JMP_WIDE ||
+              opcode == OP_HALT || opcode == OP_RETURN) {
+            break;
+          }
+
+          offset += bytecodeSizes[opcode];
+        }
+      }
+
+      return result;
+    }
+
+    /**
+     * Saves callee-saved registers, loads the VM state and checks the
+     * value stack has room for the highest stack of the function.
+     */
+    void prologue() {
+      as.push(RBX);
+      as.push(R12);
+      as.push(R13);
+
+      as.mov(RBX, RDI);
+      syncIn();
+
+      // Inline pushes don't check the stack (see maxStackHeight).
+      as.mov(RAX, R12);
+      as.addImm(RAX, VALUE_SIZE * maxHeight);
+      as.mov(RDX, RBX);
+      as.addImm(RDX, stackEndOffset);
+      as.cmpReg(RAX, RDX);
+      auto fits = as.jcc(COND_BE);
+      callHelper((void*)&JitHelpers::stackOverflow, 0);
+      as.bind(fits);
+    }
+
+    void epilogue() {
+      as.pop(R13);
+      as.pop(R12);
+      as.pop(RBX);
+      as.ret();
+    }
+
+    void syncOut() { as.store(RBX, spOffset, R12); }
+
+    void syncIn() {
+      as.load(R12, RBX, spOffset);
+      as.load(R13, RBX, bpOffset);
+    }
+
+    /**
+     * Calls JitHelper(vm, operand) with the VM state synced.
+     */
+    void callHelper(void* helper, uint32_t operand) {
+      syncOut();
+      as.mov(RDI, RBX);
+      as.movImm32(RSI, operand);
+      as.movImm64(RAX, (uint64_t)helper);
+      as.call(RAX);
+      syncIn();
+    }
+
+    void jumpTo(size_t position, size_t target) {
+      jumps.push_back({position, target});
+    }
+
+    /**
+     * Copies a value by 8-byte words: the type tag and the payload are
+     * written separately, so a wider load would miss store forwarding.
+     */
+    void copyValue(Reg dstBase, int32_t dst, Reg srcBase, int32_t src) {
+      as.load(RAX, srcBase, src);
+      if (VALUE_SIZE == 16) {
+        as.load(RCX, srcBase, src + 8);
+      }
+
+      as.store(dstBase, dst, RAX);
+      if (VALUE_SIZE == 16) {
+        as.store(dstBase, dst + 8, RCX);
+      }
+    }
+
+    void pushLocal(size_t index) {
+      copyValue(R12, 0, R13, local(index));
+      as.addImm(R12, VALUE_SIZE);
+    }
+
+    /**
+     * Constants are immutable after compilation: embedded as immediates.
+     */
+    void pushConst(size_t index) {
+      auto& value = co->constants[index];
+
+#ifdef EVA_NAN_BOXING
+      as.movImm64(RAX, value.bits);
+      as.store(R12, 0, RAX);
+#else
+      uint64_t payload;
+      memcpy(&payload, &value.value, sizeof(payload));
+
+      as.storeImm(R12, TYPE, (int32_t)value.type);
+      as.movImm64(RAX, payload);
+      as.store(R12, PAYLOAD, RAX);
+#endif
+
+      as.addImm(R12, VALUE_SIZE);
+    }
+
+    /**
+     * Jumps to the slow path (positions appended) unless the value at
+     * the stack offset is a number.
+     */
+    void checkNumber(int32_t offset, std::vector<size_t>& slowPath) {
+#ifdef EVA_NAN_BOXING
+      as.load(RAX, R12, offset);
+      as.movImm64(RDX, QNAN);
+      as.andReg(RAX, RDX);
+      as.cmpReg(RAX, RDX);
+      slowPath.push_back(as.jcc(COND_E));
+#else
+      as.cmpImm32(R12, offset + TYPE, 0);
+      slowPath.push_back(as.jcc(COND_NE));
+#endif
+    }
+
+#ifndef EVA_NAN_BOXING
+    /**
+     * Jumps to notIntegers (positions appended) unless both operands
+     * are integers.
+     */
+    void checkIntegers(std::vector<size_t>& notIntegers) {
+      as.cmpImm32(R12, top(2) + TYPE, INTEGER_TAG);
+      notIntegers.push_back(as.jcc(COND_NE));
+      as.cmpImm32(R12, top(1) + TYPE, INTEGER_TAG);
+      notIntegers.push_back(as.jcc(COND_NE));
+    }
+
+    /**
+     * ADD, SUB, MUL of integers: the result replaces the payload of the
+     * left operand (tagged INTEGER already), an overflow jumps to the
+     * slow path with the operands untouched.
+     */
+    void integerArithmetic(ByteCode opcode, std::vector<size_t>& slowPath) {
+      as.load(RAX, R12, top(2) + PAYLOAD);
+
+      if (opcode == OP_ADD) {
+        as.addMem(RAX, R12, top(1) + PAYLOAD);
+      } else if (opcode == OP_SUB) {
+        as.subMem(RAX, R12, top(1) + PAYLOAD);
+      } else {
+        as.imulMem(RAX, R12, top(1) + PAYLOAD);
+      }
+      slowPath.push_back(as.jcc(COND_O));
+
+      as.store(R12, top(2) + PAYLOAD, RAX);
+      as.subImm(R12, VALUE_SIZE);
+    }
+#endif
+
+    /**
+     * ADD: integers and numbers inline, mixed operands, overflows,
+     * strings and type errors in the VM.
+     */
+    void add() {
+      std::vector<size_t> slowPath;
+      std::vector<size_t> done;
+
+#ifndef EVA_NAN_BOXING
+      std::vector<size_t> notIntegers;
+      checkIntegers(notIntegers);
+      integerArithmetic(OP_ADD, slowPath);
+      done.push_back(as.jmp());
+
+      for (auto position : notIntegers) {
+        as.bind(position);
+      }
+#endif
+
+      checkNumber(top(2), slowPath);
+      checkNumber(top(1), slowPath);
+
+      as.movsdLoad(XMM0, R12, top(2) + PAYLOAD);
+      as.addsd(XMM0, R12, top(1) + PAYLOAD);
+      as.movsdStore(R12, top(2) + PAYLOAD, XMM0);
+      as.subImm(R12, VALUE_SIZE);
+      done.push_back(as.jmp());
+
+      for (auto position : slowPath) {
+        as.bind(position);
+      }
+      callHelper((void*)&JitHelpers::add, 0);
+
+      for (auto position : done) {
+        as.bind(position);
+      }
+    }
+
+    /**
+     * SUB, MUL, DIV: integers (but for DIV, exact only) and numbers
+     * inline, the rest in the VM.
+     */
+    void arithmetic(ByteCode opcode) {
+      std::vector<size_t> slowPath;
+      std::vector<size_t> done;
+
+#ifndef EVA_NAN_BOXING
+      if (opcode != OP_DIV) {
+        std::vector<size_t> notIntegers;
+        checkIntegers(notIntegers);
+        integerArithmetic(opcode, slowPath);
+        done.push_back(as.jmp());
+
+        for (auto position : notIntegers) {
+          as.bind(position);
+        }
+      }
+#endif
+
+      checkNumber(top(2), slowPath);
+      checkNumber(top(1), slowPath);
+
+      as.movsdLoad(XMM0, R12, top(2) + PAYLOAD);
+
+      if (opcode == OP_SUB) {
+        as.subsd(XMM0, R12, top(1) + PAYLOAD);
+      } else if (opcode == OP_MUL) {
+        as.mulsd(XMM0, R12, top(1) + PAYLOAD);
+      } else {
+        as.divsd(XMM0, R12, top(1) + PAYLOAD);
+      }
+
+      as.movsdStore(R12, top(2) + PAYLOAD, XMM0);
+      as.subImm(R12, VALUE_SIZE);
+      done.push_back(as.jmp());
+
+      for (auto position : slowPath) {
+        as.bind(position);
+      }
+      callHelper((void*)&JitHelpers::arithmetic, opcode);
+
+      for (auto position : done) {
+        as.bind(position);
+      }
+    }
+
+    void jumpIfFalse(size_t target) {
+      as.subImm(R12, VALUE_SIZE);
+
+#ifdef EVA_NAN_BOXING
+      as.movImm64(RAX, TRUE_BITS);
+      as.cmpMem(RAX, R12, 0);
+      jumpTo(as.jcc(COND_NE), target);
+#else
+      as.cmpImm8(R12, PAYLOAD, 0);
+      jumpTo(as.jcc(COND_E), target);
+#endif
+    }
+
+    /**
+     * JMP_IF_NOT_<op>: jumps if the comparison (see cmpOps) is false,
+     * unordered (NaN) compares are false as in C++.
+     */
+    void compareAndJump(uint8_t op, size_t target) {
+      std::vector<size_t> slowPath;
+      std::vector<size_t> done;
+
+#ifndef EVA_NAN_BOXING
+      // Signed integer compare, jumps on the negated condition.
+      static const Cond notCond[] = {COND_GE, COND_LE, COND_NE, COND_L, COND_G, COND_E};
+
+      std::vector<size_t> notIntegers;
+      checkIntegers(notIntegers);
+
+      as.load(RAX, R12, top(2) + PAYLOAD);
+      as.load(RCX, R12, top(1) + PAYLOAD);
+      as.subImm(R12, 2 * VALUE_SIZE);
+      as.cmpReg(RAX, RCX);
+      jumpTo(as.jcc(notCond[op]), target);
+      done.push_back(as.jmp());
+
+      for (auto position : notIntegers) {
+        as.bind(position);
+      }
+#endif
+
+      checkNumber(top(2), slowPath);
+      checkNumber(top(1), slowPath);
+
+      as.movsdLoad(XMM0, R12, top(2) + PAYLOAD);
+      as.movsdLoad(XMM1, R12, top(1) + PAYLOAD);
+      as.subImm(R12, 2 * VALUE_SIZE);
+
+      switch (op) {
+        case 0: // <
+          as.ucomisd(XMM1, XMM0);
+          jumpTo(as.jcc(COND_BE), target);
+          break;
+        case 1: // >
+          as.ucomisd(XMM0, XMM1);
+          jumpTo(as.jcc(COND_BE), target);
+          break;
+        case 2: // ==
+          as.ucomisd(XMM0, XMM1);
+          jumpTo(as.jcc(COND_NE), target);
+          jumpTo(as.jcc(COND_P), target);
+          break;
+        case 3: // >=
+          as.ucomisd(XMM0, XMM1);
+          jumpTo(as.jcc(COND_B), target);
+          break;
+        case 4: // <=
+          as.ucomisd(XMM1, XMM0);
+          jumpTo(as.jcc(COND_B), target);
+          break;
+        default: { // !=
+          as.ucomisd(XMM0, XMM1);
+          auto unordered = as.jcc(COND_P);
+          jumpTo(as.jcc(COND_E), target);
+          as.bind(unordered);
+          break;
+        }
+      }
+      done.push_back(as.jmp());
+
+      for (auto position : slowPath) {
+        as.bind(position);
+      }
+      callHelper((void*)&JitHelpers::compare, op);
+      as.testAl();
+      jumpTo(as.jcc(COND_E), target);
+
+      for (auto position : done) {
+        as.bind(position);
+      }
+    }
+};
+
+#endif
+
+EvaJit::EvaJit(EvaVM& vm) {
+  auto base = (char*)&vm;
+  spOffset_ = (char*)&vm.sp - base;
+  bpOffset_ = (char*)&vm.bp - base;
+  stackEndOffset_ = (char*)&vm.stack[EvaVM::STACK_LIMIT] - base;
+
+  setMode(isAvailable() ? JitMode::HOT : JitMode::OFF);
+}
+
+EvaJit::~EvaJit() {
+#if EVA_JIT
+  for (auto& region : regions_) {
+    munmap(region.start, region.size);
+  }
+#endif
+}
+
+void EvaJit::setMode(JitMode mode) {
+  mode_ = isAvailable() ? mode : JitMode::OFF;
+
+  switch (mode_) {
+    case JitMode::OFF:
+      callThreshold_ = SIZE_MAX;
+      break;
+    case JitMode::HOT:
+      callThreshold_ = threshold_;
+      break;
+    case JitMode::ALWAYS:
+      callThreshold_ = 1;
+      break;
+  }
+}
+
+void EvaJit::setThreshold(size_t calls) {
+  threshold_ = calls;
+  setMode(mode_);
+}
+
+bool EvaJit::compile(CodeObject* co) {
+  if (co->jitUnsupported) {
+    return false;
+  }
+
+#if EVA_JIT
+  // Register tier code is always interpreted.
+  if (co->tier == ExecutionTier::STACK) {
+    TemplateCompiler compiler(co, spOffset_, bpOffset_, stackEndOffset_, EvaVM::STACK_LIMIT);
+
+    if (compiler.compile()) {
+      co->jitCode = install(compiler.code());
+      stats_.compiled++;
+      stats_.codeBytes += compiler.code().size();
+      return true;
+    }
+  }
+#endif
+
+  co->jitUnsupported = true;
+  stats_.unsupported++;
+  return false;
+}
+
+void* EvaJit::install(const std::vector<uint8_t>& code) {
+#if EVA_JIT
+  auto size = (code.size() + 15) & ~(size_t)15;
+  auto entry = allocate(size);
+
+  // Regions are writable only while code is copied (W^X).
+  auto region = regionOf(entry);
+  mprotect(region->start, region->size, PROT_READ | PROT_WRITE);
+  memcpy(entry, code.data(), code.size());
+  mprotect(region->start, region->size, PROT_READ | PROT_EXEC);
+
+  code_[entry] = size;
+  return entry;
+#else
+  return nullptr;
+#endif
+}
+
+uint8_t* EvaJit::allocate(size_t size) {
+#if EVA_JIT
+  for (auto range = free_.begin(); range != free_.end(); range++) {
+    if (range->size >= size) {
+      auto start = range->start;
+      range->start += size;
+      range->size -= size;
+
+      if (range->size == 0) {
+        free_.erase(range);
+      }
+
+      regionOf(start)->live += size;
+      return start;
+    }
+  }
+
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  static constexpr size_t REGION_SIZE = 64 * 1024;
+
+  if (regions_.empty() || regions_.back().size - regions_.back().used < size) {
+    auto regionSize = (std::max(size, REGION_SIZE) + pageSize - 1) / pageSize * pageSize;
+    auto start = mmap(nullptr, regionSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (start == MAP_FAILED) {
+      DIE << "JIT: cannot allocate executable memory";
+    }
+
+    regions_.push_back({(uint8_t*)start, regionSize, 0, 0});
+    stats_.mappedBytes += regionSize;
+  }
+
+  auto& region = regions_.back();
+  auto start = region.start + region.used;
+  region.used += size;
+  region.live += size;
+
+  return start;
+#else
+  return nullptr;
+#endif
+}
+
+std::vector<EvaJit::CodeRegion>::iterator EvaJit::regionOf(uint8_t* address) {
+  return std::find_if(regions_.begin(), regions_.end(), [address](const CodeRegion& region) {
+    return address >= region.start && address < region.start + region.size;
+  });
+}
+
+void EvaJit::release(CodeObject* co) {
+#if EVA_JIT
+  auto entry = (uint8_t*)co->jitCode;
+  auto code = code_.find(entry);
+
+  if (code == code_.end()) {
+    return;
+  }
+
+  auto size = code->second;
+  code_.erase(code);
+  co->jitCode = nullptr;
+  stats_.releasedBytes += size;
+
+  auto region = regionOf(entry);
+  region->live -= size;
+
+  if (region->live > 0) {
+    free_.push_back({entry, size});
+    return;
+  }
+
+  // No code left: the region is unmapped with its free ranges.
+  auto start = region->start;
+  auto end = start + region->size;
+  free_.erase(std::remove_if(free_.begin(), free_.end(), [start, end](const CodeRange& range) {
+    return range.start >= start && range.start < end;
+  }), free_.end());
+
+  munmap(region->start, region->size);
+  stats_.mappedBytes -= region->size;
+  regions_.erase(region);
+#endif
+}
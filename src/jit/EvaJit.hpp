@@ -0,0 +1,190 @@
+/**
+ * Baseline JIT compiler.
+ */
+#ifndef SRC_JIT_EVAJIT_HPP
+#define SRC_JIT_EVAJIT_HPP
+
+#include "vm/EvaValue.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// x86-64 code generation into mmap'd memory (see EvaJit.cpp).
+#ifndef EVA_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define EVA_JIT 1
+#else
+#define EVA_JIT 0
+#endif
+#endif
+
+class EvaVM;
+
+/**
+ * Compiled function: runs the body of the current frame function
+ * of the VM up to its RETURN (or HALT of the main function).
+ */
+using JitFunction = void (*)(EvaVM* vm);
+
+/**
+ * When functions are compiled to machine code.
+ */
+enum class JitMode {
+  // Always interpret.
+  OFF,
+
+  // Compile a function once its call counter reaches the threshold.
+  HOT,
+
+  // Compile every function on its first call (and the main function).
+  ALWAYS,
+};
+
+/**
+ * JIT statistics.
+ */
+struct JitStats {
+  /**
+   * Compiled code objects.
+   */
+  size_t compiled = 0;
+
+  /**
+   * Code objects left to the interpreter (unsupported code).
+   */
+  size_t unsupported = 0;
+
+  /**
+   * Size of the emitted machine code.
+   */
+  size_t codeBytes = 0;
+
+  /**
+   * Machine code of swept code objects, reused or unmapped.
+   */
+  size_t releasedBytes = 0;
+
+  /**
+   * Executable memory currently mapped.
+   */
+  size_t mappedBytes = 0;
+};
+
+/**
+ * Template JIT: translates stack bytecode of a code object to x86-64
+ * code, one machine code template per opcode. Simple instructions are
+ * emitted inline, the rest calls back into the VM.
+ *
+ * Compiled code uses the VM stack and call frames the same way as the
+ * interpreter (bp/sp of the VM, Frame on calls), so compiled and
+ * interpreted functions call each other freely.
+ */
+class EvaJit final {
+  public:
+    /**
+     * Calls after which a function is compiled in the HOT mode.
+     */
+    static constexpr size_t DEFAULT_THRESHOLD = 100;
+
+    EvaJit(EvaVM& vm);
+    ~EvaJit();
+
+    /**
+     * Whether machine code can be generated in this build.
+     */
+    static constexpr bool isAvailable() { return EVA_JIT != 0; }
+
+    void setMode(JitMode mode);
+    JitMode getMode() const { return mode_; }
+
+    /**
+     * Sets the call count of the HOT mode.
+     */
+    void setThreshold(size_t calls);
+
+    /**
+     * Call count after which functions are compiled
+     * (SIZE_MAX if the JIT is off).
+     */
+    size_t callThreshold() const { return callThreshold_; }
+
+    /**
+     * Compiles the code object, sets its jitCode. Returns false if
+     * the code object is not supported, it stays interpreted.
+     */
+    bool compile(CodeObject* co);
+
+    /**
+     * Frees the machine code of a code object swept by the collector:
+     * the range is reused by the next compiled code, a region with no
+     * code left is unmapped.
+     */
+    void release(CodeObject* co);
+
+    const JitStats& getStats() const { return stats_; }
+
+  private:
+    /**
+     * Executable memory chunk, code is appended to the last one.
+     * Live is the size of the installed code not released yet.
+     */
+    struct CodeRegion {
+      uint8_t* start;
+      size_t size;
+      size_t used;
+      size_t live;
+    };
+
+    std::vector<CodeRegion> regions_;
+
+    /**
+     * Range of executable memory.
+     */
+    struct CodeRange {
+      uint8_t* start;
+      size_t size;
+    };
+
+    /**
+     * Sizes of the installed code by its entry.
+     */
+    std::unordered_map<uint8_t*, size_t> code_;
+
+    /**
+     * Released ranges of the regions, reused first fit.
+     */
+    std::vector<CodeRange> free_;
+
+    /**
+     * Copies the code to executable memory.
+     */
+    void* install(const std::vector<uint8_t>& code);
+
+    /**
+     * Takes a range of the size from the free ranges, or from the
+     * end of the last region (mapping a new one if it is full).
+     */
+    uint8_t* allocate(size_t size);
+
+    /**
+     * Region containing the address.
+     */
+    std::vector<CodeRegion>::iterator regionOf(uint8_t* address);
+
+    /**
+     * Offsets of the VM state in EvaVM, compiled code addresses
+     * the VM passed in the first argument.
+     */
+    int32_t spOffset_;
+    int32_t bpOffset_;
+    int32_t stackEndOffset_;
+
+    JitMode mode_ = JitMode::OFF;
+    size_t threshold_ = DEFAULT_THRESHOLD;
+    size_t callThreshold_ = SIZE_MAX;
+
+    JitStats stats_;
+};
+
+#endif
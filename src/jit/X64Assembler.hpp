@@ -0,0 +1,296 @@
+/**
+ * Minimal x86-64 machine code emitter used by the JIT.
+ */
+#ifndef SRC_JIT_X64ASSEMBLER_HPP
+#define SRC_JIT_X64ASSEMBLER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * General purpose registers, numbered as in the instruction encoding.
+ */
+enum Reg : uint8_t {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+/**
+ * SSE registers.
+ */
+enum Xmm : uint8_t {
+  XMM0, XMM1,
+};
+
+/**
+ * Conditions of the jcc instructions (low nibble of the opcode).
+ */
+enum Cond : uint8_t {
+  COND_O  = 0x0,
+  COND_B  = 0x2,
+  COND_AE = 0x3,
+  COND_E  = 0x4,
+  COND_NE = 0x5,
+  COND_BE = 0x6,
+  COND_A  = 0x7,
+  COND_P  = 0xA,
+  COND_L  = 0xC,
+  COND_GE = 0xD,
+  COND_LE = 0xE,
+  COND_G  = 0xF,
+};
+
+/**
+ * Appends encoded instructions to a code buffer. Memory operands
+ * are always [base + disp], with 8- or 32-bit displacement.
+ */
+class X64Assembler {
+  public:
+    /**
+     * Encoded code.
+     */
+    std::vector<uint8_t> code;
+
+    size_t size() const { return code.size(); }
+
+    void byte(uint8_t value) { code.push_back(value); }
+
+    void dword(uint32_t value) { append(&value, sizeof(value)); }
+
+    void qword(uint64_t value) { append(&value, sizeof(value)); }
+
+    // push r64
+    void push(Reg reg) {
+      rex(false, 0, reg);
+      byte(0x50 + (reg & 7));
+    }
+
+    // pop r64
+    void pop(Reg reg) {
+      rex(false, 0, reg);
+      byte(0x58 + (reg & 7));
+    }
+
+    void ret() { byte(0xC3); }
+
+    // mov dst, src
+    void mov(Reg dst, Reg src) {
+      rex(true, src, dst);
+      byte(0x89);
+      byte(0xC0 | (src & 7) << 3 | (dst & 7));
+    }
+
+    // mov dst, qword [base + disp]
+    void load(Reg dst, Reg base, int32_t disp) {
+      rex(true, dst, base);
+      byte(0x8B);
+      mem(dst, base, disp);
+    }
+
+    // mov qword [base + disp], src
+    void store(Reg base, int32_t disp, Reg src) {
+      rex(true, src, base);
+      byte(0x89);
+      mem(src, base, disp);
+    }
+
+    // mov dst, imm64
+    void movImm64(Reg dst, uint64_t imm) {
+      rex(true, 0, dst);
+      byte(0xB8 + (dst & 7));
+      qword(imm);
+    }
+
+    // mov dst32, imm32 (zero-extended)
+    void movImm32(Reg dst, uint32_t imm) {
+      rex(false, 0, dst);
+      byte(0xB8 + (dst & 7));
+      dword(imm);
+    }
+
+    // mov qword [base + disp], imm32 (sign-extended)
+    void storeImm(Reg base, int32_t disp, int32_t imm) {
+      rex(true, 0, base);
+      byte(0xC7);
+      mem(0, base, disp);
+      dword((uint32_t)imm);
+    }
+
+    // add dst, imm32
+    void addImm(Reg dst, int32_t imm) { aluImm(0, dst, imm); }
+
+    // sub dst, imm32
+    void subImm(Reg dst, int32_t imm) { aluImm(5, dst, imm); }
+
+    // add, sub, imul dst, qword [base + disp]
+    void addMem(Reg dst, Reg base, int32_t disp) { aluMem(0x03, dst, base, disp); }
+    void subMem(Reg dst, Reg base, int32_t disp) { aluMem(0x2B, dst, base, disp); }
+    void imulMem(Reg dst, Reg base, int32_t disp) {
+      rex(true, dst, base);
+      byte(0x0F);
+      byte(0xAF);
+      mem(dst, base, disp);
+    }
+
+    // and dst, src
+    void andReg(Reg dst, Reg src) {
+      rex(true, src, dst);
+      byte(0x21);
+      byte(0xC0 | (src & 7) << 3 | (dst & 7));
+    }
+
+    // cmp a, b
+    void cmpReg(Reg a, Reg b) {
+      rex(true, b, a);
+      byte(0x39);
+      byte(0xC0 | (b & 7) << 3 | (a & 7));
+    }
+
+    // cmp reg, qword [base + disp]
+    void cmpMem(Reg reg, Reg base, int32_t disp) {
+      rex(true, reg, base);
+      byte(0x3B);
+      mem(reg, base, disp);
+    }
+
+    // cmp dword [base + disp], imm32
+    void cmpImm32(Reg base, int32_t disp, uint32_t imm) {
+      rex(false, 0, base);
+      byte(0x81);
+      mem(7, base, disp);
+      dword(imm);
+    }
+
+    // cmp byte [base + disp], imm8
+    void cmpImm8(Reg base, int32_t disp, uint8_t imm) {
+      rex(false, 0, base);
+      byte(0x80);
+      mem(7, base, disp);
+      byte(imm);
+    }
+
+    // test al, al
+    void testAl() {
+      byte(0x84);
+      byte(0xC0);
+    }
+
+    // call reg
+    void call(Reg reg) {
+      rex(false, 0, reg);
+      byte(0xFF);
+      byte(0xD0 | (reg & 7));
+    }
+
+    // movsd xmm, qword [base + disp]
+    void movsdLoad(Xmm dst, Reg base, int32_t disp) { sse(0xF2, 0x10, dst, base, disp); }
+
+    // movsd qword [base + disp], xmm
+    void movsdStore(Reg base, int32_t disp, Xmm src) { sse(0xF2, 0x11, src, base, disp); }
+
+    // addsd, subsd, mulsd, divsd xmm, qword [base + disp]
+    void addsd(Xmm dst, Reg base, int32_t disp) { sse(0xF2, 0x58, dst, base, disp); }
+    void subsd(Xmm dst, Reg base, int32_t disp) { sse(0xF2, 0x5C, dst, base, disp); }
+    void mulsd(Xmm dst, Reg base, int32_t disp) { sse(0xF2, 0x59, dst, base, disp); }
+    void divsd(Xmm dst, Reg base, int32_t disp) { sse(0xF2, 0x5E, dst, base, disp); }
+
+    // ucomisd a, b
+    void ucomisd(Xmm a, Xmm b) {
+      byte(0x66);
+      byte(0x0F);
+      byte(0x2E);
+      byte(0xC0 | (a & 7) << 3 | (b & 7));
+    }
+
+    /**
+     * jmp rel32, returns the position of the displacement
+     * to be patched (see patch, bind).
+     */
+    size_t jmp() {
+      byte(0xE9);
+      dword(0);
+      return size() - 4;
+    }
+
+    /**
+     * jcc rel32, returns the position of the displacement.
+     */
+    size_t jcc(Cond cond) {
+      byte(0x0F);
+      byte(0x80 | cond);
+      dword(0);
+      return size() - 4;
+    }
+
+    /**
+     * Sets the jump displacement at position to the target offset.
+     */
+    void patch(size_t position, size_t target) {
+      int32_t rel = (int32_t)(target - (position + 4));
+      memcpy(&code[position], &rel, sizeof(rel));
+    }
+
+    /**
+     * Points the jump at position to the current offset.
+     */
+    void bind(size_t position) { patch(position, size()); }
+
+  private:
+    void append(const void* data, size_t count) {
+      auto bytes = (const uint8_t*)data;
+      code.insert(code.end(), bytes, bytes + count);
+    }
+
+    /**
+     * REX prefix, emitted only if needed (64-bit operand or
+     * an extended register).
+     */
+    void rex(bool wide, uint8_t reg, uint8_t base) {
+      uint8_t prefix = 0x40 | (wide ? 8 : 0) | (reg >> 3) << 2 | (base >> 3);
+      if (prefix != 0x40) {
+        byte(prefix);
+      }
+    }
+
+    /**
+     * ModRM (and SIB for rsp/r12 bases) of [base + disp].
+     */
+    void mem(uint8_t reg, Reg base, int32_t disp) {
+      bool shortDisp = disp >= -128 && disp <= 127;
+
+      byte((shortDisp ? 0x40 : 0x80) | (reg & 7) << 3 | (base & 7));
+      if ((base & 7) == RSP) {
+        byte(0x24);
+      }
+
+      if (shortDisp) {
+        byte((uint8_t)disp);
+      } else {
+        dword((uint32_t)disp);
+      }
+    }
+
+    void aluImm(uint8_t ext, Reg dst, int32_t imm) {
+      rex(true, 0, dst);
+      byte(0x81);
+      byte(0xC0 | ext << 3 | (dst & 7));
+      dword((uint32_t)imm);
+    }
+
+    void aluMem(uint8_t opcode, Reg dst, Reg base, int32_t disp) {
+      rex(true, dst, base);
+      byte(opcode);
+      mem(dst, base, disp);
+    }
+
+    void sse(uint8_t prefix, uint8_t opcode, Xmm reg, Reg base, int32_t disp) {
+      byte(prefix);
+      rex(false, reg, base);
+      byte(0x0F);
+      byte(opcode);
+      mem(reg, base, disp);
+    }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "parser/EvaAst.hpp"
+
+#include <charconv>
+#include <cstring>
+
+static_assert(sizeof(Exp) == 16, "Exp is a 16-byte node");
+
+Exp numberExp(std::string_view text) {
+  auto first = text.data();
+  auto last = text.data() + text.size();
+
+  int64_t number = 0;
+  if (std::from_chars(first, last, number).ec == std::errc::result_out_of_range) {
+    double real;
+    std::from_chars(first, last, real);
+    return Exp(ExpType::DOUBLE, real);
+  }
+
+  return Exp(number);
+}
+
+void* ExpArena::allocate(size_t bytes, size_t align) {
+  bytesUsed_ += bytes;
+
+  // Large allocations (e.g. the source) get a chunk of their own,
+  // the current chunk stays in use.
+  if (bytes > CHUNK_SIZE / 4) {
+    chunks_.push_back(std::make_unique<char[]>(bytes));
+    return chunks_.back().get();
+  }
+
+  auto offset = (uintptr_t)cursor_ % align;
+  auto start = cursor_ + (offset == 0 ? 0 : align - offset);
+
+  if (cursor_ == nullptr || start + bytes > limit_) {
+    chunks_.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+    start = chunks_.back().get();
+    limit_ = start + CHUNK_SIZE;
+  }
+
+  cursor_ = start + bytes;
+  return start;
+}
+
+std::string_view ExpArena::copyString(std::string_view text) {
+  if (text.empty()) {
+    return "";
+  }
+
+  auto chars = (char*)allocate(text.size(), 1);
+  memcpy(chars, text.data(), text.size());
+  return {chars, text.size()};
+}
+
+Exp ExpArena::list(const Exp* items, size_t count) {
+  auto nodes = (Exp*)allocate(count * sizeof(Exp), alignof(Exp));
+  if (count != 0) {
+    memcpy((void*)nodes, items, count * sizeof(Exp));
+  }
+  return Exp(nodes, count);
+}
+
+Exp ExpArena::closeList() {
+  auto start = listStarts_.back();
+  listStarts_.pop_back();
+
+  auto exp = list(entries_.data() + start, entries_.size() - start);
+  entries_.erase(entries_.begin() + start, entries_.end());
+  return exp;
+}
+
+void ExpArena::reset() {
+  std::unique_ptr<char[]> current;
+  for (auto& chunk : chunks_) {
+    if (chunk.get() + CHUNK_SIZE == limit_) {
+      current = std::move(chunk);
+    }
+  }
+
+  chunks_.clear();
+  bytesUsed_ = 0;
+  entries_.clear();
+  listStarts_.clear();
+
+  if (current != nullptr) {
+    cursor_ = current.get();
+    chunks_.push_back(std::move(current));
+  } else {
+    cursor_ = limit_ = nullptr;
+  }
+}
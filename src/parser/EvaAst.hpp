@@ -0,0 +1,148 @@
+/**
+ * Eva AST: compact nodes allocated from an arena.
+ */
+#ifndef SRC_PARSER_EVAAST_HPP
+#define SRC_PARSER_EVAAST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * Expression type.
+ */
+enum class ExpType : uint8_t {
+  NUMBER,
+  DOUBLE,
+  STRING,
+  SYMBOL,
+  LIST,
+};
+
+class ExpList;
+
+/**
+ * Expression, a 16-byte tagged node. Texts of strings and symbols
+ * and children of lists are not owned: they live in the arena which
+ * allocated the AST (or are static), copying a node is shallow.
+ */
+struct Exp {
+  ExpType type;
+
+  /**
+   * Length of the text or count of the children.
+   */
+  uint32_t size;
+
+  union {
+    int64_t number;
+    double real;
+    const char* chars;
+    Exp* items;
+  };
+
+  // Numbers:
+  Exp(int64_t number) : type(ExpType::NUMBER), size(0), number(number) {}
+
+  // Integer literals which do not fit 64 bits:
+  Exp(ExpType type, double real) : type(type), size(0), real(real) {}
+
+  // Strings (without quotes), Symbols:
+  Exp(ExpType type, std::string_view text)
+      : type(type), size(text.size()), chars(text.data()) {}
+
+  // Lists:
+  Exp(Exp* items, size_t count)
+      : type(ExpType::LIST), size(count), items(items) {}
+
+  std::string_view string() const { return {chars, size}; }
+  ExpList list() const;
+};
+
+/**
+ * Children of a list: contiguous nodes in the arena.
+ */
+class ExpList {
+  public:
+    ExpList(Exp* items, size_t count) : items_(items), count_(count) {}
+
+    Exp& operator[](size_t index) const { return items_[index]; }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    Exp* begin() const { return items_; }
+    Exp* end() const { return items_ + count_; }
+
+  private:
+    Exp* items_;
+    size_t count_;
+};
+
+inline ExpList Exp::list() const { return {items, size}; }
+
+/**
+ * Number literal: an integer, or a double if it does not fit 64 bits
+ * (as integer arithmetic overflowing).
+ */
+Exp numberExp(std::string_view text);
+
+/**
+ * Bump allocator owning the nodes and texts of ASTs. Everything
+ * allocated is freed at once by reset or destruction.
+ *
+ * Lists are built bottom-up by the parser: entries of the open
+ * lists are collected on a scratch stack and copied to the arena
+ * once, when the list is closed.
+ */
+class ExpArena {
+  public:
+    /**
+     * Copies the text to the arena.
+     */
+    std::string_view copyString(std::string_view text);
+
+    /**
+     * Copies the nodes to the arena as children of a new list.
+     */
+    Exp list(const Exp* items, size_t count);
+    Exp list(std::initializer_list<Exp> items) { return list(items.begin(), items.size()); }
+
+    Exp symbol(std::string_view name) { return Exp(ExpType::SYMBOL, copyString(name)); }
+    Exp string(std::string_view value) { return Exp(ExpType::STRING, copyString(value)); }
+
+    /**
+     * Starts a list, entries are appended until it is closed.
+     */
+    void openList() { listStarts_.push_back(entries_.size()); }
+    void append(const Exp& exp) { entries_.push_back(exp); }
+    Exp closeList();
+
+    /**
+     * Frees all allocations, keeps the current chunk for reuse.
+     */
+    void reset();
+
+    /**
+     * Bytes allocated since the last reset.
+     */
+    size_t bytesUsed() const { return bytesUsed_; }
+
+  private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    void* allocate(size_t bytes, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* cursor_ = nullptr;
+    char* limit_ = nullptr;
+    size_t bytesUsed_ = 0;
+
+    std::vector<Exp> entries_;
+    std::vector<size_t> listStarts_;
+};
+
+#endif
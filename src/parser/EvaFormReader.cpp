@@ -0,0 +1,154 @@
+#include "parser/EvaFormReader.hpp"
+#include "parser/EvaParser.hpp"
+
+using syntax::Tokenizer;
+
+bool EvaFormReader::next(std::string_view& form) {
+  for (;;) {
+    auto end = scan();
+
+    if (end == std::string::npos && eof_) {
+      // Only comments are left, or an incomplete form.
+      if (!hasToken_) {
+        return false;
+      }
+      end = endForm();
+    }
+
+    if (end != std::string::npos) {
+      form = std::string_view(buffer_).substr(start_, end - start_);
+      start_ = end;
+      return true;
+    }
+
+    readChunk();
+  }
+}
+
+size_t EvaFormReader::endForm() {
+  depth_ = 0;
+  hasToken_ = false;
+  return cursor_;
+}
+
+size_t EvaFormReader::scan() {
+  auto npos = std::string::npos;
+
+  while (cursor_ < buffer_.size()) {
+    auto c = buffer_[cursor_];
+    auto rest = buffer_.size() - cursor_;
+
+    if (c == '(') {
+      depth_++;
+      hasToken_ = true;
+      cursor_++;
+      continue;
+    }
+
+    if (c == ')') {
+      depth_--;
+      hasToken_ = true;
+      cursor_++;
+
+      if (depth_ <= 0) {
+        return endForm();
+      }
+      continue;
+    }
+
+    if (Tokenizer::isSpace(c)) {
+      cursor_++;
+      continue;
+    }
+
+    // Comments, an unterminated block comment is a symbol.
+    if (c == '/') {
+      if (rest < 2 && !eof_) {
+        return npos;
+      }
+
+      if (buffer_.compare(cursor_, 2, "//") == 0) {
+        auto end = buffer_.find_first_of("\n\r", cursor_ + 2);
+        if (end == npos && !eof_) {
+          return npos;
+        }
+
+        cursor_ = end == npos ? buffer_.size() : end;
+        continue;
+      }
+
+      if (buffer_.compare(cursor_, 2, "/*") == 0) {
+        auto end = buffer_.find("*/", cursor_ + 2);
+        if (end != npos) {
+          cursor_ = end + 2;
+          continue;
+        } else if (!eof_) {
+          return npos;
+        }
+      }
+    }
+
+    hasToken_ = true;
+
+    if (c == '"') {
+      auto end = buffer_.find('"', cursor_ + 1);
+      if (end == npos && !eof_) {
+        return npos;
+      }
+
+      // Unterminated string: the rest is the form.
+      if (end == npos) {
+        cursor_ = buffer_.size();
+        return endForm();
+      }
+
+      cursor_ = end + 1;
+    } else {
+      auto end = cursor_;
+      auto isPart = Tokenizer::isDigit(c) ? Tokenizer::isDigit : Tokenizer::isSymbolChar;
+      while (end < buffer_.size() && isPart(buffer_[end])) {
+        end++;
+      }
+
+      // Unknown character: the form ends with it.
+      if (end == cursor_) {
+        cursor_++;
+        return endForm();
+      }
+
+      if (end == buffer_.size() && !eof_) {
+        return npos;
+      }
+
+      cursor_ = end;
+    }
+
+    if (depth_ == 0) {
+      return endForm();
+    }
+  }
+
+  return npos;
+}
+
+void EvaFormReader::readChunk() {
+  buffer_.erase(0, start_);
+  cursor_ -= start_;
+  start_ = 0;
+
+  // Waits for one character only, then takes what the stream has
+  // available without blocking: a form completed by a partial read (a
+  // pipe, a terminal) runs before more input arrives.
+  auto c = input_.get();
+  if (c == std::istream::traits_type::eof()) {
+    eof_ = true;
+    return;
+  }
+
+  auto size = buffer_.size();
+  buffer_.resize(size + CHUNK_SIZE);
+  buffer_[size] = (char)c;
+
+  auto count = input_.readsome(&buffer_[size + 1], CHUNK_SIZE - 1);
+  buffer_.resize(size + 1 + count);
+}
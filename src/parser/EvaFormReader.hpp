@@ -0,0 +1,74 @@
+/**
+ * Incremental reader of top-level forms.
+ */
+#ifndef SRC_PARSER_EVAFORMREADER_HPP
+#define SRC_PARSER_EVAFORMREADER_HPP
+
+#include <istream>
+#include <string>
+#include <string_view>
+
+/**
+ * Reads the input as it arrives (up to a chunk at a time, never
+ * waiting for a full chunk) and splits it into top-level forms by the
+ * lexical rules of the tokenizer (parens, atoms, strings and comments),
+ * without parsing. Only the current form and the last chunk are
+ * buffered.
+ *
+ * A malformed form is returned as is, for the parser to report.
+ */
+class EvaFormReader {
+  public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    EvaFormReader(std::istream& input) : input_(input) {}
+
+    /**
+     * Source of the next form (with the comments and whitespace
+     * before it), false at the end of the input. The view is valid
+     * until the next call.
+     */
+    bool next(std::string_view& form);
+
+  private:
+    /**
+     * Scans tokens from the cursor. Returns the end of the form, or
+     * npos if more input is needed to complete it.
+     */
+    size_t scan();
+
+    /**
+     * Drops the returned forms and appends the available input: one
+     * character at least (it blocks for it), a chunk at most.
+     */
+    void readChunk();
+
+    /**
+     * Ends the current form at the cursor.
+     */
+    size_t endForm();
+
+    std::istream& input_;
+
+    std::string buffer_;
+
+    /**
+     * Start of the current form and its next token in the buffer.
+     */
+    size_t start_ = 0;
+    size_t cursor_ = 0;
+
+    /**
+     * Nesting of lists at the cursor.
+     */
+    int depth_ = 0;
+
+    /**
+     * Whether the current form has a token (not only comments).
+     */
+    bool hasToken_ = false;
+
+    bool eof_ = false;
+};
+
+#endif
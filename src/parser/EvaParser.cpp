@@ -2,28 +2,6 @@
 
 namespace syntax {
 
-// ------------------------------------------------------------------
-// Lexical rules.
-
-// clang-format off
-std::array<LexRule, Tokenizer::LEX_RULES_COUNT> Tokenizer::lexRules_ = {{
-  {std::regex(R"(^\()"), &_lexRule1},
-  {std::regex(R"(^\))"), &_lexRule2},
-  {std::regex(R"(^\/\/.*)"), &_lexRule3},
-  {std::regex(R"(^\/\*[\s\S]*?\*\/)"), &_lexRule4},
-  {std::regex(R"(^\s+)"), &_lexRule5},
-  {std::regex(R"(^"[^\"]*")"), &_lexRule6},
-  {std::regex(R"(^\d+)"), &_lexRule7},
-  {std::regex(R"(^[\w\-+*=!<>/]+)"), &_lexRule8}
-}};
-
-std::map<TokenizerState, std::vector<size_t>> Tokenizer::lexRulesByStartConditions_ =  {
-    {TokenizerState::INITIAL, {0, 1, 2, 3, 4, 5, 6, 7}}
-};
-// clang-format on
-
-std::string Tokenizer::__EOF("$");
-
 // ------------------------------------------------------------------
 // Productions.
 
@@ -65,7 +43,7 @@ void _handler4(yyparse& parser) {
 // Semantic action prologue.
 auto _1 = POP_T();
 
-auto __ = Exp(std::stoi(_1)) ;
+auto __ = numberExp(_1) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -76,7 +54,7 @@ void _handler5(yyparse& parser) {
 // Semantic action prologue.
 auto _1 = POP_T();
 
-auto __ = Exp(_1) ;
+auto __ = Exp(ExpType::STRING, _1.substr(1, _1.size() - 2)) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -87,7 +65,7 @@ void _handler6(yyparse& parser) {
 // Semantic action prologue.
 auto _1 = POP_T();
 
-auto __ = Exp(_1) ;
+auto __ = Exp(ExpType::SYMBOL, _1) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -97,10 +75,10 @@ PUSH_VR();
 void _handler7(yyparse& parser) {
 // Semantic action prologue.
 parser.tokensStack.pop_back();
-auto _2 = POP_V();
+parser.valuesStack.pop_back();
 parser.tokensStack.pop_back();
 
-auto __ = _2 ;
+auto __ = parser.arena.closeList() ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -111,7 +89,7 @@ void _handler8(yyparse& parser) {
 // Semantic action prologue.
 
 
-auto __ = Exp(std::vector<Exp>{}) ;
+parser.arena.openList(); auto __ = Exp(nullptr, 0) ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -123,7 +101,7 @@ void _handler9(yyparse& parser) {
 auto _2 = POP_V();
 auto _1 = POP_V();
 
-_1.list.push_back(_2); auto __ = _1 ;
+parser.arena.append(_2); auto __ = _1 ;
 
  // Semantic action epilogue.
 PUSH_VR();
@@ -22,9 +22,9 @@
 #include <iostream>
 #include <map>
 #include <memory>
-#include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // ------------------------------------
@@ -47,47 +47,7 @@
 //   }
 //
 // clang-format off
-#include <string>
-#include <vector>
-
-/**
- * Expression type.
- */
-enum class ExpType {
-  NUMBER,
-  STRING,
-  SYMBOL,
-  LIST,
-};
-
-/**
- * Expression.
- */
-struct Exp {
-  ExpType type;
-
-  int number;
-  std::string string;
-  std::vector<Exp> list;
-
-  // Numbers:
-  Exp(int number) : type(ExpType::NUMBER), number(number) {}
-
-  // Strings, Symbols:
-  Exp(std::string& strVal) {
-    if (strVal[0] == '"') {
-      type = ExpType::STRING;
-      string = strVal.substr(1, strVal.size() - 2);
-    } else {
-      type = ExpType::SYMBOL;
-      string = strVal;
-    }
-  }
-
-  // Lists:
-  Exp(std::vector<Exp> list) : type(ExpType::LIST), list(list) {}
-
-};
+#include "parser/EvaAst.hpp"
 
 using Value = Exp;  // clang-format on
 
@@ -95,19 +55,15 @@ namespace syntax {
 
 /**
  * Tokenizer class.
- */
-// clang-format off
-/**
- * Generic tokenizer used by the parser in the Syntax tool.
  *
- * https://www.npmjs.com/package/syntax-cli
+ * Hand-written scanner for the lexical grammar of EvaGrammar.bnf:
+ * the rules are tried in the grammar order at the cursor (parens,
+ * line and block comments, whitespace, strings, numbers, symbols).
+ *
+ * Tokens are views into the source string, nothing is allocated
+ * per token. The source must outlive the tokens.
  */
 
-#ifndef __Syntax_Tokenizer_h
-#define __Syntax_Tokenizer_h
-
-class Tokenizer;
-
 // ------------------------------------------------------------------
 // TokenType.
 
@@ -128,7 +84,7 @@ enum class TokenType {
 
 struct Token {
   TokenType type;
-  std::string value;
+  std::string_view value;
 
   int startOffset;
   int endOffset;
@@ -138,27 +94,6 @@ struct Token {
   int endColumn;
 };
 
-using SharedToken = std::shared_ptr<Token>;
-
-typedef TokenType (*LexRuleHandler)(const Tokenizer&, const std::string&);
-
-// ------------------------------------------------------------------
-// Lex rule: [regex, handler]
-
-struct LexRule {
-  std::regex regex;
-  LexRuleHandler handler;
-};
-
-// ------------------------------------------------------------------
-// Token.
-
-enum TokenizerState {
-  // clang-format off
-  INITIAL
-  // clang-format on
-};
-
 // ------------------------------------------------------------------
 // Tokenizer.
 
@@ -167,13 +102,9 @@ class Tokenizer {
   /**
    * Initializes a parsing string.
    */
-  void initString(const std::string& str) {
+  void initString(std::string_view str) {
     str_ = str;
 
-    // Initialize states.
-    states_.clear();
-    states_.push_back(TokenizerState::INITIAL);
-
     cursor_ = 0;
     currentLine_ = 1;
     currentColumn_ = 0;
@@ -192,77 +123,39 @@ class Tokenizer {
    */
   inline bool hasMoreTokens() { return cursor_ <= str_.length(); }
 
-  /**
-   * Returns current tokenizing state.
-   */
-  TokenizerState getCurrentState() { return states_.back(); }
-
-  /**
-   * Enters a new state pushing it on the states stack.
-   */
-  void pushState(TokenizerState state) { states_.push_back(state); }
-
-  /**
-   * Alias for `push_state`.
-   */
-  void begin(TokenizerState state) { states_.push_back(state); }
-
-  /**
-   * Exits a current state popping it from the states stack.
-   */
-  TokenizerState popState() {
-    auto state = states_.back();
-    states_.pop_back();
-    return state;
-  }
-
   /**
    * Returns next token.
    */
-  SharedToken getNextToken() {
-    if (!hasMoreTokens()) {
-      yytext = __EOF;
-      return toToken(TokenType::__EOF);
-    }
-
-    auto strSlice = str_.substr(cursor_);
-
-    auto lexRulesForState = lexRulesByStartConditions_.at(getCurrentState());
-
-    for (const auto& ruleIndex : lexRulesForState) {
-      auto rule = lexRules_[ruleIndex];
-      std::smatch sm;
-
-      if (std::regex_search(strSlice, sm, rule.regex)) {
-        yytext = sm[0];
-
-        captureLocations_(yytext);
-        cursor_ += yytext.length();
+  Token getNextToken() {
+    for (;;) {
+      if (!hasMoreTokens()) {
+        yytext = __EOF;
+        return toToken(TokenType::__EOF);
+      }
 
-        // Manual handling of EOF token (the end of string). Return it
-        // as `EOF` symbol.
-        if (yytext.length() == 0) {
-          cursor_++;
-        }
+      if (isEOF()) {
+        cursor_++;
+        yytext = __EOF;
+        return toToken(TokenType::__EOF);
+      }
 
-        auto tokenType = rule.handler(*this, yytext);
+      auto length = matchSkipped();
+      if (length != 0) {
+        consume(length);
+        continue;
+      }
 
-        if (tokenType == TokenType::__EMPTY) {
-          return getNextToken();
-        }
+      auto tokenType = TokenType::__EMPTY;
+      length = matchToken(tokenType);
 
-        return toToken(tokenType);
+      if (length == 0) {
+        throwUnexpectedToken(std::string(1, str_[cursor_]), currentLine_,
+                             currentColumn_);
       }
-    }
 
-    if (isEOF()) {
-      cursor_++;
-      yytext = __EOF;
-      return toToken(TokenType::__EOF);
+      consume(length);
+      return toToken(tokenType);
     }
-
-    throwUnexpectedToken(std::string(1, strSlice[0]), currentLine_,
-                         currentColumn_);
   }
 
   /**
@@ -270,8 +163,8 @@ class Tokenizer {
    */
   inline bool isEOF() { return cursor_ == str_.length(); }
 
-  SharedToken toToken(TokenType tokenType) {
-    return std::shared_ptr<Token>(new Token {
+  Token toToken(TokenType tokenType) {
+    return Token {
         tokenType,
         yytext,
         tokenStartOffset_,
@@ -280,7 +173,7 @@ class Tokenizer {
         tokenEndLine_,
         tokenStartColumn_,
         tokenEndColumn_
-    });
+    };
   }
 
   /**
@@ -290,7 +183,7 @@ class Tokenizer {
    */
   [[noreturn]] void throwUnexpectedToken(const std::string& symbol, int line,
                                          int column) {
-    std::stringstream ss{str_};
+    std::stringstream ss{std::string(str_)};
     std::string lineStr;
     int currentLine = 1;
 
@@ -314,14 +207,102 @@ class Tokenizer {
   /**
    * Matched text.
    */
-  std::string yytext;
+  std::string_view yytext;
+
+  /**
+   * Character classes of the lexical rules.
+   */
+  static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+  }
+
+  static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+  static bool isSymbolChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || isDigit(c) ||
+           c == '_' || c == '-' || c == '+' || c == '*' || c == '=' ||
+           c == '!' || c == '<' || c == '>' || c == '/';
+  }
 
  private:
   /**
-   * Captures token locations.
+   * Length of a comment or whitespace at the cursor, 0 if none.
+   */
+  size_t matchSkipped() {
+    auto rest = str_.substr(cursor_);
+
+    // Line comment, up to the line terminator.
+    if (rest.compare(0, 2, "//") == 0) {
+      auto end = rest.find_first_of("\n\r", 2);
+      return end == std::string_view::npos ? rest.length() : end;
+    }
+
+    // Block comment, an unterminated one is not a comment.
+    if (rest.compare(0, 2, "/*") == 0) {
+      auto end = rest.find("*/", 2);
+      if (end != std::string_view::npos) {
+        return end + 2;
+      }
+    }
+
+    size_t length = 0;
+    while (length < rest.length() && isSpace(rest[length])) {
+      length++;
+    }
+    return length;
+  }
+
+  /**
+   * Length of the token at the cursor (sets its type), 0 if none.
+   */
+  size_t matchToken(TokenType& tokenType) {
+    auto rest = str_.substr(cursor_);
+    auto c = rest[0];
+
+    if (c == '(') {
+      tokenType = TokenType::TOKEN_TYPE_7;
+      return 1;
+    }
+
+    if (c == ')') {
+      tokenType = TokenType::TOKEN_TYPE_8;
+      return 1;
+    }
+
+    if (c == '"') {
+      auto end = rest.find('"', 1);
+      if (end == std::string_view::npos) {
+        return 0;
+      }
+
+      tokenType = TokenType::STRING;
+      return end + 1;
+    }
+
+    size_t length = 0;
+
+    if (isDigit(c)) {
+      while (length < rest.length() && isDigit(rest[length])) {
+        length++;
+      }
+
+      tokenType = TokenType::NUMBER;
+      return length;
+    }
+
+    while (length < rest.length() && isSymbolChar(rest[length])) {
+      length++;
+    }
+
+    tokenType = TokenType::SYMBOL;
+    return length;
+  }
+
+  /**
+   * Advances the cursor over the matched text, captures its locations.
    */
-  void captureLocations_(const std::string& matched) {
-    auto len = matched.length();
+  void consume(size_t length) {
+    yytext = str_.substr(cursor_, length);
 
     // Absolute offsets.
     tokenStartOffset_ = cursor_;
@@ -330,52 +311,37 @@ class Tokenizer {
     tokenStartLine_ = currentLine_;
     tokenStartColumn_ = tokenStartOffset_ - currentLineBeginOffset_;
 
-    // Extract `\n` in the matched token.
-    std::stringstream ss{matched};
-    std::string lineStr;
-    std::getline(ss, lineStr, '\n');
-    while (ss.tellg() > 0 && ss.tellg() <= len) {
+    // Lines of the matched text.
+    for (auto newline = yytext.find('\n'); newline != std::string_view::npos;
+         newline = yytext.find('\n', newline + 1)) {
       currentLine_++;
-      currentLineBeginOffset_ = tokenStartOffset_ + ss.tellg();
-      std::getline(ss, lineStr, '\n');
+      currentLineBeginOffset_ = tokenStartOffset_ + newline + 1;
     }
 
-    tokenEndOffset_ = cursor_ + len;
+    tokenEndOffset_ = cursor_ + length;
 
     // Line-based locations, end.
     tokenEndLine_ = currentLine_;
     tokenEndColumn_ = tokenEndOffset_ - currentLineBeginOffset_;
     currentColumn_ = tokenEndColumn_;
-  }
 
-  /**
-   * Lexical rules.
-   */
-  // clang-format off
-  static constexpr size_t LEX_RULES_COUNT = 8;
-  static std::array<LexRule, LEX_RULES_COUNT> lexRules_;
-  static std::map<TokenizerState, std::vector<size_t>> lexRulesByStartConditions_;
-  // clang-format on
+    cursor_ += length;
+  }
 
   /**
    * Special EOF token.
    */
-  static std::string __EOF;
+  static constexpr std::string_view __EOF = "$";
 
   /**
    * Tokenizing string.
    */
-  std::string str_;
+  std::string_view str_;
 
   /**
    * Cursor for current symbol.
    */
-  unsigned int cursor_;
-
-  /**
-   * States.
-   */
-  std::vector<TokenizerState> states_;
+  size_t cursor_;
 
   /**
    * Line-based location tracking.
@@ -395,46 +361,6 @@ class Tokenizer {
   int tokenEndColumn_;
 };
 
-// ------------------------------------------------------------------
-// Lexical rule handlers.
-
-// clang-format off
-inline TokenType _lexRule1(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::TOKEN_TYPE_7;
-}
-
-inline TokenType _lexRule2(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::TOKEN_TYPE_8;
-}
-
-inline TokenType _lexRule3(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::__EMPTY;
-}
-
-inline TokenType _lexRule4(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::__EMPTY;
-}
-
-inline TokenType _lexRule5(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::__EMPTY;
-}
-
-inline TokenType _lexRule6(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::STRING;
-}
-
-inline TokenType _lexRule7(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::NUMBER;
-}
-
-inline TokenType _lexRule8(const Tokenizer& tokenizer, const std::string& yytext) {
-return TokenType::SYMBOL;
-}
-// clang-format on
-
-#endif
-// clang-format on
-
 #define POP_V()              \
   parser.valuesStack.back(); \
   parser.valuesStack.pop_back()
@@ -503,7 +429,7 @@ class EvaParser {
   /**
    * Token values stack.
    */
-  std::vector<std::string> tokensStack;
+  std::vector<std::string_view> tokensStack;
 
   /**
    * Parsing states stack.
@@ -515,6 +441,12 @@ class EvaParser {
    */
   Tokenizer tokenizer;
 
+  /**
+   * Arena of the parsed AST and its source, reset on each parse:
+   * the AST is valid until the next parse.
+   */
+  ExpArena arena;
+
   /**
    * Previous state to calculate the next one.
    */
@@ -523,13 +455,15 @@ class EvaParser {
   /**
    * Parses a string.
    */
-  Value parse(const std::string& str) {
+  Value parse(std::string_view str) {
     // clang-format off
     
     // clang-format on
 
-    // Initialize the tokenizer and the string.
-    tokenizer.initString(str);
+    // Initialize the arena, the tokenizer and the string (tokens
+    // and AST texts are views into the copy of the source).
+    arena.reset();
+    tokenizer.initString(arena.copyString(str));
 
     // Initialize the stacks.
     valuesStack.clear();
@@ -545,7 +479,7 @@ class EvaParser {
     // Main parsing loop.
     for (;;) {
       auto state = statesStack.back();
-      auto column = (int)token->type;
+      auto column = (int)token.type;
 
       if (table_[state].count(column) == 0) {
         throwUnexpectedToken(token);
@@ -556,7 +490,7 @@ class EvaParser {
       // Shift a token, go to state.
       if (entry.type == TE::Shift) {
         // Push token.
-        tokensStack.push_back(token->value);
+        tokensStack.emplace_back(token.value);
 
         // Push next state number: "s5" -> 5
         statesStack.push_back(entry.value);
@@ -570,7 +504,7 @@ class EvaParser {
         auto productionNumber = entry.value;
         auto production = productions_[productionNumber];
 
-        tokenizer.yytext = shiftedToken->value;
+        tokenizer.yytext = shiftedToken.value;
 
         auto rhsLength = production.rhsLength;
         while (rhsLength > 0) {
@@ -620,14 +554,14 @@ class EvaParser {
   /**
    * Throws parser error on unexpected token.
    */
-  [[noreturn]] void throwUnexpectedToken(SharedToken token) {
-    if (token->type == TokenType::__EOF && !tokenizer.hasMoreTokens()) {
+  [[noreturn]] void throwUnexpectedToken(const Token& token) {
+    if (token.type == TokenType::__EOF && !tokenizer.hasMoreTokens()) {
       std::string errMsg = "Unexpected end of input.\n";
       std::cerr << errMsg;
       throw std::runtime_error(errMsg.c_str());
     }
-    tokenizer.throwUnexpectedToken(token->value, token->startLine,
-                                   token->startColumn);
+    tokenizer.throwUnexpectedToken(std::string(token.value), token.startLine,
+                                   token.startColumn);
   }
 
   // clang-format off
@@ -0,0 +1,213 @@
+#include "profiler/EvaProfiler.hpp"
+#include "vm/EvaVM.hpp"
+#include "logging/Logger.hpp"
+
+#include <cstdio>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+
+std::atomic<EvaProfiler*> EvaProfiler::active_{nullptr};
+
+/**
+ * Thread of the profiled VM, SIGPROF can be delivered to any thread.
+ */
+static pthread_t profiledThread;
+
+static struct sigaction previousAction;
+
+EvaProfiler::EvaProfiler(EvaVM& vm) : vm_(vm) {}
+
+EvaProfiler::~EvaProfiler() {
+  if (running_) {
+    stop();
+  }
+}
+
+void EvaProfiler::start(int hz) {
+  if (running_) {
+    return;
+  }
+
+  if (hz <= 0 || hz > 1000000) {
+    DIE << "[EvaProfiler] Invalid sampling rate " << hz;
+  }
+
+  EvaProfiler* expected = nullptr;
+  if (!active_.compare_exchange_strong(expected, this)) {
+    DIE << "[EvaProfiler] Another profiler is running";
+  }
+
+  if (buffer_ == nullptr) {
+    // Not initialized: pages are touched as samples are written.
+    buffer_.reset(new SampleFrame[BUFFER_FRAMES]);
+  }
+
+  profiledThread = pthread_self();
+
+  struct sigaction action = {};
+  action.sa_handler = handleSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, &previousAction);
+
+  struct itimerval timer = {};
+  timer.it_interval.tv_usec = 1000000 / hz;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+
+  running_ = true;
+}
+
+void EvaProfiler::stop() {
+  if (!running_) {
+    return;
+  }
+
+  struct itimerval timer = {};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  sigaction(SIGPROF, &previousAction, nullptr);
+
+  active_ = nullptr;
+  running_ = false;
+
+  drain();
+}
+
+void EvaProfiler::handleSignal(int signal) {
+  auto profiler = active_.load(std::memory_order_acquire);
+  if (profiler != nullptr && pthread_equal(pthread_self(), profiledThread)) {
+    profiler->sample();
+  }
+}
+
+void EvaProfiler::addFrame(SampleFrame* frames, uint32_t& depth, CodeObject* co,
+                           const uint8_t* address) {
+  if (depth == MAX_DEPTH || co == nullptr) {
+    return;
+  }
+
+  // Machine code return addresses are not in the bytecode.
+  auto offset = NO_OFFSET;
+  auto code = co->code.data();
+  if (address >= code && address < code + co->code.size()) {
+    offset = address - code;
+  }
+
+  frames[depth++] = {co, offset};
+}
+
+void EvaProfiler::sample() {
+  auto used = used_.load(std::memory_order_relaxed);
+
+  // Room for the header and the deepest sample.
+  if (used + 1 + MAX_DEPTH > BUFFER_FRAMES) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto frames = &buffer_[used + 1];
+  uint32_t depth = 0;
+
+  if (vm_.running) {
+    // Pairs with the fences of the VM: once running is seen, fn and
+    // the stacks are set, and the frames below csp are written.
+    std::atomic_signal_fence(std::memory_order_acquire);
+
+    if (vm_.native != nullptr) {
+      frames[depth++] = {vm_.native, NO_OFFSET};
+    }
+
+    if (vm_.fn != nullptr) {
+      addFrame(frames, depth, vm_.fn->co, vm_.ip);
+    }
+
+    // Read once: the handler may interrupt a call or a return.
+    auto top = vm_.csp;
+    if (top < vm_.callStack || top > vm_.callStack + EvaVM::CALL_STACK_LIMIT) {
+      top = vm_.callStack;
+    }
+
+    for (auto frame = top; frame > vm_.callStack;) {
+      frame--;
+      if (frame->fn != nullptr) {
+        addFrame(frames, depth, frame->fn->co, frame->ra);
+      }
+    }
+  }
+
+  buffer_[used] = {nullptr, depth};
+  used_.store(used + 1 + depth, std::memory_order_release);
+}
+
+void EvaProfiler::drain() {
+  if (buffer_ == nullptr) {
+    return;
+  }
+
+  // The handler must not append while the buffer is read and reset.
+  sigset_t block, previous;
+  sigemptyset(&block);
+  sigaddset(&block, SIGPROF);
+  pthread_sigmask(SIG_BLOCK, &block, &previous);
+
+  auto used = used_.load(std::memory_order_acquire);
+
+  for (size_t i = 0; i < used;) {
+    auto depth = buffer_[i].offset;
+    auto frames = &buffer_[i + 1];
+
+    std::string stack = depth == 0 ? "[vm]" : "";
+
+    // Outermost frame first.
+    for (auto frame = frames + depth; frame > frames;) {
+      frame--;
+
+      if (!stack.empty()) {
+        stack += ';';
+      }
+
+      if (frame->object->type == ObjectType::NATIVE) {
+        stack += "native:" + ((NativeObject*)frame->object)->name;
+        continue;
+      }
+
+      stack += ((CodeObject*)frame->object)->name;
+
+      if (frame->offset != NO_OFFSET) {
+        char offset[16];
+        snprintf(offset, sizeof(offset), "+0x%02x", frame->offset);
+        stack += offset;
+      }
+    }
+
+    stacks_[stack]++;
+    stats_.samples++;
+    i += 1 + depth;
+  }
+
+  used_.store(0, std::memory_order_relaxed);
+  stats_.dropped += dropped_.exchange(0);
+
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+void EvaProfiler::writeCollapsed(std::ostream& out) {
+  drain();
+
+  for (auto& [stack, count] : stacks_) {
+    out << stack << ' ' << count << '\n';
+  }
+}
+
+void EvaProfiler::addGCRoots(std::vector<Object*>& roots) {
+  auto used = used_.load(std::memory_order_acquire);
+
+  for (size_t i = 0; i < used;) {
+    auto depth = buffer_[i].offset;
+    for (size_t frame = 1; frame <= depth; frame++) {
+      roots.push_back(buffer_[i + frame].object);
+    }
+    i += 1 + depth;
+  }
+}
@@ -0,0 +1,156 @@
+/**
+ * Sampling profiler.
+ */
+#ifndef SRC_PROFILER_EVAPROFILER_HPP
+#define SRC_PROFILER_EVAPROFILER_HPP
+
+#include "vm/EvaValue.hpp"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class EvaVM;
+
+/**
+ * Profiler statistics.
+ */
+struct ProfilerStats {
+  /**
+   * Recorded samples.
+   */
+  size_t samples = 0;
+
+  /**
+   * Samples lost because the buffer was full.
+   */
+  size_t dropped = 0;
+};
+
+/**
+ * Samples the VM on a SIGPROF timer (setitimer, process CPU time).
+ * The signal handler only copies the current function, the call stack
+ * frames and the current native function with their bytecode offsets
+ * into a preallocated buffer. The samples are turned into stacks out
+ * of the handler: on collections and when the profiler stops. The VM
+ * orders the writes the handler reads with signal fences, and the
+ * sampled call stack pointer is checked against the call stack.
+ *
+ * The VM is not touched by a stopped profiler: the only cost while
+ * disabled is the note of the native function being called.
+ *
+ * One profiler can run in a process at a time.
+ */
+class EvaProfiler final {
+  public:
+    /**
+     * Default sampling rate, samples per second of CPU time.
+     */
+    static constexpr int DEFAULT_HZ = 1000;
+
+    /**
+     * Deepest recorded frames of a sample, outer frames are cut off.
+     */
+    static constexpr size_t MAX_DEPTH = 128;
+
+    /**
+     * Frames of the sample buffer (reserved on start, used on demand).
+     */
+    static constexpr size_t BUFFER_FRAMES = 1 << 20;
+
+    EvaProfiler(EvaVM& vm);
+    ~EvaProfiler();
+
+    /**
+     * Starts sampling at the rate (samples per second of CPU time).
+     */
+    void start(int hz = DEFAULT_HZ);
+
+    /**
+     * Stops sampling and collects the pending samples.
+     */
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    /**
+     * Turns the pending samples into stacks.
+     */
+    void drain();
+
+    /**
+     * Writes the stacks in the collapsed format of flame graph tools,
+     * a line per stack, outermost frame first:
+     *
+     *   main+0x0a;fib+0x12;fib+0x12 42
+     *   main+0x0a;native:max 3
+     *
+     * Frames are code object names with the bytecode offset of the
+     * next instruction (the return address in callers), natives are
+     * prefixed with "native:". Frames running machine code show the
+     * offset of their entry, or no offset in callers. Samples outside
+     * of the execution (parsing, compiling) are "[vm]".
+     */
+    void writeCollapsed(std::ostream& out);
+
+    /**
+     * Code objects and natives of the pending samples, kept alive
+     * until they are drained.
+     */
+    void addGCRoots(std::vector<Object*>& roots);
+
+    const ProfilerStats& getStats() const { return stats_; }
+
+  private:
+    /**
+     * Frame of a sample: a code object or a native function, with the
+     * offset in the code. A sample is a header (nullptr object, offset
+     * is the depth) followed by its frames, innermost first.
+     */
+    struct SampleFrame {
+      Object* object;
+      uint32_t offset;
+    };
+
+    static constexpr uint32_t NO_OFFSET = UINT32_MAX;
+
+    static void handleSignal(int signal);
+
+    /**
+     * Records the VM state (in the signal handler).
+     */
+    void sample();
+
+    /**
+     * Appends the frame of the code object, with the offset of the
+     * address if it is in its code.
+     */
+    void addFrame(SampleFrame* frames, uint32_t& depth, CodeObject* co, const uint8_t* address);
+
+    static std::atomic<EvaProfiler*> active_;
+
+    EvaVM& vm_;
+
+    bool running_ = false;
+
+    std::unique_ptr<SampleFrame[]> buffer_;
+
+    /**
+     * Used frames of the buffer, written by the signal handler.
+     */
+    std::atomic<size_t> used_{0};
+    std::atomic<size_t> dropped_{0};
+
+    /**
+     * Sample counts of collapsed stacks.
+     */
+    std::map<std::string, size_t> stacks_;
+
+    ProfilerStats stats_;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "trace/EvaTraceDecoder.hpp"
+#include "image/EvaImage.hpp"
+#include "logging/Logger.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+static constexpr char MAGIC[4] = {'E', 'V', 'A', 'T'};
+
+static const char* LEVEL_NAMES[] = {"off", "calls", "instructions", "stack"};
+
+static const char* OBJECT_TYPE_NAMES[] = {"STRING", "CODE", "NATIVE", "FUNCTION", "CELL"};
+
+/**
+ * Reads trace file fields, every read is bounds checked.
+ */
+class TraceReader {
+  public:
+    TraceReader(const std::vector<uint8_t>& data) : data(data) {}
+
+    template <typename T>
+    T read() {
+      T value;
+      memcpy(&value, take(sizeof(T)), sizeof(T));
+      return value;
+    }
+
+    const uint8_t* take(size_t count) {
+      if (count > data.size() - offset) {
+        DIE << "[EvaTraceDecoder] Truncated trace";
+      }
+      auto bytes = &data[offset];
+      offset += count;
+      return bytes;
+    }
+
+  private:
+    const std::vector<uint8_t>& data;
+    size_t offset = 0;
+};
+
+EvaTraceDecoder::EvaTraceDecoder(const std::string& path) : global_(std::make_shared<Global>()) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    DIE << "[EvaTraceDecoder] Cannot open " << path;
+  }
+
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  TraceReader reader(data);
+
+  if (data.size() < sizeof(MAGIC) || memcmp(reader.take(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0) {
+    DIE << "[EvaTraceDecoder] Not a trace: " << path;
+  }
+
+  auto version = reader.read<uint32_t>();
+  if (version != EvaTracer::VERSION) {
+    DIE << "[EvaTraceDecoder] Incompatible trace version " << version;
+  }
+
+  auto level = reader.read<uint8_t>();
+  if (level > (uint8_t)TraceLevel::STACK) {
+    DIE << "[EvaTraceDecoder] Bad trace level " << (int)level;
+  }
+  level_ = (TraceLevel)level;
+  recorded_ = reader.read<uint64_t>();
+
+  // Images of all code objects name the same globals.
+  EvaCollector::Scope gcScope(&collector_);
+
+  auto codeCount = reader.read<uint32_t>();
+  for (uint32_t i = 0; i < codeCount; i++) {
+    auto size = reader.read<uint32_t>();
+    if (size == 0) {
+      // Dropped by the tracer, no record refers to it.
+      codeObjects_.push_back(nullptr);
+      continue;
+    }
+    auto image = reader.take(size);
+    codeObjects_.push_back(EvaImage::loadForDisassembly(image, size, *global_)[0]);
+  }
+
+  auto nativeCount = reader.read<uint32_t>();
+  for (uint32_t i = 0; i < nativeCount; i++) {
+    auto size = reader.read<uint32_t>();
+    natives_.emplace_back((const char*)reader.take(size), size);
+  }
+
+  auto recordCount = reader.read<uint32_t>();
+  records_.resize(recordCount);
+  memcpy(records_.data(), reader.take(recordCount * sizeof(TraceRecord)),
+         recordCount * sizeof(TraceRecord));
+
+  disassembler_ = std::make_unique<EvaDisassembler>(global_);
+}
+
+CodeObject* EvaTraceDecoder::codeObject(uint32_t id) {
+  if (id >= codeObjects_.size() || codeObjects_[id] == nullptr) {
+    DIE << "[EvaTraceDecoder] Bad code object id " << id;
+  }
+  return codeObjects_[id];
+}
+
+void EvaTraceDecoder::print() {
+  std::cout << "Trace: level=" << LEVEL_NAMES[(int)level_]
+    << " recorded=" << recorded_
+    << " kept=" << records_.size() << "\n\n";
+
+  for (auto& record : records_) {
+    std::cout << std::string(record.depth * 2, ' ');
+
+    switch (record.event) {
+      case TraceEvent::CALL:
+        std::cout << "CALL " << codeObject(record.code)->name << '\n';
+        continue;
+      case TraceEvent::RETURN:
+        std::cout << "RETURN " << codeObject(record.code)->name << '\n';
+        continue;
+      case TraceEvent::NATIVE:
+        std::cout << "NATIVE " << natives_.at(record.code) << '\n';
+        continue;
+      case TraceEvent::INSTRUCTION:
+        break;
+    }
+
+    auto co = codeObject(record.code);
+    std::cout << co->name << ' ';
+
+    if (record.offset >= co->code.size()) {
+      DIE << "[EvaTraceDecoder] Bad offset " << record.offset << " in " << co->name;
+    }
+    disassembler_->disassembleAt(co, record.offset);
+
+    if (level_ >= TraceLevel::STACK) {
+      std::cout << "  | stack " << record.stackSize;
+
+      switch (record.valueType) {
+        case TraceValue::NUMBER: {
+          double number;
+          memcpy(&number, &record.value, sizeof(number));
+          std::cout << ": " << number;
+          break;
+        }
+        case TraceValue::INTEGER:
+          std::cout << ": " << (int64_t)record.value;
+          break;
+        case TraceValue::BOOLEAN:
+          std::cout << ": " << (record.value ? "true" : "false");
+          break;
+        case TraceValue::OBJECT:
+          std::cout << ": " << (record.value < std::size(OBJECT_TYPE_NAMES)
+                                  ? OBJECT_TYPE_NAMES[record.value] : "OBJECT");
+          break;
+        case TraceValue::NONE:
+          break;
+      }
+    }
+
+    std::cout << '\n';
+  }
+}
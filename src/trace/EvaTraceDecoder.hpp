@@ -0,0 +1,60 @@
+/**
+ * Offline trace decoder.
+ */
+#ifndef SRC_TRACE_EVATRACEDECODER_HPP
+#define SRC_TRACE_EVATRACEDECODER_HPP
+
+#include "trace/EvaTracer.hpp"
+#include "gc/EvaCollector.hpp"
+#include "disassembler/EvaDisassembler.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Reads a trace file (see EvaTracer) and renders its records as text:
+ * calls and returns indented by the call depth, instructions through
+ * EvaDisassembler with the stack of the STACK level. The code objects
+ * are loaded from the images in the file, the program is not needed.
+ */
+class EvaTraceDecoder final {
+  public:
+    EvaTraceDecoder(const std::string& path);
+
+    /**
+     * Prints the records to the standard output.
+     */
+    void print();
+
+    TraceLevel getLevel() const { return level_; }
+
+    const std::vector<TraceRecord>& getRecords() const { return records_; }
+
+  private:
+    /**
+     * Code object of the id in a record.
+     */
+    CodeObject* codeObject(uint32_t id);
+
+    /**
+     * Owns the loaded code objects.
+     */
+    EvaCollector collector_;
+
+    std::shared_ptr<Global> global_;
+
+    std::unique_ptr<EvaDisassembler> disassembler_;
+
+    TraceLevel level_;
+
+    uint64_t recorded_;
+
+    std::vector<CodeObject*> codeObjects_;
+
+    std::vector<std::string> natives_;
+
+    std::vector<TraceRecord> records_;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "trace/EvaTracer.hpp"
+#include "image/EvaImage.hpp"
+#include "logging/Logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static constexpr char MAGIC[4] = {'E', 'V', 'A', 'T'};
+
+EvaTracer::EvaTracer(size_t capacity) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    DIE << "[EvaTracer] Capacity must be a power of two: " << capacity;
+  }
+
+  ring_.reset(new TraceRecord[capacity]);
+  mask_ = capacity - 1;
+}
+
+uint32_t EvaTracer::codeId(CodeObject* co) {
+  if (co == lastCode_) {
+    return lastCodeId_;
+  }
+
+  if (lastCode_ != nullptr) {
+    codeEnds_[lastCodeId_] = head_.load(std::memory_order_relaxed);
+  }
+
+  uint32_t id;
+  if (freeCodeIds_.empty()) {
+    id = codeObjects_.size();
+  } else {
+    id = freeCodeIds_.back();
+  }
+
+  auto [it, inserted] = codeIds_.emplace(co, id);
+  if (inserted) {
+    if (id == codeObjects_.size()) {
+      codeObjects_.push_back(co);
+      codeEnds_.push_back(0);
+    } else {
+      codeObjects_[id] = co;
+      freeCodeIds_.pop_back();
+    }
+  }
+
+  lastCode_ = co;
+  lastCodeId_ = it->second;
+  return lastCodeId_;
+}
+
+uint32_t EvaTracer::nativeId(NativeObject* native) {
+  auto [it, inserted] = nativeIds_.emplace(native, natives_.size());
+  if (inserted) {
+    natives_.push_back(native);
+  }
+  return it->second;
+}
+
+void EvaTracer::record(TraceEvent event, CodeObject* co, const uint8_t* ip, size_t depth) {
+  // Machine code does not keep ip in the bytecode.
+  auto offset = ip - co->code.data();
+  if (offset < 0 || (size_t)offset >= co->code.size()) {
+    offset = 0;
+  }
+
+  append({event, TraceValue::NONE, (uint16_t)depth, codeId(co), (uint32_t)offset, 0, 0});
+}
+
+void EvaTracer::recordNative(NativeObject* native, size_t depth) {
+  append({TraceEvent::NATIVE, TraceValue::NONE, (uint16_t)depth, nativeId(native), 0, 0, 0});
+}
+
+void EvaTracer::recordInstruction(CodeObject* co, const uint8_t* ip, size_t depth,
+                                  const EvaValue* stack, size_t stackSize) {
+  // Exit code of calls from outside the bytecode (HALT).
+  auto offset = ip - co->code.data();
+  if (offset < 0 || (size_t)offset >= co->code.size()) {
+    return;
+  }
+
+  TraceRecord record = {TraceEvent::INSTRUCTION, TraceValue::NONE, (uint16_t)depth,
+                        codeId(co), (uint32_t)offset, 0, 0};
+
+  if (level_ >= TraceLevel::STACK) {
+    record.stackSize = stackSize;
+
+    if (stackSize > 0) {
+      auto& top = stack[stackSize - 1];
+
+      if (IS_NUMBER(top)) {
+        auto number = AS_NUMBER(top);
+        record.valueType = TraceValue::NUMBER;
+        memcpy(&record.value, &number, sizeof(number));
+      } else if (IS_INTEGER(top)) {
+        record.valueType = TraceValue::INTEGER;
+        record.value = (uint64_t)AS_INTEGER(top);
+      } else if (IS_BOOLEAN(top)) {
+        record.valueType = TraceValue::BOOLEAN;
+        record.value = AS_BOOLEAN(top);
+      } else {
+        record.valueType = TraceValue::OBJECT;
+        record.value = (uint64_t)AS_OBJECT(top)->type;
+      }
+    }
+  }
+
+  append(record);
+}
+
+std::vector<TraceRecord> EvaTracer::snapshot() const {
+  auto capacity = mask_ + 1;
+  auto head = head_.load(std::memory_order_acquire);
+  auto first = head > capacity ? head - capacity : 0;
+
+  std::vector<TraceRecord> records;
+  records.reserve(head - first);
+  for (auto i = first; i < head; i++) {
+    records.push_back(ring_[i & mask_]);
+  }
+
+  // The writer may have overwritten the oldest records meanwhile
+  // (and be writing the one after its head).
+  auto newHead = head_.load(std::memory_order_acquire);
+  if (newHead + 1 > first + capacity) {
+    auto overwritten = std::min<uint64_t>(newHead + 1 - capacity - first, records.size());
+    records.erase(records.begin(), records.begin() + overwritten);
+  }
+
+  return records;
+}
+
+void EvaTracer::clear() {
+  head_.store(0, std::memory_order_release);
+  dropUnusedCode();
+}
+
+void EvaTracer::dropUnusedCode() {
+  auto capacity = mask_ + 1;
+  auto head = head_.load(std::memory_order_relaxed);
+  auto first = head > capacity ? head - capacity : 0;
+
+  for (uint32_t id = 0; id < codeObjects_.size(); id++) {
+    auto co = codeObjects_[id];
+    if (co == nullptr || co == lastCode_ || codeEnds_[id] > first) {
+      continue;
+    }
+
+    codeIds_.erase(co);
+    codeObjects_[id] = nullptr;
+    freeCodeIds_.push_back(id);
+  }
+}
+
+/**
+ * Trace file fields.
+ */
+template <typename T>
+static void writeField(std::ofstream& out, T value) {
+  out.write((const char*)&value, sizeof(value));
+}
+
+static void writeBytes(std::ofstream& out, const void* data, size_t size) {
+  writeField<uint32_t>(out, size);
+  out.write((const char*)data, size);
+}
+
+void EvaTracer::write(const std::string& path, Global& global) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    DIE << "[EvaTracer] Cannot write " << path;
+  }
+
+  out.write(MAGIC, sizeof(MAGIC));
+  writeField<uint32_t>(out, VERSION);
+  writeField<uint8_t>(out, (uint8_t)level_);
+  writeField<uint64_t>(out, getRecorded());
+
+  // Every code object is an image of its own (with the code nested
+  // in it), decoded by its id.
+  writeField<uint32_t>(out, codeObjects_.size());
+  for (auto co : codeObjects_) {
+    if (co == nullptr) {
+      writeField<uint32_t>(out, 0);
+      continue;
+    }
+    auto image = EvaImage::serialize(co, global);
+    writeBytes(out, image.data(), image.size());
+  }
+
+  writeField<uint32_t>(out, natives_.size());
+  for (auto native : natives_) {
+    writeBytes(out, native->name.data(), native->name.size());
+  }
+
+  auto records = snapshot();
+  writeField<uint32_t>(out, records.size());
+  out.write((const char*)records.data(), records.size() * sizeof(TraceRecord));
+
+  if (!out) {
+    DIE << "[EvaTracer] Cannot write " << path;
+  }
+}
+
+void EvaTracer::addGCRoots(std::vector<Object*>& roots) {
+  dropUnusedCode();
+
+  for (auto co : codeObjects_) {
+    if (co != nullptr) {
+      roots.push_back(co);
+    }
+  }
+  roots.insert(roots.end(), natives_.begin(), natives_.end());
+}
@@ -0,0 +1,227 @@
+/**
+ * Execution tracing.
+ */
+#ifndef SRC_TRACE_EVATRACER_HPP
+#define SRC_TRACE_EVATRACER_HPP
+
+#include "vm/EvaValue.hpp"
+#include "vm/Global.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Trace hooks in the interpreters (EVA_TRACE builds). Without them
+ * tracing costs nothing; with them a disabled trace costs a level
+ * check per instruction.
+ */
+#ifndef EVA_TRACE
+#define EVA_TRACE 0
+#endif
+
+/**
+ * What is recorded, each level includes the previous ones.
+ */
+enum class TraceLevel : uint8_t {
+  OFF,
+
+  // Calls and returns of functions, calls of natives.
+  CALLS,
+
+  // Every executed instruction.
+  INSTRUCTIONS,
+
+  // With the stack size and the value on top of the stack.
+  STACK,
+};
+
+enum class TraceEvent : uint8_t {
+  CALL,
+  RETURN,
+  NATIVE,
+  INSTRUCTION,
+};
+
+/**
+ * Type of the value of a record (STACK level).
+ */
+enum class TraceValue : uint8_t {
+  NONE,
+  NUMBER,
+  BOOLEAN,
+  OBJECT,
+  INTEGER,
+};
+
+/**
+ * Binary trace event.
+ */
+struct TraceRecord {
+  TraceEvent event;
+  TraceValue valueType;
+
+  /**
+   * Call depth (frames on the call stack).
+   */
+  uint16_t depth;
+
+  /**
+   * Code object id (NATIVE: native id) of the trace.
+   */
+  uint32_t code;
+
+  /**
+   * Bytecode offset of the instruction, or of the call site (CALL:
+   * the callee is entered at 0, RETURN: the RETURN instruction).
+   */
+  uint32_t offset;
+
+  /**
+   * Values on the stack before the instruction (STACK level).
+   */
+  uint32_t stackSize;
+
+  /**
+   * Value on top of the stack: NUMBER double bits, INTEGER int64
+   * bits, BOOLEAN 0/1, OBJECT the ObjectType.
+   */
+  uint64_t value;
+};
+
+/**
+ * Records trace events of a VM into a ring buffer of binary records:
+ * the newest records are kept, nothing is formatted while running.
+ * Code objects and natives are referred to by ids assigned on their
+ * first record. A code object is kept alive while records in the ring
+ * refer to it: once they are overwritten, the collector drops it (see
+ * addGCRoots) and its id is reused.
+ *
+ * The ring has a single writer (the VM thread) and is lock-free: the
+ * head is published after the record is written, and a reader
+ * (snapshot) drops records the writer overwrote while they were
+ * copied.
+ *
+ * The trace file (write) holds the records and the code objects as
+ * bytecode images, so it is decoded without the program (see
+ * EvaTraceDecoder):
+ *
+ *   "EVAT", u32 version, u8 level, u64 recorded count,
+ *   u32 count + code object images (u32 size + EvaImage bytes, empty
+ *   for a dropped id),
+ *   u32 count + native names (u32 length + bytes),
+ *   u32 count + records (oldest first)
+ */
+class EvaTracer final {
+  public:
+    static constexpr uint32_t VERSION = 2;
+
+    /**
+     * Default ring capacity in records (a power of two).
+     */
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+    EvaTracer(size_t capacity = DEFAULT_CAPACITY);
+
+    void setLevel(TraceLevel level) { level_ = level; }
+    TraceLevel getLevel() const { return level_; }
+
+    /**
+     * Whether events of the level are recorded.
+     */
+    bool isTracing(TraceLevel level) const { return level_ >= level; }
+
+    /**
+     * Records the event in the code object at the address.
+     */
+    void record(TraceEvent event, CodeObject* co, const uint8_t* ip, size_t depth);
+
+    /**
+     * Records a call of the native function.
+     */
+    void recordNative(NativeObject* native, size_t depth);
+
+    /**
+     * Records the instruction at ip, with the stack (STACK level).
+     */
+    void recordInstruction(CodeObject* co, const uint8_t* ip, size_t depth,
+                           const EvaValue* stack, size_t stackSize);
+
+    /**
+     * Records written since the start, the ring keeps the last
+     * capacity of them.
+     */
+    uint64_t getRecorded() const { return head_.load(std::memory_order_acquire); }
+
+    /**
+     * Copies the records in the ring, oldest first.
+     */
+    std::vector<TraceRecord> snapshot() const;
+
+    /**
+     * Drops all records.
+     */
+    void clear();
+
+    /**
+     * Writes the trace file.
+     */
+    void write(const std::string& path, Global& global);
+
+    /**
+     * Traced code objects still referred to by records in the ring,
+     * the others are dropped.
+     */
+    void addGCRoots(std::vector<Object*>& roots);
+
+  private:
+    uint32_t codeId(CodeObject* co);
+
+    uint32_t nativeId(NativeObject* native);
+
+    /**
+     * Appends the record, overwriting the oldest one if full.
+     */
+    void append(const TraceRecord& record) {
+      auto head = head_.load(std::memory_order_relaxed);
+      ring_[head & mask_] = record;
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    TraceLevel level_ = TraceLevel::OFF;
+
+    std::unique_ptr<TraceRecord[]> ring_;
+    size_t mask_;
+
+    std::atomic<uint64_t> head_{0};
+
+    /**
+     * Drops the code objects no record in the ring refers to.
+     */
+    void dropUnusedCode();
+
+    /**
+     * Traced code objects and natives by id, the last one is cached
+     * since instructions of a function come in runs.
+     */
+    std::vector<CodeObject*> codeObjects_;
+    std::unordered_map<CodeObject*, uint32_t> codeIds_;
+    CodeObject* lastCode_ = nullptr;
+    uint32_t lastCodeId_ = 0;
+
+    /**
+     * Head after the last record of each code object (the cached one
+     * excepted, set when another one is recorded), and ids of dropped
+     * code objects to reuse.
+     */
+    std::vector<uint64_t> codeEnds_;
+    std::vector<uint32_t> freeCodeIds_;
+
+    std::vector<NativeObject*> natives_;
+    std::unordered_map<NativeObject*, uint32_t> nativeIds_;
+};
+
+#endif
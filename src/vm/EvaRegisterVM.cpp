@@ -0,0 +1,318 @@
+/**
+ * Register tier interpreter loop.
+ *
+ * Frame registers live on the VM stack: bp points to r0 (the function),
+ * registers of the callee frame start at the callee register of the
+ * caller, so arguments are passed in place.
+ *
+ * sp is kept at the high-water mark of the frames: every slot below it
+ * is either initialized by the frame setup or written by the code, so
+ * the collector never scans a stale slot.
+ */
+
+#include "EvaVM.hpp"
+#include "RegOpCode.hpp"
+
+#define OPCODE(op) ROP_##op
+#include "InterpreterMacros.hpp"
+
+#define REG(index) bp[index]
+
+// Integers which don't overflow inline, the rest by numbersOp.
+#define BINARY_OP(checked, numbersOp) do {                          \
+    auto dst = next_byte();                                         \
+    auto& op1 = REG(next_byte());                                   \
+    auto& op2 = REG(next_byte());                                   \
+    int64_t result;                                                 \
+                                                                    \
+    if (IS_INTEGER(op1) && IS_INTEGER(op2) &&                       \
+        checked(AS_INTEGER(op1), AS_INTEGER(op2), &result)) {       \
+      REG(dst) = INTEGER(result);                                   \
+    } else {                                                        \
+      REG(dst) = numbersOp(op1, op2);                               \
+    }                                                               \
+} while (0)
+
+// rA = function(K[index]) capturing cells rC..rC+N.
+#define MAKE_FUNCTION(next_index) do {                              \
+    auto dst = next_byte();                                         \
+    auto co = AS_CODE(fn->co->constants[next_index()]);             \
+    auto firstCell = next_byte();                                   \
+    auto cellsCount = next_byte();                                  \
+                                                                    \
+    auto fnValue = MEM(ALLOC_FUNCTION, co);                         \
+    auto closure = AS_FUNCTION(fnValue);                            \
+                                                                    \
+    for (auto i = 0; i < cellsCount; i++) {                         \
+      closure->cells.push_back(AS_CELL(REG(firstCell + i)));        \
+    }                                                               \
+                                                                    \
+    REG(dst) = fnValue;                                             \
+} while (0)
+
+void EvaVM::enterRegisterFrame(EvaValue* base, size_t initialized) {
+  auto frameEnd = base + fn->co->frameSize;
+
+  if (frameEnd > &stack[STACK_LIMIT]) {
+    DIE << "Stack overflow (limit: " << STACK_LIMIT << " slots)";
+  }
+
+  for (auto slot = base + initialized; slot < frameEnd; slot++) {
+    *slot = NUMBER(0);
+  }
+
+  bp = base;
+  ip = &fn->co->code[0];
+
+  if (sp < frameEnd) {
+    sp = frameEnd;
+  }
+}
+
+EvaValue EvaVM::evalRegister() {
+#if EVA_THREADED_DISPATCH
+  static void* const dispatchTable[] = { EVA_REG_BYTECODES(LABEL_ADDRESS) };
+
+  DISPATCH();
+#else
+  while(true) {
+    TRACE_INSTRUCTION();
+    COUNT_INSTRUCTION();
+    PROFILE_OPCODE();
+    auto bytecode = next_byte();
+    switch (bytecode) {
+#endif
+      INSTRUCTION(HALT):
+        return REG(next_byte());
+
+      INSTRUCTION(LOADK): {
+        auto dst = next_byte();
+        REG(dst) = fn->co->constants[next_byte()];
+        DISPATCH();
+      }
+
+      INSTRUCTION(MOVE): {
+        auto dst = next_byte();
+        REG(dst) = REG(next_byte());
+        DISPATCH();
+      }
+
+      INSTRUCTION(ADD): {
+        auto dst = next_byte();
+        auto op1 = REG(next_byte());
+        auto op2 = REG(next_byte());
+
+        int64_t sum;
+        if (IS_INTEGER(op1) && IS_INTEGER(op2) &&
+            CHECKED_ADD(AS_INTEGER(op1), AS_INTEGER(op2), &sum)) {
+          REG(dst) = INTEGER(sum);
+        } else if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {
+          REG(dst) = addNumbers(op1, op2);
+        } else if (IS_STRING(op1) && IS_STRING(op2)) {
+          auto string = AS_CPPSTRING(op1) + AS_CPPSTRING(op2);
+          REG(dst) = MEM(ALLOC_STRING, string);
+        } else {
+          DIE << "Incompatible types in addition \n";
+        }
+        DISPATCH();
+      }
+
+      INSTRUCTION(SUB):
+        BINARY_OP(CHECKED_SUB, subtractNumbers);
+        DISPATCH();
+
+      INSTRUCTION(MUL):
+        BINARY_OP(CHECKED_MUL, multiplyNumbers);
+        DISPATCH();
+
+      INSTRUCTION(DIV): {
+        auto dst = next_byte();
+        auto& op1 = REG(next_byte());
+        auto& op2 = REG(next_byte());
+        REG(dst) = divideNumbers(op1, op2);
+        DISPATCH();
+      }
+
+      INSTRUCTION(CMP): {
+        auto dst = next_byte();
+        auto op1 = REG(next_byte());
+        auto op2 = REG(next_byte());
+        auto op = next_byte();
+
+        if (IS_INTEGER(op1) && IS_INTEGER(op2)) {
+          REG(dst) = BOOLEAN(compareValues(op, AS_INTEGER(op1), AS_INTEGER(op2)));
+        } else if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {
+          REG(dst) = BOOLEAN(compareNumbers(op, op1, op2));
+        } else if (IS_STRING(op1) && IS_STRING(op2)) {
+          REG(dst) = BOOLEAN(compareStrings(op, AS_STRING(op1), AS_STRING(op2)));
+        } else {
+          DIE << "Incompatible types in comparison \n";
+        }
+        DISPATCH();
+      }
+
+      INSTRUCTION(JMP): {
+        ip = TO_ADDRESS(next_short());
+        DISPATCH();
+      }
+
+      INSTRUCTION(JMP_IF_FALSE): {
+        auto cond = AS_BOOLEAN(REG(next_byte()));
+        auto address = next_short();
+
+        if (!cond) {
+          ip = TO_ADDRESS(address);
+        }
+        DISPATCH();
+      }
+
+      INSTRUCTION(GET_GLOBAL): {
+        auto dst = next_byte();
+        REG(dst) = global->get(next_byte()).value;
+        DISPATCH();
+      }
+
+      INSTRUCTION(SET_GLOBAL): {
+        auto globalIndex = next_byte();
+        global->set(globalIndex, REG(next_byte()));
+        DISPATCH();
+      }
+
+      // Registers of the defining (caller) frame.
+      INSTRUCTION(GET_OUTER): {
+        auto dst = next_byte();
+        REG(dst) = (csp - 1)->bp[next_byte()];
+        DISPATCH();
+      }
+
+      INSTRUCTION(SET_OUTER): {
+        auto reg = next_byte();
+        (csp - 1)->bp[reg] = REG(next_byte());
+        DISPATCH();
+      }
+
+      // Cell values.
+      INSTRUCTION(GET_CELL): {
+        auto dst = next_byte();
+        REG(dst) = *fn->cells[next_byte()]->location;
+        DISPATCH();
+      }
+
+      INSTRUCTION(SET_CELL): {
+        auto cellIndex = next_byte();
+        *fn->cells[cellIndex]->location = REG(next_byte());
+        DISPATCH();
+      }
+
+      INSTRUCTION(LOAD_CELL): {
+        auto dst = next_byte();
+        REG(dst) = CELL(fn->cells[next_byte()]);
+        DISPATCH();
+      }
+
+      INSTRUCTION(CAPTURE): {
+        auto dst = next_byte();
+        REG(dst) = CELL(captureCell(&REG(next_byte())));
+        DISPATCH();
+      }
+
+      INSTRUCTION(CLOSE): {
+        closeCells(&REG(next_byte()));
+        DISPATCH();
+      }
+
+      INSTRUCTION(MAKE_FUNCTION):
+        MAKE_FUNCTION(next_byte);
+        DISPATCH();
+
+      INSTRUCTION(CALL): {
+        auto base = next_byte();
+        auto argc = next_byte();
+        auto fnValue = REG(base);
+
+        // Native functions take arguments from the top of the stack.
+        if (IS_NATIVE(fnValue)) {
+          auto frameTop = sp;
+
+          for (auto i = 0; i <= argc; i++) {
+            push(REG(base + i));
+          }
+
+          callNative(AS_NATIVE(fnValue));
+
+          REG(base) = pop();
+          sp = frameTop;
+
+          DISPATCH();
+        }
+
+        // User functions:
+        auto callee = AS_FUNCTION(fnValue);
+        checkArity(callee, argc);
+        pushFrame();
+
+        fn = callee;
+        enterRegisterFrame(&REG(base), argc + 1);
+        traceCall(TraceEvent::CALL);
+
+        DISPATCH();
+      }
+
+      INSTRUCTION(RETURN): {
+        closeCells(bp);
+
+        // r0 of the callee is the callee register of the caller,
+        // the result replaces the function there.
+        REG(0) = REG(next_byte());
+        traceCall(TraceEvent::RETURN);
+        popFrame();
+        DISPATCH();
+      }
+
+      // Wide forms: the constant or global index is 2 bytes.
+      INSTRUCTION(LOADK_WIDE): {
+        auto dst = next_byte();
+        REG(dst) = fn->co->constants[next_short()];
+        DISPATCH();
+      }
+
+      INSTRUCTION(GET_GLOBAL_WIDE): {
+        auto dst = next_byte();
+        REG(dst) = global->get(next_short()).value;
+        DISPATCH();
+      }
+
+      INSTRUCTION(SET_GLOBAL_WIDE): {
+        auto globalIndex = next_short();
+        global->set(globalIndex, REG(next_byte()));
+        DISPATCH();
+      }
+
+      INSTRUCTION(MAKE_FUNCTION_WIDE):
+        MAKE_FUNCTION(next_short);
+        DISPATCH();
+
+      // Wide jumps: the address is 4 bytes.
+      INSTRUCTION(JMP_WIDE): {
+        ip = TO_ADDRESS(next_int());
+        DISPATCH();
+      }
+
+      INSTRUCTION(JMP_IF_FALSE_WIDE): {
+        auto cond = AS_BOOLEAN(REG(next_byte()));
+        auto address = next_int();
+
+        if (!cond) {
+          ip = TO_ADDRESS(address);
+        }
+        DISPATCH();
+      }
+
+#if !EVA_THREADED_DISPATCH
+      default:
+        DIE << "Illegal bytecode: " << HEX(bytecode) << '\n';
+        DISPATCH();
+    }
+  }
+#endif
+}
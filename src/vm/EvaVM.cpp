@@ -1,126 +1,378 @@
 #include "EvaVM.hpp"
 #include "OpCode.hpp"
+#include "RegOpCode.hpp"
+#include "image/EvaImage.hpp"
+#include "isolate/EvaProgram.hpp"
+#include "parser/EvaFormReader.hpp"
+
+#define OPCODE(op) OP_##op
+#include "InterpreterMacros.hpp"
+
+// Integers which don't overflow inline, the rest by numbersOp.
+#define BINARY_OP(checked, numbersOp) do {                          \
+    auto op2 = pop();                                               \
+    auto op1 = pop();                                               \
+    int64_t result;                                                 \
+                                                                    \
+    if (IS_INTEGER(op1) && IS_INTEGER(op2) &&                       \
+        checked(AS_INTEGER(op1), AS_INTEGER(op2), &result)) {       \
+      push(INTEGER(result));                                        \
+    } else {                                                        \
+      push(numbersOp(op1, op2));                                    \
+    }                                                               \
+} while (0)
+
+// Adds by the operand types, one test of each: the generic ADD at the
+// site (nullptr elsewhere) is quickened to the form of the types.
+#define ADD_VALUES(op1, op2, site) do {                             \
+    if (IS_INTEGER(op1) && IS_INTEGER(op2)) {                       \
+      if (site) quicken(site, OP_ADD_INT);                          \
+      push(addNumbers(op1, op2));                                   \
+    } else if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {                \
+      if (site) quicken(site, OP_ADD_NUM);                          \
+      push(addNumbers(op1, op2));                                   \
+    } else if (IS_STRING(op1) && IS_STRING(op2)) {                  \
+      if (site) quicken(site, OP_ADD_STR);                          \
+      /* Operands are not on the stack anymore: concatenate */      \
+      /* before a possible collection. */                           \
+      auto string = AS_CPPSTRING(op1) + AS_CPPSTRING(op2);          \
+      push(MEM(ALLOC_STRING, string));                              \
+    } else {                                                        \
+      DIE << "Incompatible types in addition \n";                   \
+    }                                                               \
+} while (0)
 
-#define BINARY_OP(op) do {              \
-    auto op2 = AS_NUMBER(pop());        \
-    auto op1 = AS_NUMBER(pop());        \
-    push(NUMBER(op1 op op2));           \
+#define CMP_VALUES(op, op1, op2) do {                                        \
+    if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {                               \
+      push(BOOLEAN(compareNumbers(op, op1, op2)));                          \
+    } else if (IS_STRING(op1) && IS_STRING(op2)) {                          \
+      push(BOOLEAN(compareStrings(op, AS_STRING(op1), AS_STRING(op2))));    \
+    } else {                                                                \
+      DIE << "Incompatible types in comparison \n";                         \
+    }                                                                       \
 } while (0)
 
-#define COMPARE_VALUES(op, v1, v2) do { \
-    bool res{};                         \
-    switch (op) {                       \
-    case 0:                             \
-        res = v1 < v2;                  \
-        break;                          \
-    case 1:                             \
-        res = v1 > v2;                  \
-        break;                          \
-    case 2:                             \
-        res = v1 == v2;                 \
-        break;                          \
-    case 3:                             \
-        res = v1 >= v2;                 \
-        break;                          \
-    case 4:                             \
-        res = v1 <= v2;                 \
-        break;                          \
-    case 5:                             \
-        res = v1 != v2;                 \
-        break;                          \
-    default:                            \
-        DIE << "Bad comparison op!";    \
-    }                                   \
-    push(BOOLEAN(res));                 \
+// Fused CMP <op>; JMP_IF_FALSE: the comparison is known statically.
+#define COMPARE_AND_JUMP(op, cmp) do {                              \
+    auto address = next_short();                                    \
+    auto op2 = pop();                                               \
+    auto op1 = pop();                                               \
+    bool result;                                                    \
+                                                                    \
+    if (IS_INTEGER(op1) && IS_INTEGER(op2)) {                       \
+      result = AS_INTEGER(op1) op AS_INTEGER(op2);                  \
+    } else if (IS_NUMERIC(op1) && IS_NUMERIC(op2)) {                \
+      result = TO_NUMBER(op1) op TO_NUMBER(op2);                    \
+    } else if (IS_STRING(op1) && IS_STRING(op2)) {                  \
+      result = compareStrings(cmp, AS_STRING(op1), AS_STRING(op2)); \
+    } else {                                                        \
+      DIE << "Incompatible types in comparison \n";                 \
+      result = false;                                               \
+    }                                                               \
+                                                                    \
+    if (!result) {                                                  \
+      ip = TO_ADDRESS(address);                                     \
+    }                                                               \
 } while (0)
 
-#define TO_ADDRESS(index) (&fn->co->code[index])
+// Pops the locals of a scope, leaving its result on the top.
+#define SCOPE_EXIT(vars) do {                                       \
+    /* Captured locals of the scope (and params of the function */  \
+    /* body) leave the stack. */                                    \
+    closeCells(sp - 1 - vars);                                      \
+                                                                    \
+    *(sp - 1 - vars) = peek(0);                                     \
+                                                                    \
+    popN(vars);                                                     \
+} while (0)
 
 EvaValue EvaVM::exec(const std::string& program) {
+  EvaCollector::Scope gcScope(collector.get());
+
+  if (compileCache != nullptr) {
+    compileCached(program);
+  } else {
+    compileProgram(program);
+  }
+  return run();
+}
+
+void EvaVM::compileImage(const std::string& program, const std::string& path) {
+  EvaCollector::Scope gcScope(collector.get());
+
+  compileProgram(program);
+  EvaImage::write(path, compiler->getMainFunction()->co, *global);
+}
+
+EvaValue EvaVM::execStream(std::istream& input) {
+  EvaCollector::Scope gcScope(collector.get());
+
+  EvaFormReader reader(input);
+  std::string_view form;
+  EvaValue result = NUMBER(0);
+
+  while (reader.next(form)) {
+    // Code of the executed forms is garbage unless reachable from
+    // the globals: collect it between forms.
+    if (collector->shouldCollect()) {
+      gc();
+    }
+
+    // Each form is a program of its own: (begin <form>).
+    auto ast = parser->parse(form);
+    Exp program[] = {Exp(ExpType::SYMBOL, "begin"), ast};
+    auto block = Exp(program, 2);
+
+    compileAst(block);
+    result = run();
+  }
+
+  return result;
+}
+
+EvaValue EvaVM::execImage(const std::string& path) {
+  EvaCollector::Scope gcScope(collector.get());
+
+  // No parsing or compiling: the code is installed as is.
+  compiler->setCode(EvaImage::load(path, *global));
+  return run();
+}
+
+EvaValue EvaVM::exec(const EvaProgram& program) {
+  if (program.getTier() != tier) {
+    DIE << "[EvaVM] exec: the program is compiled for another execution tier";
+  }
+
+  EvaCollector::Scope gcScope(collector.get());
+
+  // The code refers to the globals by index: they must be laid out
+  // as in the VM the program was compiled with.
+  auto& names = program.getGlobalNames();
+  for (size_t i = 0; i < names.size(); i++) {
+    global->define(names[i]);
+
+    if (global->getGlobalIndex(names[i]) != (int)i) {
+      DIE << "[EvaVM] exec: global " << names[i] << " of the program is defined at another index";
+    }
+  }
+
+  compiler->setCode(program.getCodeObjects());
+  return run();
+}
+
+/**
+ * Return addresses of the frame entered by call(): the callee returns
+ * to a HALT of its tier, which ends the interpreter loop.
+ */
+static uint8_t callExitCode[] = { OP_HALT };
+static uint8_t registerCallExitCode[] = { ROP_HALT, 0 };
+
+EvaValue EvaVM::call(const std::string& name, std::initializer_list<EvaValue> args) {
+  return call(name, args.begin(), args.size());
+}
+
+EvaValue EvaVM::call(const std::string& name, const EvaValue* args, size_t argc) {
+  auto index = global->getGlobalIndex(name);
+  if (index < 0) {
+    DIE << "[EvaVM] call: undefined function " << name;
+  }
+
+  EvaCollector::Scope gcScope(collector.get());
+  return callValue(global->get(index).value, args, argc);
+}
+
+EvaValue EvaVM::callValue(const EvaValue& fnValue, const EvaValue* args, size_t argc) {
+  if (!IS_FUNCTION(fnValue) && !IS_NATIVE(fnValue)) {
+    DIE << "[EvaVM] call: " << evaValueToConstantString(fnValue) << " is not a function";
+  }
+
+  // Clean stacks, as for run().
+  sp = &stack[0];
+  csp = &callStack[0];
+  openCells = nullptr;
+
+  auto base = sp;
+  push(fnValue);
+  for (size_t i = 0; i < argc; i++) {
+    push(args[i]);
+  }
+
+  EvaValue result;
+
+  if (IS_NATIVE(fnValue)) {
+    callNative(AS_NATIVE(fnValue));
+    result = pop();
+  } else {
+    auto callee = AS_FUNCTION(fnValue);
+    checkArity(callee, argc);
+
+    // The exit frame (of the main function): its HALT returns the
+    // result the callee leaves at the base.
+    fn = compiler->getMainFunction();
+    std::atomic_signal_fence(std::memory_order_release);
+    running = true;
+
+    bp = base;
+    ip = callee->co->tier == ExecutionTier::REGISTER ? registerCallExitCode : callExitCode;
+    pushFrame();
+
+    fn = callee;
+
+    if (callee->co->tier == ExecutionTier::REGISTER) {
+      enterRegisterFrame(base, argc + 1);
+      traceCall(TraceEvent::CALL);
+      result = evalRegister();
+    } else {
+      ip = &callee->co->code[0];
+      traceCall(TraceEvent::CALL);
+      result = enterJit(callee->co) ? pop() : eval();
+    }
+  }
+
+  running = false;
+  sp = base;
+
+  return result;
+}
+
+void EvaVM::disassemble(const std::string& program) {
+  EvaCollector::Scope gcScope(collector.get());
+
+  compileProgram(program);
+  compiler->disassembleBytecode();
+}
+
+Exp EvaVM::parseProgram(const std::string& program) {
+  return parser->parse("(begin " + program + ")");
+}
+
+void EvaVM::compileProgram(const std::string& program) {
   // 1. Parse AST
-  auto ast = parser->parse("(begin " + program + ")");
+  auto ast = parseProgram(program);
 
   // 2. Compile AST to bytecode.
-  compiler->compile(ast);
+  compileAst(ast);
+}
+
+void EvaVM::compileCached(const std::string& program) {
+  // The bytecode depends on the tier and on the compiler options.
+  std::string config = tier == ExecutionTier::REGISTER ? "register" : "stack";
+  config += compiler->getPeephole() ? "+peephole" : "";
+  config += compiler->getEscapeAnalysis() ? "" : "+noescape";
+  config += compiler->getIntegers() ? "" : "+nointegers";
+
+  auto key = EvaCompileCache::key(program, config, *global);
+
+  auto codeObjects = compileCache->lookup(key, *global);
+  if (!codeObjects.empty()) {
+    compiler->setCode(codeObjects);
+    return;
+  }
+
+  compileProgram(program);
+  compileCache->store(key, compiler->getMainFunction()->co, *global);
+}
+
+void EvaVM::compileAst(Exp& ast) {
+  if (tier == ExecutionTier::REGISTER) {
+    compiler->compileRegister(ast);
+  } else {
+    compiler->compile(ast);
+  }
+}
+
+EvaValue EvaVM::run() {
   fn = compiler->getMainFunction();
 
   ip = &fn->co->code[0];
+  lastOpcode = OP_HALT;
   sp = &stack[0];
   bp = sp;
+  csp = &callStack[0];
+  openCells = nullptr;
+
+  std::atomic_signal_fence(std::memory_order_release);
+  running = true;
+  EvaValue result;
+
+  if (fn->co->tier == ExecutionTier::REGISTER) {
+    enterRegisterFrame(bp, 0);
+    result = evalRegister();
+  } else if (enterJit(fn->co)) {
+    // Compiled main function leaves the result on the stack.
+    result = pop();
+  } else {
+    result = eval();
+  }
 
-  // Debug assembly
-  compiler->disassembleBytecode();
-
-  return eval();
+  running = false;
+  return result;
 }
 
 EvaValue EvaVM::eval() {
+#if EVA_THREADED_DISPATCH
+  static void* const dispatchTable[] = { EVA_BYTECODES(LABEL_ADDRESS) };
+
+  DISPATCH();
+#else
   while(true) {
-    dumpStack();
+    TRACE_INSTRUCTION();
+    COUNT_INSTRUCTION();
+    PROFILE_OPCODE();
     auto bytecode = next_byte();
     switch (bytecode) {
-      case OP_HALT:
+#endif
+      INSTRUCTION(HALT):
         return pop();
 
-      case OP_CONST:
+      INSTRUCTION(CONST):
         push(fn->co->constants[next_byte()]);
-        break;
+        DISPATCH();
 
-      case OP_ADD: {
+      INSTRUCTION(ADD): {
         auto op2 = pop();
         auto op1 = pop();
-
-        if (IS_NUMBER(op1) && IS_NUMBER(op2)) {
-          auto n1 = AS_NUMBER(op1);
-          auto n2 = AS_NUMBER(op2);
-          push(NUMBER(n1 + n2));
-        } else if (IS_STRING(op1) && IS_STRING(op2)) {
-          auto s1 = AS_CPPSTRING(op1);
-          auto s2 = AS_CPPSTRING(op2);
-          push(ALLOC_STRING(s1 + s2));
-        } else {
-          DIE << "Incompatible types in addition \n";
-        }
-        break;
+        ADD_VALUES(op1, op2, ip - 1);
+        DISPATCH();
       }
 
-      case OP_SUB:
-        BINARY_OP(-);
-        break;
+      INSTRUCTION(SUB):
+        BINARY_OP(CHECKED_SUB, subtractNumbers);
+        DISPATCH();
 
-      case OP_MUL:
-        BINARY_OP(*);
-        break;
+      INSTRUCTION(MUL):
+        BINARY_OP(CHECKED_MUL, multiplyNumbers);
+        DISPATCH();
 
-      case OP_DIV:
-        BINARY_OP(/);
-        break;
+      INSTRUCTION(DIV): {
+        auto op2 = pop();
+        auto op1 = pop();
+        push(divideNumbers(op1, op2));
+        DISPATCH();
+      }
 
-      case OP_CMP: {
+      INSTRUCTION(CMP): {
         auto op = next_byte();
 
         auto op2 = pop();
         auto op1 = pop();
 
-        if (IS_NUMBER(op1) && IS_NUMBER(op2)) {
-          auto v1 = AS_NUMBER(op1);
-          auto v2 = AS_NUMBER(op2);
-          COMPARE_VALUES(op, v1, v2);
-        } else if (IS_STRING(op1) && IS_STRING(op2)) {
-          auto s1 = AS_CPPSTRING(op1);
-          auto s2 = AS_CPPSTRING(op2);
-          COMPARE_VALUES(op, s1, s2);
+        if (op == 0 && IS_INTEGER(op1) && IS_INTEGER(op2)) {
+          quicken(ip - 2, OP_LT_INT);
+        } else if (op == 0 && IS_NUMERIC(op1) && IS_NUMERIC(op2)) {
+          quicken(ip - 2, OP_LT_NUM);
         }
 
-        break;
+        CMP_VALUES(op, op1, op2);
+        DISPATCH();
       }
 
-      case OP_JMP: {
+      INSTRUCTION(JMP): {
         ip = TO_ADDRESS(next_short());
-        break;
+        DISPATCH();
       }
 
-      case OP_JMP_IF_FALSE: {
+      INSTRUCTION(JMP_IF_FALSE): {
         auto cond = AS_BOOLEAN(pop()); // TODO: TO_BOOLEAN converter
 
         auto address = next_short();
@@ -128,23 +380,23 @@ EvaValue EvaVM::eval() {
         if (!cond) {
           ip = TO_ADDRESS(address);
         }
-        break;
+        DISPATCH();
       }
 
-      case OP_GET_GLOBAL: {
+      INSTRUCTION(GET_GLOBAL): {
         auto globalIndex = next_byte();
         push(global->get(globalIndex).value);
-        break;
+        DISPATCH();
       }
 
-      case OP_SET_GLOBAL: {
+      INSTRUCTION(SET_GLOBAL): {
         auto globalIndex = next_byte();
         auto value = peek();
         global->set(globalIndex, value);
-        break;
+        DISPATCH();
       }
 
-      case OP_GET_LOCAL: {
+      INSTRUCTION(GET_LOCAL): {
         auto localIndex = next_byte();
 #if 0
         if (0 < localIndex && localIndex >= STACK_LIMIT) {
@@ -152,10 +404,10 @@ EvaValue EvaVM::eval() {
         }
 #endif
         push(bp[localIndex]);
-        break;
+        DISPATCH();
       }
 
-      case OP_SET_LOCAL: {
+      INSTRUCTION(SET_LOCAL): {
         auto localIndex = next_byte();
         auto value = peek(0);
 #if 0
@@ -164,83 +416,95 @@ EvaValue EvaVM::eval() {
         }
 #endif
         bp[localIndex] = value;
-        break;
+        DISPATCH();
+      }
+
+      // Locals of the defining (caller) frame.
+      INSTRUCTION(GET_OUTER): {
+        auto localIndex = next_byte();
+        push((csp - 1)->bp[localIndex]);
+        DISPATCH();
+      }
+
+      INSTRUCTION(SET_OUTER): {
+        auto localIndex = next_byte();
+        (csp - 1)->bp[localIndex] = peek(0);
+        DISPATCH();
       }
 
       // Cell values.
-      case OP_GET_CELL: {
+      INSTRUCTION(GET_CELL): {
         auto cellIndex = next_byte();
-        push(fn->cells[cellIndex]->value);
-        break;
+        push(*fn->cells[cellIndex]->location);
+        DISPATCH();
       }
 
-      case OP_SET_CELL: {
+      INSTRUCTION(SET_CELL): {
         auto cellIndex = next_byte();
-        auto value = peek(0);
-
-        if (fn->cells.size() <= cellIndex) {
-          fn->cells.push_back(AS_CELL(ALLOC_CELL(value)));
-        } else {
-          // Update the cell value.
-          fn->cells[cellIndex]->value = value;
-        }
-        break;
+        *fn->cells[cellIndex]->location = peek(0);
+        DISPATCH();
       }
 
-      case OP_LOAD_CELL: {
+      INSTRUCTION(LOAD_CELL): {
         auto cellIndex = next_byte();
         push(CELL(fn->cells[cellIndex]));
-        break;
+        DISPATCH();
+      }
+
+      INSTRUCTION(CAPTURE_LOCAL): {
+        auto localIndex = next_byte();
+        push(CELL(captureCell(&bp[localIndex])));
+        DISPATCH();
       }
 
-      case OP_MAKE_FUNCTION: {
+      INSTRUCTION(MAKE_FUNCTION): {
         auto co = AS_CODE(pop());
         auto cellsCount = next_byte();
-        auto fnValue = ALLOC_FUNCTION(co);
+        auto fnValue = MEM(ALLOC_FUNCTION, co);
         auto fn = AS_FUNCTION(fnValue);
 
-        for (auto i = 0; i < cellsCount; i++) {
-          fn->cells.push_back(AS_CELL(pop()));
+        // Cells are pushed in the order of cellNames.
+        fn->cells.resize(cellsCount);
+        for (auto i = cellsCount; i > 0; i--) {
+          fn->cells[i - 1] = AS_CELL(pop());
         }
 
         push(fnValue);
-        break;
+        DISPATCH();
       }
 
-      case OP_SCOPE_EXIT: {
+      INSTRUCTION(SCOPE_EXIT): {
         auto vars = next_byte();
-
-        *(sp - 1 - vars) = peek(0);
-
-        popN(vars);
-        break;
+        SCOPE_EXIT(vars);
+        DISPATCH();
       }
 
-      case OP_POP: {
+      INSTRUCTION(POP): {
         pop();
-        break;
+        DISPATCH();
       }
 
-      case OP_CALL: {
+      INSTRUCTION(CALL): {
         auto argc = next_byte();
         auto fnValue = peek(argc);
 
         // Native functions:
         if (IS_NATIVE(fnValue)) {
-          AS_NATIVE(fnValue)->function();
+          callNative(AS_NATIVE(fnValue));
 
           auto result = pop();
 
           popN(argc + 1); // Pop all arguments + function
           push(result);
 
-          break;
+          DISPATCH();
         }
 
         // User functions:
         auto callee = AS_FUNCTION(fnValue);
+        checkArity(callee, argc);
 
-        callStack.push(Frame{ip, bp, fn});
+        pushFrame();
 
         // To access locals, etc.
         fn = callee;
@@ -250,24 +514,249 @@ EvaValue EvaVM::eval() {
         // Jump to the function code.
         ip = &callee->co->code[0];
 
-        break;
+        traceCall(TraceEvent::CALL);
+
+        // Compiled code returns with the caller frame restored.
+        enterJit(callee->co);
+
+        DISPATCH();
+      }
+
+      INSTRUCTION(RETURN): {
+        traceCall(TraceEvent::RETURN);
+        popFrame();
+        DISPATCH();
+      }
+
+      // Superinstructions.
+      INSTRUCTION(JMP_IF_NOT_LT):
+        COMPARE_AND_JUMP(<, 0);
+        DISPATCH();
+
+      INSTRUCTION(JMP_IF_NOT_GT):
+        COMPARE_AND_JUMP(>, 1);
+        DISPATCH();
+
+      INSTRUCTION(JMP_IF_NOT_EQ):
+        COMPARE_AND_JUMP(==, 2);
+        DISPATCH();
+
+      INSTRUCTION(JMP_IF_NOT_GE):
+        COMPARE_AND_JUMP(>=, 3);
+        DISPATCH();
+
+      INSTRUCTION(JMP_IF_NOT_LE):
+        COMPARE_AND_JUMP(<=, 4);
+        DISPATCH();
+
+      INSTRUCTION(JMP_IF_NOT_NE):
+        COMPARE_AND_JUMP(!=, 5);
+        DISPATCH();
+
+      INSTRUCTION(ADD_LOCAL_LOCAL): {
+        auto op1 = bp[next_byte()];
+        auto op2 = bp[next_byte()];
+        ADD_VALUES(op1, op2, nullptr);
+        DISPATCH();
+      }
+
+      INSTRUCTION(CONST_SET_LOCAL): {
+        auto value = fn->co->constants[next_byte()];
+        bp[next_byte()] = value;
+        push(value);
+        DISPATCH();
+      }
+
+      INSTRUCTION(SET_LOCAL_POP): {
+        auto localIndex = next_byte();
+        bp[localIndex] = pop();
+        DISPATCH();
+      }
+
+      INSTRUCTION(ADD_LOCAL_CONST): {
+        auto op1 = bp[next_byte()];
+        auto op2 = fn->co->constants[next_byte()];
+        ADD_VALUES(op1, op2, nullptr);
+        DISPATCH();
+      }
+
+      // Quickened instructions: a guard of the operand types, the
+      // generic instruction is restored when it fails.
+      // Numbers with a double, or mixed: a site whose operands turn
+      // from integers to doubles stays quickened.
+      INSTRUCTION(ADD_NUM): {
+        auto op2 = pop();
+        auto op1 = pop();
+
+        if (IS_NUMBER(op1) && IS_NUMBER(op2)) {
+          push(NUMBER(AS_NUMBER(op1) + AS_NUMBER(op2)));
+          DISPATCH();
+        }
+
+        if (!IS_NUMERIC(op1) || !IS_NUMERIC(op2)) {
+          deoptimize(ip - 1, OP_ADD);
+          ADD_VALUES(op1, op2, nullptr);
+          DISPATCH();
+        }
+
+        push(addNumbers(op1, op2));
+        DISPATCH();
+      }
+
+      INSTRUCTION(ADD_STR): {
+        auto op2 = pop();
+        auto op1 = pop();
+
+        if (!IS_STRING(op1) || !IS_STRING(op2)) {
+          deoptimize(ip - 1, OP_ADD);
+          ADD_VALUES(op1, op2, nullptr);
+          DISPATCH();
+        }
+
+        // In a block of its own: DISPATCH jumps out of the handler
+        // without running the destructors of its scope.
+        {
+          auto string = AS_CPPSTRING(op1) + AS_CPPSTRING(op2);
+          push(MEM(ALLOC_STRING, string));
+        }
+        DISPATCH();
+      }
+
+      INSTRUCTION(LT_NUM): {
+        auto op = next_byte();
+
+        auto op2 = pop();
+        auto op1 = pop();
+
+        if (IS_NUMBER(op1) && IS_NUMBER(op2)) {
+          push(BOOLEAN(AS_NUMBER(op1) < AS_NUMBER(op2)));
+          DISPATCH();
+        }
+
+        if (!IS_NUMERIC(op1) || !IS_NUMERIC(op2)) {
+          deoptimize(ip - 2, OP_CMP);
+          CMP_VALUES(op, op1, op2);
+          DISPATCH();
+        }
+
+        push(BOOLEAN(compareNumbers(op, op1, op2)));
+        DISPATCH();
+      }
+
+      // Integers which overflow are added as doubles, the operands
+      // still match the guard.
+      INSTRUCTION(ADD_INT): {
+        auto op2 = pop();
+        auto op1 = pop();
+
+        if (!IS_INTEGER(op1) || !IS_INTEGER(op2)) {
+          deoptimize(ip - 1, OP_ADD);
+          ADD_VALUES(op1, op2, nullptr);
+          DISPATCH();
+        }
+
+        int64_t sum;
+        if (CHECKED_ADD(AS_INTEGER(op1), AS_INTEGER(op2), &sum)) {
+          push(INTEGER(sum));
+        } else {
+          push(NUMBER(TO_NUMBER(op1) + TO_NUMBER(op2)));
+        }
+        DISPATCH();
+      }
+
+      INSTRUCTION(LT_INT): {
+        auto op = next_byte();
+
+        auto op2 = pop();
+        auto op1 = pop();
+
+        if (!IS_INTEGER(op1) || !IS_INTEGER(op2)) {
+          deoptimize(ip - 2, OP_CMP);
+          CMP_VALUES(op, op1, op2);
+          DISPATCH();
+        }
+
+        push(BOOLEAN(AS_INTEGER(op1) < AS_INTEGER(op2)));
+        DISPATCH();
+      }
+
+      // Wide forms: the index operand is 2 bytes.
+      INSTRUCTION(CONST_WIDE):
+        push(fn->co->constants[next_short()]);
+        DISPATCH();
+
+      INSTRUCTION(GET_GLOBAL_WIDE):
+        push(global->get(next_short()).value);
+        DISPATCH();
+
+      INSTRUCTION(SET_GLOBAL_WIDE): {
+        auto globalIndex = next_short();
+        auto value = peek();
+        global->set(globalIndex, value);
+        DISPATCH();
       }
 
-      case OP_RETURN: {
-        auto callerFrame = callStack.top();
-        ip = callerFrame.ra;
-        bp = callerFrame.bp;
-        fn = callerFrame.fn;
+      INSTRUCTION(SET_LOCAL_WIDE):
+        bp[next_short()] = peek(0);
+        DISPATCH();
+
+      INSTRUCTION(GET_LOCAL_WIDE):
+        push(bp[next_short()]);
+        DISPATCH();
 
-        callStack.pop();
-        break;
+      INSTRUCTION(SCOPE_EXIT_WIDE): {
+        auto vars = next_short();
+        SCOPE_EXIT(vars);
+        DISPATCH();
       }
 
+      INSTRUCTION(SET_CELL_WIDE):
+        *fn->cells[next_short()]->location = peek(0);
+        DISPATCH();
+
+      INSTRUCTION(GET_CELL_WIDE):
+        push(*fn->cells[next_short()]->location);
+        DISPATCH();
+
+      INSTRUCTION(LOAD_CELL_WIDE):
+        push(CELL(fn->cells[next_short()]));
+        DISPATCH();
+
+      INSTRUCTION(GET_OUTER_WIDE):
+        push((csp - 1)->bp[next_short()]);
+        DISPATCH();
+
+      INSTRUCTION(SET_OUTER_WIDE):
+        (csp - 1)->bp[next_short()] = peek(0);
+        DISPATCH();
+
+      INSTRUCTION(CAPTURE_LOCAL_WIDE):
+        push(CELL(captureCell(&bp[next_short()])));
+        DISPATCH();
+
+      // Wide jumps: the address is 4 bytes.
+      INSTRUCTION(JMP_WIDE): {
+        ip = TO_ADDRESS(next_int());
+        DISPATCH();
+      }
+
+      INSTRUCTION(JMP_IF_FALSE_WIDE): {
+        auto cond = AS_BOOLEAN(pop());
+        auto address = next_int();
+
+        if (!cond) {
+          ip = TO_ADDRESS(address);
+        }
+        DISPATCH();
+      }
+
+#if !EVA_THREADED_DISPATCH
       default:
         DIE << "Illegal bytecode: " << HEX(bytecode) << '\n';
-        break;
+        DISPATCH();
     }
   }
+#endif
 }
 
 void EvaVM::setGlobalVariables() {
@@ -275,8 +764,8 @@ void EvaVM::setGlobalVariables() {
   global->addNativeFunction(
       "native-square",
       [&](){
-      auto x = AS_NUMBER(peek());
-      push(NUMBER(x * x));
+      auto x = peek();
+      push(multiplyNumbers(x, x));
       },
       1 // argc
       );
@@ -284,9 +773,9 @@ void EvaVM::setGlobalVariables() {
   global->addNativeFunction(
       "max",
       [&](){
-      auto x = AS_NUMBER(peek());
-      auto y = AS_NUMBER(peek(1));
-      push(NUMBER(x > y ? x : y));
+      auto x = peek();
+      auto y = peek(1);
+      push(compareNumbers(1, x, y) ? x : y);
       },
       2 // argc
       );
@@ -294,14 +783,74 @@ void EvaVM::setGlobalVariables() {
   global->addNativeFunction(
       "min",
       [&](){
-      auto x = AS_NUMBER(peek());
-      auto y = AS_NUMBER(peek(1));
-      push(NUMBER(x < y ? x : y));
+      auto x = peek();
+      auto y = peek(1);
+      push(compareNumbers(0, x, y) ? x : y);
       },
       2 // argc
       );
 
+  global->addNativeFunction(
+      "gc",
+      [&](){
+      push(INTEGER(gc()));
+      },
+      0 // argc
+      );
+
+  global->addNativeFunction(
+      "heap-size",
+      [&](){
+      push(INTEGER(getGCStats().bytesAllocated));
+      },
+      0 // argc
+      );
+
   // GlobalVariables:
-  global->addConst("VERSION", 2);
+  global->addConst("VERSION", INTEGER(2));
+}
+
+std::vector<Object*> EvaVM::getGCRoots() {
+  std::vector<Object*> roots;
+
+  // Stack values.
+  for (auto slot = &stack[0]; slot < sp; slot++) {
+    if (IS_OBJECT(*slot)) {
+      roots.push_back(AS_OBJECT(*slot));
+    }
+  }
+
+  // Open cells, possibly not referred to by any closure yet.
+  for (auto cell = openCells; cell != nullptr; cell = cell->nextOpen) {
+    roots.push_back(cell);
+  }
+
+  // Current and suspended functions.
+  roots.push_back(fn);
+  for (auto frame = &callStack[0]; frame < csp; frame++) {
+    roots.push_back(frame->fn);
+  }
+
+  // Globals.
+  for (size_t i = 0; i < global->size(); i++) {
+    auto& value = global->get(i).value;
+    if (IS_OBJECT(value)) {
+      roots.push_back(AS_OBJECT(value));
+    }
+  }
+
+  // Compiled code and the main function.
+  roots.push_back(compiler->getMainFunction());
+  for (auto co : compiler->getCodeObjects()) {
+    roots.push_back(co);
+  }
+
+  // Functions of the samples not collected by the profiler yet.
+  profiler->addGCRoots(roots);
+
+  // Traced code, referred to by the trace records.
+  tracer->addGCRoots(roots);
+
+  return roots;
 }
 
@@ -4,14 +4,38 @@
 
 #include "vm/Global.hpp"
 #include "vm/EvaValue.hpp"
+#include "vm/OpCode.hpp"
+#include "gc/EvaCollector.hpp"
+#include "jit/EvaJit.hpp"
+#include "profiler/EvaProfiler.hpp"
+#include "trace/EvaTracer.hpp"
+#include "image/EvaCompileCache.hpp"
 #include "logging/Logger.hpp"
 #include "parser/EvaParser.hpp"
 #include "compiler/EvaCompiler.hpp"
 
-#include <stack>
+#include <atomic>
+#include <vector>
 
 using syntax::EvaParser;
 
+class EvaProgram;
+
+/**
+ * Maximum depth of the call stack.
+ */
+#ifndef EVA_CALL_STACK_LIMIT
+#define EVA_CALL_STACK_LIMIT 1024
+#endif
+
+/**
+ * Slots of the value stack: by default 16 (locals and temporaries)
+ * for every frame of the call stack.
+ */
+#ifndef EVA_STACK_LIMIT
+#define EVA_STACK_LIMIT (16 * EVA_CALL_STACK_LIMIT)
+#endif
+
 /**
  * Stack frame for the function calls.
  */
@@ -33,6 +57,22 @@ struct Frame final {
 };
 
 class EvaVM final {
+  // Compiled code works on the VM state directly.
+  friend class EvaJit;
+  friend struct JitHelpers;
+
+  // Samples the VM state from its signal handler.
+  friend class EvaProfiler;
+
+  // Compiles the shared programs.
+  friend class EvaProgram;
+
+  /**
+   * Garbage collector, owns all heap objects of the VM.
+   * Declared first to be destroyed last.
+   */
+  std::unique_ptr<EvaCollector> collector;
+
   /**
    * Instruction pointer.
    */
@@ -51,13 +91,27 @@ class EvaVM final {
   /**
    * Evaluation stack.
    */
-  static constexpr size_t STACK_LIMIT = 1024;
+  static constexpr size_t STACK_LIMIT = EVA_STACK_LIMIT;
   EvaValue stack[STACK_LIMIT];
 
   /**
-   * Call stack to keep return addresses.
+   * Call stack to keep return addresses. Preallocated, so calls
+   * and returns never allocate.
    */
-  std::stack<Frame> callStack;
+  static constexpr size_t CALL_STACK_LIMIT = EVA_CALL_STACK_LIMIT;
+  Frame callStack[CALL_STACK_LIMIT];
+
+  /**
+   * Call stack pointer (next free frame). The profiler samples the
+   * frames below it from a signal handler: a frame is written before
+   * csp moves past it (see pushFrame).
+   */
+  Frame* csp;
+
+  /**
+   * Open cells, from the highest stack slot down.
+   */
+  CellObject* openCells = nullptr;
 
   /**
    * Global object. Shared with compiler.
@@ -79,10 +133,82 @@ class EvaVM final {
    */
   FunctionObject* fn;
 
+  /**
+   * Instruction set programs are compiled to and executed by.
+   */
+  ExecutionTier tier;
+
+  /**
+   * Baseline JIT of the stack tier.
+   */
+  std::unique_ptr<EvaJit> jit;
+
+  /**
+   * Persistent cache of compiled programs, none by default. Can be
+   * shared by VMs of one thread.
+   */
+  std::shared_ptr<EvaCompileCache> compileCache;
+
+  /**
+   * Sampling profiler, stopped by default.
+   */
+  std::unique_ptr<EvaProfiler> profiler;
+
+  /**
+   * Execution trace recorder, off by default.
+   */
+  std::unique_ptr<EvaTracer> tracer;
+
+  /**
+   * Whether run() is executing code, and the native function being
+   * called (for the profiler). Set once fn and the stacks are.
+   */
+  bool running = false;
+  NativeObject* native = nullptr;
+
+  /**
+   * Executed instructions, counted with EVA_INSTRUCTION_COUNT only.
+   */
+  uint64_t instructionsExecuted = 0;
+
+  /**
+   * Counts of executed opcode pairs of the stack tier, indexed by
+   * previous * BYTECODES_COUNT + current (EVA_OPCODE_PAIRS only).
+   */
+  std::vector<uint64_t> opcodePairs;
+  ByteCode lastOpcode = OP_HALT;
+
+  /**
+   * Whether generic instructions of the stack tier are rewritten to
+   * the forms of the operand types they meet (see quicken).
+   */
+  bool quickening = true;
+
+  /**
+   * Deoptimizations after which an instruction stays generic: the
+   * operand types of the site keep changing.
+   */
+  static constexpr uint8_t DEOPTIMIZATION_LIMIT = 4;
+
   public:
-  EvaVM() : global(std::make_shared<Global>()),
+  EvaVM(ExecutionTier tier = ExecutionTier::STACK) : collector(std::make_unique<EvaCollector>()),
+  global(std::make_shared<Global>()),
   parser(std::make_unique<EvaParser>()),
-  compiler(std::make_unique<EvaCompiler>(global)) {
+  compiler(std::make_unique<EvaCompiler>(global)),
+  tier(tier),
+  jit(std::make_unique<EvaJit>(*this)),
+  profiler(std::make_unique<EvaProfiler>(*this)),
+  tracer(std::make_unique<EvaTracer>()) {
+    sp = &stack[0];
+    bp = sp;
+    csp = &callStack[0];
+    openCells = nullptr;
+    fn = nullptr;
+
+    // Machine code of swept functions is reused.
+    collector->setCodeFinalizer([this](CodeObject* co) { jit->release(co); });
+
+    EvaCollector::Scope gcScope(collector.get());
     setGlobalVariables();
   };
 
@@ -91,11 +217,254 @@ class EvaVM final {
    */
   EvaValue exec(const std::string& program);
 
+  /**
+   * Executes the program read from the stream one top-level form at
+   * a time: each form is parsed, compiled and executed before the
+   * next one is read, so the source is never held as a whole.
+   * Returns the value of the last form.
+   */
+  EvaValue execStream(std::istream& input);
+
+  /**
+   * Compiles the program and writes its bytecode image (see EvaImage).
+   */
+  void compileImage(const std::string& program, const std::string& path);
+
+  /**
+   * Executes the bytecode image, the program is not parsed or compiled.
+   */
+  EvaValue execImage(const std::string& path);
+
+  /**
+   * Executes the shared program (see EvaProgram): defines its globals
+   * in this VM and runs its main function. The code is not copied, its
+   * functions can be called after (see call).
+   */
+  EvaValue exec(const EvaProgram& program);
+
+  /**
+   * Calls the global function (or native) of a program executed
+   * before, with the arguments. Runs through the call frames as OP_CALL
+   * does, nothing is parsed or compiled. Object arguments must be
+   * allocated in the heap of the VM.
+   *
+   *   vm.exec(program);
+   *   auto result = vm.call("handler", {INTEGER(1), INTEGER(2)});
+   */
+  EvaValue call(const std::string& name, std::initializer_list<EvaValue> args);
+  EvaValue call(const std::string& name, const EvaValue* args, size_t argc);
+
+  /**
+   * Calls the function value with the arguments (see call).
+   */
+  EvaValue callValue(const EvaValue& fnValue, const EvaValue* args, size_t argc);
+
+  /**
+   * Compiles the program and prints its bytecode.
+   */
+  void disassemble(const std::string& program);
+
+  /**
+   * Parses the program to its top-level block. The AST is valid
+   * until the next parse.
+   */
+  Exp parseProgram(const std::string& program);
+
+  /**
+   * Parses and compiles the program to the main function.
+   */
+  void compileProgram(const std::string& program);
+
+  /**
+   * Loads the compiled program from the compile cache, or compiles
+   * and stores it on a miss.
+   */
+  void compileCached(const std::string& program);
+
+  /**
+   * Compiles the parsed program (top-level block) to the main function.
+   */
+  void compileAst(Exp& ast);
+
+  /**
+   * Executes the main function of the compiler from a clean stack.
+   */
+  EvaValue run();
+
   /**
    * Main interpreter loop.
    */
   EvaValue eval();
 
+  /**
+   * Register tier interpreter loop (EvaRegisterVM.cpp).
+   */
+  EvaValue evalRegister();
+
+  /**
+   * Sets up the register frame of fn at base: registers starting
+   * from the initialized count are cleared.
+   */
+  void enterRegisterFrame(EvaValue* base, size_t initialized);
+
+  /**
+   * Runs the function of the frame just entered in machine code if
+   * it is compiled or gets hot, up to its return. Returns false if
+   * the function is left to the interpreter.
+   */
+  bool enterJit(CodeObject* co) {
+    if (co->jitCode == nullptr) {
+      // Shared code is read-only: it stays interpreted.
+      if (co->shared || ++co->callCount < jit->callThreshold() || !jit->compile(co)) {
+        return false;
+      }
+    }
+
+    ((JitFunction)co->jitCode)(this);
+    return true;
+  }
+
+  /**
+   * Selects when functions are compiled to machine code (JitMode::OFF
+   * forces the interpreter). Affects functions not compiled yet.
+   */
+  void setJitMode(JitMode mode) { jit->setMode(mode); }
+
+  /**
+   * Sets the amount of calls which makes a function hot.
+   */
+  void setJitThreshold(size_t calls) { jit->setThreshold(calls); }
+
+  /**
+   * JIT statistics.
+   */
+  const JitStats& getJitStats() const { return jit->getStats(); }
+
+  /**
+   * Calls the native function, its arguments are on the stack.
+   */
+  void callNative(NativeObject* callee) {
+#if EVA_TRACE
+    if (tracer->isTracing(TraceLevel::CALLS)) {
+      tracer->recordNative(callee, csp - callStack);
+    }
+#endif
+
+    native = callee;
+    callee->function();
+    native = nullptr;
+  }
+
+  /**
+   * Records the call or return event of the current function.
+   */
+  void traceCall(TraceEvent event) {
+#if EVA_TRACE
+    if (tracer->isTracing(TraceLevel::CALLS)) {
+      tracer->record(event, fn->co, ip, csp - callStack);
+    }
+#endif
+  }
+
+  /**
+   * Records the instruction at ip.
+   */
+  void traceInstruction() {
+#if EVA_TRACE
+    if (tracer->isTracing(TraceLevel::INSTRUCTIONS)) {
+      tracer->recordInstruction(fn->co, ip, csp - callStack, stack, sp - stack);
+    }
+#endif
+  }
+
+  /**
+   * Sets the trace level (EVA_TRACE builds, see EvaTracer). Machine
+   * code is traced on calls only: set JitMode::OFF for complete
+   * instruction traces.
+   */
+  void setTraceLevel(TraceLevel level) { tracer->setLevel(level); }
+
+  /**
+   * Writes the recorded trace (see EvaTraceDecoder).
+   */
+  void writeTrace(const std::string& path) { tracer->write(path, *global); }
+
+  /**
+   * Starts the sampling profiler (samples per second of CPU time).
+   */
+  void startProfiler(int hz = EvaProfiler::DEFAULT_HZ) { profiler->start(hz); }
+
+  void stopProfiler() { profiler->stop(); }
+
+  /**
+   * Writes the sampled stacks in the collapsed flame graph format.
+   */
+  void writeProfile(std::ostream& out) { profiler->writeCollapsed(out); }
+
+  /**
+   * Profiler statistics.
+   */
+  const ProfilerStats& getProfilerStats() const { return profiler->getStats(); }
+
+  /**
+   * Number of executed instructions (EVA_INSTRUCTION_COUNT builds).
+   */
+  uint64_t getInstructionsExecuted() const { return instructionsExecuted; }
+
+  /**
+   * Records the opcode executed after the previous one.
+   */
+  void recordOpcodePair(ByteCode opcode) {
+    if (tier != ExecutionTier::STACK) {
+      return;
+    }
+
+    if (opcodePairs.empty()) {
+      opcodePairs.resize(BYTECODES_COUNT * BYTECODES_COUNT);
+    }
+
+    opcodePairs[lastOpcode * BYTECODES_COUNT + opcode]++;
+    lastOpcode = opcode;
+  }
+
+  /**
+   * Opcode pair counts (EVA_OPCODE_PAIRS builds), empty if nothing
+   * was recorded.
+   */
+  const std::vector<uint64_t>& getOpcodePairs() const { return opcodePairs; }
+
+  /**
+   * Disables superinstructions, e.g. to profile unfused opcode pairs.
+   */
+  void setPeephole(bool enabled) { compiler->setPeephole(enabled); }
+
+  /**
+   * Disables escape analysis: all captured variables become cells.
+   */
+  void setEscapeAnalysis(bool enabled) { compiler->setEscapeAnalysis(enabled); }
+
+  /**
+   * Disables integers: number literals compile to doubles.
+   */
+  void setIntegers(bool enabled) { compiler->setIntegers(enabled); }
+
+  /**
+   * Disables quickening: the stack tier runs the generic instructions.
+   */
+  void setQuickening(bool enabled) { quickening = enabled; }
+
+  /**
+   * Prints the bytecode of the loaded code, with the sites quickened
+   * by the runs so far.
+   */
+  void disassembleCode() { compiler->disassembleBytecode(); }
+
+  /**
+   * Makes exec look up compiled programs in the cache (nullptr
+   * disables it).
+   */
+  void setCompileCache(std::shared_ptr<EvaCompileCache> cache) { compileCache = cache; }
+
   const uint8_t next_byte() {
     // Return current byte and increment IP
     return *ip++;
@@ -107,16 +476,126 @@ class EvaVM final {
     return (uint16_t)((ip[-2] << 8) | ip[-1]);
   }
 
+  const uint32_t next_int() {
+    // Return 4-byte operand (wide jump address) and increment IP
+    ip += 4;
+    return (uint32_t)readJumpAddress(ip - 4, 4);
+  }
+
   const void push(const EvaValue& value) {
     // Push the value on TOS and increment SP
     if ((size_t) (sp - stack) == STACK_LIMIT) {
-      DIE << "Stack overflow";
+      DIE << "Stack overflow (limit: " << STACK_LIMIT << " slots)";
     }
 
     *sp = value;
     ++sp;
   }
 
+  /**
+   * Checks the arguments count of a call to a user function: its frame
+   * (locals, scope exit) is laid out for the arity.
+   */
+  void checkArity(FunctionObject* callee, size_t argc) {
+    if (callee->co->arity != argc) {
+      DIE << "[EvaVM] call: " << callee->co->name << " takes " << callee->co->arity
+        << " arguments, " << argc << " passed";
+    }
+  }
+
+  /**
+   * Saves the caller state on the call stack.
+   */
+  void pushFrame() {
+    if ((size_t) (csp - callStack) == CALL_STACK_LIMIT) {
+      DIE << "Call stack overflow (limit: " << CALL_STACK_LIMIT << " frames)";
+    }
+
+    *csp = Frame{ip, bp, fn};
+    std::atomic_signal_fence(std::memory_order_release);
+    ++csp;
+  }
+
+  /**
+   * Restores the caller state from the call stack.
+   */
+  void popFrame() {
+    --csp;
+    ip = csp->ra;
+    bp = csp->bp;
+    fn = csp->fn;
+  }
+
+  /**
+   * Returns the open cell of the stack slot, creates it on the first
+   * capture.
+   */
+  CellObject* captureCell(EvaValue* slot) {
+    maybeGC();
+
+    auto link = &openCells;
+    while (*link != nullptr && (*link)->location > slot) {
+      link = &(*link)->nextOpen;
+    }
+
+    if (*link != nullptr && (*link)->location == slot) {
+      return *link;
+    }
+
+    auto cell = AS_CELL(ALLOC_CELL(slot));
+    cell->nextOpen = *link;
+    *link = cell;
+    return cell;
+  }
+
+  /**
+   * Closes the open cells of the slots from the last one up: the
+   * slots are about to be popped.
+   */
+  void closeCells(EvaValue* last) {
+    while (openCells != nullptr && openCells->location >= last) {
+      auto cell = openCells;
+      cell->value = *cell->location;
+      cell->location = &cell->value;
+      openCells = cell->nextOpen;
+    }
+  }
+
+  /**
+   * Rewrites the generic instruction at the address of the current
+   * code to its quickened form. Frozen code (shared by isolates) and
+   * sites deoptimized DEOPTIMIZATION_LIMIT times stay generic.
+   */
+  void quicken(uint8_t* address, ByteCode opcode) {
+    if (quickening && !fn->co->shared) {
+      const auto& deoptimizations = fn->co->deoptimizations;
+
+      if (deoptimizations.empty() ||
+          deoptimizations[address - fn->co->code.data()] < DEOPTIMIZATION_LIMIT) {
+        *address = opcode;
+      }
+    }
+  }
+
+  /**
+   * Rewrites a quickened instruction back to the generic form, once
+   * its guard failed, and counts it. It is quickened again by its next
+   * run until the limit.
+   */
+  void deoptimize(uint8_t* address, ByteCode opcode) {
+    *address = opcode;
+
+    auto& deoptimizations = fn->co->deoptimizations;
+    if (deoptimizations.empty()) {
+      deoptimizations.resize(fn->co->code.size(), 0);
+    }
+
+    auto& count = deoptimizations[address - fn->co->code.data()];
+    if (count < DEOPTIMIZATION_LIMIT) {
+      count++;
+    }
+  }
+
   /**
    * Pops the value from the stack.
    */
@@ -155,6 +634,50 @@ class EvaVM final {
    */
   void setGlobalVariables();
 
+  /**
+   * Runs a collection if the heap has grown over the threshold.
+   */
+  void maybeGC() {
+    if (collector->shouldCollect()) {
+      gc();
+    }
+  }
+
+  /**
+   * Runs a full collection, returns the amount of freed bytes.
+   */
+  size_t gc() {
+    profiler->drain();
+    return collector->collect(getGCRoots());
+  }
+
+  /**
+   * Objects directly reachable by the VM: stack, call frames,
+   * globals and compiled code.
+   */
+  std::vector<Object*> getGCRoots();
+
+  /**
+   * Collector of the VM heap. Compiling or running outside of exec
+   * allocates in it through EvaCollector::Scope.
+   */
+  EvaCollector* getCollector() { return collector.get(); }
+
+  /**
+   * Heap statistics.
+   */
+  const GCStats& getGCStats() const { return collector->getStats(); }
+
+  /**
+   * Sets the minimal heap size which triggers a collection.
+   */
+  void setGCThreshold(size_t bytes) { collector->setThreshold(bytes); }
+
+  /**
+   * Enables or disables interning of new strings.
+   */
+  void setStringInterning(bool enabled) { collector->setInterning(enabled); }
+
   /**
    * Dumps stack to the screen.
    */
@@ -3,6 +3,8 @@
 std::string evaValueToTypeStr(const EvaValue& evaValue) {
   if (IS_NUMBER(evaValue)) {
     return "NUMBER";
+  } else if (IS_INTEGER(evaValue)) {
+    return "INTEGER";
   } else if (IS_BOOLEAN(evaValue)) {
     return "BOOLEAN";
   } else if (IS_STRING(evaValue)) {
@@ -23,9 +25,11 @@ std::string evaValueToTypeStr(const EvaValue& evaValue) {
 std::string evaValueToConstantString(const EvaValue& evaValue) {
   std::stringstream ss;
   if (IS_NUMBER(evaValue)) {
-    ss << evaValue.value.number;
+    ss << AS_NUMBER(evaValue);
+  } else if (IS_INTEGER(evaValue)) {
+    ss << AS_INTEGER(evaValue);
   } else if (IS_BOOLEAN(evaValue)) {
-    ss << (evaValue.value.boolean ? "true" : "false");
+    ss << (AS_BOOLEAN(evaValue) ? "true" : "false");
   } else if (IS_STRING(evaValue)) {
     ss << '"' << AS_CPPSTRING(evaValue) << '"';
   } else if (IS_CODE(evaValue)) {
@@ -39,7 +43,7 @@ std::string evaValueToConstantString(const EvaValue& evaValue) {
     ss << fn->co->name << '/' << fn->co->arity;
   } else if (IS_CELL(evaValue)) {
     auto cell = AS_CELL(evaValue);
-    ss << "cell: " << evaValueToConstantString(cell->value);
+    ss << "cell: " << evaValueToConstantString(*cell->location);
   }  else {
     DIE << "evaValueToConstantString: unknown type";
   }
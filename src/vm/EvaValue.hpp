@@ -6,6 +6,8 @@
 
 #include <string>
 #include <vector>
+#include <cstring>
+#include <cstdint>
 #include <functional>
 
 /**
@@ -13,6 +15,7 @@
  */
 enum class EvaValueType {
   NUMBER,
+  INTEGER,
   BOOLEAN,
   OBJECT
 };
@@ -28,8 +31,90 @@ enum class ObjectType {
 struct Object {
   Object (ObjectType type) : type(type) {}
   ObjectType type;
+
+  /**
+   * Whether the object is reachable (set during GC marking).
+   */
+  bool marked = false;
+
+  /**
+   * Whether the object is frozen and shared by VMs on several threads
+   * (see EvaProgram): their collectors never mark or free it.
+   */
+  bool shared = false;
+
+  /**
+   * Allocated size with the owned buffers, accounted by the collector.
+   */
+  size_t size = 0;
+
+  /**
+   * Next object in the heap list of the owning collector.
+   */
+  Object* next = nullptr;
 };
 
+/**
+ * Registers newly allocated object in the heap of the current
+ * collector (see EvaCollector). Objects allocated without an
+ * active collector are never freed.
+ */
+void trackObject(Object* object, size_t size);
+
+/**
+ * Allocates a heap object of type T tracked by the collector.
+ */
+template <typename T, typename... Args>
+Object* allocObject(Args&&... args) {
+  auto object = new T(std::forward<Args>(args)...);
+  trackObject(object, sizeof(T));
+  return object;
+}
+
+#ifdef EVA_NAN_BOXING
+
+static_assert(sizeof(void*) == 8, "NaN-boxing requires 64-bit pointers");
+
+/**
+ * Value - NaN-boxed 64-bit word.
+ *
+ * Numbers are stored as plain doubles. Everything else is encoded
+ * in the payload of a quiet NaN, that is never produced by arithmetic:
+ *
+ *   booleans: QNAN | 0b10 (false), QNAN | 0b11 (true)
+ *   objects:  SIGN_BIT | QNAN | 48-bit pointer
+ *
+ * There is no room for 64-bit integers: they are doubles in this
+ * representation (exact up to 2^53).
+ */
+struct EvaValue {
+  EvaValue() {};
+  explicit EvaValue(uint64_t bits) : bits(bits) {}
+
+  uint64_t bits;
+};
+
+constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+constexpr uint64_t QNAN     = 0x7ffc000000000000;
+
+constexpr uint64_t FALSE_BITS  = QNAN | 2;
+constexpr uint64_t TRUE_BITS   = QNAN | 3;
+constexpr uint64_t OBJECT_BITS = SIGN_BIT | QNAN;
+
+inline EvaValue numberToEvaValue(double number) {
+  uint64_t bits;
+  memcpy(&bits, &number, sizeof(double));
+  return EvaValue(bits);
+}
+
+inline double evaValueToNumber(EvaValue value) {
+  double number;
+  memcpy(&number, &value.bits, sizeof(double));
+  return number;
+}
+
+#else
+
 /**
  * Value - union with a tag
  */
@@ -39,25 +124,74 @@ struct EvaValue {
     type(t) { value.boolean = v; };
   EvaValue(EvaValueType t, double v) :
     type(t) { value.number = v; };
+  EvaValue(EvaValueType t, int64_t v) :
+    type(t) { value.integer = v; };
   EvaValue(EvaValueType t, Object* v) :
     type(t) { value.object = v; };
 
   EvaValueType type;
   union {
     double number;
+    int64_t integer;
     bool boolean;
     Object* object;
   } value;
 };
 
+#endif
+
 struct StringObject : public Object {
-  StringObject(const std::string &string) 
-    : Object(ObjectType::STRING), string(string) {}
+  StringObject(const std::string &string)
+    : StringObject(string, std::hash<std::string>{}(string)) {}
+
+  StringObject(const std::string &string, size_t hash)
+    : Object(ObjectType::STRING), string(string), hash(hash) {}
+
+  /**
+   * String value, immutable (length is cached by the std::string).
+   */
+  const std::string string;
 
   /**
-   * String value.
+   * Cached hash of the string.
    */
-  std::string string;
+  const size_t hash;
+
+  /**
+   * Whether the object is the only instance of the string
+   * in the intern table of the collector.
+   */
+  bool interned = false;
+};
+
+/**
+ * Equality of strings, interned strings are equal only if
+ * they are the same object.
+ */
+inline bool stringEquals(const StringObject* s1, const StringObject* s2) {
+  if (s1 == s2) {
+    return true;
+  }
+
+  if (s1->interned && s2->interned) {
+    return false;
+  }
+
+  return s1->hash == s2->hash && s1->string == s2->string;
+}
+
+/**
+ * Returns the interned string object of the current collector
+ * (see EvaCollector::intern), allocates it on the first use.
+ */
+Object* internString(const std::string& string);
+
+/**
+ * Instruction set the code is compiled to.
+ */
+enum class ExecutionTier {
+  STACK,
+  REGISTER,
 };
 
 struct LocalVar {
@@ -113,6 +247,37 @@ struct CodeObject : public Object {
    */
   size_t arity;
 
+  /**
+   * Instruction set of the bytecode.
+   */
+  ExecutionTier tier = ExecutionTier::STACK;
+
+  /**
+   * Amount of registers used by the frame (register tier).
+   */
+  size_t frameSize = 0;
+
+  /**
+   * Calls of the code, counted until it is compiled by the JIT.
+   */
+  size_t callCount = 0;
+
+  /**
+   * Machine code (JitFunction), nullptr while interpreted.
+   */
+  void* jitCode = nullptr;
+
+  /**
+   * Whether the JIT rejected the code.
+   */
+  bool jitUnsupported = false;
+
+  /**
+   * Deoptimizations of the quickened instructions by offset, allocated
+   * on the first one (see EvaVM::deoptimize).
+   */
+  std::vector<uint8_t> deoptimizations;
+
   /**
    * Defines new local variable.
    */
@@ -165,10 +330,29 @@ struct NativeObject : public Object {
 
 /**
  * Used to capture closured values.
+ *
+ * A cell is open while the captured variable is alive in its frame:
+ * the location is the stack slot of the variable, the frame and the
+ * closures share it. When the slot is popped the cell is closed: the
+ * value moves into the cell (see EvaVM::closeCells).
  */
 struct CellObject : public Object {
-  CellObject(EvaValue v) : Object(ObjectType::CELL), value(v) {}
+  CellObject(EvaValue* slot) : Object(ObjectType::CELL), location(slot) {}
+
+  /**
+   * Value of the closed cell.
+   */
   EvaValue value;
+
+  /**
+   * Slot of the variable, or the value of the closed cell.
+   */
+  EvaValue* location;
+
+  /**
+   * Next open cell, in the order of slots from the top of the stack.
+   */
+  CellObject* nextOpen = nullptr;
 };
 
 struct FunctionObject : public Object {
@@ -188,38 +372,67 @@ struct FunctionObject : public Object {
 };
 
 // Type constructors:
+#ifdef EVA_NAN_BOXING
+#define NUMBER(value)  numberToEvaValue(static_cast<double>(value))
+#define INTEGER(value) NUMBER(static_cast<int64_t>(value))
+#define BOOLEAN(value) EvaValue(static_cast<bool>(value) ? TRUE_BITS : FALSE_BITS)
+#define OBJECT(value)  EvaValue(OBJECT_BITS | (uint64_t)(uintptr_t)static_cast<Object*>(value))
+#else
 #define NUMBER(value)  EvaValue(EvaValueType::NUMBER, static_cast<double>(value))
+#define INTEGER(value) EvaValue(EvaValueType::INTEGER, static_cast<int64_t>(value))
 #define BOOLEAN(value) EvaValue(EvaValueType::BOOLEAN, static_cast<bool>(value))
 #define OBJECT(value)  EvaValue(EvaValueType::OBJECT, static_cast<Object*>(value))
+#endif
 
 #define ALLOC_STRING(value) \
-  EvaValue(EvaValueType::OBJECT, (Object*) new StringObject(value))
+  OBJECT(internString(value))
 #define ALLOC_CODE(name, arity) \
-  EvaValue(EvaValueType::OBJECT, (Object*) new CodeObject(name, arity))
+  OBJECT(allocObject<CodeObject>(name, arity))
 #define ALLOC_NATIVE(fn, name, arity) \
-  EvaValue(EvaValueType::OBJECT, (Object*) new NativeObject(fn, name, arity))
+  OBJECT(allocObject<NativeObject>(fn, name, arity))
 #define ALLOC_FUNCTION(co) \
-  EvaValue(EvaValueType::OBJECT, (Object*) new FunctionObject(co))
-#define ALLOC_CELL(co) \
-  EvaValue(EvaValueType::OBJECT,   (Object*) new CellObject(co))
+  OBJECT(allocObject<FunctionObject>(co))
+#define ALLOC_CELL(slot) \
+  OBJECT(allocObject<CellObject>(slot))
 
 #define CELL(value)    OBJECT((Object*)value)
 
 // Accessors:
+#ifdef EVA_NAN_BOXING
+#define AS_NUMBER(evaValue)    evaValueToNumber(evaValue)
+#define AS_INTEGER(evaValue)   ((int64_t)evaValueToNumber(evaValue))
+#define AS_BOOLEAN(evaValue)   ((evaValue).bits == TRUE_BITS)
+#define AS_OBJECT(evaValue)    ((Object*)(uintptr_t)((evaValue).bits & ~OBJECT_BITS))
+#else
 #define AS_NUMBER(evaValue)    ((double)((evaValue).value.number))
+#define AS_INTEGER(evaValue)   ((int64_t)((evaValue).value.integer))
 #define AS_BOOLEAN(evaValue)   ((bool)((evaValue).value.boolean))
 #define AS_OBJECT(evaValue)    ((Object*)((evaValue).value.object))
-#define AS_STRING(evaValue)    ((StringObject*)((evaValue).value.object))
+#endif
+#define AS_STRING(evaValue)    ((StringObject*)AS_OBJECT(evaValue))
 #define AS_CPPSTRING(evaValue) (AS_STRING(evaValue)->string)
-#define AS_CODE(evaValue)      ((CodeObject*)((evaValue).value.object))
-#define AS_NATIVE(evaValue)    ((NativeObject*)((evaValue).value.object))
-#define AS_FUNCTION(evaValue)  ((FunctionObject*)((evaValue).value.object))
-#define AS_CELL(evaValue)      ((CellObject*)((evaValue).value.object))
+#define AS_CODE(evaValue)      ((CodeObject*)AS_OBJECT(evaValue))
+#define AS_NATIVE(evaValue)    ((NativeObject*)AS_OBJECT(evaValue))
+#define AS_FUNCTION(evaValue)  ((FunctionObject*)AS_OBJECT(evaValue))
+#define AS_CELL(evaValue)      ((CellObject*)AS_OBJECT(evaValue))
 
 // Testers:
+#ifdef EVA_NAN_BOXING
+#define IS_NUMBER(evaValue)    (((evaValue).bits & QNAN) != QNAN)
+#define IS_INTEGER(evaValue)   false
+#define IS_BOOLEAN(evaValue)   (((evaValue).bits | 1) == TRUE_BITS)
+#define IS_OBJECT(evaValue)    (((evaValue).bits & OBJECT_BITS) == OBJECT_BITS)
+#else
 #define IS_NUMBER(evaValue)    ((evaValue).type == EvaValueType::NUMBER)
+#define IS_INTEGER(evaValue)   ((evaValue).type == EvaValueType::INTEGER)
 #define IS_BOOLEAN(evaValue)   ((evaValue).type == EvaValueType::BOOLEAN)
 #define IS_OBJECT(evaValue)    ((evaValue).type == EvaValueType::OBJECT)
+#endif
+
+// Numbers of either representation (doubles and integers):
+#define IS_NUMERIC(evaValue)   (IS_NUMBER(evaValue) || IS_INTEGER(evaValue))
+#define TO_NUMBER(evaValue) \
+  (IS_INTEGER(evaValue) ? (double)AS_INTEGER(evaValue) : AS_NUMBER(evaValue))
 
 #define IS_OBJECT_TYPE(evaValue, objectType) \
   (IS_OBJECT(evaValue) && AS_OBJECT(evaValue)->type == objectType)
@@ -8,33 +8,34 @@ void Global::set(size_t index, EvaValue& value) {
   globals[index].value = value;
 }
 
-void Global::addConst(const std::string& name, double value) {
-  if (exists(name)) return;
-  globals.push_back(GlobalVar{name, NUMBER(value)});
+void Global::addConst(const std::string& name, const EvaValue& value) {
+  add(name, value);
 }
 
 void Global::addNativeFunction(const std::string& name, std::function<void()> fn, size_t arity) {
   if (exists(name)) return;
-  globals.push_back(GlobalVar{name, ALLOC_NATIVE(fn, name, arity)});
+  add(name, ALLOC_NATIVE(fn, name, arity));
 }
 
-int Global::getGlobalIndex(const std::string& name) {
-  if (globals.size() > 0) {
-    for (int i = 0; i < (int)globals.size(); i++) {
-      if (globals[i].name == name) {
-        return i;
-      }
-    }
+int Global::getGlobalIndex(const std::string& name) const {
+  auto it = index.find(name);
+  if (it == index.end()) {
+    return -1; // Not found
   }
 
-  return -1; // Not found
+  return it->second;
 }
 
 void Global::define(const std::string& name) {
-  if (getGlobalIndex(name) != -1) {
+  add(name, NUMBER(0));
+}
+
+void Global::add(const std::string& name, const EvaValue& value) {
+  if (exists(name)) {
     return; // Already defined
   }
 
-  globals.push_back(GlobalVar{name, NUMBER(0)});
+  index.emplace(name, globals.size());
+  globals.push_back(GlobalVar{name, value});
 }
 
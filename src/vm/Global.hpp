@@ -4,6 +4,8 @@
 
 #include "vm/EvaValue.hpp"
 
+#include <unordered_map>
+
 /**
  * Gloal variable entry.
  */
@@ -21,6 +23,11 @@ struct Global {
    */
   GlobalVar& get(size_t index) { return globals[index]; }
 
+  /**
+   * Amount of globals.
+   */
+  size_t size() const { return globals.size(); }
+
   /**
    * Sets global value at index.
    */
@@ -29,7 +36,7 @@ struct Global {
   /**
    * Adding constant to global variables.
    */
-  void addConst(const std::string& name, double value);
+  void addConst(const std::string& name, const EvaValue& value);
 
   /**
    * Adding native function to global variables.
@@ -37,14 +44,14 @@ struct Global {
   void addNativeFunction(const std::string& name, std::function<void()> fn, size_t arity);
 
   /**
-   * Get an index of the global value.
+   * Get an index of the global value, -1 if not defined.
    */
-  int getGlobalIndex(const std::string& name);
+  int getGlobalIndex(const std::string& name) const;
 
   /**
    * Check if the global variable exists.
    */
-  bool exists(const std::string& name) { return getGlobalIndex(name) != -1; }
+  bool exists(const std::string& name) const { return index.count(name) != 0; }
 
   /**
    * Defines a global with a name.
@@ -53,9 +60,21 @@ struct Global {
 
   private:
   /**
-   * Global variables and functions.
+   * Global variables and functions, dense for OP_GET_GLOBAL.
    */
   std::vector<GlobalVar> globals;
+
+  /**
+   * Global names to their indices in globals. Keys are copies of the
+   * names hashed by value (the compiler and the image loader look
+   * names up as strings), not interned string objects.
+   */
+  std::unordered_map<std::string, size_t> index;
+
+  /**
+   * Appends a new global unless the name is already defined.
+   */
+  void add(const std::string& name, const EvaValue& value);
 };
 
 #endif
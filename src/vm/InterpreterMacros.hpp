@@ -0,0 +1,182 @@
+/**
+ * Helpers shared by the interpreter loops (stack and register tiers).
+ *
+ * Must be included in EvaVM member functions translation units only.
+ * Including file defines OPCODE(op) to map instruction names to opcodes.
+ */
+#ifndef SRC_VM_INTERPRETERMACROS_HPP
+#define SRC_VM_INTERPRETERMACROS_HPP
+
+// Labels as values are a GCC/Clang extension.
+#ifndef EVA_THREADED_DISPATCH
+#if defined(__GNUC__)
+#define EVA_THREADED_DISPATCH 1
+#else
+#define EVA_THREADED_DISPATCH 0
+#endif
+#endif
+
+#define TO_ADDRESS(index) (&fn->co->code[index])
+
+// Allocation at a safe point: may trigger a collection before
+// allocating, all live values must be reachable from the roots.
+#define MEM(allocator, ...) (maybeGC(), allocator(__VA_ARGS__))
+
+#if EVA_TRACE
+#define TRACE_INSTRUCTION() traceInstruction()
+#else
+#define TRACE_INSTRUCTION() do {} while (0)
+#endif
+
+#ifdef EVA_INSTRUCTION_COUNT
+#define COUNT_INSTRUCTION() instructionsExecuted++
+#else
+#define COUNT_INSTRUCTION() do {} while (0)
+#endif
+
+#ifdef EVA_OPCODE_PAIRS
+#define PROFILE_OPCODE() recordOpcodePair(*ip)
+#else
+#define PROFILE_OPCODE() do {} while (0)
+#endif
+
+/**
+ * Threaded dispatch: every instruction handler jumps directly
+ * to the handler of the next opcode through the dispatch table,
+ * so each handler gets its own indirect branch. Bytecode is trusted,
+ * the compiler emits only valid opcodes.
+ *
+ * Portable fallback is a switch inside of the loop.
+ */
+#if EVA_THREADED_DISPATCH
+#define LABEL_ADDRESS(op, ...) &&op_##op,
+#define INSTRUCTION(op) op_##op
+#define DISPATCH() do {                         \
+    TRACE_INSTRUCTION();                        \
+    COUNT_INSTRUCTION();                        \
+    PROFILE_OPCODE();                           \
+    goto *dispatchTable[next_byte()];           \
+} while (0)
+#else
+#define INSTRUCTION(op) case OPCODE(op)
+#define DISPATCH() break
+#endif
+
+/**
+ * Compares values with the comparison operator encoded
+ * by the compiler (see EvaCompiler::cmpOps).
+ */
+template <typename T>
+inline bool compareValues(uint8_t op, const T& v1, const T& v2) {
+  switch (op) {
+    case 0:
+      return v1 < v2;
+    case 1:
+      return v1 > v2;
+    case 2:
+      return v1 == v2;
+    case 3:
+      return v1 >= v2;
+    case 4:
+      return v1 <= v2;
+    case 5:
+      return v1 != v2;
+    default:
+      DIE << "Bad comparison op!";
+      return false;
+  }
+}
+
+/**
+ * Compares strings by reference, equality of interned strings
+ * is a pointer compare.
+ */
+inline bool compareStrings(uint8_t op, const StringObject* s1, const StringObject* s2) {
+  switch (op) {
+    case 2:
+      return stringEquals(s1, s2);
+    case 5:
+      return !stringEquals(s1, s2);
+    default:
+      return compareValues(op, s1->string, s2->string);
+  }
+}
+
+/**
+ * Integer arithmetic with overflow check: returns false if the
+ * result doesn't fit 64 bits.
+ */
+#if defined(__GNUC__)
+#define CHECKED_ADD(a, b, result) (!__builtin_add_overflow(a, b, result))
+#define CHECKED_SUB(a, b, result) (!__builtin_sub_overflow(a, b, result))
+#define CHECKED_MUL(a, b, result) (!__builtin_mul_overflow(a, b, result))
+#else
+inline bool checkedAdd(int64_t a, int64_t b, int64_t* result) {
+  *result = (int64_t)((uint64_t)a + (uint64_t)b);
+  return b > 0 ? a <= INT64_MAX - b : a >= INT64_MIN - b;
+}
+inline bool checkedSub(int64_t a, int64_t b, int64_t* result) {
+  *result = (int64_t)((uint64_t)a - (uint64_t)b);
+  return b < 0 ? a <= INT64_MAX + b : a >= INT64_MIN + b;
+}
+inline bool checkedMul(int64_t a, int64_t b, int64_t* result) {
+  *result = (int64_t)((uint64_t)a * (uint64_t)b);
+  return a == 0 || (!(a == -1 && b == INT64_MIN) && !(b == -1 && a == INT64_MIN) &&
+                    *result / a == b);
+}
+#define CHECKED_ADD(a, b, result) checkedAdd(a, b, result)
+#define CHECKED_SUB(a, b, result) checkedSub(a, b, result)
+#define CHECKED_MUL(a, b, result) checkedMul(a, b, result)
+#endif
+
+/**
+ * Arithmetic of numbers: integers stay integers, a result which
+ * overflows and mixed operands are computed on doubles.
+ */
+#define NUMBERS_OP(checked, op) do {                                  \
+    int64_t result;                                                   \
+    if (IS_INTEGER(v1) && IS_INTEGER(v2) &&                           \
+        checked(AS_INTEGER(v1), AS_INTEGER(v2), &result)) {           \
+      return INTEGER(result);                                         \
+    }                                                                 \
+    return NUMBER(TO_NUMBER(v1) op TO_NUMBER(v2));                    \
+} while (0)
+
+inline EvaValue addNumbers(const EvaValue& v1, const EvaValue& v2) {
+  NUMBERS_OP(CHECKED_ADD, +);
+}
+
+inline EvaValue subtractNumbers(const EvaValue& v1, const EvaValue& v2) {
+  NUMBERS_OP(CHECKED_SUB, -);
+}
+
+inline EvaValue multiplyNumbers(const EvaValue& v1, const EvaValue& v2) {
+  NUMBERS_OP(CHECKED_MUL, *);
+}
+
+/**
+ * Division is an integer only if it is exact: (/ 7 2) is 3.5.
+ */
+inline EvaValue divideNumbers(const EvaValue& v1, const EvaValue& v2) {
+  if (IS_INTEGER(v1) && IS_INTEGER(v2)) {
+    auto a = AS_INTEGER(v1);
+    auto b = AS_INTEGER(v2);
+
+    if (b != 0 && !(a == INT64_MIN && b == -1) && a % b == 0) {
+      return INTEGER(a / b);
+    }
+  }
+  return NUMBER(TO_NUMBER(v1) / TO_NUMBER(v2));
+}
+
+/**
+ * Compares numbers: integers exactly, doubles otherwise.
+ */
+inline bool compareNumbers(uint8_t op, const EvaValue& v1, const EvaValue& v2) {
+  if (IS_INTEGER(v1) && IS_INTEGER(v2)) {
+    return compareValues(op, AS_INTEGER(v1), AS_INTEGER(v2));
+  }
+  return compareValues(op, TO_NUMBER(v1), TO_NUMBER(v2));
+}
+
+#endif
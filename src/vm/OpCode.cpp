@@ -1,37 +1,89 @@
-
 #include "vm/OpCode.hpp"
 #include "logging/Logger.hpp"
 
-#define OP_STR(op)  \
-  case OP_##op:   \
-  return #op
+#define OP_STR(op, operandBytes) #op,
+
+static const char* opcodeNames[] = { EVA_BYTECODES(OP_STR) };
 
 std::string opcodeToString(ByteCode opcode) {
-  switch(opcode) {
-    OP_STR(HALT);
-    OP_STR(CONST);
-    OP_STR(ADD);
-    OP_STR(SUB);
-    OP_STR(MUL);
-    OP_STR(DIV);
-    OP_STR(CMP);
-    OP_STR(JMP);
-    OP_STR(JMP_IF_FALSE);
-    OP_STR(GET_GLOBAL);
-    OP_STR(SET_GLOBAL);
-    OP_STR(POP);
-    OP_STR(SET_LOCAL);
-    OP_STR(GET_LOCAL);
-    OP_STR(SCOPE_EXIT);
-    OP_STR(CALL);
-    OP_STR(RETURN);
-    OP_STR(GET_CELL);
-    OP_STR(SET_CELL);
-    OP_STR(LOAD_CELL);
-    OP_STR(MAKE_FUNCTION);
-    default:
+  if (opcode >= BYTECODES_COUNT) {
     DIE << "Unknown bytecode: " << HEX(opcode);
-    return "";
   }
+  return opcodeNames[opcode];
 }
 
+StackEffect stackEffect(const uint8_t* instruction) {
+  auto opcode = instruction[0];
+  auto isWide = isWideOpcode(opcode);
+
+  // Count operand (a wide index is 2 bytes).
+  auto count = [&]() {
+    return isWide ? (int32_t)((instruction[1] << 8) | instruction[2]) : (int32_t)instruction[1];
+  };
+
+  if (isWide) {
+    opcode = narrowOpcode(opcode);
+  }
+
+  switch (opcode) {
+    case OP_CONST:
+    case OP_GET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_GET_CELL:
+    case OP_GET_OUTER:
+    case OP_LOAD_CELL:
+    case OP_CAPTURE_LOCAL:
+    case OP_CONST_SET_LOCAL:
+      return {0, 1, 1};
+
+    // Both operands are pushed before the add.
+    case OP_ADD_LOCAL_LOCAL:
+    case OP_ADD_LOCAL_CONST:
+      return {0, 2, 1};
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_CMP:
+    case OP_ADD_NUM:
+    case OP_ADD_STR:
+    case OP_ADD_INT:
+    case OP_LT_NUM:
+    case OP_LT_INT:
+      return {2, 0, -1};
+
+    case OP_HALT:
+    case OP_JMP_IF_FALSE:
+    case OP_JMP_IF_FALSE_WIDE:
+    case OP_POP:
+    case OP_SET_LOCAL_POP:
+      return {1, 0, -1};
+
+    // Setters and RETURN keep the value on the stack.
+    case OP_SET_LOCAL:
+    case OP_SET_GLOBAL:
+    case OP_SET_CELL:
+    case OP_SET_OUTER:
+    case OP_RETURN:
+      return {1, 0, 0};
+
+    case OP_JMP_IF_NOT_LT:
+    case OP_JMP_IF_NOT_GT:
+    case OP_JMP_IF_NOT_EQ:
+    case OP_JMP_IF_NOT_GE:
+    case OP_JMP_IF_NOT_LE:
+    case OP_JMP_IF_NOT_NE:
+      return {2, 0, -2};
+
+    // The result replaces the function and arguments, the function
+    // the code object and cells, the value the variables.
+    case OP_CALL:
+    case OP_MAKE_FUNCTION:
+    case OP_SCOPE_EXIT:
+      return {count() + 1, 0, -count()};
+
+    default:
+      return {0, 0, 0};
+  }
+}
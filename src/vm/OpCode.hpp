@@ -3,6 +3,8 @@
 #define SRC_OPCODE_HPP
 
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 using ByteCode = uint8_t;
 
@@ -46,9 +48,259 @@ enum ByteCodes : ByteCode {
 
   // Function construction
   OP_MAKE_FUNCTION = 0x14,
+
+  // Superinstructions (emitted by EvaPeephole only).
+
+  // CMP <op>; JMP_IF_FALSE <addr>, in the order of comparison operators
+  OP_JMP_IF_NOT_LT = 0x15,
+  OP_JMP_IF_NOT_GT = 0x16,
+  OP_JMP_IF_NOT_EQ = 0x17,
+  OP_JMP_IF_NOT_GE = 0x18,
+  OP_JMP_IF_NOT_LE = 0x19,
+  OP_JMP_IF_NOT_NE = 0x1A,
+
+  // GET_LOCAL <a>; GET_LOCAL <b>; ADD
+  OP_ADD_LOCAL_LOCAL = 0x1B,
+
+  // CONST <k>; SET_LOCAL <l>
+  OP_CONST_SET_LOCAL = 0x1C,
+
+  // SET_LOCAL <l>; POP
+  OP_SET_LOCAL_POP   = 0x1D,
+
+  // GET_LOCAL <l>; CONST <k>; ADD
+  OP_ADD_LOCAL_CONST = 0x1E,
+
+  // Locals of the caller frame (see AllocType::OUTER)
+  OP_GET_OUTER       = 0x1F,
+  OP_SET_OUTER       = 0x20,
+
+  // Push the open cell of a local (captured by the closure made next)
+  OP_CAPTURE_LOCAL   = 0x21,
+
+  // Quickened forms (rewritten by the interpreter, see EvaVM::quicken).
+
+  // ADD of numbers (a double among them), ADD of strings
+  OP_ADD_NUM         = 0x22,
+  OP_ADD_STR         = 0x23,
+
+  // CMP < of numbers (a double among them)
+  OP_LT_NUM          = 0x24,
+
+  // ADD of integers, CMP < of integers
+  OP_ADD_INT         = 0x25,
+  OP_LT_INT          = 0x26,
+
+  // Wide forms: the index operand is 2 bytes (big endian), emitted by
+  // the compiler when the index does not fit a byte.
+  OP_CONST_WIDE         = 0x27,
+  OP_GET_GLOBAL_WIDE    = 0x28,
+  OP_SET_GLOBAL_WIDE    = 0x29,
+  OP_SET_LOCAL_WIDE     = 0x2A,
+  OP_GET_LOCAL_WIDE     = 0x2B,
+  OP_SCOPE_EXIT_WIDE    = 0x2C,
+  OP_SET_CELL_WIDE      = 0x2D,
+  OP_GET_CELL_WIDE      = 0x2E,
+  OP_LOAD_CELL_WIDE     = 0x2F,
+  OP_GET_OUTER_WIDE     = 0x30,
+  OP_SET_OUTER_WIDE     = 0x31,
+  OP_CAPTURE_LOCAL_WIDE = 0x32,
+
+  // Wide jumps: the address is 4 bytes (big endian), emitted by the
+  // compiler when the code does not fit 2-byte addresses.
+  OP_JMP_WIDE           = 0x33,
+  OP_JMP_IF_FALSE_WIDE  = 0x34,
 };
 
+/**
+ * All opcodes in the order of their values with the size of operands
+ * in bytes. Used to build per-opcode tables (e.g. the interpreter
+ * dispatch table).
+ */
+#define EVA_BYTECODES(V)        \
+  V(HALT,               0)      \
+  V(CONST,              1)      \
+  V(ADD,                0)      \
+  V(SUB,                0)      \
+  V(MUL,                0)      \
+  V(DIV,                0)      \
+  V(CMP,                1)      \
+  V(JMP,                2)      \
+  V(JMP_IF_FALSE,       2)      \
+  V(GET_GLOBAL,         1)      \
+  V(SET_GLOBAL,         1)      \
+  V(POP,                0)      \
+  V(SET_LOCAL,          1)      \
+  V(GET_LOCAL,          1)      \
+  V(SCOPE_EXIT,         1)      \
+  V(CALL,               1)      \
+  V(RETURN,             0)      \
+  V(SET_CELL,           1)      \
+  V(GET_CELL,           1)      \
+  V(LOAD_CELL,          1)      \
+  V(MAKE_FUNCTION,      1)      \
+  V(JMP_IF_NOT_LT,      2)      \
+  V(JMP_IF_NOT_GT,      2)      \
+  V(JMP_IF_NOT_EQ,      2)      \
+  V(JMP_IF_NOT_GE,      2)      \
+  V(JMP_IF_NOT_LE,      2)      \
+  V(JMP_IF_NOT_NE,      2)      \
+  V(ADD_LOCAL_LOCAL,    2)      \
+  V(CONST_SET_LOCAL,    2)      \
+  V(SET_LOCAL_POP,      1)      \
+  V(ADD_LOCAL_CONST,    2)      \
+  V(GET_OUTER,          1)      \
+  V(SET_OUTER,          1)      \
+  V(CAPTURE_LOCAL,      1)      \
+  V(ADD_NUM,            0)      \
+  V(ADD_STR,            0)      \
+  V(LT_NUM,             1)      \
+  V(ADD_INT,            0)      \
+  V(LT_INT,             1)      \
+  V(CONST_WIDE,         2)      \
+  V(GET_GLOBAL_WIDE,    2)      \
+  V(SET_GLOBAL_WIDE,    2)      \
+  V(SET_LOCAL_WIDE,     2)      \
+  V(GET_LOCAL_WIDE,     2)      \
+  V(SCOPE_EXIT_WIDE,    2)      \
+  V(SET_CELL_WIDE,      2)      \
+  V(GET_CELL_WIDE,      2)      \
+  V(LOAD_CELL_WIDE,     2)      \
+  V(GET_OUTER_WIDE,     2)      \
+  V(SET_OUTER_WIDE,     2)      \
+  V(CAPTURE_LOCAL_WIDE, 2)      \
+  V(JMP_WIDE,           4)      \
+  V(JMP_IF_FALSE_WIDE,  4)
+
+#define BYTECODE_VALUE(op, operandBytes) OP_##op,
+#define BYTECODE_SIZE(op, operandBytes) 1 + operandBytes,
+
+constexpr ByteCode bytecodesList[] = { EVA_BYTECODES(BYTECODE_VALUE) };
+
+/**
+ * Instruction sizes (opcode and operands) indexed by opcode.
+ */
+constexpr size_t bytecodeSizes[] = { EVA_BYTECODES(BYTECODE_SIZE) };
+
+#undef BYTECODE_VALUE
+#undef BYTECODE_SIZE
+
+/**
+ * Number of opcodes.
+ */
+constexpr size_t BYTECODES_COUNT = sizeof(bytecodesList) / sizeof(ByteCode);
+
+/**
+ * Checks that opcodes are listed densely and in the order of their values.
+ */
+constexpr bool isBytecodesListOrdered() {
+  for (size_t i = 0; i < BYTECODES_COUNT; i++) {
+    if (bytecodesList[i] != i) return false;
+  }
+  return true;
+}
+
+static_assert(isBytecodesListOrdered(),
+    "EVA_BYTECODES must list all opcodes in the order of their values");
+
 std::string opcodeToString(ByteCode opcode);
 
+/**
+ * Whether the opcode is a jump, the address is its first operand.
+ */
+constexpr bool isJumpOpcode(ByteCode opcode) {
+  return opcode == OP_JMP || opcode == OP_JMP_IF_FALSE ||
+    (opcode >= OP_JMP_IF_NOT_LT && opcode <= OP_JMP_IF_NOT_NE) ||
+    opcode == OP_JMP_WIDE || opcode == OP_JMP_IF_FALSE_WIDE;
+}
+
+/**
+ * Size of the address operand of the jump opcode.
+ */
+constexpr size_t jumpAddressSize(ByteCode opcode) {
+  return opcode == OP_JMP_WIDE || opcode == OP_JMP_IF_FALSE_WIDE ? 4 : 2;
+}
+
+/**
+ * Reads a big endian jump address of the given size.
+ */
+inline size_t readJumpAddress(const uint8_t* operand, size_t size) {
+  size_t address = 0;
+  for (size_t i = 0; i < size; i++) {
+    address = address << 8 | operand[i];
+  }
+  return address;
+}
+
+/**
+ * Writes a big endian jump address of the given size.
+ */
+inline void writeJumpAddress(uint8_t* operand, size_t size, size_t address) {
+  for (size_t i = size; i > 0; i--) {
+    operand[i - 1] = address & 0xFF;
+    address >>= 8;
+  }
+}
+
+/**
+ * Whether the opcode is a quickened form of a generic one.
+ */
+constexpr bool isQuickenedOpcode(ByteCode opcode) {
+  return opcode >= OP_ADD_NUM && opcode <= OP_LT_INT;
+}
+
+/**
+ * Wide form of an opcode with a one-byte index operand, or OP_HALT
+ * if it has none.
+ */
+constexpr ByteCode wideOpcode(ByteCode opcode) {
+  switch (opcode) {
+    case OP_CONST: return OP_CONST_WIDE;
+    case OP_GET_GLOBAL: return OP_GET_GLOBAL_WIDE;
+    case OP_SET_GLOBAL: return OP_SET_GLOBAL_WIDE;
+    case OP_SET_LOCAL: return OP_SET_LOCAL_WIDE;
+    case OP_GET_LOCAL: return OP_GET_LOCAL_WIDE;
+    case OP_SCOPE_EXIT: return OP_SCOPE_EXIT_WIDE;
+    case OP_SET_CELL: return OP_SET_CELL_WIDE;
+    case OP_GET_CELL: return OP_GET_CELL_WIDE;
+    case OP_LOAD_CELL: return OP_LOAD_CELL_WIDE;
+    case OP_GET_OUTER: return OP_GET_OUTER_WIDE;
+    case OP_SET_OUTER: return OP_SET_OUTER_WIDE;
+    case OP_CAPTURE_LOCAL: return OP_CAPTURE_LOCAL_WIDE;
+    default: return OP_HALT;
+  }
+}
+
+/**
+ * Whether the opcode is a wide form, its index operand is 2 bytes.
+ */
+constexpr bool isWideOpcode(ByteCode opcode) {
+  return opcode >= OP_CONST_WIDE && opcode <= OP_CAPTURE_LOCAL_WIDE;
+}
+
+/**
+ * Opcode whose wide form is the given one.
+ */
+constexpr ByteCode narrowOpcode(ByteCode opcode) {
+  for (ByteCode narrow = 0; narrow < OP_CONST_WIDE; narrow++) {
+    if (wideOpcode(narrow) == opcode) return narrow;
+  }
+  return opcode;
+}
+
+/**
+ * Stack effect of an instruction as the interpreter (and the JIT
+ * templates) run it: how many values it takes from the stack, the
+ * highest number of values it pushes above the height before it at
+ * once, and the change of the height when it is done.
+ */
+struct StackEffect {
+  int32_t pops;
+  int32_t peak;
+  int32_t delta;
+};
+
+StackEffect stackEffect(const uint8_t* instruction);
+
 #endif
 
@@ -0,0 +1,30 @@
+#include "vm/RegOpCode.hpp"
+#include "logging/Logger.hpp"
+
+#define REG_OP_STR(op, operands) #op,
+#define REG_OP_OPERANDS(op, operands) operands,
+
+static const char* regOpcodeNames[] = { EVA_REG_BYTECODES(REG_OP_STR) };
+static const char* regOpcodeOperandKinds[] = { EVA_REG_BYTECODES(REG_OP_OPERANDS) };
+
+std::string regOpcodeToString(ByteCode opcode) {
+  if (opcode >= REG_BYTECODES_COUNT) {
+    DIE << "Unknown register bytecode: " << HEX(opcode);
+  }
+  return regOpcodeNames[opcode];
+}
+
+const char* regOpcodeOperands(ByteCode opcode) {
+  if (opcode >= REG_BYTECODES_COUNT) {
+    DIE << "Unknown register bytecode: " << HEX(opcode);
+  }
+  return regOpcodeOperandKinds[opcode];
+}
+
+size_t regBytecodeSize(ByteCode opcode) {
+  size_t size = 1;
+  for (auto kind = regOpcodeOperands(opcode); *kind != '\0'; kind++) {
+    size += regOperandSize(*kind);
+  }
+  return size;
+}
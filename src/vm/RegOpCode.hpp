@@ -0,0 +1,167 @@
+/**
+ * Register-based instruction set.
+ *
+ * Operands are bytes: registers are frame-relative (r0 is the function
+ * itself, then arguments, locals and temporaries), jump addresses are
+ * 2 bytes (4 in wide jumps). Operand kinds (used by the disassembler):
+ *
+ *   r - register, k - constant, g - global, l - cell,
+ *   c - comparison operator, n - count, j - jump address,
+ *   o - register of the caller frame
+ *
+ * Upper case kinds are wide: K - constant, G - global (2 bytes),
+ * J - jump address (4 bytes).
+ */
+#ifndef SRC_VM_REGOPCODE_HPP
+#define SRC_VM_REGOPCODE_HPP
+
+#include "vm/OpCode.hpp"
+
+enum RegByteCodes : ByteCode {
+  // Return rA from the main function.
+  ROP_HALT          = 0x00,
+
+  // rA = K[B]
+  ROP_LOADK         = 0x01,
+
+  // rA = rB
+  ROP_MOVE          = 0x02,
+
+  // rA = rB <op> rC
+  ROP_ADD           = 0x03,
+  ROP_SUB           = 0x04,
+  ROP_MUL           = 0x05,
+  ROP_DIV           = 0x06,
+
+  // rA = rB <cmp C> rC
+  ROP_CMP           = 0x07,
+
+  // Branch instructions
+  ROP_JMP           = 0x08,
+  ROP_JMP_IF_FALSE  = 0x09,
+
+  // rA = G[B], G[A] = rB
+  ROP_GET_GLOBAL    = 0x0A,
+  ROP_SET_GLOBAL    = 0x0B,
+
+  // rA = cells[B].value, cells[A].value = rB, rA = cells[B]
+  ROP_GET_CELL      = 0x0C,
+  ROP_SET_CELL      = 0x0D,
+  ROP_LOAD_CELL     = 0x0E,
+
+  // rA = function(K[B]) capturing cells rC..rC+N
+  ROP_MAKE_FUNCTION = 0x0F,
+
+  // Call rA with N arguments rA+1..rA+N, result in rA
+  ROP_CALL          = 0x10,
+
+  // Return rA to the caller
+  ROP_RETURN        = 0x11,
+
+  // rA = caller.rB, caller.rA = rB (see AllocType::OUTER)
+  ROP_GET_OUTER     = 0x12,
+  ROP_SET_OUTER     = 0x13,
+
+  // rA = open cell of rB, close the cells of rA and above
+  ROP_CAPTURE       = 0x14,
+  ROP_CLOSE         = 0x15,
+
+  // Wide forms of LOADK, GET_GLOBAL, SET_GLOBAL and MAKE_FUNCTION
+  ROP_LOADK_WIDE         = 0x16,
+  ROP_GET_GLOBAL_WIDE    = 0x17,
+  ROP_SET_GLOBAL_WIDE    = 0x18,
+  ROP_MAKE_FUNCTION_WIDE = 0x19,
+
+  // Jumps with 4-byte addresses
+  ROP_JMP_WIDE           = 0x1A,
+  ROP_JMP_IF_FALSE_WIDE  = 0x1B,
+};
+
+/**
+ * All register opcodes in the order of their values with operand kinds.
+ */
+#define EVA_REG_BYTECODES(V)        \
+  V(HALT,                "r")       \
+  V(LOADK,               "rk")      \
+  V(MOVE,                "rr")      \
+  V(ADD,                 "rrr")     \
+  V(SUB,                 "rrr")     \
+  V(MUL,                 "rrr")     \
+  V(DIV,                 "rrr")     \
+  V(CMP,                 "rrrc")    \
+  V(JMP,                 "j")       \
+  V(JMP_IF_FALSE,        "rj")      \
+  V(GET_GLOBAL,          "rg")      \
+  V(SET_GLOBAL,          "gr")      \
+  V(GET_CELL,            "rl")      \
+  V(SET_CELL,            "lr")      \
+  V(LOAD_CELL,           "rl")      \
+  V(MAKE_FUNCTION,       "rkrn")    \
+  V(CALL,                "rn")      \
+  V(RETURN,              "r")       \
+  V(GET_OUTER,           "ro")      \
+  V(SET_OUTER,           "or")      \
+  V(CAPTURE,             "rr")      \
+  V(CLOSE,               "r")       \
+  V(LOADK_WIDE,          "rK")      \
+  V(GET_GLOBAL_WIDE,     "rG")      \
+  V(SET_GLOBAL_WIDE,     "Gr")      \
+  V(MAKE_FUNCTION_WIDE,  "rKrn")    \
+  V(JMP_WIDE,            "J")       \
+  V(JMP_IF_FALSE_WIDE,   "rJ")
+
+#define REG_BYTECODE_VALUE(op, operands) ROP_##op,
+
+constexpr ByteCode regBytecodesList[] = { EVA_REG_BYTECODES(REG_BYTECODE_VALUE) };
+
+#undef REG_BYTECODE_VALUE
+
+/**
+ * Number of register opcodes.
+ */
+constexpr size_t REG_BYTECODES_COUNT = sizeof(regBytecodesList) / sizeof(ByteCode);
+
+constexpr bool isRegBytecodesListOrdered() {
+  for (size_t i = 0; i < REG_BYTECODES_COUNT; i++) {
+    if (regBytecodesList[i] != i) return false;
+  }
+  return true;
+}
+
+static_assert(isRegBytecodesListOrdered(),
+    "EVA_REG_BYTECODES must list all opcodes in the order of their values");
+
+std::string regOpcodeToString(ByteCode opcode);
+
+/**
+ * Operand kinds of the register opcode.
+ */
+const char* regOpcodeOperands(ByteCode opcode);
+
+/**
+ * Size of the register opcode operand of the kind.
+ */
+constexpr size_t regOperandSize(char kind) {
+  return kind == 'J' ? 4 : kind == 'j' || kind == 'K' || kind == 'G' ? 2 : 1;
+}
+
+/**
+ * Size of the register instruction (opcode and operands).
+ */
+size_t regBytecodeSize(ByteCode opcode);
+
+/**
+ * Wide form of a register opcode with a constant or global operand, or
+ * ROP_HALT if it has none.
+ */
+constexpr ByteCode regWideOpcode(ByteCode opcode) {
+  switch (opcode) {
+    case ROP_LOADK: return ROP_LOADK_WIDE;
+    case ROP_GET_GLOBAL: return ROP_GET_GLOBAL_WIDE;
+    case ROP_SET_GLOBAL: return ROP_SET_GLOBAL_WIDE;
+    case ROP_MAKE_FUNCTION: return ROP_MAKE_FUNCTION_WIDE;
+    default: return ROP_HALT;
+  }
+}
+
+#endif
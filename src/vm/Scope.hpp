@@ -9,7 +9,7 @@
 
 #include <set>
 #include <map>
-#include <map>
+#include <memory>
 
 /**
  * Type of the scope.
@@ -27,6 +27,10 @@ enum class AllocType {
   GLOBAL,
   LOCAL,
   CELL,
+
+  // Local of the caller frame, captured by a function which is only
+  // called from the frame it is defined in (see EvaCompiler::analyze).
+  OUTER,
 };
 
 struct Scope {
@@ -54,10 +58,32 @@ struct Scope {
   std::set<std::string> free;
 
   /**
-   * Set of own cells.
+   * Set of own cells: locals captured by closures. They stay in their
+   * slots, the closures share them through open cells.
    */
-
   std::set<std::string> cells;
+
+  /**
+   * Locals accessed by the functions defined in the frame (see
+   * AllocType::OUTER).
+   */
+  std::set<std::string> outers;
+
+  /**
+   * Functions bound to the names declared in the scope (def, or var
+   * of a lambda).
+   */
+  std::map<std::string, Scope*> functions;
+
+  /**
+   * Whether the function of this (function) scope may run in another
+   * frame than the one it is defined in: stored, passed, returned,
+   * called from another function or recursively. Variables it captures
+   * from its defining frame are cells then, otherwise they stay locals
+   * of that frame.
+   */
+  bool escapes = true;
+
   /**
    * Register a local.
    */
@@ -76,72 +102,57 @@ struct Scope {
   }
 
   /**
-   * Register a cell.
+   * Register a cell. The owner keeps accessing it as a local.
    */
   void addCell(const std::string& name) {
     cells.insert(name);
-    allocInfo[name] = AllocType::CELL;
   }
 
-  void maybePromote(const std::string& name) {
-    auto initAllocType = type == ScopeType::GLOBAL ? AllocType::GLOBAL : AllocType::LOCAL;
-
-    if (allocInfo.count(name) != 0) {
-      // We already have info about this var.
-      initAllocType = allocInfo[name];
-    }
-
-    auto [ownerScope, allocType] = resolve(name, initAllocType);
+  /**
+   * Scope which declares the variable (nullptr if none) and the amount
+   * of function boundaries crossed to reach it.
+   */
+  std::pair<Scope*, size_t> lookup(const std::string& name) {
+    size_t crossed = 0;
 
-    // Update the alloc type based on resolution.
-    allocInfo[name] = allocType;
+    for (auto scope = this; scope != nullptr; scope = scope->parent.get()) {
+      if (scope->allocInfo.count(name) != 0) {
+        return std::make_pair(scope, crossed);
+      }
 
-    // If resolved as a cell, promote it to heap.
-    if (allocType == AllocType::CELL) {
-      promote(name, ownerScope);
+      if (scope->type == ScopeType::FUNCTION) {
+        crossed++;
+      }
     }
+
+    return std::make_pair(nullptr, crossed);
   }
 
   /**
-   * Resovle the variable in the Scope chain.
-   *
-   * Initially all variable are threated as a local, however if during the
-   * resolution we passed local scope boundary, it is free and should be
-   * promoted to the cell unless it is global.
+   * Innermost function scope containing this scope (nullptr for the
+   * main function).
    */
-  std::pair<Scope*, AllocType> resolve(const std::string& name, AllocType allocType) {
-    if (allocInfo.count(name) != 0) {
-      // Found in the local scope.
-      return std::make_pair(this, allocType);
-    }
-
-    // We crossed the boundary of the function and still have not found the variable.
-    // Further resolution should be free.
-    if (type == ScopeType::FUNCTION) {
-      allocType = AllocType::CELL;
-    }
-
-    if (parent == nullptr) {
-      DIE << "[Scope] Refference error: " << name << " is not defined." << std::endl;
-    }
-
-    if (parent->type == ScopeType::GLOBAL) {
-      allocType = AllocType::GLOBAL;
+  Scope* frame() {
+    auto scope = this;
+    while (scope != nullptr && scope->type != ScopeType::FUNCTION) {
+      scope = scope->parent.get();
     }
-
-    return parent->resolve(name, allocType);
+    return scope;
   }
 
   /**
-   * Promote variable from local (stack) to cell (heap).
+   * Promote variable from local to cell: closures between this scope
+   * and the owner access it through cells.
    */
   void promote(const std::string& name, Scope* ownerScope) {
     ownerScope->addCell(name);
 
     // Make the variable free at all scopes in the chain
-    // to propogate it to our scope.
+    // to propogate it to our scope. Blocks of the owner function
+    // access it as a local.
+    auto ownerFrame = ownerScope->frame();
     auto scope = this;
-    while (scope != ownerScope) {
+    while (scope->frame() != ownerFrame) {
       scope->addFree(name);
       scope = scope->parent.get();
     }
@@ -158,7 +169,11 @@ struct Scope {
         return OP_GET_LOCAL;
       case AllocType::CELL:
         return OP_GET_CELL;
+      case AllocType::OUTER:
+        return OP_GET_OUTER;
     }
+    DIE << "[Scope] Unknown allocation type for: " << name;
+    return OP_HALT;
   }
 
   /**
@@ -172,7 +187,11 @@ struct Scope {
         return OP_SET_LOCAL;
       case AllocType::CELL:
         return OP_SET_CELL;
+      case AllocType::OUTER:
+        return OP_SET_OUTER;
     }
+    DIE << "[Scope] Unknown allocation type for: " << name;
+    return OP_HALT;
   }
 };
 
@@ -0,0 +1,236 @@
+/**
+ * Test driver.
+ *
+ * Usage:
+ *
+ *   evm-test <config> <file> <work dir>
+ *
+ * Executes the source file in the configuration and prints the result
+ * (as evaValueToConstantString, numbers with all their digits), which
+ * ctest compares with the expected output of the program (see
+ * test/RunTest.cmake). Errors are printed by DIE, so they are expected
+ * output as well.
+ *
+ * Configurations:
+ *
+ *   stack            stack tier, interpreted
+ *   register         register tier
+ *   jit              stack tier, every function compiled to machine code
+ *   generic          stack tier without quickening and superinstructions
+ *   gc               stack tier, collecting whenever the live heap
+ *                    doubles (no minimal threshold)
+ *   image            compiled to an image, executed by another VM
+ *   register-image   the same on the register tier
+ *   cache            executed twice through the compile cache, the
+ *                    second run loads the cached image; the temporary
+ *                    file of a crashed store is removed by the first
+ *   stream           executed form by form
+ *   call             executed, then `entry` is called with vm.call
+ *                    (0 to CALLS - 1), after a collection and with no
+ *                    minimal threshold
+ *   recompile        executed RECOMPILES times by one VM, every function
+ *                    compiled to machine code and collected after the
+ *                    next run: its machine code is reused, no more
+ *                    executable memory is mapped after the second run
+ *
+ * The work dir keeps the images and the cache of the run. With
+ * EVA_TEST_MAX_RSS_MB set, a run whose peak resident memory is over
+ * it fails.
+ */
+
+#include "vm/EvaVM.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+
+/**
+ * Calls of the entry function in the call configuration.
+ */
+static constexpr int64_t CALLS = 200;
+
+/**
+ * Runs of the program in the recompile configuration.
+ */
+static constexpr int RECOMPILES = 50;
+
+static std::string readFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    DIE << "Cannot open " << path;
+  }
+
+  std::stringstream source;
+  source << file.rdbuf();
+  return source.str();
+}
+
+/**
+ * Printed result, taken while the VM owning it is alive. Numbers are
+ * printed exactly, so integers computed as doubles (EVA_NAN_BOXING)
+ * print as integers.
+ */
+static std::string resultString(const EvaValue& result) {
+  if (IS_NUMBER(result)) {
+    std::stringstream number;
+    number << std::setprecision(17) << AS_NUMBER(result);
+    return number.str();
+  }
+
+  return evaValueToConstantString(result);
+}
+
+/**
+ * Executes the source in a VM of the tier through an image.
+ */
+static std::string execImage(ExecutionTier tier, const std::string& source, const std::string& path) {
+  {
+    EvaVM compiler(tier);
+    compiler.compileImage(source, path);
+  }
+
+  EvaVM vm(tier);
+  vm.setJitMode(JitMode::OFF);
+  return resultString(vm.execImage(path));
+}
+
+/**
+ * Executes the source twice in fresh VMs sharing a compile cache.
+ */
+static std::string execCached(const std::string& source, const std::string& dir) {
+  std::filesystem::remove_all(dir);
+  auto cache = std::make_shared<EvaCompileCache>(dir);
+
+  // Left by a store which crashed before the rename an hour ago.
+  auto temp = dir + "/.tmp-0-0";
+  std::ofstream(temp) << "partial entry";
+  std::filesystem::last_write_time(temp, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+
+  std::string result;
+  for (int run = 0; run < 2; run++) {
+    EvaVM vm;
+    vm.setJitMode(JitMode::OFF);
+    vm.setCompileCache(cache);
+    result = resultString(vm.exec(source));
+  }
+
+  if (cache->getStats().hits != 1) {
+    DIE << "[evm-test] The second run did not load the cached program";
+  }
+
+  if (std::filesystem::exists(temp) || cache->getStats().staleTemps != 1) {
+    DIE << "[evm-test] The stale temporary file was not removed";
+  }
+
+  return result;
+}
+
+/**
+ * Executes the source, then calls its entry function under GC pressure.
+ */
+static std::string execCalls(const std::string& source) {
+  EvaVM vm;
+  vm.setJitMode(JitMode::OFF);
+  vm.exec(source);
+  vm.setGCThreshold(0);
+
+  EvaValue result;
+  for (int64_t i = 0; i < CALLS; i++) {
+    vm.gc();
+    result = vm.call("entry", {INTEGER(i)});
+  }
+
+  return resultString(result);
+}
+
+/**
+ * Executes the source over and over in one VM with every function
+ * compiled, collecting the code of the previous runs.
+ */
+static std::string execRecompiled(const std::string& source) {
+  EvaVM vm;
+  vm.setJitMode(JitMode::ALWAYS);
+
+  std::string result;
+  size_t mapped = 0;
+
+  for (int run = 0; run < RECOMPILES; run++) {
+    result = resultString(vm.exec(source));
+    vm.gc();
+
+    // The code of the first run is collected after the second one.
+    if (run == 1) {
+      mapped = vm.getJitStats().mappedBytes;
+    }
+  }
+
+  if (vm.getJitStats().mappedBytes > mapped) {
+    DIE << "[evm-test] Machine code mapped " << vm.getJitStats().mappedBytes << " bytes, "
+        << mapped << " after the second run";
+  }
+
+  return result;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: evm-test <config> <file> <work dir>\n";
+    return 1;
+  }
+
+  std::string config = argv[1];
+  auto source = readFile(argv[2]);
+  std::string workDir = argv[3];
+  std::filesystem::create_directories(workDir);
+
+  std::string result;
+
+  if (config == "image") {
+    result = execImage(ExecutionTier::STACK, source, workDir + "/program.evi");
+  } else if (config == "register-image") {
+    result = execImage(ExecutionTier::REGISTER, source, workDir + "/program.evi");
+  } else if (config == "cache") {
+    result = execCached(source, workDir + "/cache");
+  } else if (config == "call") {
+    result = execCalls(source);
+  } else if (config == "recompile") {
+    result = execRecompiled(source);
+  } else {
+    EvaVM vm(config == "register" ? ExecutionTier::REGISTER : ExecutionTier::STACK);
+    vm.setJitMode(config == "jit" ? JitMode::ALWAYS : JitMode::OFF);
+
+    if (config == "generic") {
+      vm.setQuickening(false);
+      vm.setPeephole(false);
+    } else if (config == "gc") {
+      vm.setGCThreshold(0);
+    } else if (config != "stack" && config != "register" && config != "jit" && config != "stream") {
+      DIE << "[evm-test] Unknown configuration " << config;
+    }
+
+    if (config == "stream") {
+      std::ifstream file(argv[2], std::ios::binary);
+      result = resultString(vm.execStream(file));
+    } else {
+      result = resultString(vm.exec(source));
+    }
+  }
+
+  if (auto maxRss = std::getenv("EVA_TEST_MAX_RSS_MB")) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // Kilobytes on Linux.
+    auto rss = usage.ru_maxrss / 1024;
+    if (rss > std::atol(maxRss)) {
+      DIE << "[evm-test] Peak RSS " << rss << " MB, over " << maxRss << " MB";
+    }
+  }
+
+  std::cout << result << '\n';
+  return 0;
+}
@@ -0,0 +1,37 @@
+# Runs a test program with evm-test and compares its output (standard
+# output and errors) with the expected one:
+#
+#   cmake -DDRIVER=<evm-test> -DCONFIG=<config> -DPROGRAM=<file.eva>
+#         -DEXPECTED=<file.expected> -DWORK_DIR=<dir> [-DMAX_RSS=<MB>]
+#         -P RunTest.cmake
+#
+# A program expected to fail (DIE) exits with an error, any other one
+# must exit cleanly. With MAX_RSS, a run whose peak resident memory is
+# over it fails.
+
+if(MAX_RSS)
+  set(ENV{EVA_TEST_MAX_RSS_MB} ${MAX_RSS})
+endif()
+
+execute_process(
+  COMMAND ${DRIVER} ${CONFIG} ${PROGRAM} ${WORK_DIR}
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE output
+  RESULT_VARIABLE status
+)
+
+file(READ ${EXPECTED} expected)
+
+string(STRIP "${output}" output)
+string(STRIP "${expected}" expected)
+
+if(NOT output STREQUAL expected)
+  message(FATAL_ERROR "${PROGRAM} (${CONFIG}):\nexpected:\n${expected}\ngot:\n${output}")
+endif()
+
+string(FIND "${expected}" "Fatal error" fatal)
+if(fatal EQUAL -1 AND NOT status EQUAL 0)
+  message(FATAL_ERROR "${PROGRAM} (${CONFIG}) exited with ${status}")
+elseif(NOT fatal EQUAL -1 AND status EQUAL 0)
+  message(FATAL_ERROR "${PROGRAM} (${CONFIG}) was expected to fail")
+endif()
@@ -0,0 +1,78 @@
+# Test programs past the one-byte operands and the 2-byte jump
+# addresses (wide forms), generated into the build tree with their
+# expected results (see bench/WideBench.cpp for the benchmark):
+#
+#   wide-globals    a loop summing 300 globals
+#   wide-locals     a loop summing 300 locals of a function
+#   wide-jumps      a loop over a body of 14000 statements, its code
+#                   is over 64 KB
+#
+# Every variable has a value of its own, so each one is a constant.
+
+set(EVA_WIDE_VARIABLES 300)
+set(EVA_WIDE_STATEMENTS 14000)
+set(EVA_WIDE_LOOPS 3)
+
+set(EVA_WIDE_DIR ${CMAKE_CURRENT_BINARY_DIR}/test/programs)
+file(MAKE_DIRECTORY ${EVA_WIDE_DIR})
+
+# Writes the program with the loop of the run function over the body.
+function(eva_wide_program name definitions locals body expected)
+  file(WRITE ${EVA_WIDE_DIR}/${name}.eva
+    "${definitions}"
+    "(def run (n)\n"
+    "  (begin\n"
+    "${locals}"
+    "    (var total 0)\n"
+    "    (var i 0)\n"
+    "    (while (< i n)\n"
+    "      (begin\n"
+    "${body}"
+    "        (set i (+ i 1))))\n"
+    "    total))\n"
+    "(run ${EVA_WIDE_LOOPS})\n"
+  )
+  file(WRITE ${EVA_WIDE_DIR}/${name}.expected "${expected}\n")
+endfunction()
+
+math(EXPR last "${EVA_WIDE_VARIABLES} - 1")
+set(globals "")
+set(locals "")
+set(globalSum "")
+set(localSum "")
+set(sum 0)
+
+foreach(i RANGE ${last})
+  math(EXPR value "1000 + ${i} * 7")
+  math(EXPR sum "${sum} + ${value}")
+  string(APPEND globals "(var g${i} ${value})\n")
+  string(APPEND locals "    (var l${i} ${value})\n")
+  string(APPEND globalSum "(set total (+ total g${i}))\n")
+  string(APPEND localSum "(set total (+ total l${i}))\n")
+endforeach()
+
+math(EXPR expected "${sum} * ${EVA_WIDE_LOOPS}")
+eva_wide_program(wide-globals "${globals}" "" "${globalSum}" ${expected})
+eva_wide_program(wide-locals "" "${locals}" "${localSum}" ${expected})
+
+# Ten locals summed over and over.
+set(locals "")
+foreach(i RANGE 9)
+  math(EXPR value "1000 + ${i} * 7")
+  string(APPEND locals "    (var l${i} ${value})\n")
+endforeach()
+
+math(EXPR last "${EVA_WIDE_STATEMENTS} - 1")
+set(body "")
+set(sum 0)
+
+foreach(i RANGE ${last})
+  math(EXPR local "${i} % 10")
+  math(EXPR sum "${sum} + 1000 + ${local} * 7")
+  string(APPEND body "(set total (+ total l${local}))\n")
+endforeach()
+
+math(EXPR expected "${sum} * ${EVA_WIDE_LOOPS}")
+eva_wide_program(wide-jumps "" "${locals}" "${body}" ${expected})
+
+file(GLOB EVA_WIDE_PROGRAMS ${EVA_WIDE_DIR}/*.eva)